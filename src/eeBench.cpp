@@ -0,0 +1,865 @@
+/*
+ ***********************************************************************
+ *
+ *  eeBench.cpp - part of eeprom access project
+ *
+ *  Copyright (C) 2013-2019 Dreamshader (aka Dirk Schanz)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ *
+ ***********************************************************************
+ *
+ * Throughput and latency benchmark. Runs a fixed matrix of cases
+ *
+ *   read, write
+ *   x byte, word, page and buffers of 1, 4, 16, ... bytes up to the
+ *     whole chip
+ *   x sequential, random addresses
+ *   x one device, all devices at the same time (a thread each)
+ *
+ * and prints bytes/s, ops/s and the latency percentiles of every
+ * case as JSON on stdout. Each case ends after --ops operations
+ * per device or after --time ms, whatever comes first; an operation
+ * started is finished, so writing the whole chip takes a write
+ * cycle per page however short --time is. The latency of an
+ * operation includes waiting for the write cycle of the operation
+ * before, as an application would see it.
+ *
+ * The first EE_PRIVATE_HDR_LEN bytes (magic and type) are never
+ * written.
+ *
+ * Options:
+ *
+ * --sim (same as -s)
+ *
+ *   simulated devices (see i2cSim.h) instead of hardware, the
+ *   default without --bus
+ *
+ * --bus <bus #> (same as --bus=<bus #> resp. -b <bus #>)
+ *
+ * --address <list> (same as --address=<list> resp. -a <list>)
+ *
+ *   comma separated slave addresses in hex, default 50
+ *
+ * --devices <n> (same as -d <n>)
+ *
+ *   number of simulated devices at 50, 51, ..., default 2
+ *
+ * --type <type> (same as -t <type>)
+ *
+ *   EEPROM type, default is detecting it (hardware) resp. 24C65
+ *   (simulated)
+ *
+ * --khz <clock> (same as -k <clock>)
+ *
+ *   bus clock of the simulation, default the 4.5 V clock of the type
+ *
+ * --write (same as -w)
+ *
+ *   run the write cases on hardware too, this destroys the contents
+ *
+ * --ops <n> (same as -n <n>), --time <ms> (same as -T <ms>)
+ *
+ *   limits per case, default 1000 operations and 250 ms
+ *
+ * --seed <n> (same as -r <n>)
+ *
+ *   seed of the random addresses, default 1
+ *
+ * --verbose (same as -v)
+ *
+ *   progress on stderr
+ *
+ ***********************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+
+#include <vector>
+
+#include "i2cEEPROM.h"
+#include "i2cSim.h"
+
+#define BENCH_SIM_BUS          99
+#define BENCH_FIRST_ADDR       0x50
+#define BENCH_MAX_DEVICES      8
+#define BENCH_DEFAULT_TYPE     EE_TYPE_24C65
+#define BENCH_DEFAULT_OPS      1000
+#define BENCH_DEFAULT_TIME_MS  250
+
+#define BENCH_OP_READ          0
+#define BENCH_OP_WRITE         1
+
+#define BENCH_KIND_BYTE        0
+#define BENCH_KIND_WORD        1
+#define BENCH_KIND_PAGE        2
+#define BENCH_KIND_BUFFER      3
+
+#define BENCH_SEQUENTIAL       0
+#define BENCH_RANDOM           1
+
+#define ERROR_PARAM            -1
+#define ERROR_SIM              -2
+#define ERROR_OPEN             -3
+#define ERROR_TYPE             -4
+
+struct _caller_options {
+    bool     simOpt;
+    int      busOpt;
+    int      addrOpt[BENCH_MAX_DEVICES];
+    int      addrCount;
+    int      devicesOpt;
+    int      typeOpt;
+    int      khzOpt;
+    bool     writeOpt;
+    int      opsOpt;
+    int      timeMsOpt;
+    uint32_t seedOpt;
+    bool     verboseOpt;
+};
+
+struct _bench_case {
+    int op;
+    int kind;
+    int pattern;
+    int size;
+    int devices;
+};
+
+struct _bench_worker {
+    i2cEEPROM*           pDevice;
+    const struct _bench_case* pCase;
+    const struct _ee_type_info* pInfo;
+    int                  maxOps;
+    uint64_t             until;
+    uint32_t             rnd;
+    uint64_t             ops;
+    uint64_t             errors;
+    uint64_t             bytes;
+    uint64_t             finished;
+    i2cHistogram*        pHist;
+    std::vector<uint8_t> buffer;
+    pthread_t            thread;
+};
+
+static const char* opNames[]      = { "read", "write" };
+static const char* kindNames[]    = { "byte", "word", "page", "buffer" };
+static const char* patternNames[] = { "sequential", "random" };
+
+/* -------------------------------------------------------------------------
+ | void help( void )
+ |
+ | print help screen and exit
+ ---------------------------------------------------------------------------
+*/
+void help( void )
+{
+    fprintf(stderr, "usage: eeBench [--sim] [--bus <bus #>] "
+            "[--address <addr>[,<addr>...]]\n"
+            "               [--devices <n>] [--type <type>] [--khz <clock>] "
+            "[--write]\n"
+            "               [--ops <n>] [--time <ms>] [--seed <n>] "
+            "[--verbose]\n");
+    exit(0);
+}
+
+/* -------------------------------------------------------------------------
+ | void resetArgs( struct _caller_options *pParam )
+ |
+ | reset options to defaults
+ ---------------------------------------------------------------------------
+*/
+void resetArgs( struct _caller_options *pParam )
+{
+    if( pParam != NULL )
+    {
+        pParam->simOpt     = false;
+        pParam->busOpt     = -1;
+        pParam->addrOpt[0] = BENCH_FIRST_ADDR;
+        pParam->addrCount  = 0;
+        pParam->devicesOpt = 2;
+        pParam->typeOpt    = -1;
+        pParam->khzOpt     = -1;
+        pParam->writeOpt   = false;
+        pParam->opsOpt     = BENCH_DEFAULT_OPS;
+        pParam->timeMsOpt  = BENCH_DEFAULT_TIME_MS;
+        pParam->seedOpt    = 1;
+        pParam->verboseOpt = false;
+    }
+}
+
+/* -------------------------------------------------------------------------
+ | int parseAddresses( const char *pList, struct _caller_options *pParam )
+ |
+ | comma separated slave addresses in hex
+ ---------------------------------------------------------------------------
+*/
+int parseAddresses( const char *pList, struct _caller_options *pParam )
+{
+    int retVal = 0;
+    unsigned int addr;
+    int used;
+
+    pParam->addrCount = 0;
+
+    while( *pList != '\0' && retVal == 0 )
+    {
+        if( pParam->addrCount >= BENCH_MAX_DEVICES ||
+            sscanf( pList, "%x%n", &addr, &used ) != 1 || addr > 0x7f )
+        {
+            retVal = ERROR_PARAM;
+        }
+        else
+        {
+            pParam->addrOpt[pParam->addrCount++] = (int) addr;
+            pList += used;
+
+            if( *pList == ',' )
+            {
+                pList++;
+            }
+        }
+    }
+
+    return( retVal );
+}
+
+/* -------------------------------------------------------------------------
+ | int get_arguments(int argc, char **argv, struct _caller_options *pParam)
+ |
+ | scan commandline for arguments an set the corresponding value
+ ---------------------------------------------------------------------------
+*/
+int get_arguments ( int argc, char **argv, struct _caller_options *pParam )
+{
+    int retVal = 0;
+    int next_option;
+    /* valid short options letters */
+    const char* const short_options = "sb:a:d:t:k:wn:T:r:vh?";
+
+    /* valid long options */
+    const struct option long_options[] = {
+         { "sim",     0, NULL, 's' },
+         { "bus",     1, NULL, 'b' },
+         { "address", 1, NULL, 'a' },
+         { "devices", 1, NULL, 'd' },
+         { "type",    1, NULL, 't' },
+         { "khz",     1, NULL, 'k' },
+         { "write",   0, NULL, 'w' },
+         { "ops",     1, NULL, 'n' },
+         { "time",    1, NULL, 'T' },
+         { "seed",    1, NULL, 'r' },
+         { "verbose", 0, NULL, 'v' },
+         { "help",    0, NULL, 'h' },
+        { NULL,       0, NULL,  0  }
+    };
+
+    resetArgs( pParam );
+
+    do
+    {
+        next_option = getopt_long (argc, argv, short_options,
+            long_options, NULL);
+
+        switch (next_option) {
+            case 's':
+                pParam->simOpt = true;
+                break;
+            case 'b':
+                pParam->busOpt = atoi(optarg);
+                break;
+            case 'a':
+                if( parseAddresses( optarg, pParam ) != 0 )
+                {
+                    fprintf(stderr, "invalid address list %s\n", optarg);
+                    retVal = ERROR_PARAM;
+                }
+                break;
+            case 'd':
+                pParam->devicesOpt = atoi(optarg);
+                break;
+            case 't':
+                pParam->typeOpt = atoi(optarg);
+                break;
+            case 'k':
+                pParam->khzOpt = atoi(optarg);
+                break;
+            case 'w':
+                pParam->writeOpt = true;
+                break;
+            case 'n':
+                pParam->opsOpt = atoi(optarg);
+                break;
+            case 'T':
+                pParam->timeMsOpt = atoi(optarg);
+                break;
+            case 'r':
+                pParam->seedOpt = (uint32_t) strtoul(optarg, NULL, 0);
+                break;
+            case 'v':
+                pParam->verboseOpt = true;
+                break;
+            case 'h':
+            case '?':
+                help();
+                break;
+            default:
+                break;
+        }
+    } while (next_option != -1);
+
+    if( pParam->busOpt < 0 )
+    {
+        pParam->simOpt = true;
+    }
+
+    if( pParam->simOpt )
+    {
+        if( pParam->busOpt < 0 )
+        {
+            pParam->busOpt = BENCH_SIM_BUS;
+        }
+
+        if( pParam->addrCount == 0 )
+        {
+            if( pParam->devicesOpt < 1 ||
+                pParam->devicesOpt > BENCH_MAX_DEVICES )
+            {
+                fprintf(stderr, "--devices must be 1..%d\n",
+                        BENCH_MAX_DEVICES);
+                retVal = ERROR_PARAM;
+            }
+            else
+            {
+                for( ; pParam->addrCount < pParam->devicesOpt;
+                     pParam->addrCount++ )
+                {
+                    pParam->addrOpt[pParam->addrCount] =
+                        BENCH_FIRST_ADDR + pParam->addrCount;
+                }
+            }
+        }
+
+        if( pParam->typeOpt < 0 )
+        {
+            pParam->typeOpt = BENCH_DEFAULT_TYPE;
+        }
+    }
+    else
+    {
+        if( pParam->addrCount == 0 )
+        {
+            pParam->addrCount = 1;
+        }
+    }
+
+    if( pParam->opsOpt < 1 || pParam->timeMsOpt < 1 )
+    {
+        fprintf(stderr, "--ops and --time must be positive\n");
+        retVal = ERROR_PARAM;
+    }
+
+    return( retVal );
+}
+
+/* -------------------------------------------------------------------------
+ | int attachSimulation( struct _caller_options *pParam,
+ |                       const struct _ee_type_info *pInfo )
+ |
+ | create the simulated devices, with a header so the type is
+ | detected like on a real chip
+ ---------------------------------------------------------------------------
+*/
+int attachSimulation( struct _caller_options *pParam,
+                      const struct _ee_type_info *pInfo )
+{
+    int retVal = 0;
+    struct _i2c_sim_config config;
+    uint8_t hdr[EE_PRIVATE_HDR_LEN];
+    int i;
+
+    config.size           = pInfo->page_size * pInfo->total_pages;
+    config.page_size      = pInfo->page_size;
+    config.addr16         = pInfo->addressing_16_bit;
+    config.write_cycle_us = pInfo->write_cycle_time * 1000;
+    config.bus_khz        = pParam->khzOpt >= 0 ? pParam->khzOpt :
+                            pInfo->bus_frequency_4V5;
+
+    // magic and type MSB first, see i2cEEPROM::eeInit()
+    hdr[0] = (makeMagic() >> 8) & 0x00ff;
+    hdr[1] = makeMagic() & 0x00ff;
+    hdr[2] = (pInfo->type >> 8) & 0x00ff;
+    hdr[3] = pInfo->type & 0x00ff;
+
+    for( i = 0; i < pParam->addrCount && retVal == 0; i++ )
+    {
+        if( i2cSimAttach( pParam->busOpt, pParam->addrOpt[i],
+                          &config ) != E_SIM_SUCCESS ||
+            i2cSimLoad( pParam->busOpt, pParam->addrOpt[i], 0, hdr,
+                        sizeof(hdr) ) != E_SIM_SUCCESS )
+        {
+            fprintf(stderr, "can not simulate a %s at %d-%02x\n",
+                    pInfo->name, pParam->busOpt, pParam->addrOpt[i]);
+            retVal = ERROR_SIM;
+        }
+    }
+
+    return( retVal );
+}
+
+/* -------------------------------------------------------------------------
+ | int openDevice( i2cEEPROM *pDevice, int bus, int addr, int *pType )
+ |
+ | connect directly, set the type *pType or, if that is < 0, the
+ | detected one and return it in *pType
+ ---------------------------------------------------------------------------
+*/
+int openDevice( i2cEEPROM *pDevice, int bus, int addr, int *pType )
+{
+    int retVal;
+    uint16_t magic;
+    uint16_t found;
+
+    pDevice->eeSetDaemonUse( false );
+
+    if( (retVal = pDevice->eeOpen( bus, addr )) != E_EE_SUCCESS )
+    {
+        fprintf(stderr, "can not open %d-%02x: %d\n", bus, addr, retVal);
+        retVal = ERROR_OPEN;
+    }
+    else
+    {
+        if( *pType < 0 )
+        {
+            if( pDevice->eeTypeDetect( &magic, &found ) != E_EE_SUCCESS )
+            {
+                fprintf(stderr, "no type found on %d-%02x, use --type\n",
+                        bus, addr);
+                retVal = ERROR_TYPE;
+            }
+            else
+            {
+                *pType = found;
+            }
+        }
+
+        if( retVal == E_EE_SUCCESS &&
+            pDevice->eeTypeSet( (uint16_t) *pType ) != E_EE_SUCCESS )
+        {
+            fprintf(stderr, "invalid type %d for %d-%02x\n", *pType, bus,
+                    addr);
+            retVal = ERROR_TYPE;
+        }
+    }
+
+    return( retVal );
+}
+
+/* -------------------------------------------------------------------------
+ | uint32_t nextRandom( uint32_t *pState )
+ |
+ | xorshift, the same sequence for the same --seed
+ ---------------------------------------------------------------------------
+*/
+uint32_t nextRandom( uint32_t *pState )
+{
+    uint32_t x = *pState;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+
+    return( *pState = x );
+}
+
+/* -------------------------------------------------------------------------
+ | void *benchWorker( void *pArg )
+ |
+ | run one case on one device
+ ---------------------------------------------------------------------------
+*/
+void *benchWorker( void *pArg )
+{
+    struct _bench_worker *pWorker = (struct _bench_worker*) pArg;
+    const struct _bench_case *pCase = pWorker->pCase;
+    i2cEEPROM *pDevice = pWorker->pDevice;
+    uint8_t *pData = pWorker->buffer.data();
+    int capacity;
+    int pageSize;
+    int first;
+    int slots;
+    int slot;
+    int addr;
+    int res;
+    uint16_t word;
+    uint64_t started;
+
+    capacity = pWorker->pInfo->page_size * pWorker->pInfo->total_pages;
+    pageSize = pWorker->pInfo->page_size;
+
+    // the header is left alone, pages start page aligned behind it
+    if( pCase->kind == BENCH_KIND_PAGE )
+    {
+        first = (EE_PRIVATE_HDR_LEN + pageSize - 1) / pageSize * pageSize;
+        slots = (capacity - first) / pageSize;
+    }
+    else
+    {
+        first = EE_PRIVATE_HDR_LEN;
+        slots = (capacity - first) / pCase->size;
+    }
+
+    for( slot = 0; (int) pWorker->ops < pWorker->maxOps &&
+                   i2cMonotonicUs() < pWorker->until; slot++ )
+    {
+        if( pCase->pattern == BENCH_RANDOM )
+        {
+            addr = first + (int) (nextRandom( &pWorker->rnd ) % slots) *
+                   pCase->size;
+        }
+        else
+        {
+            addr = first + (slot % slots) * pCase->size;
+        }
+
+        // eeRead() and friends count from the start of the chip,
+        // the header is not skipped by the library
+        started = i2cMonotonicUs();
+
+        if( pCase->op == BENCH_OP_WRITE )
+        {
+            switch( pCase->kind )
+            {
+                case BENCH_KIND_BYTE:
+                    res = pDevice->eeWriteByte( addr, (uint8_t) slot );
+                    break;
+                case BENCH_KIND_WORD:
+                    res = pDevice->eeWriteWord( addr, (uint16_t) slot );
+                    break;
+                default:
+                    pData[0] = (uint8_t) slot;
+                    res = pDevice->eeWrite( addr, pData, pCase->size );
+                    break;
+            }
+        }
+        else
+        {
+            switch( pCase->kind )
+            {
+                case BENCH_KIND_BYTE:
+                    res = pDevice->eeReadByte( addr, pData );
+                    break;
+                case BENCH_KIND_WORD:
+                    res = pDevice->eeReadWord( addr, &word );
+                    break;
+                default:
+                    res = pDevice->eeRead( addr, pData, pCase->size );
+                    break;
+            }
+        }
+
+        pWorker->pHist->record( i2cMonotonicUs() - started );
+        pWorker->ops++;
+
+        if( res == E_EE_SUCCESS )
+        {
+            pWorker->bytes += pCase->size;
+        }
+        else
+        {
+            pWorker->errors++;
+        }
+    }
+
+    pWorker->finished = i2cMonotonicUs();
+
+    return( NULL );
+}
+
+/* -------------------------------------------------------------------------
+ | void runCase( std::vector<i2cEEPROM*>& devices,
+ |               const struct _ee_type_info *pInfo,
+ |               const struct _bench_case *pCase,
+ |               struct _caller_options *pParam, bool firstResult )
+ |
+ | run a case on pCase->devices devices in parallel, print the result
+ ---------------------------------------------------------------------------
+*/
+void runCase( std::vector<i2cEEPROM*>& devices,
+              const struct _ee_type_info *pInfo,
+              const struct _bench_case *pCase,
+              struct _caller_options *pParam, bool firstResult )
+{
+    std::vector<struct _bench_worker> workers( pCase->devices );
+    struct _i2c_hist_summary latency;
+    i2cHistogram hist;
+    uint64_t started;
+    uint64_t finished;
+    uint64_t ops = 0;
+    uint64_t errors = 0;
+    uint64_t bytes = 0;
+    double seconds;
+    int i;
+
+    if( pParam->verboseOpt )
+    {
+        fprintf(stderr, "%s %s %s %d bytes on %d device(s)\n",
+                opNames[pCase->op], kindNames[pCase->kind],
+                patternNames[pCase->pattern], pCase->size, pCase->devices);
+    }
+
+    started = i2cMonotonicUs();
+
+    for( i = 0; i < pCase->devices; i++ )
+    {
+        workers[i].pDevice = devices[i];
+        workers[i].pCase   = pCase;
+        workers[i].pInfo   = pInfo;
+        workers[i].maxOps  = pParam->opsOpt;
+        workers[i].until   = started + (uint64_t) pParam->timeMsOpt * 1000;
+        workers[i].rnd     = pParam->seedOpt * 2654435761u + i + 1;
+        workers[i].ops     = 0;
+        workers[i].errors  = 0;
+        workers[i].bytes   = 0;
+        workers[i].pHist   = &hist;
+        workers[i].buffer.assign( pCase->size, 0x5a );
+    }
+
+    for( i = 1; i < pCase->devices; i++ )
+    {
+        pthread_create( &workers[i].thread, NULL, benchWorker, &workers[i] );
+    }
+
+    benchWorker( &workers[0] );
+    finished = workers[0].finished;
+
+    for( i = 0; i < pCase->devices; i++ )
+    {
+        if( i > 0 )
+        {
+            pthread_join( workers[i].thread, NULL );
+            if( workers[i].finished > finished )
+            {
+                finished = workers[i].finished;
+            }
+        }
+
+        ops    += workers[i].ops;
+        errors += workers[i].errors;
+        bytes  += workers[i].bytes;
+    }
+
+    if( pCase->op == BENCH_OP_WRITE )
+    {
+        // the last write cycle must not slow down the next case
+        usleep( pInfo->write_cycle_time * 1000 );
+    }
+
+    seconds = (finished - started) / 1000000.0;
+    hist.summary( &latency );
+
+    printf("%s    { \"op\": \"%s\", \"kind\": \"%s\", \"pattern\": \"%s\", "
+           "\"size\": %d, \"devices\": %d,\n"
+           "      \"ops\": %llu, \"errors\": %llu, \"bytes\": %llu, "
+           "\"seconds\": %.6f,\n"
+           "      \"bytes_per_s\": %.1f, \"ops_per_s\": %.1f,\n"
+           "      \"latency_us\": { \"min\": %llu, \"mean\": %llu, "
+           "\"p50\": %llu, \"p99\": %llu, \"p999\": %llu, \"max\": %llu } }",
+           firstResult ? "" : ",\n",
+           opNames[pCase->op], kindNames[pCase->kind],
+           patternNames[pCase->pattern], pCase->size, pCase->devices,
+           (unsigned long long) ops, (unsigned long long) errors,
+           (unsigned long long) bytes, seconds,
+           seconds > 0 ? bytes / seconds : 0.0,
+           seconds > 0 ? ops / seconds : 0.0,
+           (unsigned long long) latency.min_us,
+           (unsigned long long) latency.mean_us,
+           (unsigned long long) latency.p50_us,
+           (unsigned long long) latency.p99_us,
+           (unsigned long long) latency.p999_us,
+           (unsigned long long) latency.max_us );
+    fflush( stdout );
+}
+
+/* -------------------------------------------------------------------------
+ | void buildMatrix( std::vector<struct _bench_case>& cases,
+ |                   const struct _ee_type_info *pInfo, int deviceCount,
+ |                   bool withWrites )
+ |
+ | all combinations of operation, kind, size, pattern and devices
+ ---------------------------------------------------------------------------
+*/
+void buildMatrix( std::vector<struct _bench_case>& cases,
+                  const struct _ee_type_info *pInfo, int deviceCount,
+                  bool withWrites )
+{
+    struct _bench_case benchCase;
+    std::vector<int> sizes;
+    int usable;
+    int size;
+    int kind;
+
+    usable = pInfo->page_size * pInfo->total_pages - EE_PRIVATE_HDR_LEN;
+
+    for( benchCase.op = BENCH_OP_READ;
+         benchCase.op <= (withWrites ? BENCH_OP_WRITE : BENCH_OP_READ);
+         benchCase.op++ )
+    {
+        for( kind = BENCH_KIND_BYTE; kind <= BENCH_KIND_BUFFER; kind++ )
+        {
+            sizes.clear();
+
+            switch( kind )
+            {
+                case BENCH_KIND_BYTE:
+                    sizes.push_back( 1 );
+                    break;
+                case BENCH_KIND_WORD:
+                    sizes.push_back( 2 );
+                    break;
+                case BENCH_KIND_PAGE:
+                    sizes.push_back( pInfo->page_size );
+                    break;
+                default:
+                    for( size = 1; size < usable; size *= 4 )
+                    {
+                        sizes.push_back( size );
+                    }
+                    // the whole chip behind the header
+                    sizes.push_back( usable );
+                    break;
+            }
+
+            benchCase.kind = kind;
+
+            for( size_t i = 0; i < sizes.size(); i++ )
+            {
+                benchCase.size = sizes[i];
+
+                for( benchCase.pattern = BENCH_SEQUENTIAL;
+                     benchCase.pattern <= BENCH_RANDOM; benchCase.pattern++ )
+                {
+                    benchCase.devices = 1;
+                    cases.push_back( benchCase );
+
+                    if( deviceCount > 1 )
+                    {
+                        benchCase.devices = deviceCount;
+                        cases.push_back( benchCase );
+                    }
+                }
+            }
+        }
+    }
+}
+
+/* -------------------------------------------------------------------------
+ | int main( int argc, char *argv[] )
+ ---------------------------------------------------------------------------
+*/
+int main( int argc, char *argv[] )
+{
+    int retVal;
+    struct _caller_options callerOptions;
+    const struct _ee_type_info *pInfo = NULL;
+    std::vector<i2cEEPROM*> devices;
+    std::vector<struct _bench_case> cases;
+    int i;
+
+    if( (retVal = get_arguments( argc, argv, &callerOptions )) != 0 )
+    {
+        return( retVal );
+    }
+
+    if( callerOptions.simOpt )
+    {
+        if( (pInfo = eeTypeInfo( callerOptions.typeOpt )) == NULL )
+        {
+            fprintf(stderr, "unknown type %d\n", callerOptions.typeOpt);
+            return( ERROR_TYPE );
+        }
+
+        if( (retVal = attachSimulation( &callerOptions, pInfo )) != 0 )
+        {
+            return( retVal );
+        }
+    }
+
+    for( i = 0; i < callerOptions.addrCount && retVal == 0; i++ )
+    {
+        devices.push_back( new i2cEEPROM() );
+        // all devices get the type given or found on the first
+        retVal = openDevice( devices.back(), callerOptions.busOpt,
+                             callerOptions.addrOpt[i],
+                             &callerOptions.typeOpt );
+    }
+
+    if( retVal == 0 && pInfo == NULL )
+    {
+        pInfo = eeTypeInfo( callerOptions.typeOpt );
+    }
+
+    if( retVal == 0 )
+    {
+        buildMatrix( cases, pInfo, callerOptions.addrCount,
+                     callerOptions.simOpt || callerOptions.writeOpt );
+
+        printf("{\n  \"benchmark\": \"eeBench\",\n"
+               "  \"target\": \"%s\",\n  \"bus\": %d,\n  \"addresses\": [",
+               callerOptions.simOpt ? "simulated" : "hardware",
+               callerOptions.busOpt );
+        for( i = 0; i < callerOptions.addrCount; i++ )
+        {
+            printf("%s\"0x%02x\"", i > 0 ? ", " : "",
+                   callerOptions.addrOpt[i]);
+        }
+        printf("],\n  \"type\": \"%s\",\n  \"capacity\": %d,\n"
+               "  \"page_size\": %d,\n  \"write_cycle_ms\": %d,\n",
+               pInfo->name, pInfo->page_size * pInfo->total_pages,
+               pInfo->page_size, pInfo->write_cycle_time );
+        if( callerOptions.simOpt )
+        {
+            printf("  \"bus_khz\": %d,\n", callerOptions.khzOpt >= 0 ?
+                   callerOptions.khzOpt : pInfo->bus_frequency_4V5 );
+        }
+        printf("  \"max_ops\": %d,\n  \"max_ms\": %d,\n  \"seed\": %u,\n"
+               "  \"results\": [\n", callerOptions.opsOpt,
+               callerOptions.timeMsOpt, callerOptions.seedOpt );
+
+        for( i = 0; i < (int) cases.size(); i++ )
+        {
+            runCase( devices, pInfo, &cases[i], &callerOptions, i == 0 );
+        }
+
+        printf("\n  ]\n}\n");
+    }
+
+    for( i = 0; i < (int) devices.size(); i++ )
+    {
+        devices[i]->eeClose();
+        delete devices[i];
+    }
+
+    return( retVal );
+}
+
@@ -67,6 +67,36 @@
  *
  * --check (same as -c)
  *
+ * ---------------------------- scan -----------------------------------
+ *
+ * --scan (same as -s)
+ *
+ *   look for EEPROMs on all i2c buses and list them
+ *
+ * --range <first>-<last> (same as --range=<first>-<last> resp. -r ...)
+ *
+ *   probe these addresses (hex) in addition to 50-57 with --scan
+ *
+ * ------------------------- provisioning ------------------------------
+ *
+ * --provision <image> (same as --provision=<image> resp. -p <image>)
+ *
+ *   write header and the contents of file <image> to every target
+ *   given with --targets and verify them. Needs --type. Targets on
+ *   one bus are written interleaved, each bus by its own thread
+ *
+ * --targets <list> (same as --targets=<list> resp. -T <list>)
+ *
+ *   comma separated list of <bus>:<addr> or <bus>:<addr>-<addr>,
+ *   addresses in hex, e.g. 1:50-57,2:50
+ *
+ * ---------------------------- stats ----------------------------------
+ *
+ * --stats (same as -S)
+ *
+ *   print transfer counters and latency histograms of the devices
+ *   used by --check, --info, --provision or the initialization
+ *
  * ---------------------------- help -----------------------------------
  *
  * --help     (same as -? )
@@ -82,6 +112,7 @@
 #include <errno.h>
 #include <stdint.h>
 #include <getopt.h>
+#include <pthread.h>
 
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -90,6 +121,8 @@
 #include "i2cEEPROM.h"
 #include "i2cEEPROM.h"
 
+#include <vector>
+
 #define OPTION_TYPE_SET     0x0001
 #define OPTION_MAGIC_SET    0x0002
 #define OPTION_ADDR_SET     0x0004
@@ -99,6 +132,11 @@
 #define OPTION_FORCE_SET    0x0040
 #define OPTION_VERBOSE_SET  0x0080
 #define OPTION_CHECK_SET    0x0100
+#define OPTION_PROVISION_SET 0x0200
+#define OPTION_TARGETS_SET  0x0400
+#define OPTION_SCAN_SET     0x0800
+#define OPTION_RANGE_SET    0x1000
+#define OPTION_STATS_SET    0x2000
 
 struct _caller_options {
     uint16_t eeTypeOpt;
@@ -111,6 +149,27 @@ struct _caller_options {
     bool     eeForceOpt;
     bool     eeVerboseOpt;
     bool     eeCheckOopt;
+    char    *eeImageOpt;
+    char    *eeTargetsOpt;
+    int      eeRangeFirstOpt;
+    int      eeRangeLastOpt;
+    bool     eeStatsOpt;
+};
+
+struct _ee_target {
+    int  bus;
+    int  addr;
+    int  result;
+    struct eeStats stats;
+};
+
+struct _bus_worker {
+    int            bus;
+    uint16_t       type;
+    uint8_t       *pImage;
+    int            imageLen;
+    pthread_t      thread;
+    std::vector<struct _ee_target*> targets;
 };
 
 /* -------------------------------------------------------------------------
@@ -150,6 +209,12 @@ void dumpArgs( struct _caller_options *pParam )
                 pParam->eeVerboseOpt == true ? "true" : "false" );
         fprintf(stderr, "Check only .: %s\n", 
                 pParam->eeCheckOopt == true ? "true" : "false" );
+        fprintf(stderr, "Image ......: %s\n", 
+                pParam->eeImageOpt != NULL ? pParam->eeImageOpt : "-" );
+        fprintf(stderr, "Targets ....: %s\n", 
+                pParam->eeTargetsOpt != NULL ? pParam->eeTargetsOpt : "-" );
+        fprintf(stderr, "Stats ......: %s\n", 
+                pParam->eeStatsOpt == true ? "true" : "false" );
 
     }
 }
@@ -180,6 +245,11 @@ void resetArgs( struct _caller_options *pParam )
         pParam->eeForceOpt     = false;
         pParam->eeVerboseOpt   = false;
         pParam->eeCheckOopt    = false;
+        pParam->eeImageOpt     = NULL;
+        pParam->eeTargetsOpt   = NULL;
+        pParam->eeRangeFirstOpt = -1;
+        pParam->eeRangeLastOpt  = -1;
+        pParam->eeStatsOpt     = false;
     }
 }
 
@@ -195,7 +265,7 @@ void get_arguments ( int argc, char **argv, struct _caller_options *pParam )
     int failed = 0;
     int next_option;
     /* valid short options letters */
-    const char* const short_options = "t:m:a:b:lifvch?";
+    const char* const short_options = "t:m:a:b:lifvcp:T:sr:Sh?";
     unsigned long scanValue;
 
     if( pParam != NULL )
@@ -212,6 +282,11 @@ void get_arguments ( int argc, char **argv, struct _caller_options *pParam )
              { "force",   0, NULL, 'f' },
              { "verbose", 0, NULL, 'v' },
              { "check",   0, NULL, 'c' },
+             { "provision", 1, NULL, 'p' },
+             { "targets", 1, NULL, 'T' },
+             { "scan",    0, NULL, 's' },
+             { "range",   1, NULL, 'r' },
+             { "stats",   0, NULL, 'S' },
              { "help",    0, NULL, 'h' },
             { NULL,       0, NULL,  0  }
         };
@@ -262,6 +337,28 @@ void get_arguments ( int argc, char **argv, struct _caller_options *pParam )
                     pParam->eeCheckOopt = true;
                     pParam->eeOptFlags |= OPTION_CHECK_SET;
                     break;
+                case 'p':
+                    pParam->eeImageOpt = optarg;
+                    pParam->eeOptFlags |= OPTION_PROVISION_SET;
+                    break;
+                case 'T':
+                    pParam->eeTargetsOpt = optarg;
+                    pParam->eeOptFlags |= OPTION_TARGETS_SET;
+                    break;
+                case 's':
+                    pParam->eeOptFlags |= OPTION_SCAN_SET;
+                    break;
+                case 'r':
+                    if( sscanf(optarg, "%x-%x", &pParam->eeRangeFirstOpt,
+                               &pParam->eeRangeLastOpt) == 2 )
+                    {
+                        pParam->eeOptFlags |= OPTION_RANGE_SET;
+                    }
+                    break;
+                case 'S':
+                    pParam->eeStatsOpt = true;
+                    pParam->eeOptFlags |= OPTION_STATS_SET;
+                    break;
                 case 'h':
                 case '?':
                     dumpArgs( pParam );
@@ -280,6 +377,9 @@ void get_arguments ( int argc, char **argv, struct _caller_options *pParam )
 #define ERROR_NO_TYPE_MAGIC -2
 #define ERROR_I2C_PARAM     -3
 #define USER_ABORT          -4
+#define ERROR_TARGETS       -5
+#define ERROR_IMAGE         -6
+#define ERROR_PROVISION     -7
 
 int listKnownTypes( i2cEEPROM *pDevice, struct _caller_options *pParam )
 {
@@ -343,6 +443,11 @@ int check4EEPROM( i2cEEPROM *pDevice, struct _caller_options *pParam )
                     // pParam->eeVerboseOpt
                     // pParam->eeCheckOopt
 
+                if( pParam->eeStatsOpt )
+                {
+                    pDevice->eePrintStats( stdout );
+                }
+
                 fprintf(stderr, "close device\n");
                 pDevice->eeClose();
             }
@@ -391,6 +496,11 @@ fprintf(stderr, "there seems to be no valid ID!\n");
 fprintf(stderr, "retVal = %d\n", retVal);
                 }
 
+                if( pParam->eeStatsOpt )
+                {
+                    pDevice->eePrintStats( stdout );
+                }
+
                 fprintf(stderr, "close device\n");
                 pDevice->eeClose();
             }
@@ -471,6 +581,11 @@ printf("Write magic=%x and type=%x to EEPROM at address=%x on i2c-bus %d?\n",
                         }
                     }
 
+                    if( pParam->eeStatsOpt )
+                    {
+                        pDevice->eePrintStats( stdout );
+                    }
+
                     pDevice->eeClose();
                 }
             }
@@ -491,6 +606,469 @@ printf("Write magic=%x and type=%x to EEPROM at address=%x on i2c-bus %d?\n",
     return( retVal );
 }
 
+/* -------------------------------------------------------------------------
+ | int scanForEEPROMs( struct _caller_options *pParam )
+ |
+ | list the EEPROMs found on all buses
+ ---------------------------------------------------------------------------
+*/
+int scanForEEPROMs( struct _caller_options *pParam )
+{
+    int retVal;
+    size_t i;
+    uint64_t started;
+    std::vector<struct eeScanResult> results;
+    struct eeScanResult *pFound;
+
+    if( pParam == (struct _caller_options*) NULL )
+    {
+        return( ERROR_NULL );
+    }
+
+    started = i2cMonotonicUs();
+
+    if( (retVal = i2cEEPROM::eeScan( results, pParam->eeRangeFirstOpt, 
+                                     pParam->eeRangeLastOpt )) == 
+        E_EE_SUCCESS )
+    {
+        printf("device      addr  magic  type  name     size  page\n");
+
+        for( i = 0; i < results.size(); i++ )
+        {
+            pFound = &results[i];
+
+            printf("/dev/i2c-%-2d 0x%02x  ", pFound->bus, pFound->addr);
+
+            switch( pFound->state )
+            {
+                case EE_SCAN_FOUND:
+                    if( pFound->pInfo != NULL )
+                    {
+                        printf("%04x   %4d  %-8s %5d  %4d\n", pFound->magic,
+                               pFound->type, pFound->pInfo->name,
+                               pFound->pInfo->page_size * 
+                               pFound->pInfo->total_pages,
+                               pFound->pInfo->page_size);
+                    }
+                    else
+                    {
+                        printf("%04x   %4d  unknown type\n", pFound->magic,
+                               pFound->type);
+                    }
+                    break;
+                case EE_SCAN_NO_HEADER:
+                    printf("-      -     no header\n");
+                    break;
+                case EE_SCAN_IN_USE:
+                    printf("-      -     in use by a driver\n");
+                    break;
+                default:
+                    printf("?\n");
+                    break;
+            }
+        }
+
+        printf("%d devices, scan took %.3f s\n", (int) results.size(),
+               (i2cMonotonicUs() - started) / 1000000.0);
+    }
+    else
+    {
+fprintf(stderr, "no i2c bus found\n");
+    }
+
+    return( retVal );
+}
+
+/* -------------------------------------------------------------------------
+ | int parseTargets( const char *pList, std::vector<struct _ee_target> &targets )
+ |
+ | split a target list like 1:50-57,2:50 into single bus/address targets
+ ---------------------------------------------------------------------------
+*/
+int parseTargets( const char *pList, std::vector<struct _ee_target> &targets )
+{
+    int retVal = 0;
+    int bus;
+    unsigned int first;
+    unsigned int last;
+    unsigned int addr;
+    int fields;
+    char item[64];
+    const char *pItem;
+    const char *pEnd;
+    struct _ee_target target;
+
+    targets.clear();
+
+    for( pItem = pList; pItem != NULL && *pItem != '\0' && retVal == 0; 
+         pItem = *pEnd == ',' ? pEnd + 1 : NULL )
+    {
+        if( (pEnd = strchr( pItem, ',' )) == NULL )
+        {
+            pEnd = pItem + strlen( pItem );
+        }
+
+        if( pEnd - pItem >= (int) sizeof(item) )
+        {
+            retVal = ERROR_TARGETS;
+        }
+        else
+        {
+            memcpy( item, pItem, pEnd - pItem );
+            item[pEnd - pItem] = '\0';
+
+            fields = sscanf( item, "%d:%x-%x", &bus, &first, &last );
+
+            if( fields == 2 )
+            {
+                last = first;
+            }
+
+            if( fields < 2 || bus < 0 || first > last || last > 0x7f )
+            {
+fprintf(stderr, "invalid target %s\n", item);
+                retVal = ERROR_TARGETS;
+            }
+            else
+            {
+                for( addr = first; addr <= last; addr++ )
+                {
+                    target.bus    = bus;
+                    target.addr   = addr;
+                    target.result = E_EE_FAIL;
+                    memset( &target.stats, 0, sizeof(target.stats) );
+                    targets.push_back( target );
+                }
+            }
+        }
+    }
+
+    if( retVal == 0 && targets.empty() )
+    {
+        retVal = ERROR_TARGETS;
+    }
+
+    return( retVal );
+}
+
+/* -------------------------------------------------------------------------
+ | int loadImage( const char *pPath, std::vector<uint8_t> &image )
+ |
+ | read the whole image file into memory
+ ---------------------------------------------------------------------------
+*/
+int loadImage( const char *pPath, std::vector<uint8_t> &image )
+{
+    int retVal = 0;
+    FILE *pFile;
+    size_t got;
+    uint8_t chunk[4096];
+
+    image.clear();
+
+    if( (pFile = fopen( pPath, "rb" )) != NULL )
+    {
+        while( (got = fread( chunk, 1, sizeof(chunk), pFile )) > 0 )
+        {
+            image.insert( image.end(), chunk, chunk + got );
+        }
+
+        if( ferror( pFile ) )
+        {
+            retVal = ERROR_IMAGE;
+        }
+
+        fclose( pFile );
+    }
+    else
+    {
+        perror( pPath );
+        retVal = ERROR_IMAGE;
+    }
+
+    return( retVal );
+}
+
+/* -------------------------------------------------------------------------
+ | void *provisionBus( void *pArg )
+ |
+ | worker of one bus: write header and image to all targets of the bus,
+ | interleaved by the bus scheduler, then read back and compare
+ ---------------------------------------------------------------------------
+*/
+void *provisionBus( void *pArg )
+{
+    struct _bus_worker *pWorker = (struct _bus_worker*) pArg;
+    struct _ee_target *pTarget;
+    i2cBusScheduler sched( pWorker->bus );
+    std::vector<i2cEEPROM*> devices;
+    std::vector< std::vector<uint8_t> > readBack;
+    std::vector<int> ioResult;
+    uint16_t rdMagic;
+    uint16_t rdType;
+    size_t i;
+
+    devices.resize( pWorker->targets.size(), (i2cEEPROM*) NULL );
+    readBack.resize( pWorker->targets.size() );
+    ioResult.resize( pWorker->targets.size(), E_EE_SUCCESS );
+
+    for( i = 0; i < pWorker->targets.size(); i++ )
+    {
+        pTarget = pWorker->targets[i];
+
+        if( (devices[i] = new i2cEEPROM()) == NULL )
+        {
+            pTarget->result = E_EE_MEM;
+            continue;
+        }
+
+        // the scheduler needs the bus itself, not eepromd
+        devices[i]->eeSetDaemonUse( false );
+
+        if( (pTarget->result = devices[i]->eeOpen( pTarget->bus, 
+                                                   pTarget->addr )) == 
+            E_EE_SUCCESS &&
+            (pTarget->result = devices[i]->eeTypeSet( pWorker->type )) ==
+            E_EE_SUCCESS )
+        {
+            // eeInit() writes the header of release 2, unless the chip
+            // already has one of release 1, which is shorter
+            if( pWorker->imageLen > 
+                devices[i]->eeCapacity() - EE_PRIVATE_HDR_V2_LEN )
+            {
+                pTarget->result = E_EE_INVAL_PARAM;
+            }
+            else
+            {
+                // the header write does not wait for the write cycle,
+                // the next device is initialized meanwhile
+                if( (pTarget->result = devices[i]->eeInit()) == 
+                    E_EE_SUCCESS && pWorker->imageLen > 0 )
+                {
+                    readBack[i].resize( pWorker->imageLen );
+
+                    if( (pTarget->result = devices[i]->eeQueueWrite( &sched, 
+                                0, pWorker->pImage, pWorker->imageLen,
+                                [&ioResult, i]( int result ) {
+                                    if( result != E_EE_SUCCESS )
+                                    {
+                                        ioResult[i] = result;
+                                    } } )) == E_EE_SUCCESS )
+                    {
+                        pTarget->result = devices[i]->eeQueueRead( &sched, 
+                                0, readBack[i].data(), pWorker->imageLen,
+                                [&ioResult, i]( int result ) {
+                                    if( result != E_EE_SUCCESS )
+                                    {
+                                        ioResult[i] = result;
+                                    } } );
+                    }
+                }
+            }
+        }
+    }
+
+    sched.run();
+
+    for( i = 0; i < pWorker->targets.size(); i++ )
+    {
+        pTarget = pWorker->targets[i];
+
+        if( pTarget->result == E_EE_SUCCESS )
+        {
+            if( (pTarget->result = ioResult[i]) == E_EE_SUCCESS )
+            {
+                if( pWorker->imageLen > 0 &&
+                    memcmp( readBack[i].data(), pWorker->pImage, 
+                            pWorker->imageLen ) != 0 )
+                {
+                    pTarget->result = E_EE_VERIFY;
+                }
+                else
+                {
+                    if( devices[i]->eeTypeDetect( &rdMagic, &rdType ) != 
+                        E_EE_SUCCESS || !isIdValid( rdMagic ) || 
+                        rdType != pWorker->type )
+                    {
+                        pTarget->result = E_EE_VERIFY;
+                    }
+                }
+            }
+        }
+
+        if( devices[i] != NULL )
+        {
+            devices[i]->eeGetStats( &pTarget->stats );
+            devices[i]->eeClose();
+            delete devices[i];
+        }
+    }
+
+    return( NULL );
+}
+
+/* -------------------------------------------------------------------------
+ | void printStats( struct eeStats *pStats )
+ |
+ | short form of the statistics of a device that is closed already
+ ---------------------------------------------------------------------------
+*/
+void printStats( struct eeStats *pStats )
+{
+    static const char* kinds[I2C_HIST_KINDS] = 
+        { "read", "write", "program", "wait" };
+    int kind;
+
+    printf("    %llu transactions, %llu bytes read, %llu bytes written, "
+           "%llu page writes, %llu retries, %llu nacks, %llu bus errors\n",
+           (unsigned long long) pStats->bus.transactions,
+           (unsigned long long) pStats->bus.bytes_read,
+           (unsigned long long) pStats->bus.bytes_written,
+           (unsigned long long) pStats->bus.page_writes,
+           (unsigned long long) pStats->bus.retries,
+           (unsigned long long) pStats->bus.nacks,
+           (unsigned long long) pStats->bus.bus_errors );
+
+    for( kind = 0; kind < I2C_HIST_KINDS; kind++ )
+    {
+        if( pStats->bus_latency[kind].count > 0 )
+        {
+            printf("    %-8s n=%llu p50=%llu p99=%llu max=%llu us\n", 
+                   kinds[kind],
+                   (unsigned long long) pStats->bus_latency[kind].count,
+                   (unsigned long long) pStats->bus_latency[kind].p50_us,
+                   (unsigned long long) pStats->bus_latency[kind].p99_us,
+                   (unsigned long long) pStats->bus_latency[kind].max_us );
+        }
+    }
+}
+
+/* -------------------------------------------------------------------------
+ | int provisionEEPROMs( struct _caller_options *pParam )
+ |
+ | write the image to all targets, one worker thread per bus
+ ---------------------------------------------------------------------------
+*/
+int provisionEEPROMs( struct _caller_options *pParam )
+{
+    int retVal = 0;
+    int failed;
+    size_t i;
+    size_t w;
+    uint64_t started;
+    uint64_t elapsed;
+    uint64_t bytes;
+    std::vector<uint8_t> image;
+    std::vector<struct _ee_target> targets;
+    std::vector<struct _bus_worker> workers;
+
+    if( pParam == (struct _caller_options*) NULL )
+    {
+        return( ERROR_NULL );
+    }
+
+    if( (pParam->eeOptFlags & OPTION_TYPE_SET) != OPTION_TYPE_SET )
+    {
+        return( ERROR_NO_TYPE_MAGIC );
+    }
+
+    if( (pParam->eeOptFlags & OPTION_TARGETS_SET) != OPTION_TARGETS_SET ||
+        (retVal = parseTargets( pParam->eeTargetsOpt, targets )) != 0 )
+    {
+        return( ERROR_TARGETS );
+    }
+
+    if( (retVal = loadImage( pParam->eeImageOpt, image )) != 0 )
+    {
+        return( retVal );
+    }
+
+    // one worker per bus, targets in the order given
+    for( i = 0; i < targets.size(); i++ )
+    {
+        for( w = 0; w < workers.size() && workers[w].bus != targets[i].bus; 
+             w++ )
+            ;
+
+        if( w == workers.size() )
+        {
+            workers.resize( w + 1 );
+            workers[w].bus      = targets[i].bus;
+            workers[w].type     = pParam->eeTypeOpt;
+            workers[w].pImage   = image.data();
+            workers[w].imageLen = image.size();
+        }
+
+        workers[w].targets.push_back( &targets[i] );
+    }
+
+    if( !pParam->eeForceOpt )
+    {
+printf("Write type=%x and %d bytes of %s to %d EEPROMs on %d i2c-buses?\n", 
+       pParam->eeTypeOpt, (int) image.size(), pParam->eeImageOpt, 
+       (int) targets.size(), (int) workers.size() );
+
+        if( !confirm_YN('n') )
+        {
+            printf("\nabgebrochen!\n");
+            return( USER_ABORT );
+        }
+    }
+
+    started = i2cMonotonicUs();
+
+    for( w = 0; w < workers.size(); w++ )
+    {
+        if( pthread_create( &workers[w].thread, NULL, provisionBus, 
+                            &workers[w] ) != 0 )
+        {
+            // no thread, do it in this one
+            provisionBus( &workers[w] );
+            workers[w].thread = 0;
+        }
+    }
+
+    for( w = 0; w < workers.size(); w++ )
+    {
+        if( workers[w].thread != 0 )
+        {
+            pthread_join( workers[w].thread, NULL );
+        }
+    }
+
+    elapsed = i2cMonotonicUs() - started;
+
+    failed = 0;
+    bytes  = 0;
+
+    for( i = 0; i < targets.size(); i++ )
+    {
+        if( targets[i].result == E_EE_SUCCESS )
+        {
+            printf("i2c-%d 0x%02x: ok\n", targets[i].bus, targets[i].addr);
+            bytes += image.size() + EE_PRIVATE_HDR_V2_LEN;
+        }
+        else
+        {
+            printf("i2c-%d 0x%02x: FAILED (%d)\n", targets[i].bus, 
+                   targets[i].addr, targets[i].result);
+            failed++;
+        }
+
+        if( pParam->eeStatsOpt )
+        {
+            printStats( &targets[i].stats );
+        }
+    }
+
+    printf("%d of %d EEPROMs provisioned on %d buses in %.3f s, %.1f KiB/s\n",
+           (int) targets.size() - failed, (int) targets.size(), 
+           (int) workers.size(), elapsed / 1000000.0,
+           elapsed > 0 ? (bytes / 1024.0) / (elapsed / 1000000.0) : 0.0 );
+
+    return( failed == 0 ? 0 : ERROR_PROVISION );
+}
+
 /* -------------------------------------------------------------------------
  | int main( int argc, char *argv[] )
  |
@@ -513,19 +1091,34 @@ int main( int argc, char *argv[] )
         }
         else
         {
-            if( (param.eeOptFlags & OPTION_CHECK_SET) == OPTION_CHECK_SET )
+            if( (param.eeOptFlags & OPTION_SCAN_SET) == OPTION_SCAN_SET )
             {
-                retVal = check4EEPROM( pDevice, &param );
+                retVal = scanForEEPROMs( &param );
             }
             else
             {
-                if( (param.eeOptFlags & OPTION_INFO_SET) == OPTION_INFO_SET )
+                if( (param.eeOptFlags & OPTION_CHECK_SET) == OPTION_CHECK_SET )
                 {
-                    retVal = infoOnEEPROM( pDevice, &param );
+                    retVal = check4EEPROM( pDevice, &param );
                 }
                 else
                 {
-                    retVal = initializeEEPROM( pDevice, &param );
+                    if( (param.eeOptFlags & OPTION_INFO_SET) == OPTION_INFO_SET )
+                    {
+                        retVal = infoOnEEPROM( pDevice, &param );
+                    }
+                    else
+                    {
+                        if( (param.eeOptFlags & OPTION_PROVISION_SET) == 
+                            OPTION_PROVISION_SET )
+                        {
+                            retVal = provisionEEPROMs( &param );
+                        }
+                        else
+                        {
+                            retVal = initializeEEPROM( pDevice, &param );
+                        }
+                    }
                 }
             }
         }
@@ -0,0 +1,761 @@
+/*
+ ***********************************************************************
+ *
+ *  eeReplay.cpp - part of eeprom access project
+ *
+ *  Copyright (C) 2013-2019 Dreamshader (aka Dirk Schanz)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ *
+ ***********************************************************************
+ *
+ * Replay a recording (see i2cRecord.h) against a simulated device
+ * (see i2cSim.h) with different configurations of the library and
+ * compare what each costs:
+ *
+ *   cache     eeCacheEnable( true )
+ *   coalesce  consecutive writes go into one eeWriteV(), up to the
+ *             next read or flush and at most REPLAY_MAX_COALESCE
+ *   bytewise  no page bursts, every write is split into single
+ *             byte writes, as a naive driver would do
+ *   poll      ACK polling instead of waiting the data sheet write
+ *             cycle time, see struct _i2c_retry_policy
+ *
+ * bytewise takes precedence over coalesce.
+ *
+ * Every configuration gets a fresh device. Reported are the time of
+ * the replay, the bus time and messages seen by the device, the
+ * write cycles, the not acknowledged polls and the wear: the pages
+ * written at all and the write cycles of the most written one.
+ * The recording has no data, written bytes are a pattern.
+ *
+ * Usage: eeReplay [options] <recording>
+ *
+ * --type <type> (same as -t <type>)
+ *
+ *   EEPROM type, default the one of the recording
+ *
+ * --khz <clock> (same as -k <clock>)
+ *
+ *   bus clock of the simulation, default the 4.5 V clock of the type
+ *
+ * --cycle <us> (same as -c <us>)
+ *
+ *   write cycle of the simulated chip, default 60% of the data
+ *   sheet maximum, as real chips are faster
+ *
+ * --matrix (same as -m)
+ *
+ *   all 16 combinations instead of the baseline, each change alone
+ *   and all changes that help together
+ *
+ * --paced (same as -p)
+ *
+ *   keep the pauses between the calls of the recording
+ *
+ * --json (same as -j)
+ *
+ *   JSON on stdout instead of a table
+ *
+ * --dump (same as -d)
+ *
+ *   print the recorded calls and exit
+ *
+ * --verbose (same as -v)
+ *
+ *   progress on stderr
+ *
+ ***********************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include <vector>
+
+#include "i2cEEPROM.h"
+#include "i2cSim.h"
+#include "i2cRecord.h"
+
+#define REPLAY_SIM_BUS         99
+#define REPLAY_ADDR            0x50
+#define REPLAY_CYCLE_PERCENT   60
+#define REPLAY_MAX_COALESCE    16
+
+#define REPLAY_CACHE           0x01
+#define REPLAY_COALESCE        0x02
+#define REPLAY_BYTEWISE        0x04
+#define REPLAY_POLL            0x08
+#define REPLAY_CONFIGS         16
+
+#define ERROR_PARAM            -1
+#define ERROR_FILE             -2
+#define ERROR_TYPE             -3
+#define ERROR_SIM              -4
+#define ERROR_OPEN             -5
+
+struct _caller_options {
+    const char* pFileOpt;
+    int  typeOpt;
+    int  khzOpt;
+    int  cycleUsOpt;
+    bool matrixOpt;
+    bool pacedOpt;
+    bool jsonOpt;
+    bool dumpOpt;
+    bool verboseOpt;
+};
+
+struct _replay_result {
+    int      config;
+    uint64_t elapsed_us;
+    uint64_t calls;
+    uint64_t errors;
+    struct _i2c_sim_stats sim;
+    struct eeStats lib;
+};
+
+/* -------------------------------------------------------------------------
+ | void help( void )
+ |
+ | print help screen and exit
+ ---------------------------------------------------------------------------
+*/
+void help( void )
+{
+    fprintf(stderr, "usage: eeReplay [--type <type>] [--khz <clock>] "
+            "[--cycle <us>] [--matrix]\n"
+            "                [--paced] [--json] [--dump] [--verbose] "
+            "<recording>\n");
+    exit(0);
+}
+
+/* -------------------------------------------------------------------------
+ | void resetArgs( struct _caller_options *pParam )
+ |
+ | reset options to defaults
+ ---------------------------------------------------------------------------
+*/
+void resetArgs( struct _caller_options *pParam )
+{
+    if( pParam != NULL )
+    {
+        pParam->pFileOpt   = NULL;
+        pParam->typeOpt    = -1;
+        pParam->khzOpt     = -1;
+        pParam->cycleUsOpt = -1;
+        pParam->matrixOpt  = false;
+        pParam->pacedOpt   = false;
+        pParam->jsonOpt    = false;
+        pParam->dumpOpt    = false;
+        pParam->verboseOpt = false;
+    }
+}
+
+/* -------------------------------------------------------------------------
+ | int get_arguments(int argc, char **argv, struct _caller_options *pParam)
+ |
+ | scan commandline for arguments an set the corresponding value
+ ---------------------------------------------------------------------------
+*/
+int get_arguments ( int argc, char **argv, struct _caller_options *pParam )
+{
+    int retVal = 0;
+    int next_option;
+    /* valid short options letters */
+    const char* const short_options = "t:k:c:mpjdvh?";
+
+    /* valid long options */
+    const struct option long_options[] = {
+         { "type",    1, NULL, 't' },
+         { "khz",     1, NULL, 'k' },
+         { "cycle",   1, NULL, 'c' },
+         { "matrix",  0, NULL, 'm' },
+         { "paced",   0, NULL, 'p' },
+         { "json",    0, NULL, 'j' },
+         { "dump",    0, NULL, 'd' },
+         { "verbose", 0, NULL, 'v' },
+         { "help",    0, NULL, 'h' },
+        { NULL,       0, NULL,  0  }
+    };
+
+    resetArgs( pParam );
+
+    do
+    {
+        next_option = getopt_long (argc, argv, short_options,
+            long_options, NULL);
+
+        switch (next_option) {
+            case 't':
+                pParam->typeOpt = atoi(optarg);
+                break;
+            case 'k':
+                pParam->khzOpt = atoi(optarg);
+                break;
+            case 'c':
+                pParam->cycleUsOpt = atoi(optarg);
+                break;
+            case 'm':
+                pParam->matrixOpt = true;
+                break;
+            case 'p':
+                pParam->pacedOpt = true;
+                break;
+            case 'j':
+                pParam->jsonOpt = true;
+                break;
+            case 'd':
+                pParam->dumpOpt = true;
+                break;
+            case 'v':
+                pParam->verboseOpt = true;
+                break;
+            case 'h':
+            case '?':
+                help();
+                break;
+            default:
+                break;
+        }
+    } while (next_option != -1);
+
+    if( optind == argc - 1 )
+    {
+        pParam->pFileOpt = argv[optind];
+    }
+    else
+    {
+        fprintf(stderr, "exactly one recording expected\n");
+        retVal = ERROR_PARAM;
+    }
+
+    return( retVal );
+}
+
+/* -------------------------------------------------------------------------
+ | int loadRecording( const char *pPath, struct _ee_record_hdr *pHdr,
+ |                    std::vector<struct _ee_record>& entries )
+ |
+ | read a recording. The entries are read up to the end of the file,
+ | the count in the header is wrong if the recorder was not stopped
+ ---------------------------------------------------------------------------
+*/
+int loadRecording( const char *pPath, struct _ee_record_hdr *pHdr,
+                   std::vector<struct _ee_record>& entries )
+{
+    int retVal = 0;
+    FILE *pIn;
+    struct _ee_record entry;
+
+    if( (pIn = fopen( pPath, "rb" )) == NULL )
+    {
+        perror( pPath );
+        retVal = ERROR_FILE;
+    }
+    else
+    {
+        if( i2cRecordRead( pIn, pHdr ) != E_REC_SUCCESS )
+        {
+            fprintf(stderr, "%s is no recording\n", pPath);
+            retVal = ERROR_FILE;
+        }
+        else
+        {
+            while( fread( &entry, sizeof(entry), 1, pIn ) == 1 )
+            {
+                entries.push_back( entry );
+            }
+        }
+
+        fclose( pIn );
+    }
+
+    return( retVal );
+}
+
+/* -------------------------------------------------------------------------
+ | void dumpRecording( const struct _ee_record_hdr *pHdr,
+ |                     std::vector<struct _ee_record>& entries )
+ |
+ | print the calls of a recording
+ ---------------------------------------------------------------------------
+*/
+void dumpRecording( const struct _ee_record_hdr *pHdr,
+                    std::vector<struct _ee_record>& entries )
+{
+    uint64_t at = 0;
+    size_t i;
+
+    printf("type %04x, page size %d, capacity %u, %zu calls\n",
+           pHdr->type, pHdr->page_size, pHdr->capacity, entries.size());
+
+    for( i = 0; i < entries.size(); i++ )
+    {
+        at += entries[i].delta_us;
+        printf("%12llu %-10s %04x %5d %s%d\n", (unsigned long long) at,
+               i2cRecordOpName( entries[i].op ), entries[i].addr,
+               entries[i].amount,
+               entries[i].flags & EE_REC_FLAG_LAST ? "last " : "",
+               entries[i].result );
+    }
+}
+
+/* -------------------------------------------------------------------------
+ | const char* configName( int config, char *pName, size_t len )
+ |
+ | readable name of a combination of REPLAY_ flags
+ ---------------------------------------------------------------------------
+*/
+const char* configName( int config, char *pName, size_t len )
+{
+    snprintf( pName, len, "%s%s%s%s%s",
+              config == 0 ? "baseline" : "",
+              config & REPLAY_CACHE    ? "+cache"    : "",
+              config & REPLAY_COALESCE ? "+coalesce" : "",
+              config & REPLAY_BYTEWISE ? "+bytewise" : "",
+              config & REPLAY_POLL     ? "+poll"     : "" );
+
+    return( pName[0] == '+' ? pName + 1 : pName );
+}
+
+/* -------------------------------------------------------------------------
+ | bool isWrite( uint8_t op )
+ |
+ | whether a recorded call writes
+ ---------------------------------------------------------------------------
+*/
+bool isWrite( uint8_t op )
+{
+    return( op == EE_REC_WRITE || op == EE_REC_WRITE_BYTE ||
+            op == EE_REC_WRITE_WORD || op == EE_REC_WRITEV );
+}
+
+/* -------------------------------------------------------------------------
+ | int writeEntry( i2cEEPROM *pDevice, const struct _ee_record *pEntry,
+ |                 uint8_t *pData, int config )
+ |
+ | one recorded write, byte by byte for REPLAY_BYTEWISE
+ ---------------------------------------------------------------------------
+*/
+int writeEntry( i2cEEPROM *pDevice, const struct _ee_record *pEntry,
+                uint8_t *pData, int config )
+{
+    int retVal = E_EE_SUCCESS;
+    int i;
+
+    if( config & REPLAY_BYTEWISE )
+    {
+        for( i = 0; i < pEntry->amount && retVal == E_EE_SUCCESS; i++ )
+        {
+            retVal = pDevice->eeWriteByte( pEntry->addr + i, pData[i] );
+        }
+    }
+    else
+    {
+        switch( pEntry->op )
+        {
+            case EE_REC_WRITE_BYTE:
+                retVal = pDevice->eeWriteByte( pEntry->addr, pData[0] );
+                break;
+            case EE_REC_WRITE_WORD:
+                retVal = pDevice->eeWriteWord( pEntry->addr,
+                                               (pData[0] << 8) | pData[1] );
+                break;
+            default:
+                retVal = pDevice->eeWrite( pEntry->addr, pData,
+                                           pEntry->amount );
+                break;
+        }
+    }
+
+    return( retVal );
+}
+
+/* -------------------------------------------------------------------------
+ | int readEntry( i2cEEPROM *pDevice, const struct _ee_record *pEntry,
+ |                uint8_t *pData )
+ |
+ | one recorded read
+ ---------------------------------------------------------------------------
+*/
+int readEntry( i2cEEPROM *pDevice, const struct _ee_record *pEntry,
+               uint8_t *pData )
+{
+    int retVal;
+    uint16_t word;
+
+    switch( pEntry->op )
+    {
+        case EE_REC_READ_BYTE:
+            retVal = pDevice->eeReadByte( pEntry->addr, pData );
+            break;
+        case EE_REC_READ_WORD:
+            retVal = pDevice->eeReadWord( pEntry->addr, &word );
+            break;
+        case EE_REC_FLUSH:
+            retVal = pDevice->eeFlush();
+            break;
+        default:
+            retVal = pDevice->eeRead( pEntry->addr, pData, pEntry->amount );
+            break;
+    }
+
+    return( retVal );
+}
+
+/* -------------------------------------------------------------------------
+ | int replay( i2cEEPROM *pDevice,
+ |             std::vector<struct _ee_record>& entries, int config,
+ |             bool paced, struct _replay_result *pResult )
+ |
+ | run the calls of a recording on an open device
+ ---------------------------------------------------------------------------
+*/
+int replay( i2cEEPROM *pDevice, std::vector<struct _ee_record>& entries,
+            int config, bool paced, struct _replay_result *pResult )
+{
+    std::vector<uint8_t> data( I2C_SIM_MAX_SIZE );
+    std::vector<struct eeIoVec> batch;
+    struct eeIoVec elem;
+    uint64_t started;
+    uint64_t due;
+    size_t i;
+    int res;
+
+    for( i = 0; i < data.size(); i++ )
+    {
+        data[i] = (uint8_t) (i * 7 + 1);
+    }
+
+    started = due = i2cMonotonicUs();
+
+    for( i = 0; i < entries.size(); i++ )
+    {
+        if( paced )
+        {
+            due += entries[i].delta_us;
+            i2cSleepUntil( due );
+        }
+
+        if( (config & REPLAY_COALESCE) && !(config & REPLAY_BYTEWISE) &&
+            isWrite( entries[i].op ) )
+        {
+            // a write is collected, written with the next read or
+            // flush, the next pause of --paced or when full
+            elem.addr    = entries[i].addr;
+            elem.pBuffer = &data[entries[i].addr];
+            elem.amount  = entries[i].amount;
+            batch.push_back( elem );
+
+            if( batch.size() < REPLAY_MAX_COALESCE &&
+                i + 1 < entries.size() && isWrite( entries[i + 1].op ) &&
+                (!paced || entries[i + 1].delta_us == 0) )
+            {
+                continue;
+            }
+
+            res = pDevice->eeWriteV( batch.data(), batch.size() );
+            batch.clear();
+        }
+        else
+        {
+            if( isWrite( entries[i].op ) )
+            {
+                res = writeEntry( pDevice, &entries[i],
+                                  &data[entries[i].addr], config );
+            }
+            else
+            {
+                res = readEntry( pDevice, &entries[i],
+                                 &data[entries[i].addr] );
+            }
+        }
+
+        pResult->calls++;
+
+        if( res != E_EE_SUCCESS )
+        {
+            pResult->errors++;
+        }
+    }
+
+    // the last write cycle is part of the cost
+    pDevice->eeFlush();
+
+    pResult->elapsed_us = i2cMonotonicUs() - started;
+
+    return( 0 );
+}
+
+/* -------------------------------------------------------------------------
+ | int runConfig( const struct _ee_type_info *pInfo,
+ |                std::vector<struct _ee_record>& entries, int config,
+ |                struct _caller_options *pParam,
+ |                struct _replay_result *pResult )
+ |
+ | replay on a fresh simulated device with the library set up as
+ | config says
+ ---------------------------------------------------------------------------
+*/
+int runConfig( const struct _ee_type_info *pInfo,
+               std::vector<struct _ee_record>& entries, int config,
+               struct _caller_options *pParam,
+               struct _replay_result *pResult )
+{
+    int retVal = 0;
+    struct _i2c_sim_config simConfig;
+    struct _i2c_retry_policy policy;
+    i2cEEPROM device;
+    char name[64];
+
+    memset( pResult, 0, sizeof(*pResult) );
+    pResult->config = config;
+
+    simConfig.size           = pInfo->page_size * pInfo->total_pages;
+    simConfig.page_size      = pInfo->page_size;
+    simConfig.addr16         = pInfo->addressing_16_bit;
+    simConfig.write_cycle_us = pParam->cycleUsOpt >= 0 ? pParam->cycleUsOpt :
+                               pInfo->write_cycle_time * 1000 *
+                               REPLAY_CYCLE_PERCENT / 100;
+    simConfig.bus_khz        = pParam->khzOpt >= 0 ? pParam->khzOpt :
+                               pInfo->bus_frequency_4V5;
+
+    if( pParam->verboseOpt )
+    {
+        fprintf(stderr, "replaying %s\n",
+                configName( config, name, sizeof(name) ));
+    }
+
+    if( i2cSimAttach( REPLAY_SIM_BUS, REPLAY_ADDR,
+                      &simConfig ) != E_SIM_SUCCESS )
+    {
+        fprintf(stderr, "can not simulate a %s\n", pInfo->name);
+        return( ERROR_SIM );
+    }
+
+    // no eeInit(), so the recorded device addresses are used as they are
+    device.eeSetDaemonUse( false );
+
+    if( device.eeOpen( REPLAY_SIM_BUS, REPLAY_ADDR ) != E_EE_SUCCESS ||
+        device.eeTypeSet( pInfo->type ) != E_EE_SUCCESS )
+    {
+        fprintf(stderr, "can not open the simulated %s\n", pInfo->name);
+        retVal = ERROR_OPEN;
+    }
+    else
+    {
+        if( config & REPLAY_CACHE )
+        {
+            device.eeCacheEnable( true );
+        }
+
+        if( config & REPLAY_POLL )
+        {
+            i2cDefaultRetryPolicy( &policy );
+            policy.ack_polling = true;
+            device.eeSetRetryPolicy( &policy );
+        }
+
+        retVal = replay( &device, entries, config, pParam->pacedOpt,
+                         pResult );
+
+        device.eeGetStats( &pResult->lib );
+        i2cSimGetStats( REPLAY_SIM_BUS, REPLAY_ADDR, &pResult->sim );
+    }
+
+    device.eeClose();
+    i2cSimDetach( REPLAY_SIM_BUS, REPLAY_ADDR );
+
+    return( retVal );
+}
+
+/* -------------------------------------------------------------------------
+ | void printTable( std::vector<struct _replay_result>& results )
+ |
+ | one line per configuration
+ ---------------------------------------------------------------------------
+*/
+void printTable( std::vector<struct _replay_result>& results )
+{
+    char name[64];
+    size_t i;
+
+    printf("%-26s %10s %10s %8s %8s %7s %6s %6s %6s\n",
+           "configuration", "time ms", "bus ms", "messages", "cycles",
+           "nacks", "pages", "wear", "errors");
+
+    for( i = 0; i < results.size(); i++ )
+    {
+        printf("%-26s %10.1f %10.1f %8llu %8llu %7llu %6u %6u %6llu\n",
+               configName( results[i].config, name, sizeof(name) ),
+               results[i].elapsed_us / 1000.0,
+               results[i].sim.bus_us / 1000.0,
+               (unsigned long long) results[i].sim.messages,
+               (unsigned long long) results[i].sim.write_cycles,
+               (unsigned long long) results[i].sim.nacks,
+               results[i].sim.pages_written,
+               results[i].sim.max_page_wear,
+               (unsigned long long) results[i].errors );
+    }
+}
+
+/* -------------------------------------------------------------------------
+ | void printJson( const char *pPath, const struct _ee_type_info *pInfo,
+ |                 size_t calls, std::vector<struct _replay_result>& results )
+ |
+ | the same as JSON, with the counters of the library
+ ---------------------------------------------------------------------------
+*/
+void printJson( const char *pPath, const struct _ee_type_info *pInfo,
+                size_t calls, std::vector<struct _replay_result>& results )
+{
+    char name[64];
+    size_t i;
+
+    printf("{\n  \"recording\": \"%s\",\n  \"type\": \"%s\",\n"
+           "  \"calls\": %zu,\n  \"results\": [\n", pPath, pInfo->name,
+           calls );
+
+    for( i = 0; i < results.size(); i++ )
+    {
+        printf("    { \"config\": \"%s\", \"elapsed_us\": %llu, "
+               "\"errors\": %llu,\n"
+               "      \"bus_us\": %llu, \"messages\": %llu, "
+               "\"bus_bits\": %llu, \"nacks\": %llu,\n"
+               "      \"write_cycles\": %llu, \"bytes_programmed\": %llu, "
+               "\"pages_written\": %u, \"max_page_wear\": %u,\n"
+               "      \"cache_hits\": %llu, \"wait_us\": %llu }%s\n",
+               configName( results[i].config, name, sizeof(name) ),
+               (unsigned long long) results[i].elapsed_us,
+               (unsigned long long) results[i].errors,
+               (unsigned long long) results[i].sim.bus_us,
+               (unsigned long long) results[i].sim.messages,
+               (unsigned long long) results[i].sim.bus_bits,
+               (unsigned long long) results[i].sim.nacks,
+               (unsigned long long) results[i].sim.write_cycles,
+               (unsigned long long) results[i].sim.bytes_programmed,
+               results[i].sim.pages_written,
+               results[i].sim.max_page_wear,
+               (unsigned long long) results[i].lib.device.cache_hits,
+               (unsigned long long) results[i].lib.bus.wait_us,
+               i + 1 < results.size() ? "," : "" );
+    }
+
+    printf("  ]\n}\n");
+}
+
+/* -------------------------------------------------------------------------
+ | int main( int argc, char *argv[] )
+ ---------------------------------------------------------------------------
+*/
+int main( int argc, char *argv[] )
+{
+    int retVal;
+    struct _caller_options callerOptions;
+    struct _ee_record_hdr hdr;
+    const struct _ee_type_info *pInfo;
+    std::vector<struct _ee_record> entries;
+    std::vector<struct _replay_result> results;
+    std::vector<int> configs;
+    int config;
+    size_t i;
+
+    if( (retVal = get_arguments( argc, argv, &callerOptions )) != 0 )
+    {
+        return( retVal );
+    }
+
+    if( (retVal = loadRecording( callerOptions.pFileOpt, &hdr,
+                                 entries )) != 0 )
+    {
+        return( retVal );
+    }
+
+    if( callerOptions.dumpOpt )
+    {
+        dumpRecording( &hdr, entries );
+        return( 0 );
+    }
+
+    if( callerOptions.typeOpt < 0 )
+    {
+        callerOptions.typeOpt = hdr.type;
+    }
+
+    if( (pInfo = eeTypeInfo( callerOptions.typeOpt )) == NULL )
+    {
+        fprintf(stderr, "unknown type %d, use --type\n",
+                callerOptions.typeOpt);
+        return( ERROR_TYPE );
+    }
+
+    for( i = 0; i < entries.size(); i++ )
+    {
+        if( entries[i].addr + entries[i].amount >
+            pInfo->page_size * pInfo->total_pages )
+        {
+            fprintf(stderr, "call %zu at %04x does not fit into a %s\n", i,
+                    entries[i].addr, pInfo->name);
+            return( ERROR_TYPE );
+        }
+    }
+
+    if( callerOptions.matrixOpt )
+    {
+        for( config = 0; config < REPLAY_CONFIGS; config++ )
+        {
+            configs.push_back( config );
+        }
+    }
+    else
+    {
+        configs.push_back( 0 );
+        configs.push_back( REPLAY_CACHE );
+        configs.push_back( REPLAY_COALESCE );
+        configs.push_back( REPLAY_BYTEWISE );
+        configs.push_back( REPLAY_POLL );
+        configs.push_back( REPLAY_CACHE | REPLAY_COALESCE | REPLAY_POLL );
+    }
+
+    results.resize( configs.size() );
+
+    for( i = 0; i < configs.size() && retVal == 0; i++ )
+    {
+        retVal = runConfig( pInfo, entries, configs[i], &callerOptions,
+                            &results[i] );
+    }
+
+    if( retVal == 0 )
+    {
+        if( callerOptions.jsonOpt )
+        {
+            printJson( callerOptions.pFileOpt, pInfo, entries.size(),
+                       results );
+        }
+        else
+        {
+            printTable( results );
+        }
+    }
+
+    return( retVal );
+}
+
@@ -0,0 +1,1156 @@
+/*
+ ***********************************************************************
+ *
+ *  eeStress.cpp - part of eeprom access project
+ *
+ *  Copyright (C) 2013-2019 Dreamshader (aka Dirk Schanz)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ *
+ ***********************************************************************
+ *
+ * Stress and soak test. --threads threads share the devices, each
+ * running randomized reads and writes of all kinds (byte, word,
+ * buffers crossing page boundaries, eeReadV/eeWriteV, flushes) for
+ * --duration seconds. Every device has a reference image on the
+ * host: writes update it, every read is checked against it. A read
+ * that differs is a divergence, it is reported with the thread, the
+ * call and the first differing byte. At the end the whole chips are
+ * compared once more.
+ *
+ * Calls of different threads on the same pages would make the
+ * expected result depend on the order, so a thread locks the pages
+ * of a call in the reference image for the time of the call. Calls
+ * on other pages of the same device run concurrently.
+ *
+ * Every --interval seconds a line with the throughput of the
+ * interval is printed. The calls of a thread only depend on --seed
+ * and its number, the interleaving of the threads does not; the
+ * command line to run the same calls again is part of the report.
+ *
+ * The exit code is 0 if nothing diverged.
+ *
+ * The first EE_PRIVATE_HDR_LEN bytes (magic and type) are never
+ * written.
+ *
+ * Options:
+ *
+ * --sim (same as -s)
+ *
+ *   simulated devices (see i2cSim.h) instead of hardware, the
+ *   default without --bus
+ *
+ * --bus <bus #> (same as --bus=<bus #> resp. -b <bus #>)
+ *
+ * --address <list> (same as --address=<list> resp. -a <list>)
+ *
+ *   comma separated slave addresses in hex, default 50
+ *
+ * --devices <n> (same as -d <n>)
+ *
+ *   number of simulated devices at 50, 51, ..., default 2
+ *
+ * --type <type> (same as -t <type>)
+ *
+ *   EEPROM type, default is detecting it (hardware) resp. 24C65
+ *   (simulated)
+ *
+ * --khz <clock> (same as -k <clock>)
+ *
+ *   bus clock of the simulation, default the 4.5 V clock of the type
+ *
+ * --write (same as -w)
+ *
+ *   needed to run on hardware, this destroys the contents
+ *
+ * --threads <n> (same as -n <n>)
+ *
+ *   default 4
+ *
+ * --duration <s> (same as -D <s>), --interval <s> (same as -i <s>)
+ *
+ *   default 10 s and a report every second
+ *
+ * --reads <percent> (same as -R <percent>)
+ *
+ *   share of the reads, default 60
+ *
+ * --cache (same as -c)
+ *
+ *   with page cache, see eeCacheEnable()
+ *
+ * --seed <n> (same as -r <n>)
+ *
+ *   default the time
+ *
+ * --verbose (same as -v)
+ *
+ *   every divergence, not just the first STRESS_MAX_REPORTS
+ *
+ ***********************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+
+#include <vector>
+#include <algorithm>
+
+#include "i2cEEPROM.h"
+#include "i2cSim.h"
+
+#define STRESS_SIM_BUS         99
+#define STRESS_FIRST_ADDR      0x50
+#define STRESS_MAX_DEVICES     8
+#define STRESS_MAX_THREADS     64
+#define STRESS_DEFAULT_TYPE    EE_TYPE_24C65
+#define STRESS_MAX_VEC         4
+#define STRESS_MAX_REPORTS     10
+
+#define STRESS_READ            0
+#define STRESS_READ_BYTE       1
+#define STRESS_READ_WORD       2
+#define STRESS_READV           3
+#define STRESS_WRITE           4
+#define STRESS_WRITE_BYTE      5
+#define STRESS_WRITE_WORD      6
+#define STRESS_WRITEV          7
+#define STRESS_FLUSH           8
+#define STRESS_OPS             9
+
+#define ERROR_PARAM            -1
+#define ERROR_SIM              -2
+#define ERROR_OPEN             -3
+#define ERROR_TYPE             -4
+#define ERROR_DIVERGED         -5
+
+struct _caller_options {
+    bool     simOpt;
+    int      busOpt;
+    int      addrOpt[STRESS_MAX_DEVICES];
+    int      addrCount;
+    int      devicesOpt;
+    int      typeOpt;
+    int      khzOpt;
+    bool     writeOpt;
+    int      threadsOpt;
+    int      durationOpt;
+    int      intervalOpt;
+    int      readsOpt;
+    bool     cacheOpt;
+    uint32_t seedOpt;
+    bool     verboseOpt;
+};
+
+struct _stress_device {
+    i2cEEPROM*           pDevice;
+    int                  addr;
+    int                  capacity;
+    int                  pageSize;
+    std::vector<uint8_t> reference;
+    std::vector<pthread_mutex_t> pageLocks;
+};
+
+struct _stress_counters {
+    uint64_t ops;
+    uint64_t reads;
+    uint64_t writes;
+    uint64_t bytes;
+    uint64_t errors;
+    uint64_t divergences;
+};
+
+struct _stress_thread {
+    int                  number;
+    struct _stress_device* pDev;
+    const struct _caller_options* pParam;
+    uint32_t             rnd;
+    volatile bool*       pStop;
+    struct _stress_counters* pCounters;
+    std::vector<uint8_t> buffer;
+    pthread_t            thread;
+};
+
+static const char* opNames[STRESS_OPS] = {
+    "eeRead", "eeReadByte", "eeReadWord", "eeReadV",
+    "eeWrite", "eeWriteByte", "eeWriteWord", "eeWriteV", "eeFlush"
+};
+
+static pthread_mutex_t reportLock = PTHREAD_MUTEX_INITIALIZER;
+
+/* -------------------------------------------------------------------------
+ | void help( void )
+ |
+ | print help screen and exit
+ ---------------------------------------------------------------------------
+*/
+void help( void )
+{
+    fprintf(stderr, "usage: eeStress [--sim] [--bus <bus #>] "
+            "[--address <addr>[,<addr>...]]\n"
+            "                [--devices <n>] [--type <type>] "
+            "[--khz <clock>] [--write]\n"
+            "                [--threads <n>] [--duration <s>] "
+            "[--interval <s>]\n"
+            "                [--reads <percent>] [--cache] [--seed <n>] "
+            "[--verbose]\n");
+    exit(0);
+}
+
+/* -------------------------------------------------------------------------
+ | void resetArgs( struct _caller_options *pParam )
+ |
+ | reset options to defaults
+ ---------------------------------------------------------------------------
+*/
+void resetArgs( struct _caller_options *pParam )
+{
+    if( pParam != NULL )
+    {
+        pParam->simOpt      = false;
+        pParam->busOpt      = -1;
+        pParam->addrOpt[0]  = STRESS_FIRST_ADDR;
+        pParam->addrCount   = 0;
+        pParam->devicesOpt  = 2;
+        pParam->typeOpt     = -1;
+        pParam->khzOpt      = -1;
+        pParam->writeOpt    = false;
+        pParam->threadsOpt  = 4;
+        pParam->durationOpt = 10;
+        pParam->intervalOpt = 1;
+        pParam->readsOpt    = 60;
+        pParam->cacheOpt    = false;
+        pParam->seedOpt     = (uint32_t) time( NULL );
+        pParam->verboseOpt  = false;
+    }
+}
+
+/* -------------------------------------------------------------------------
+ | int parseAddresses( const char *pList, struct _caller_options *pParam )
+ |
+ | comma separated slave addresses in hex
+ ---------------------------------------------------------------------------
+*/
+int parseAddresses( const char *pList, struct _caller_options *pParam )
+{
+    int retVal = 0;
+    unsigned int addr;
+    int used;
+
+    pParam->addrCount = 0;
+
+    while( *pList != '\0' && retVal == 0 )
+    {
+        if( pParam->addrCount >= STRESS_MAX_DEVICES ||
+            sscanf( pList, "%x%n", &addr, &used ) != 1 || addr > 0x7f )
+        {
+            retVal = ERROR_PARAM;
+        }
+        else
+        {
+            pParam->addrOpt[pParam->addrCount++] = (int) addr;
+            pList += used;
+
+            if( *pList == ',' )
+            {
+                pList++;
+            }
+        }
+    }
+
+    return( retVal );
+}
+
+/* -------------------------------------------------------------------------
+ | int get_arguments(int argc, char **argv, struct _caller_options *pParam)
+ |
+ | scan commandline for arguments an set the corresponding value
+ ---------------------------------------------------------------------------
+*/
+int get_arguments ( int argc, char **argv, struct _caller_options *pParam )
+{
+    int retVal = 0;
+    int next_option;
+    /* valid short options letters */
+    const char* const short_options = "sb:a:d:t:k:wn:D:i:R:cr:vh?";
+
+    /* valid long options */
+    const struct option long_options[] = {
+         { "sim",      0, NULL, 's' },
+         { "bus",      1, NULL, 'b' },
+         { "address",  1, NULL, 'a' },
+         { "devices",  1, NULL, 'd' },
+         { "type",     1, NULL, 't' },
+         { "khz",      1, NULL, 'k' },
+         { "write",    0, NULL, 'w' },
+         { "threads",  1, NULL, 'n' },
+         { "duration", 1, NULL, 'D' },
+         { "interval", 1, NULL, 'i' },
+         { "reads",    1, NULL, 'R' },
+         { "cache",    0, NULL, 'c' },
+         { "seed",     1, NULL, 'r' },
+         { "verbose",  0, NULL, 'v' },
+         { "help",     0, NULL, 'h' },
+        { NULL,        0, NULL,  0  }
+    };
+
+    resetArgs( pParam );
+
+    do
+    {
+        next_option = getopt_long (argc, argv, short_options,
+            long_options, NULL);
+
+        switch (next_option) {
+            case 's':
+                pParam->simOpt = true;
+                break;
+            case 'b':
+                pParam->busOpt = atoi(optarg);
+                break;
+            case 'a':
+                if( parseAddresses( optarg, pParam ) != 0 )
+                {
+                    fprintf(stderr, "invalid address list %s\n", optarg);
+                    retVal = ERROR_PARAM;
+                }
+                break;
+            case 'd':
+                pParam->devicesOpt = atoi(optarg);
+                break;
+            case 't':
+                pParam->typeOpt = atoi(optarg);
+                break;
+            case 'k':
+                pParam->khzOpt = atoi(optarg);
+                break;
+            case 'w':
+                pParam->writeOpt = true;
+                break;
+            case 'n':
+                pParam->threadsOpt = atoi(optarg);
+                break;
+            case 'D':
+                pParam->durationOpt = atoi(optarg);
+                break;
+            case 'i':
+                pParam->intervalOpt = atoi(optarg);
+                break;
+            case 'R':
+                pParam->readsOpt = atoi(optarg);
+                break;
+            case 'c':
+                pParam->cacheOpt = true;
+                break;
+            case 'r':
+                pParam->seedOpt = (uint32_t) strtoul(optarg, NULL, 0);
+                break;
+            case 'v':
+                pParam->verboseOpt = true;
+                break;
+            case 'h':
+            case '?':
+                help();
+                break;
+            default:
+                break;
+        }
+    } while (next_option != -1);
+
+    if( pParam->busOpt < 0 )
+    {
+        pParam->simOpt = true;
+    }
+
+    if( pParam->simOpt )
+    {
+        if( pParam->busOpt < 0 )
+        {
+            pParam->busOpt = STRESS_SIM_BUS;
+        }
+
+        if( pParam->addrCount == 0 )
+        {
+            if( pParam->devicesOpt < 1 ||
+                pParam->devicesOpt > STRESS_MAX_DEVICES )
+            {
+                fprintf(stderr, "--devices must be 1..%d\n",
+                        STRESS_MAX_DEVICES);
+                retVal = ERROR_PARAM;
+            }
+            else
+            {
+                for( ; pParam->addrCount < pParam->devicesOpt;
+                     pParam->addrCount++ )
+                {
+                    pParam->addrOpt[pParam->addrCount] =
+                        STRESS_FIRST_ADDR + pParam->addrCount;
+                }
+            }
+        }
+
+        if( pParam->typeOpt < 0 )
+        {
+            pParam->typeOpt = STRESS_DEFAULT_TYPE;
+        }
+    }
+    else
+    {
+        if( pParam->addrCount == 0 )
+        {
+            pParam->addrCount = 1;
+        }
+
+        if( !pParam->writeOpt )
+        {
+            fprintf(stderr, "the contents of the device are destroyed, "
+                    "use --write to do so\n");
+            retVal = ERROR_PARAM;
+        }
+    }
+
+    if( pParam->threadsOpt < 1 || pParam->threadsOpt > STRESS_MAX_THREADS )
+    {
+        fprintf(stderr, "--threads must be 1..%d\n", STRESS_MAX_THREADS);
+        retVal = ERROR_PARAM;
+    }
+
+    if( pParam->durationOpt < 1 || pParam->intervalOpt < 1 ||
+        pParam->readsOpt < 0 || pParam->readsOpt > 100 )
+    {
+        fprintf(stderr, "--duration and --interval must be positive, "
+                "--reads 0..100\n");
+        retVal = ERROR_PARAM;
+    }
+
+    return( retVal );
+}
+
+/* -------------------------------------------------------------------------
+ | uint32_t nextRandom( uint32_t *pState )
+ |
+ | xorshift, the same sequence for the same --seed
+ ---------------------------------------------------------------------------
+*/
+uint32_t nextRandom( uint32_t *pState )
+{
+    uint32_t x = *pState;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+
+    return( *pState = x );
+}
+
+/* -------------------------------------------------------------------------
+ | int attachSimulation( struct _caller_options *pParam,
+ |                       const struct _ee_type_info *pInfo )
+ |
+ | create the simulated devices, with a header so the type is
+ | detected like on a real chip, and random contents
+ ---------------------------------------------------------------------------
+*/
+int attachSimulation( struct _caller_options *pParam,
+                      const struct _ee_type_info *pInfo )
+{
+    int retVal = 0;
+    struct _i2c_sim_config config;
+    std::vector<uint8_t> image;
+    uint32_t rnd;
+    size_t n;
+    int i;
+
+    config.size           = pInfo->page_size * pInfo->total_pages;
+    config.page_size      = pInfo->page_size;
+    config.addr16         = pInfo->addressing_16_bit;
+    config.write_cycle_us = pInfo->write_cycle_time * 1000;
+    config.bus_khz        = pParam->khzOpt >= 0 ? pParam->khzOpt :
+                            pInfo->bus_frequency_4V5;
+
+    image.resize( config.size );
+
+    for( i = 0; i < pParam->addrCount && retVal == 0; i++ )
+    {
+        rnd = pParam->seedOpt * 2654435761u + 0x5eed + i;
+
+        for( n = 0; n < image.size(); n++ )
+        {
+            image[n] = (uint8_t) nextRandom( &rnd );
+        }
+
+        // magic and type MSB first, see i2cEEPROM::eeInit()
+        image[0] = (makeMagic() >> 8) & 0x00ff;
+        image[1] = makeMagic() & 0x00ff;
+        image[2] = (pInfo->type >> 8) & 0x00ff;
+        image[3] = pInfo->type & 0x00ff;
+
+        if( i2cSimAttach( pParam->busOpt, pParam->addrOpt[i],
+                          &config ) != E_SIM_SUCCESS ||
+            i2cSimLoad( pParam->busOpt, pParam->addrOpt[i], 0, image.data(),
+                        image.size() ) != E_SIM_SUCCESS )
+        {
+            fprintf(stderr, "can not simulate a %s at %d-%02x\n",
+                    pInfo->name, pParam->busOpt, pParam->addrOpt[i]);
+            retVal = ERROR_SIM;
+        }
+    }
+
+    return( retVal );
+}
+
+/* -------------------------------------------------------------------------
+ | int openDevice( struct _stress_device *pDev, int bus, int *pType,
+ |                 bool cache )
+ |
+ | connect directly, set the type *pType or, if that is < 0, the
+ | detected one and return it in *pType. The reference image is
+ | the contents read at start
+ ---------------------------------------------------------------------------
+*/
+int openDevice( struct _stress_device *pDev, int bus, int *pType,
+                bool cache )
+{
+    int retVal;
+    uint16_t magic;
+    uint16_t found;
+    int i;
+
+    pDev->pDevice = new i2cEEPROM();
+    pDev->pDevice->eeSetDaemonUse( false );
+    pDev->pDevice->eeSetThreadSafe( true );
+
+    if( (retVal = pDev->pDevice->eeOpen( bus, pDev->addr )) != E_EE_SUCCESS )
+    {
+        fprintf(stderr, "can not open %d-%02x: %d\n", bus, pDev->addr,
+                retVal);
+        return( ERROR_OPEN );
+    }
+
+    if( *pType < 0 )
+    {
+        if( pDev->pDevice->eeTypeDetect( &magic, &found ) != E_EE_SUCCESS )
+        {
+            fprintf(stderr, "no type found on %d-%02x, use --type\n",
+                    bus, pDev->addr);
+            return( ERROR_TYPE );
+        }
+
+        *pType = found;
+    }
+
+    if( pDev->pDevice->eeTypeSet( (uint16_t) *pType ) != E_EE_SUCCESS )
+    {
+        fprintf(stderr, "invalid type %d for %d-%02x\n", *pType, bus,
+                pDev->addr);
+        return( ERROR_TYPE );
+    }
+
+    if( cache )
+    {
+        pDev->pDevice->eeCacheEnable( true );
+    }
+
+    pDev->capacity = pDev->pDevice->eeCapacity();
+    pDev->pageSize = pDev->pDevice->ee_page_size;
+    pDev->reference.resize( pDev->capacity );
+    pDev->pageLocks.resize( pDev->capacity / pDev->pageSize );
+
+    for( i = 0; i < (int) pDev->pageLocks.size(); i++ )
+    {
+        pthread_mutex_init( &pDev->pageLocks[i], NULL );
+    }
+
+    if( pDev->pDevice->eeRead( 0, pDev->reference.data(),
+                               pDev->capacity ) != E_EE_SUCCESS )
+    {
+        fprintf(stderr, "can not read %d-%02x\n", bus, pDev->addr);
+        retVal = ERROR_OPEN;
+    }
+
+    return( retVal );
+}
+
+/* -------------------------------------------------------------------------
+ | void lockPages( struct _stress_device *pDev, std::vector<int>& pages,
+ |                 bool lock )
+ |
+ | lock resp. unlock the pages of a call, in ascending order so two
+ | threads never wait for each other
+ ---------------------------------------------------------------------------
+*/
+void lockPages( struct _stress_device *pDev, std::vector<int>& pages,
+                bool lock )
+{
+    size_t i;
+
+    for( i = 0; i < pages.size(); i++ )
+    {
+        if( lock )
+        {
+            pthread_mutex_lock( &pDev->pageLocks[pages[i]] );
+        }
+        else
+        {
+            pthread_mutex_unlock( &pDev->pageLocks[pages[i]] );
+        }
+    }
+}
+
+/* -------------------------------------------------------------------------
+ | void addPages( struct _stress_device *pDev, int addr, int amount,
+ |                std::vector<int>& pages )
+ |
+ | add the pages of a range to the pages of a call
+ ---------------------------------------------------------------------------
+*/
+void addPages( struct _stress_device *pDev, int addr, int amount,
+               std::vector<int>& pages )
+{
+    int page;
+
+    for( page = addr / pDev->pageSize;
+         page <= (addr + amount - 1) / pDev->pageSize; page++ )
+    {
+        pages.push_back( page );
+    }
+}
+
+/* -------------------------------------------------------------------------
+ | void reportDivergence( struct _stress_thread *pThread, int op,
+ |                        int addr, int amount, int offset,
+ |                        uint8_t expected, uint8_t found )
+ |
+ | print a read that does not match the reference
+ ---------------------------------------------------------------------------
+*/
+void reportDivergence( struct _stress_thread *pThread, int op, int addr,
+                       int amount, int offset, uint8_t expected,
+                       uint8_t found )
+{
+    uint64_t count;
+
+    count = __atomic_add_fetch( &pThread->pCounters->divergences, 1,
+                                __ATOMIC_RELAXED );
+
+    if( count <= STRESS_MAX_REPORTS || pThread->pParam->verboseOpt )
+    {
+        pthread_mutex_lock( &reportLock );
+        fprintf(stderr, "DIVERGENCE: thread %d, device %d-%02x, %s( 0x%04x, "
+                "%d ): byte 0x%04x is 0x%02x, expected 0x%02x (seed %u)\n",
+                pThread->number, pThread->pParam->busOpt, pThread->pDev->addr,
+                opNames[op], addr, amount, addr + offset, found, expected,
+                pThread->pParam->seedOpt);
+        pthread_mutex_unlock( &reportLock );
+    }
+}
+
+/* -------------------------------------------------------------------------
+ | void checkRead( struct _stress_thread *pThread, int op, int addr,
+ |                 const uint8_t *pData, int amount )
+ |
+ | compare what was read with the reference
+ ---------------------------------------------------------------------------
+*/
+void checkRead( struct _stress_thread *pThread, int op, int addr,
+                const uint8_t *pData, int amount )
+{
+    const uint8_t *pRef = &pThread->pDev->reference[addr];
+    int i;
+
+    if( memcmp( pData, pRef, amount ) != 0 )
+    {
+        for( i = 0; pData[i] == pRef[i]; i++ )
+            ;
+
+        reportDivergence( pThread, op, addr, amount, i, pRef[i], pData[i] );
+    }
+}
+
+/* -------------------------------------------------------------------------
+ | void resync( struct _stress_device *pDev, int addr, int amount )
+ |
+ | after a failed write the device may hold old or new data, read
+ | back what it holds
+ ---------------------------------------------------------------------------
+*/
+void resync( struct _stress_device *pDev, int addr, int amount )
+{
+    pDev->pDevice->eeRead( addr, &pDev->reference[addr], amount );
+}
+
+/* -------------------------------------------------------------------------
+ | int randomLength( struct _stress_thread *pThread, int addr )
+ |
+ | mostly up to a page, sometimes up to four pages, so page
+ | boundaries are crossed often
+ ---------------------------------------------------------------------------
+*/
+int randomLength( struct _stress_thread *pThread, int addr )
+{
+    int maxLen;
+    int len;
+
+    maxLen = pThread->pDev->pageSize;
+
+    if( nextRandom( &pThread->rnd ) % 4 == 0 )
+    {
+        maxLen *= 4;
+    }
+
+    len = 1 + nextRandom( &pThread->rnd ) % maxLen;
+
+    if( addr + len > pThread->pDev->capacity )
+    {
+        len = pThread->pDev->capacity - addr;
+    }
+
+    return( len );
+}
+
+/* -------------------------------------------------------------------------
+ | int randomOp( struct _stress_thread *pThread )
+ |
+ | --reads percent of the calls read, flushes are rare
+ ---------------------------------------------------------------------------
+*/
+int randomOp( struct _stress_thread *pThread )
+{
+    uint32_t r = nextRandom( &pThread->rnd );
+    int retVal;
+
+    if( r % 100 == 0 )
+    {
+        retVal = STRESS_FLUSH;
+    }
+    else
+    {
+        // byte, word, buffer and vector calls alike
+        retVal = (r >> 8) % 4;
+
+        if( (int) ((r >> 16) % 100) >= pThread->pParam->readsOpt )
+        {
+            retVal += STRESS_WRITE;
+        }
+    }
+
+    return( retVal );
+}
+
+/* -------------------------------------------------------------------------
+ | void *stressThread( void *pArg )
+ |
+ | random calls on one device until stopped
+ ---------------------------------------------------------------------------
+*/
+void *stressThread( void *pArg )
+{
+    struct _stress_thread *pThread = (struct _stress_thread*) pArg;
+    struct _stress_device *pDev = pThread->pDev;
+    struct _stress_counters *pCnt = pThread->pCounters;
+    struct eeIoVec vec[STRESS_MAX_VEC];
+    std::vector<int> pages;
+    uint8_t *pData = pThread->buffer.data();
+    uint16_t wordValue;
+    int first = EE_PRIVATE_HDR_LEN;
+    int op;
+    int addr;
+    int amount;
+    int count;
+    int used;
+    int res;
+    int i;
+
+    while( !*pThread->pStop )
+    {
+        op     = randomOp( pThread );
+        addr   = first + nextRandom( &pThread->rnd ) %
+                 (pDev->capacity - first);
+        amount = op == STRESS_READ_BYTE || op == STRESS_WRITE_BYTE ? 1 :
+                 op == STRESS_READ_WORD || op == STRESS_WRITE_WORD ? 2 :
+                 randomLength( pThread, addr );
+        count  = 1;
+
+        if( addr + amount > pDev->capacity )
+        {
+            addr = pDev->capacity - amount;
+        }
+
+        pages.clear();
+
+        if( op == STRESS_READV || op == STRESS_WRITEV )
+        {
+            // elements may overlap, the later one wins, data of all
+            // elements comes from pThread->buffer one after another
+            count = 1 + nextRandom( &pThread->rnd ) % STRESS_MAX_VEC;
+            used = 0;
+
+            for( i = 0; i < count; i++ )
+            {
+                vec[i].addr    = first + nextRandom( &pThread->rnd ) %
+                                 (pDev->capacity - first);
+                vec[i].amount  = randomLength( pThread, vec[i].addr );
+                vec[i].pBuffer = pData + used;
+                used += vec[i].amount;
+                addPages( pDev, vec[i].addr, vec[i].amount, pages );
+            }
+
+            amount = used;
+        }
+        else
+        {
+            if( op != STRESS_FLUSH )
+            {
+                addPages( pDev, addr, amount, pages );
+            }
+        }
+
+        std::sort( pages.begin(), pages.end() );
+        pages.erase( std::unique( pages.begin(), pages.end() ), pages.end() );
+
+        lockPages( pDev, pages, true );
+
+        if( op >= STRESS_WRITE && op != STRESS_FLUSH )
+        {
+            for( i = 0; i < amount; i++ )
+            {
+                pData[i] = (uint8_t) nextRandom( &pThread->rnd );
+            }
+        }
+
+        switch( op )
+        {
+            case STRESS_READ:
+                res = pDev->pDevice->eeRead( addr, pData, amount );
+                break;
+            case STRESS_READ_BYTE:
+                res = pDev->pDevice->eeReadByte( addr, pData );
+                break;
+            case STRESS_READ_WORD:
+                res = pDev->pDevice->eeReadWord( addr, &wordValue );
+                pData[0] = wordValue >> 8;
+                pData[1] = wordValue & 0x00ff;
+                break;
+            case STRESS_READV:
+                res = pDev->pDevice->eeReadV( vec, count );
+                break;
+            case STRESS_WRITE:
+                res = pDev->pDevice->eeWrite( addr, pData, amount );
+                break;
+            case STRESS_WRITE_BYTE:
+                res = pDev->pDevice->eeWriteByte( addr, pData[0] );
+                break;
+            case STRESS_WRITE_WORD:
+                res = pDev->pDevice->eeWriteWord( addr, (pData[0] << 8) |
+                                                  pData[1] );
+                break;
+            case STRESS_WRITEV:
+                res = pDev->pDevice->eeWriteV( vec, count );
+                break;
+            default:
+                res = pDev->pDevice->eeFlush();
+                break;
+        }
+
+        if( op != STRESS_FLUSH )
+        {
+            if( op >= STRESS_WRITE )
+            {
+                __atomic_fetch_add( &pCnt->writes, 1, __ATOMIC_RELAXED );
+
+                for( i = 0; i < count; i++ )
+                {
+                    if( op == STRESS_WRITEV )
+                    {
+                        addr   = vec[i].addr;
+                        amount = vec[i].amount;
+                        memcpy( &pDev->reference[addr], vec[i].pBuffer,
+                                amount );
+                    }
+                    else
+                    {
+                        memcpy( &pDev->reference[addr], pData, amount );
+                    }
+
+                    if( res != E_EE_SUCCESS )
+                    {
+                        resync( pDev, addr, amount );
+                    }
+                }
+            }
+            else
+            {
+                __atomic_fetch_add( &pCnt->reads, 1, __ATOMIC_RELAXED );
+
+                if( res == E_EE_SUCCESS )
+                {
+                    if( op == STRESS_READV )
+                    {
+                        for( i = 0; i < count; i++ )
+                        {
+                            checkRead( pThread, op, vec[i].addr,
+                                       vec[i].pBuffer, vec[i].amount );
+                        }
+                    }
+                    else
+                    {
+                        checkRead( pThread, op, addr, pData, amount );
+                    }
+                }
+            }
+        }
+
+        lockPages( pDev, pages, false );
+
+        __atomic_fetch_add( &pCnt->ops, 1, __ATOMIC_RELAXED );
+
+        if( res == E_EE_SUCCESS )
+        {
+            __atomic_fetch_add( &pCnt->bytes, op == STRESS_FLUSH ? 0 : amount,
+                                __ATOMIC_RELAXED );
+        }
+        else
+        {
+            __atomic_fetch_add( &pCnt->errors, 1, __ATOMIC_RELAXED );
+        }
+    }
+
+    return( NULL );
+}
+
+/* -------------------------------------------------------------------------
+ | int verifyDevice( struct _stress_device *pDev, int bus )
+ |
+ | compare the whole chip with the reference after the run
+ ---------------------------------------------------------------------------
+*/
+int verifyDevice( struct _stress_device *pDev, int bus )
+{
+    std::vector<uint8_t> image( pDev->capacity );
+    int retVal = 0;
+    int i;
+
+    pDev->pDevice->eeFlush();
+
+    if( pDev->pDevice->eeRead( 0, image.data(), pDev->capacity ) !=
+        E_EE_SUCCESS )
+    {
+        fprintf(stderr, "can not read %d-%02x for the final check\n",
+                bus, pDev->addr);
+        retVal = ERROR_OPEN;
+    }
+    else
+    {
+        for( i = 0; i < pDev->capacity; i++ )
+        {
+            if( image[i] != pDev->reference[i] )
+            {
+                if( retVal == 0 )
+                {
+                    fprintf(stderr, "DIVERGENCE: device %d-%02x differs at "
+                            "the end, first at 0x%04x: 0x%02x, expected "
+                            "0x%02x\n", bus, pDev->addr, i, image[i],
+                            pDev->reference[i]);
+                }
+                retVal++;
+            }
+        }
+    }
+
+    return( retVal );
+}
+
+/* -------------------------------------------------------------------------
+ | int main( int argc, char *argv[] )
+ ---------------------------------------------------------------------------
+*/
+int main( int argc, char *argv[] )
+{
+    int retVal;
+    struct _caller_options callerOptions;
+    const struct _ee_type_info *pInfo = NULL;
+    std::vector<struct _stress_device> devices;
+    std::vector<struct _stress_thread> threads;
+    struct _stress_counters counters;
+    struct _stress_counters last;
+    volatile bool stop = false;
+    uint64_t started;
+    uint64_t now;
+    uint64_t lastReport;
+    uint64_t ops;
+    double seconds;
+    int finalDiffs = 0;
+    int diffs;
+    int i;
+
+    if( (retVal = get_arguments( argc, argv, &callerOptions )) != 0 )
+    {
+        return( retVal );
+    }
+
+    if( callerOptions.simOpt )
+    {
+        if( (pInfo = eeTypeInfo( callerOptions.typeOpt )) == NULL )
+        {
+            fprintf(stderr, "unknown type %d\n", callerOptions.typeOpt);
+            return( ERROR_TYPE );
+        }
+
+        if( (retVal = attachSimulation( &callerOptions, pInfo )) != 0 )
+        {
+            return( retVal );
+        }
+    }
+
+    devices.resize( callerOptions.addrCount );
+
+    for( i = 0; i < callerOptions.addrCount && retVal == 0; i++ )
+    {
+        devices[i].addr = callerOptions.addrOpt[i];
+        // all devices get the type given or found on the first
+        retVal = openDevice( &devices[i], callerOptions.busOpt,
+                             &callerOptions.typeOpt, callerOptions.cacheOpt );
+    }
+
+    if( retVal == 0 && pInfo == NULL )
+    {
+        pInfo = eeTypeInfo( callerOptions.typeOpt );
+    }
+
+    if( retVal == 0 )
+    {
+        printf("eeStress: %d thread(s) on %d %s device(s), %d s, "
+               "%d%% reads%s\n"
+               "reproduce with: %s --seed %u --threads %d --devices %d "
+               "--type %d --reads %d --khz %d%s%s\n",
+               callerOptions.threadsOpt, callerOptions.addrCount,
+               callerOptions.simOpt ? "simulated" : "hardware",
+               callerOptions.durationOpt, callerOptions.readsOpt,
+               callerOptions.cacheOpt ? ", cached" : "",
+               argv[0], callerOptions.seedOpt, callerOptions.threadsOpt,
+               callerOptions.addrCount, callerOptions.typeOpt,
+               callerOptions.readsOpt, callerOptions.khzOpt >= 0 ?
+               callerOptions.khzOpt : pInfo->bus_frequency_4V5,
+               callerOptions.cacheOpt ? " --cache" : "",
+               callerOptions.simOpt ? "" : " --write --bus <bus #>");
+        printf("%8s %10s %10s %10s %12s %8s %8s\n", "time s", "ops/s",
+               "reads/s", "writes/s", "bytes/s", "errors", "diverged");
+        fflush( stdout );
+
+        memset( &counters, 0, sizeof(counters) );
+        memset( &last, 0, sizeof(last) );
+        threads.resize( callerOptions.threadsOpt );
+
+        for( i = 0; i < callerOptions.threadsOpt; i++ )
+        {
+            threads[i].number    = i;
+            threads[i].pDev      = &devices[i % devices.size()];
+            threads[i].pParam    = &callerOptions;
+            threads[i].rnd       = callerOptions.seedOpt * 2654435761u + i + 1;
+            threads[i].pStop     = &stop;
+            threads[i].pCounters = &counters;
+            threads[i].buffer.resize( STRESS_MAX_VEC * 4 *
+                                      threads[i].pDev->pageSize );
+        }
+
+        started = lastReport = i2cMonotonicUs();
+
+        for( i = 0; i < callerOptions.threadsOpt; i++ )
+        {
+            pthread_create( &threads[i].thread, NULL, stressThread,
+                            &threads[i] );
+        }
+
+        do
+        {
+            i2cSleepUntil( lastReport + callerOptions.intervalOpt * 1000000ULL );
+            now = i2cMonotonicUs();
+            seconds = (now - lastReport) / 1000000.0;
+
+            ops = __atomic_load_n( &counters.ops, __ATOMIC_RELAXED );
+            printf("%8.1f %10.1f %10.1f %10.1f %12.1f %8llu %8llu\n",
+                   (now - started) / 1000000.0,
+                   (ops - last.ops) / seconds,
+                   (counters.reads - last.reads) / seconds,
+                   (counters.writes - last.writes) / seconds,
+                   (counters.bytes - last.bytes) / seconds,
+                   (unsigned long long) counters.errors,
+                   (unsigned long long) counters.divergences);
+            fflush( stdout );
+
+            last = counters;
+            last.ops = ops;
+            lastReport = now;
+        } while( now - started < callerOptions.durationOpt * 1000000ULL );
+
+        stop = true;
+
+        for( i = 0; i < callerOptions.threadsOpt; i++ )
+        {
+            pthread_join( threads[i].thread, NULL );
+        }
+
+        for( i = 0; i < (int) devices.size(); i++ )
+        {
+            if( (diffs = verifyDevice( &devices[i],
+                                       callerOptions.busOpt )) != 0 )
+            {
+                finalDiffs += diffs < 0 ? 1 : diffs;
+            }
+        }
+
+        seconds = (i2cMonotonicUs() - started) / 1000000.0;
+
+        printf("total: %llu ops (%llu reads, %llu writes), %llu bytes, "
+               "%.1f ops/s, %llu errors, %llu diverged reads, %d bytes "
+               "differ at the end\n",
+               (unsigned long long) counters.ops,
+               (unsigned long long) counters.reads,
+               (unsigned long long) counters.writes,
+               (unsigned long long) counters.bytes, counters.ops / seconds,
+               (unsigned long long) counters.errors,
+               (unsigned long long) counters.divergences, finalDiffs);
+
+        if( counters.divergences != 0 || finalDiffs != 0 )
+        {
+            printf("FAILED, seed %u\n", callerOptions.seedOpt);
+            retVal = ERROR_DIVERGED;
+        }
+        else
+        {
+            printf("PASSED\n");
+        }
+    }
+
+    for( i = 0; i < (int) devices.size(); i++ )
+    {
+        if( devices[i].pDevice != NULL )
+        {
+            devices[i].pDevice->eeClose();
+            delete devices[i].pDevice;
+        }
+    }
+
+    return( retVal );
+}
+
@@ -0,0 +1,230 @@
+/*
+ ***********************************************************************
+ *
+ *  eeTrace.cpp - part of eeprom access project
+ *
+ *  Copyright (C) 2013-2019 Dreamshader (Dirk Schanz)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ *
+ ***********************************************************************
+ *
+ * Decoder for trace dumps, see i2cTrace.h
+ *
+ *   eeTrace <file>
+ *
+ * prints the events of all threads merged by time, one per line:
+ * time since the first event in us, thread, device (bus-addr),
+ * event, its arguments, result and duration
+ *
+ ***********************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <vector>
+#include <algorithm>
+
+#include "i2cTrace.h"
+
+#define ERROR_USAGE         -1
+#define ERROR_FILE          -2
+#define ERROR_FORMAT        -3
+
+struct _decoded_event {
+    uint64_t tid;
+    struct _i2c_trace_event ev;
+};
+
+/* -------------------------------------------------------------------------
+ | bool byTime( const struct _decoded_event& a, 
+ |              const struct _decoded_event& b )
+ |
+ | order of the output
+ ---------------------------------------------------------------------------
+*/
+bool byTime( const struct _decoded_event& a, const struct _decoded_event& b )
+{
+    return( a.ev.ts_us < b.ev.ts_us );
+}
+
+/* -------------------------------------------------------------------------
+ | int readTrace( FILE *pIn, std::vector<struct _decoded_event>& events,
+ |                uint64_t *pDropped )
+ |
+ | read all rings of a dump
+ ---------------------------------------------------------------------------
+*/
+int readTrace( FILE *pIn, std::vector<struct _decoded_event>& events,
+               uint64_t *pDropped )
+{
+    int retVal = 0;
+    struct _i2c_trace_file_hdr fileHdr;
+    struct _i2c_trace_ring_hdr ringHdr;
+    struct _decoded_event decoded;
+    uint32_t ring;
+    uint32_t n;
+
+    if( fread( &fileHdr, sizeof(fileHdr), 1, pIn ) != 1 ||
+        memcmp( fileHdr.magic, I2C_TRACE_MAGIC, sizeof(fileHdr.magic) ) != 0 ||
+        fileHdr.version != I2C_TRACE_VERSION )
+    {
+        return( ERROR_FORMAT );
+    }
+
+    *pDropped = fileHdr.dropped;
+
+    for( ring = 0; ring < fileHdr.rings && retVal == 0; ring++ )
+    {
+        if( fread( &ringHdr, sizeof(ringHdr), 1, pIn ) != 1 )
+        {
+            retVal = ERROR_FORMAT;
+        }
+        else
+        {
+            if( ringHdr.written > ringHdr.count )
+            {
+                printf("# thread %llu: %llu older events overwritten\n",
+                       (unsigned long long) ringHdr.tid,
+                       (unsigned long long) (ringHdr.written - ringHdr.count));
+            }
+
+            for( n = 0; n < ringHdr.count && retVal == 0; n++ )
+            {
+                decoded.tid = ringHdr.tid;
+
+                if( fread( &decoded.ev, sizeof(decoded.ev), 1, pIn ) != 1 )
+                {
+                    retVal = ERROR_FORMAT;
+                }
+                else
+                {
+                    events.push_back( decoded );
+                }
+            }
+        }
+    }
+
+    return( retVal );
+}
+
+/* -------------------------------------------------------------------------
+ | void printEvent( struct _decoded_event *pEvent, uint64_t origin )
+ |
+ | one line per event
+ ---------------------------------------------------------------------------
+*/
+void printEvent( struct _decoded_event *pEvent, uint64_t origin )
+{
+    struct _i2c_trace_event *pEv = &pEvent->ev;
+
+    printf("%12llu %6llu %2d-%02x %-9s ", 
+           (unsigned long long) (pEv->ts_us - origin),
+           (unsigned long long) pEvent->tid, 
+           pEv->dev >> 8, pEv->dev & 0xff,
+           i2cTraceEventName( pEv->event ) );
+
+    switch( pEv->event )
+    {
+        case I2C_EV_OPEN:
+            printf("bus=%u addr=0x%02x", pEv->a, pEv->b);
+            break;
+        case I2C_EV_EE_READ:
+        case I2C_EV_EE_WRITE:
+            printf("addr=0x%04x len=%u", pEv->a, pEv->b);
+            break;
+        case I2C_EV_BUS_READ:
+        case I2C_EV_BUS_WRITE:
+            printf("len=%u", pEv->a);
+            break;
+        case I2C_EV_BUS_XFER:
+            printf("len=%u msgs=%u", pEv->a, pEv->b);
+            break;
+        case I2C_EV_RETRY:
+            printf("errno=%u attempt=%u", pEv->a, pEv->b);
+            break;
+        case I2C_EV_FAIL:
+            printf("errno=%u", pEv->a);
+            break;
+        case I2C_EV_DEADLINE:
+            printf("len=%u attempt=%u", pEv->a, pEv->b);
+            break;
+        default:
+            break;
+    }
+
+    printf(" -> %d", pEv->result);
+
+    if( pEv->dur_us > 0 )
+    {
+        printf(" (%u us)", pEv->dur_us);
+    }
+
+    printf("\n");
+}
+
+/* -------------------------------------------------------------------------
+ | int main( int argc, char *argv[] )
+ |
+ | decode the dump given as argument
+ ---------------------------------------------------------------------------
+*/
+int main( int argc, char *argv[] )
+{
+    int retVal;
+    FILE *pIn;
+    uint64_t dropped = 0;
+    size_t i;
+    std::vector<struct _decoded_event> events;
+
+    if( argc != 2 )
+    {
+        fprintf(stderr, "usage: %s <trace file>\n", argv[0]);
+        return( ERROR_USAGE );
+    }
+
+    if( (pIn = fopen( argv[1], "rb" )) == NULL )
+    {
+        perror( argv[1] );
+        return( ERROR_FILE );
+    }
+
+    if( (retVal = readTrace( pIn, events, &dropped )) != 0 )
+    {
+        fprintf(stderr, "%s: not a trace dump or truncated\n", argv[1]);
+    }
+
+    fclose( pIn );
+
+    std::stable_sort( events.begin(), events.end(), byTime );
+
+    if( dropped > 0 )
+    {
+        printf("# %llu events of threads without ring dropped\n",
+               (unsigned long long) dropped);
+    }
+
+    for( i = 0; i < events.size(); i++ )
+    {
+        printEvent( &events[i], events[0].ev.ts_us );
+    }
+
+    return( retVal );
+}
+
@@ -0,0 +1,848 @@
+/*
+ ***********************************************************************
+ *
+ *  eepromd.cpp - part of eeprom access project
+ *
+ *  Copyright (C) 2013-2019 Dreamshader (Dirk Schanz)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ *
+ ***********************************************************************
+ *
+ * eepromd - owns the i2c buses and serves i2cEEPROM clients
+ *
+ * Clients connect to a unix domain socket (see i2cRemote.h). The
+ * daemon keeps one image cache per device, serves reads from it
+ * and collects writes of all clients. Dirty pages are programmed
+ * when a client asks for a flush, when they are older than the
+ * flush delay, and on shutdown.
+ *
+ * Options:
+ *
+ * --socket <path> (same as -s <path>)
+ *
+ *   socket to listen on, default /run/eepromd.sock
+ *
+ * --delay <ms> (same as -d <ms>)
+ *
+ *   how long dirty pages may be collected, default 50 ms
+ *
+ * --verbose (same as -v)
+ *
+ * --help (same as -?)
+ *
+ ***********************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <signal.h>
+#include <poll.h>
+#include <time.h>
+#include <getopt.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+
+#include <vector>
+
+#include "i2cEEPROM.h"
+#include "i2cRemote.h"
+
+#define EEPROMD_DEFAULT_DELAY      50
+// a failed flush is put off by another 10 ms, doubled up to 5 s
+#define EEPROMD_RETRY_MIN          10
+#define EEPROMD_RETRY_MAX        5000
+#define EEPROMD_PAGE_VALID       0x01
+#define EEPROMD_PAGE_DIRTY       0x02
+
+struct _eepromd_device {
+    int                  bus;
+    int                  slave;
+    i2cEEPROM           *pDevice;
+    std::vector<uint8_t> image;
+    std::vector<uint8_t> pageState;
+    int                  pageSize;
+    bool                 dirty;
+    uint64_t             dirtySince;
+    int                  failures;
+};
+
+struct _eepromd_client {
+    int      fd;
+    uint8_t *pShm;
+    size_t   shmLen;
+};
+
+static const char* socketPath = EEPROMD_SOCKET_PATH;
+static int  flushDelay = EEPROMD_DEFAULT_DELAY;
+static bool verbose = false;
+static volatile sig_atomic_t running = 1;
+
+static std::vector<struct _eepromd_device*> devices;
+static std::vector<struct _eepromd_client> clients;
+
+/* -------------------------------------------------------------------------
+ | static uint64_t nowMs( void )
+ |
+ | monotonic time in milliseconds
+ ---------------------------------------------------------------------------
+*/
+static uint64_t nowMs( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return( (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000 );
+}
+
+/* -------------------------------------------------------------------------
+ | static void onSignal( int sig )
+ |
+ | stop the main loop, dirty pages are flushed before exit
+ ---------------------------------------------------------------------------
+*/
+static void onSignal( int sig )
+{
+    running = 0;
+}
+
+/* -------------------------------------------------------------------------
+ | void help( void )
+ |
+ | print help screen and exit
+ ---------------------------------------------------------------------------
+*/
+void help( void )
+{
+    fprintf(stderr, "usage: eepromd [-s socket] [-d delay ms] [-v]\n");
+    exit(0);
+}
+
+/* -------------------------------------------------------------------------
+ | static struct _eepromd_device* deviceFind( int bus, int slave )
+ |
+ | look up a device opened by any client
+ ---------------------------------------------------------------------------
+*/
+static struct _eepromd_device* deviceFind( int bus, int slave )
+{
+    size_t i;
+
+    for( i = 0; i < devices.size(); i++ )
+    {
+        if( devices[i]->bus == bus && devices[i]->slave == slave )
+        {
+            return( devices[i] );
+        }
+    }
+
+    return( NULL );
+}
+
+/* -------------------------------------------------------------------------
+ | static int deviceOpen( int bus, int slave )
+ |
+ | open the device directly, unless it is already open
+ ---------------------------------------------------------------------------
+*/
+static int deviceOpen( int bus, int slave )
+{
+    int retVal = E_EE_SUCCESS;
+    struct _eepromd_device* pDev;
+
+    if( deviceFind( bus, slave ) == NULL )
+    {
+        pDev = new struct _eepromd_device;
+        pDev->bus      = bus;
+        pDev->slave    = slave;
+        pDev->pageSize = 0;
+        pDev->dirty    = false;
+        pDev->failures = 0;
+        pDev->pDevice  = new i2cEEPROM();
+
+        // the daemon must not talk to itself
+        pDev->pDevice->eeSetDaemonUse( false );
+
+        if( (retVal = pDev->pDevice->eeOpen( bus, slave )) == E_EE_SUCCESS )
+        {
+            devices.push_back( pDev );
+            if( verbose )
+            {
+                fprintf(stderr, "eepromd: opened %d/%02x\n", bus, slave);
+            }
+        }
+        else
+        {
+            delete pDev->pDevice;
+            delete pDev;
+        }
+    }
+
+    return( retVal );
+}
+
+/* -------------------------------------------------------------------------
+ | static int deviceFill( struct _eepromd_device* pDev, int start, int end )
+ |
+ | load all pages of [start, end) that are not cached yet, adjacent
+ | missing pages are read in one transfer
+ ---------------------------------------------------------------------------
+*/
+static int deviceFill( struct _eepromd_device* pDev, int start, int end )
+{
+    int retVal = E_EE_SUCCESS;
+    int page;
+    int lastPage;
+    int runStart;
+
+    page     = start / pDev->pageSize;
+    lastPage = (end - 1) / pDev->pageSize;
+
+    while( page <= lastPage && retVal == E_EE_SUCCESS )
+    {
+        if( pDev->pageState[page] & EEPROMD_PAGE_VALID )
+        {
+            page++;
+            continue;
+        }
+
+        runStart = page;
+        while( page <= lastPage &&
+               !(pDev->pageState[page] & EEPROMD_PAGE_VALID) )
+        {
+            page++;
+        }
+
+        if( (retVal = pDev->pDevice->eeRead( runStart * pDev->pageSize,
+                                  &pDev->image[runStart * pDev->pageSize],
+                                  (page - runStart) * pDev->pageSize )) ==
+            E_EE_SUCCESS )
+        {
+            for( ; runStart < page; runStart++ )
+            {
+                pDev->pageState[runStart] |= EEPROMD_PAGE_VALID;
+            }
+        }
+    }
+
+    return( retVal );
+}
+
+/* -------------------------------------------------------------------------
+ | static int deviceFlush( struct _eepromd_device* pDev )
+ |
+ | program all dirty pages, adjacent dirty pages in one call.
+ | After a failure the next attempt is put off, longer with every
+ | failure in a row, so a chip that is gone does not keep the
+ | daemon busy
+ ---------------------------------------------------------------------------
+*/
+static int deviceFlush( struct _eepromd_device* pDev )
+{
+    int retVal = E_EE_SUCCESS;
+    int page = 0;
+    int pages;
+    int runStart;
+    int written = 0;
+    int retry;
+    int i;
+
+    if( !pDev->dirty )
+    {
+        return( E_EE_SUCCESS );
+    }
+
+    pages = pDev->pageState.size();
+
+    while( page < pages && retVal == E_EE_SUCCESS )
+    {
+        if( !(pDev->pageState[page] & EEPROMD_PAGE_DIRTY) )
+        {
+            page++;
+            continue;
+        }
+
+        runStart = page;
+        while( page < pages && (pDev->pageState[page] & EEPROMD_PAGE_DIRTY) )
+        {
+            page++;
+        }
+
+        if( (retVal = pDev->pDevice->eeWrite( runStart * pDev->pageSize,
+                                   &pDev->image[runStart * pDev->pageSize],
+                                   (page - runStart) * pDev->pageSize )) ==
+            E_EE_SUCCESS )
+        {
+            written += page - runStart;
+            for( ; runStart < page; runStart++ )
+            {
+                pDev->pageState[runStart] &= ~EEPROMD_PAGE_DIRTY;
+            }
+        }
+    }
+
+    if( retVal == E_EE_SUCCESS )
+    {
+        pDev->dirty    = false;
+        pDev->failures = 0;
+    }
+    else
+    {
+        retry = EEPROMD_RETRY_MIN;
+        for( i = 0; i < pDev->failures && retry < EEPROMD_RETRY_MAX; i++ )
+        {
+            retry *= 2;
+        }
+
+        if( retry > EEPROMD_RETRY_MAX )
+        {
+            retry = EEPROMD_RETRY_MAX;
+        }
+
+        // the pages count as written to now, plus the pause
+        pDev->failures++;
+        pDev->dirtySince = nowMs() + retry;
+
+        if( pDev->failures == 1 )
+        {
+            fprintf(stderr, "eepromd: %d/%02x flush failed, rc=%d\n",
+                    pDev->bus, pDev->slave, retVal);
+        }
+    }
+
+    if( verbose )
+    {
+        fprintf(stderr, "eepromd: %d/%02x flushed %d pages, rc=%d\n",
+                pDev->bus, pDev->slave, written, retVal);
+    }
+
+    return( retVal );
+}
+
+/* -------------------------------------------------------------------------
+ | static int deviceType( struct _eepromd_device* pDev, uint16_t type )
+ |
+ | set the EEPROM type and size the cache accordingly
+ ---------------------------------------------------------------------------
+*/
+static int deviceType( struct _eepromd_device* pDev, uint16_t type )
+{
+    int retVal;
+
+    if( pDev->pDevice->ee_type == type && pDev->pageSize > 0 )
+    {
+        return( E_EE_SUCCESS );
+    }
+
+    // whatever is cached was collected with the old geometry
+    deviceFlush( pDev );
+
+    if( (retVal = pDev->pDevice->eeTypeSet( type )) == E_EE_SUCCESS )
+    {
+        pDev->pageSize = pDev->pDevice->ee_page_size;
+        pDev->image.assign( pDev->pDevice->eeCapacity(), 0xff );
+        pDev->pageState.assign( pDev->pDevice->ee_total_pages, 0 );
+    }
+
+    return( retVal );
+}
+
+/* -------------------------------------------------------------------------
+ | static int deviceRead( ... )
+ |
+ | serve a read from the cache, loading missing pages
+ ---------------------------------------------------------------------------
+*/
+static int deviceRead( struct _eepromd_device* pDev, uint32_t addr,
+                       uint8_t* pBuffer, uint32_t amount )
+{
+    int retVal;
+
+    if( pDev->pageSize == 0 )
+    {
+        // type unknown, nothing can be cached
+        return( pDev->pDevice->eeRead( addr, pBuffer, amount ) );
+    }
+
+    if( amount == 0 || addr + amount > pDev->image.size() )
+    {
+        return( E_EE_INVAL_PARAM );
+    }
+
+    if( (retVal = deviceFill( pDev, addr, addr + amount )) == E_EE_SUCCESS )
+    {
+        memcpy( pBuffer, &pDev->image[addr], amount );
+    }
+
+    return( retVal );
+}
+
+/* -------------------------------------------------------------------------
+ | static int deviceWrite( ... )
+ |
+ | collect a write in the cache. Partially written pages are loaded
+ | first, the whole page is programmed on flush
+ ---------------------------------------------------------------------------
+*/
+static int deviceWrite( struct _eepromd_device* pDev, uint32_t addr,
+                        const uint8_t* pBuffer, uint32_t amount )
+{
+    int retVal = E_EE_SUCCESS;
+    uint32_t page;
+    uint32_t lastPage;
+
+    if( pDev->pageSize == 0 )
+    {
+        return( pDev->pDevice->eeWrite( addr, (uint8_t*) pBuffer, amount ) );
+    }
+
+    if( amount == 0 || addr + amount > pDev->image.size() )
+    {
+        return( E_EE_INVAL_PARAM );
+    }
+
+    page     = addr / pDev->pageSize;
+    lastPage = (addr + amount - 1) / pDev->pageSize;
+
+    if( addr % pDev->pageSize != 0 )
+    {
+        retVal = deviceFill( pDev, addr, addr + 1 );
+    }
+
+    if( retVal == E_EE_SUCCESS && (addr + amount) % pDev->pageSize != 0 )
+    {
+        retVal = deviceFill( pDev, addr + amount - 1, addr + amount );
+    }
+
+    if( retVal == E_EE_SUCCESS )
+    {
+        memcpy( &pDev->image[addr], pBuffer, amount );
+
+        for( ; page <= lastPage; page++ )
+        {
+            pDev->pageState[page] |= EEPROMD_PAGE_VALID | EEPROMD_PAGE_DIRTY;
+        }
+
+        if( !pDev->dirty )
+        {
+            pDev->dirty = true;
+            pDev->dirtySince = nowMs();
+        }
+    }
+
+    return( retVal );
+}
+
+/* -------------------------------------------------------------------------
+ | static void clientDrop( size_t idx )
+ |
+ | forget a client and unmap its payload buffer
+ ---------------------------------------------------------------------------
+*/
+static void clientDrop( size_t idx )
+{
+    if( clients[idx].pShm != NULL )
+    {
+        munmap( clients[idx].pShm, clients[idx].shmLen );
+    }
+    close( clients[idx].fd );
+    clients.erase( clients.begin() + idx );
+}
+
+/* -------------------------------------------------------------------------
+ | static int clientHello( struct _eepromd_client* pClient )
+ |
+ | receive the HELLO record together with the payload buffer
+ ---------------------------------------------------------------------------
+*/
+static int clientHello( struct _eepromd_client* pClient )
+{
+    struct _eepromd_request req;
+    struct _eepromd_reply reply;
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *pCmsg;
+    char ctrlBuf[CMSG_SPACE(sizeof(int))];
+    int shmFd = -1;
+    int seals;
+    struct stat shmStat;
+    void* pMap;
+
+    iov.iov_base = &req;
+    iov.iov_len  = sizeof(req);
+
+    memset( &msg, 0, sizeof(msg) );
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = ctrlBuf;
+    msg.msg_controllen = sizeof(ctrlBuf);
+
+    if( recvmsg( pClient->fd, &msg, MSG_CMSG_CLOEXEC ) != sizeof(req) )
+    {
+        return( E_REMOTE_IO );
+    }
+
+    if( (pCmsg = CMSG_FIRSTHDR( &msg )) != NULL &&
+        pCmsg->cmsg_level == SOL_SOCKET && pCmsg->cmsg_type == SCM_RIGHTS )
+    {
+        memcpy( &shmFd, CMSG_DATA(pCmsg), sizeof(int) );
+    }
+
+    memset( &reply, 0, sizeof(reply) );
+
+    if( req.op != EEPROMD_OP_HELLO || shmFd < 0 ||
+        req.type != EEPROMD_PROTOCOL_VERSION || req.amount == 0 )
+    {
+        reply.status = E_REMOTE_PROTOCOL;
+    }
+    else
+    {
+        // a buffer shorter than announced, or one the client could
+        // still shrink, would make the daemon die of SIGBUS
+        if( fstat( shmFd, &shmStat ) < 0 || 
+            shmStat.st_size < (off_t) req.amount ||
+            (seals = fcntl( shmFd, F_GET_SEALS )) < 0 ||
+            (seals & F_SEAL_SHRINK) == 0 )
+        {
+            reply.status = E_REMOTE_PROTOCOL;
+        }
+        else
+        {
+            if( (pMap = mmap( NULL, req.amount, PROT_READ | PROT_WRITE,
+                              MAP_SHARED, shmFd, 0 )) == MAP_FAILED )
+            {
+                reply.status = E_REMOTE_MEM;
+            }
+            else
+            {
+                pClient->pShm   = (uint8_t*) pMap;
+                pClient->shmLen = req.amount;
+                reply.status    = E_REMOTE_SUCCESS;
+            }
+        }
+    }
+
+    if( shmFd >= 0 )
+    {
+        close( shmFd );
+    }
+
+    send( pClient->fd, &reply, sizeof(reply), MSG_NOSIGNAL );
+
+    return( reply.status );
+}
+
+/* -------------------------------------------------------------------------
+ | static int clientRequest( struct _eepromd_client* pClient )
+ |
+ | handle one request of a client
+ ---------------------------------------------------------------------------
+*/
+static int clientRequest( struct _eepromd_client* pClient )
+{
+    struct _eepromd_request req;
+    struct _eepromd_reply reply;
+    struct _eepromd_device* pDev = NULL;
+    ssize_t len;
+
+    if( (len = recv( pClient->fd, &req, sizeof(req), 0 )) != sizeof(req) )
+    {
+        return( E_REMOTE_IO );
+    }
+
+    memset( &reply, 0, sizeof(reply) );
+
+    if( req.op != EEPROMD_OP_OPEN &&
+        (pDev = deviceFind( req.bus, req.slave )) == NULL )
+    {
+        reply.status = E_EE_NO_CONNECTION;
+    }
+    else
+    {
+        switch( req.op )
+        {
+            case EEPROMD_OP_OPEN:
+                reply.status = deviceOpen( req.bus, req.slave );
+                break;
+            case EEPROMD_OP_TYPE:
+                reply.status = deviceType( pDev, req.type );
+                break;
+            case EEPROMD_OP_DETECT:
+                // the header may be waiting in the cache
+                if( (reply.status = deviceFlush( pDev )) == E_EE_SUCCESS )
+                {
+                    reply.status = pDev->pDevice->eeTypeDetect( &reply.magic,
+                                                                &reply.type );
+                }
+                break;
+            case EEPROMD_OP_READ:
+                if( req.amount > pClient->shmLen )
+                {
+                    reply.status = E_EE_INVAL_PARAM;
+                }
+                else
+                {
+                    reply.status = deviceRead( pDev, req.addr, pClient->pShm,
+                                               req.amount );
+                    reply.amount = req.amount;
+                }
+                break;
+            case EEPROMD_OP_WRITE:
+                if( req.amount > pClient->shmLen )
+                {
+                    reply.status = E_EE_INVAL_PARAM;
+                }
+                else
+                {
+                    reply.status = deviceWrite( pDev, req.addr, pClient->pShm,
+                                                req.amount );
+                    reply.amount = req.amount;
+                }
+                break;
+            case EEPROMD_OP_FLUSH:
+                reply.status = deviceFlush( pDev );
+                break;
+            default:
+                reply.status = E_REMOTE_PROTOCOL;
+                break;
+        }
+    }
+
+    if( send( pClient->fd, &reply, sizeof(reply), MSG_NOSIGNAL ) !=
+        sizeof(reply) )
+    {
+        return( E_REMOTE_IO );
+    }
+
+    return( E_REMOTE_SUCCESS );
+}
+
+/* -------------------------------------------------------------------------
+ | static int nextFlushTimeout( void )
+ |
+ | milliseconds until the oldest dirty device must be flushed,
+ | -1 if nothing is dirty
+ ---------------------------------------------------------------------------
+*/
+static int nextFlushTimeout( void )
+{
+    int retVal = -1;
+    int64_t left;
+    uint64_t now = nowMs();
+    size_t i;
+
+    for( i = 0; i < devices.size(); i++ )
+    {
+        if( devices[i]->dirty )
+        {
+            left = (int64_t) (devices[i]->dirtySince + flushDelay) - now;
+            if( left < 0 )
+            {
+                left = 0;
+            }
+            if( retVal < 0 || left < retVal )
+            {
+                retVal = left;
+            }
+        }
+    }
+
+    return( retVal );
+}
+
+/* -------------------------------------------------------------------------
+ | void get_arguments(int argc, char **argv)
+ |
+ | scan commandline for arguments an set the corresponding value
+ ---------------------------------------------------------------------------
+*/
+void get_arguments( int argc, char **argv )
+{
+    int next_option;
+    const char* const short_options = "s:d:vh?";
+    const struct option long_options[] = {
+        { "socket",  1, NULL, 's' },
+        { "delay",   1, NULL, 'd' },
+        { "verbose", 0, NULL, 'v' },
+        { "help",    0, NULL, 'h' },
+        { NULL,      0, NULL,  0  }
+    };
+
+    if( getenv( EEPROMD_SOCKET_ENV ) != NULL )
+    {
+        socketPath = getenv( EEPROMD_SOCKET_ENV );
+    }
+
+    do
+    {
+        next_option = getopt_long( argc, argv, short_options,
+                                   long_options, NULL );
+
+        switch( next_option )
+        {
+            case 's':
+                socketPath = optarg;
+                break;
+            case 'd':
+                flushDelay = atoi(optarg);
+                break;
+            case 'v':
+                verbose = true;
+                break;
+            case 'h':
+            case '?':
+                help();
+                break;
+            default:
+                break;
+        }
+    } while( next_option != -1 );
+}
+
+/* -------------------------------------------------------------------------
+ | int main( int argc, char *argv[] )
+ |
+ | ...
+ ---------------------------------------------------------------------------
+*/
+int main( int argc, char *argv[] )
+{
+    int listenFd;
+    struct sockaddr_un sockAddr;
+    struct sigaction sa;
+    std::vector<struct pollfd> pollFds;
+    struct _eepromd_client client;
+    size_t i;
+    int timeout;
+
+    get_arguments( argc, argv );
+
+    memset( &sa, 0, sizeof(sa) );
+    sa.sa_handler = onSignal;
+    sigaction( SIGTERM, &sa, NULL );
+    sigaction( SIGINT, &sa, NULL );
+    signal( SIGPIPE, SIG_IGN );
+
+    if( (listenFd = socket( AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0 )) < 0 )
+    {
+        perror("eepromd socket");
+        return( E_EE_FAIL );
+    }
+
+    memset( &sockAddr, 0, sizeof(sockAddr) );
+    sockAddr.sun_family = AF_UNIX;
+    strncpy( sockAddr.sun_path, socketPath, sizeof(sockAddr.sun_path) - 1 );
+    unlink( socketPath );
+
+    if( bind( listenFd, (struct sockaddr*) &sockAddr, sizeof(sockAddr) ) < 0 ||
+        listen( listenFd, 16 ) < 0 )
+    {
+        perror("eepromd bind");
+        close( listenFd );
+        return( E_EE_FAIL );
+    }
+
+    if( verbose )
+    {
+        fprintf(stderr, "eepromd: listening on %s\n", socketPath);
+    }
+
+    while( running )
+    {
+        pollFds.resize( clients.size() + 1 );
+        pollFds[0].fd     = listenFd;
+        pollFds[0].events = POLLIN;
+        for( i = 0; i < clients.size(); i++ )
+        {
+            pollFds[i + 1].fd     = clients[i].fd;
+            pollFds[i + 1].events = POLLIN;
+        }
+
+        timeout = nextFlushTimeout();
+
+        if( poll( pollFds.data(), pollFds.size(), timeout ) < 0 )
+        {
+            if( errno != EINTR )
+            {
+                perror("eepromd poll");
+                break;
+            }
+            continue;
+        }
+
+        // clients first, new connections are appended behind them
+        for( i = clients.size(); i > 0; i-- )
+        {
+            if( pollFds[i].revents & (POLLIN | POLLHUP | POLLERR) )
+            {
+                if( ( clients[i - 1].pShm == NULL ?
+                      clientHello( &clients[i - 1] ) :
+                      clientRequest( &clients[i - 1] ) ) != E_REMOTE_SUCCESS )
+                {
+                    clientDrop( i - 1 );
+                }
+            }
+        }
+
+        if( pollFds[0].revents & POLLIN )
+        {
+            if( (client.fd = accept4( listenFd, NULL, NULL,
+                                      SOCK_CLOEXEC )) >= 0 )
+            {
+                client.pShm   = NULL;
+                client.shmLen = 0;
+                clients.push_back( client );
+            }
+        }
+
+        for( i = 0; i < devices.size(); i++ )
+        {
+            if( devices[i]->dirty &&
+                nowMs() >= devices[i]->dirtySince + flushDelay )
+            {
+                deviceFlush( devices[i] );
+            }
+        }
+    }
+
+    while( !clients.empty() )
+    {
+        clientDrop( clients.size() - 1 );
+    }
+
+    for( i = 0; i < devices.size(); i++ )
+    {
+        deviceFlush( devices[i] );
+        devices[i]->pDevice->eeClose();
+        delete devices[i]->pDevice;
+        delete devices[i];
+    }
+
+    close( listenFd );
+    unlink( socketPath );
+
+    return( 0 );
+}
+
@@ -0,0 +1,563 @@
+/*
+ ***********************************************************************
+ *
+ *  i2cArbiter.cpp - part of eeprom access project
+ *
+ *  Copyright (C) 2013-2019 Dreamshader (aka Dirk Schanz)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ *
+ ***********************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+
+#include "i2cCore.h"
+#include "i2cArbiter.h"
+
+struct _i2c_arbiter_op {
+    std::function<int(void)> func;
+    int       result;
+    int       lastError;
+    bool      done;
+    pthread_t owner;
+    uint64_t  deadline;      // of the owner, 0 for none
+};
+
+// > 0 while the calling thread runs operations under the adapter lock
+static __thread int arbiterDepth = 0;
+
+static pthread_mutex_t arbitersLock = PTHREAD_MUTEX_INITIALIZER;
+static i2cArbiter* arbiters[I2C_ARBITER_MAX_BUS];
+
+/*
+ ***************************************************************************
+ * i2cArbiter::i2cArbiter( int bus )
+ * ----------------------------------------------------
+ * create the arbiter of adapter <bus>, use forBus()
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+i2cArbiter::i2cArbiter( int bus )
+{
+    arb_bus     = bus;
+    lock_fd     = -1;
+    window_us   = I2C_ARBITER_WINDOW_US;
+    max_hold_us = I2C_ARBITER_MAX_HOLD_US;
+    combining   = false;
+    memset( &stats, 0, sizeof(stats) );
+    pthread_mutex_init( &queue_lock, NULL );
+    pthread_cond_init( &queue_cond, NULL );
+}
+
+/*
+ ***************************************************************************
+ * i2cArbiter::~i2cArbiter()
+ * ----------------------------------------------------
+ * arbiters live as long as the process, never called
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+i2cArbiter::~i2cArbiter()
+{
+    if( lock_fd >= 0 )
+    {
+        close( lock_fd );
+    }
+    pthread_cond_destroy( &queue_cond );
+    pthread_mutex_destroy( &queue_lock );
+}
+
+/*
+ ***************************************************************************
+ * i2cArbiter* i2cArbiter::forBus( int bus )
+ * ----------------------------------------------------
+ * the process wide arbiter of adapter /dev/i2c-<bus>
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns the arbiter, NULL for an invalid bus number
+ ***************************************************************************
+*/
+i2cArbiter* i2cArbiter::forBus( int bus )
+{
+    i2cArbiter* retVal = NULL;
+
+    if( bus >= 0 && bus < I2C_ARBITER_MAX_BUS )
+    {
+        pthread_mutex_lock( &arbitersLock );
+
+        if( arbiters[bus] == NULL )
+        {
+            arbiters[bus] = new i2cArbiter( bus );
+        }
+        retVal = arbiters[bus];
+
+        pthread_mutex_unlock( &arbitersLock );
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * void i2cArbiter::setWindow( int windowUs, int maxHoldUs )
+ * ----------------------------------------------------
+ * set the batching window and the hold limit
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+void i2cArbiter::setWindow( int windowUs, int maxHoldUs )
+{
+    pthread_mutex_lock( &queue_lock );
+    window_us   = windowUs >= 0 ? windowUs : 0;
+    max_hold_us = maxHoldUs > 0 ? maxHoldUs : I2C_ARBITER_MAX_HOLD_US;
+    pthread_mutex_unlock( &queue_lock );
+}
+
+/*
+ ***************************************************************************
+ * void i2cArbiter::getStats( struct _i2c_arbiter_stats* pStats )
+ * ----------------------------------------------------
+ * copy the counters, e.g. to check fairness between processes
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+void i2cArbiter::getStats( struct _i2c_arbiter_stats* pStats )
+{
+    if( pStats != NULL )
+    {
+        pthread_mutex_lock( &queue_lock );
+        *pStats = stats;
+        pthread_mutex_unlock( &queue_lock );
+    }
+}
+
+/*
+ ***************************************************************************
+ * int i2cArbiter::openLockFile( void )
+ * ----------------------------------------------------
+ * open the lock file of the adapter unless it is open.
+ * Called with queue_lock held
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns an errorcode, E_ARB_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cArbiter::openLockFile( void )
+{
+    char lockPath[I2C_ARBITER_PATH_LEN];
+    const char* pDir;
+
+    if( lock_fd < 0 )
+    {
+        if( (pDir = getenv( I2C_ARBITER_LOCK_DIR_ENV )) == NULL )
+        {
+            pDir = I2C_ARBITER_LOCK_DIR;
+        }
+
+        snprintf( lockPath, sizeof(lockPath), I2C_ARBITER_LOCK_FMT,
+                  pDir, arb_bus );
+
+        if( (lock_fd = open( lockPath, O_RDWR | O_CREAT | O_CLOEXEC,
+                             0666 )) < 0 )
+        {
+            perror("i2cArbiter lock file");
+            return( E_ARB_LOCKFILE );
+        }
+    }
+
+    return( E_ARB_SUCCESS );
+}
+
+/*
+ ***************************************************************************
+ * int i2cArbiter::prepare( void )
+ * ----------------------------------------------------
+ * open the lock file now, so a lock directory that can not
+ * be used shows up when arbitration is turned on
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns an errorcode, E_ARB_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cArbiter::prepare( void )
+{
+    int retVal;
+
+    pthread_mutex_lock( &queue_lock );
+    retVal = openLockFile();
+    pthread_mutex_unlock( &queue_lock );
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * int i2cArbiter::lockAdapter( uint64_t deadline )
+ * ----------------------------------------------------
+ * take the advisory lock of the adapter, wait if another
+ * process holds it, but not past deadline unless it is 0.
+ * Called with queue_lock held and combining set, queue_lock
+ * is released while waiting
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns an errorcode, E_ARB_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cArbiter::lockAdapter( uint64_t deadline )
+{
+    uint64_t waitStart;
+    uint64_t waited;
+    uint64_t now;
+    uint64_t delay;
+    int retVal;
+
+    if( (retVal = openLockFile()) != E_ARB_SUCCESS )
+    {
+        return( retVal );
+    }
+
+    if( flock( lock_fd, LOCK_EX | LOCK_NB ) < 0 )
+    {
+        stats.contended++;
+        waitStart = i2cMonotonicUs();
+
+        // other threads may queue meanwhile, combining keeps them out
+        pthread_mutex_unlock( &queue_lock );
+
+        if( deadline == 0 )
+        {
+            while( flock( lock_fd, LOCK_EX ) < 0 && retVal == E_ARB_SUCCESS )
+            {
+                if( errno != EINTR )
+                {
+                    retVal = E_ARB_FAIL;
+                }
+            }
+        }
+        else
+        {
+            // flock() has no timeout
+            delay = I2C_ARBITER_POLL_MIN_US;
+
+            while( flock( lock_fd, LOCK_EX | LOCK_NB ) < 0 && 
+                   retVal == E_ARB_SUCCESS )
+            {
+                now = i2cMonotonicUs();
+
+                if( errno != EWOULDBLOCK && errno != EINTR )
+                {
+                    retVal = E_ARB_FAIL;
+                }
+                else
+                {
+                    if( now >= deadline )
+                    {
+                        retVal = E_ARB_DEADLINE;
+                    }
+                    else
+                    {
+                        i2cSleepUntil( now + delay < deadline ? 
+                                       now + delay : deadline );
+                        delay = delay * 2 < I2C_ARBITER_POLL_MAX_US ? 
+                                delay * 2 : I2C_ARBITER_POLL_MAX_US;
+                    }
+                }
+            }
+        }
+
+        pthread_mutex_lock( &queue_lock );
+
+        waited = i2cMonotonicUs() - waitStart;
+        stats.wait_us_total += waited;
+        if( waited > stats.wait_us_max )
+        {
+            stats.wait_us_max = waited;
+        }
+    }
+
+    if( retVal == E_ARB_SUCCESS )
+    {
+        stats.acquisitions++;
+
+        // another process may have switched the muxes of the bus
+        i2cMuxForget( arb_bus );
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * void i2cArbiter::unlockAdapter( uint64_t heldSince, uint64_t batch )
+ * ----------------------------------------------------
+ * release the advisory lock and account the hold time.
+ * Called with queue_lock held
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+void i2cArbiter::unlockAdapter( uint64_t heldSince, uint64_t batch )
+{
+    uint64_t held;
+
+    flock( lock_fd, LOCK_UN );
+
+    held = i2cMonotonicUs() - heldSince;
+    stats.hold_us_total += held;
+    if( held > stats.hold_us_max )
+    {
+        stats.hold_us_max = held;
+    }
+    if( batch > stats.max_batch )
+    {
+        stats.max_batch = batch;
+    }
+}
+
+/*
+ ***************************************************************************
+ * uint64_t i2cArbiter::queueDeadline( void )
+ * ----------------------------------------------------
+ * the earliest deadline of the queued operations.
+ * Called with queue_lock held
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns the deadline, 0 if none has one
+ ***************************************************************************
+*/
+uint64_t i2cArbiter::queueDeadline( void )
+{
+    uint64_t retVal = 0;
+    size_t i;
+
+    for( i = 0; i < queue.size(); i++ )
+    {
+        if( queue[i]->deadline != 0 && 
+            (retVal == 0 || queue[i]->deadline < retVal) )
+        {
+            retVal = queue[i]->deadline;
+        }
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * void i2cArbiter::failQueued( int result, bool expiredOnly )
+ * ----------------------------------------------------
+ * take the queued operations, only those past their deadline
+ * if expiredOnly is set, off the queue. They fail with result
+ * without being run. Called with queue_lock held
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+void i2cArbiter::failQueued( int result, bool expiredOnly )
+{
+    struct _i2c_arbiter_op* pOp;
+    uint64_t now;
+    size_t i;
+
+    now = i2cMonotonicUs();
+
+    for( i = 0; i < queue.size(); )
+    {
+        pOp = queue[i];
+
+        if( !expiredOnly || (pOp->deadline != 0 && pOp->deadline <= now) )
+        {
+            pOp->result    = result;
+            pOp->lastError = result;
+            pOp->done      = true;
+            queue.erase( queue.begin() + i );
+        }
+        else
+        {
+            i++;
+        }
+    }
+
+    pthread_cond_broadcast( &queue_cond );
+}
+
+/*
+ ***************************************************************************
+ * int i2cArbiter::run( std::function<int(void)> op )
+ * ----------------------------------------------------
+ * run op under the adapter lock. The op is queued; if no other
+ * thread of this process holds the lock, the calling thread
+ * takes it and runs all queued operations, otherwise it waits
+ * until its op was run by the holder. Each op runs with the
+ * deadline of the thread that queued it
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns the result of op
+ ***************************************************************************
+*/
+int i2cArbiter::run( std::function<int(void)> op )
+{
+    struct _i2c_arbiter_op myOp;
+    struct _i2c_arbiter_op* pOp;
+    struct timespec until;
+    uint64_t heldSince;
+    uint64_t batch;
+    uint64_t ownDeadline;
+    int lockResult;
+
+    if( arbiterDepth > 0 )
+    {
+        // nested, the lock is held by this thread already
+        return( op() );
+    }
+
+    myOp.func     = op;
+    myOp.done     = false;
+    myOp.owner    = pthread_self();
+    myOp.deadline = ownDeadline = i2cGetDeadline();
+
+    pthread_mutex_lock( &queue_lock );
+
+    queue.push_back( &myOp );
+    pthread_cond_broadcast( &queue_cond );
+
+    while( !myOp.done )
+    {
+        if( combining )
+        {
+            pthread_cond_wait( &queue_cond, &queue_lock );
+            continue;
+        }
+
+        combining = true;
+
+        // waited for as long as the most urgent queued op allows
+        if( (lockResult = lockAdapter( queueDeadline() )) != E_ARB_SUCCESS )
+        {
+            if( lockResult == E_ARB_DEADLINE )
+            {
+                // the others wait on, one of them takes over if need be
+                failQueued( E_I2C_DEADLINE, true );
+            }
+            else
+            {
+                // no exclusion from other processes, nothing may run
+                failQueued( E_I2C_LOCK, false );
+            }
+
+            combining = false;
+            pthread_cond_broadcast( &queue_cond );
+            continue;
+        }
+
+        heldSince = i2cMonotonicUs();
+        batch     = 0;
+        arbiterDepth++;
+
+        while( true )
+        {
+            while( !queue.empty() &&
+                   i2cMonotonicUs() - heldSince < (uint64_t) max_hold_us )
+            {
+                pOp = queue.front();
+                queue.pop_front();
+
+                pthread_mutex_unlock( &queue_lock );
+                i2cSetDeadline( pOp->deadline );
+                // no error of the op before may stick to this one
+                i2cSetLastError( E_I2C_SUCCESS );
+                pOp->result    = pOp->func();
+                pOp->lastError = i2cLastError();
+                i2cSetDeadline( ownDeadline );
+                pthread_mutex_lock( &queue_lock );
+
+                pOp->done = true;
+                batch++;
+                stats.operations++;
+                if( !pthread_equal( pOp->owner, myOp.owner ) )
+                {
+                    stats.combined++;
+                }
+                pthread_cond_broadcast( &queue_cond );
+            }
+
+            if( !queue.empty() || window_us == 0 ||
+                i2cMonotonicUs() - heldSince >= (uint64_t) max_hold_us )
+            {
+                // hold limit reached, let other processes in
+                break;
+            }
+
+            // batching window: wait a little for more operations
+            clock_gettime( CLOCK_REALTIME, &until );
+            until.tv_nsec += (long) window_us * 1000;
+            until.tv_sec  += until.tv_nsec / 1000000000;
+            until.tv_nsec %= 1000000000;
+
+            pthread_cond_timedwait( &queue_cond, &queue_lock, &until );
+
+            if( queue.empty() )
+            {
+                break;
+            }
+        }
+
+        arbiterDepth--;
+        unlockAdapter( heldSince, batch );
+        combining = false;
+        pthread_cond_broadcast( &queue_cond );
+    }
+
+    pthread_mutex_unlock( &queue_lock );
+
+    i2cSetLastError( myOp.lastError );
+
+    return( myOp.result );
+}
+
@@ -0,0 +1,122 @@
+/*
+ ***********************************************************************
+ *
+ *  i2cArbiter.h - part of eeprom access project
+ *
+ *  Copyright (C) 2013-2019 Dreamshader (aka Dirk Schanz)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ *
+ ***********************************************************************
+ *
+ * Cross-process arbitration of an i2c adapter.
+ *
+ * All processes using the library on /dev/i2c-N take an advisory
+ * lock (flock) on a lock file of that adapter around each logical
+ * operation. Within one process operations are queued: the thread
+ * that gets the lock runs the queued operations of all threads and
+ * keeps the lock for a short batching window to pick up operations
+ * arriving meanwhile. A hold limit keeps other processes from
+ * starving.
+ *
+ * Operations run under the lock must not take locks of their own,
+ * they may be run by another thread of the process. They run with
+ * the deadline of the thread that queued them (see i2cDeadline in
+ * i2cCore.h); an operation whose deadline passes while the lock is
+ * waited for fails with E_I2C_DEADLINE. If the lock file can not be
+ * opened or locked, the queued operations fail with E_I2C_LOCK
+ * instead of running without exclusion.
+ *
+ ***********************************************************************
+ */
+
+#ifndef I2CARBITER_H
+#define I2CARBITER_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include <deque>
+#include <functional>
+
+#define E_ARB_SUCCESS               0
+#define E_ARB_FAIL                 -1
+#define E_ARB_LOCKFILE             -2
+#define E_ARB_DEADLINE             -3
+
+#define I2C_ARBITER_LOCK_DIR       "/run/lock"
+#define I2C_ARBITER_LOCK_DIR_ENV   "I2C_LOCK_DIR"
+#define I2C_ARBITER_LOCK_FMT       "%s/i2c-%d.lock"
+#define I2C_ARBITER_PATH_LEN       256
+#define I2C_ARBITER_MAX_BUS        32
+
+// keep the lock this long for operations arriving after the queue ran dry
+#define I2C_ARBITER_WINDOW_US      200
+// never keep the lock longer than this while others may be waiting
+#define I2C_ARBITER_MAX_HOLD_US    20000
+// with a deadline the lock is polled, from this interval doubling up to
+// the maximum
+#define I2C_ARBITER_POLL_MIN_US    50
+#define I2C_ARBITER_POLL_MAX_US    1000
+
+struct _i2c_arbiter_stats {
+    uint64_t acquisitions;   // times the adapter lock was taken
+    uint64_t contended;      // ... of which another process held it
+    uint64_t operations;     // operations run under the lock
+    uint64_t combined;       // ... of which run for another thread
+    uint64_t wait_us_total;  // time spent waiting for the lock
+    uint64_t wait_us_max;
+    uint64_t hold_us_total;  // time the lock was held
+    uint64_t hold_us_max;
+    uint64_t max_batch;      // most operations run in one acquisition
+};
+
+struct _i2c_arbiter_op;
+
+class i2cArbiter {
+
+    private:
+        int             arb_bus;
+        int             lock_fd;
+        int             window_us;
+        int             max_hold_us;
+        bool            combining;
+        pthread_mutex_t queue_lock;
+        pthread_cond_t  queue_cond;
+        std::deque<struct _i2c_arbiter_op*> queue;
+        struct _i2c_arbiter_stats stats;
+
+        i2cArbiter( int bus );
+        ~i2cArbiter();
+
+        int openLockFile( void );
+        int lockAdapter( uint64_t deadline );
+        void unlockAdapter( uint64_t heldSince, uint64_t batch );
+        uint64_t queueDeadline( void );
+        void failQueued( int result, bool expiredOnly );
+
+    public:
+        static i2cArbiter* forBus( int bus );
+
+        int prepare( void );
+        int run( std::function<int(void)> op );
+
+        void setWindow( int windowUs, int maxHoldUs );
+        void getStats( struct _i2c_arbiter_stats* pStats );
+};
+
+#endif /* I2CARBITER_H */
+
@@ -38,11 +38,21 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <stdint.h>
+#include <time.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <linux/i2c.h>
 #include <linux/i2c-dev.h>
 
 #include "i2cCore.h"
+#include "i2cSim.h"
+
+// last error per thread, connections may be shared between threads
+static __thread int i2cThreadLastError = E_I2C_SUCCESS;
+
+// deadline of the calling thread, CLOCK_MONOTONIC in us, 0 = none
+static __thread uint64_t i2cThreadDeadline = 0;
 
 
 /*
@@ -51,25 +61,139 @@
  * ----------------------------------------------------
  * detect whether system is big endian or not
  * ----------------------------------------------------
- * 
+ * known at compile time, see I2C_HOST_BIG_ENDIAN
  * ----------------------------------------------------
  * 
  ***************************************************************************
 */
 bool isBigEndian()
 {
-    uint16_t word = 1;
-    char* pWord = (char*) &word;
+    return( I2C_HOST_BIG_ENDIAN );
+}
+
+/*
+ ***************************************************************************
+ * int i2cLastError( void )
+ * ----------------------------------------------------
+ * last error recorded by any connection in the calling thread
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns the errorcode resp. errno value
+ ***************************************************************************
+*/
+int i2cLastError( void )
+{
+    return( i2cThreadLastError );
+}
+
+/*
+ ***************************************************************************
+ * void i2cSetLastError( int err )
+ * ----------------------------------------------------
+ * record err as last error of the calling thread
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+void i2cSetLastError( int err )
+{
+    i2cThreadLastError = err;
+}
+
+/*
+ ***************************************************************************
+ * uint64_t i2cMonotonicUs( void )
+ * ----------------------------------------------------
+ * monotonic time in microseconds, not affected by clock changes
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns the time in us
+ ***************************************************************************
+*/
+uint64_t i2cMonotonicUs( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return( (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000 );
+}
+
+/*
+ ***************************************************************************
+ * void i2cSleepUntil( uint64_t untilUs )
+ * ----------------------------------------------------
+ * sleep until the absolute time untilUs (see i2cMonotonicUs()).
+ * Absolute, so a signal or a late wakeup does not add up
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+void i2cSleepUntil( uint64_t untilUs )
+{
+    struct timespec until;
 
-    if( pWord[0] == 0 )
+    until.tv_sec  = untilUs / 1000000;
+    until.tv_nsec = (untilUs % 1000000) * 1000;
+
+    while( clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &until, 
+                            NULL ) == EINTR )
     {
-// fprintf(stderr, "isBigEndian = true\n");
-        return( true );
+        ;
     }
-    else
+}
+
+/*
+ ***************************************************************************
+ * void i2cSetDeadline( uint64_t deadlineUs )
+ * uint64_t i2cGetDeadline( void )
+ * ----------------------------------------------------
+ * absolute deadline (see i2cMonotonicUs()) for the transfers
+ * of the calling thread, 0 for none. Usually set through an
+ * i2cDeadline object
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * i2cGetDeadline() returns the deadline
+ ***************************************************************************
+*/
+void i2cSetDeadline( uint64_t deadlineUs )
+{
+    i2cThreadDeadline = deadlineUs;
+}
+
+uint64_t i2cGetDeadline( void )
+{
+    return( i2cThreadDeadline );
+}
+
+/*
+ ***************************************************************************
+ * void i2cDefaultRetryPolicy( struct _i2c_retry_policy* pPolicy )
+ * ----------------------------------------------------
+ * fill in the default retry policy
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+void i2cDefaultRetryPolicy( struct _i2c_retry_policy* pPolicy )
+{
+    if( pPolicy != NULL )
     {
-// fprintf(stderr, "isBigEndian = false\n");
-        return( false );
+        pPolicy->max_retries        = I2C_DEFAULT_MAX_RETRIES;
+        pPolicy->busy_poll_us       = I2C_DEFAULT_BUSY_POLL_US;
+        pPolicy->backoff_us         = I2C_DEFAULT_BACKOFF_US;
+        pPolicy->backoff_max_us     = I2C_DEFAULT_BACKOFF_MAX_US;
+        pPolicy->adapter_timeout_ms = I2C_DEFAULT_ADAPTER_TIMEOUT_MS;
+        pPolicy->adapter_retries    = 0;
+        pPolicy->ack_polling        = false;
     }
 }
 
@@ -90,9 +214,27 @@ uint16_t makeMagic( void )
 
 
     retVal = I2C_EE_MAGIC;
- 
 
-fprintf(stderr, "makeMagic: %4x\n", retVal );
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * uint16_t makeMagicV2( void )
+ * ----------------------------------------------------
+ * magic of a header with serial and generation
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * 
+ ***************************************************************************
+*/
+uint16_t makeMagicV2( void )
+{
+    uint16_t retVal;
+
+
+    retVal = I2C_EE_MAGIC_V2;
 
     return( retVal );
 }
@@ -101,7 +243,7 @@ fprintf(stderr, "makeMagic: %4x\n", retVal );
  ***************************************************************************
  * bool isIdValid( uint16_t eeMagic )
  * ----------------------------------------------------
- * detect whether Id is valid magic
+ * detect whether Id is valid magic, of either header release
  * ----------------------------------------------------
  * 
  * ----------------------------------------------------
@@ -110,14 +252,14 @@ fprintf(stderr, "makeMagic: %4x\n", retVal );
 */
 bool isIdValid( uint16_t eeMagic )
 {
-    return( eeMagic == makeMagic() );
+    return( eeMagic == makeMagic() || eeMagic == makeMagicV2() );
 }
 
 /*
  ***************************************************************************
  * void getWordFromBuffer( uint8_t* pBuf, uint16_t* pWord )
  * ----------------------------------------------------
- * get word from buffer depending on byte order
+ * get word from buffer, the buffer holds the word MSB first
  * ----------------------------------------------------
  * 
  * ----------------------------------------------------
@@ -128,15 +270,39 @@ void getWordFromBuffer( uint8_t* pBuf, uint16_t* pWord )
 {
     if( pBuf != NULL && pWord != NULL )
     {
-        if( isBigEndian() )
-        {
-            return;
-        }
-        else
+        // assembling by shifts gives the same result on any host
+        *pWord = ((*pBuf & 0xff) << 8) | (*(pBuf+1) & 0xff);
+    }
+}
+
+/*
+ ***************************************************************************
+ * uint16_t i2cCrc16( const uint8_t* pData, int len, uint16_t crc )
+ * ----------------------------------------------------
+ * CRC-16/CCITT (polynomial 0x1021, start 0xffff) of records
+ * stored in the EEPROM, to tell torn writes from data. Data
+ * read in pieces passes the CRC of the previous ones as crc
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns the CRC
+ ***************************************************************************
+*/
+uint16_t i2cCrc16( const uint8_t* pData, int len, uint16_t crc )
+{
+    int bit;
+
+    while( len-- > 0 )
+    {
+        crc ^= (uint16_t) *pData++ << 8;
+
+        for( bit = 0; bit < 8; bit++ )
         {
-            *pWord = ((*pBuf & 0xff) << 8) | (*(pBuf+1) & 0xff);
+            crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
         }
     }
+
+    return( crc );
 }
 
 
@@ -160,6 +326,17 @@ i2cConnection::i2cConnection( void )
     i2c_flags = I2C_NULL_FLAGS;
     byte_order_big_endian = isBigEndian();
     i2c_16bit_addressing = false;
+    i2c_write_cycle_time = 0;
+    i2c_page_size = 0;
+    i2c_busy_until = 0;
+    i2c_program_start = 0;
+    i2c_deadline_missed = false;
+    i2c_simulated = false;
+    i2c_route.mux_type = I2C_MUX_NONE;
+    i2c_route.mux_addr = 0;
+    i2c_route.channel  = I2C_MUX_CHANNEL_NONE;
+    memset( &i2c_stats, 0, sizeof(i2c_stats) );
+    i2cDefaultRetryPolicy( &i2c_policy );
 }
 
 /*
@@ -182,6 +359,17 @@ i2cConnection::i2cConnection(int bus, int addr, bool force, int flags)
     i2c_flags = flags;
     byte_order_big_endian = isBigEndian();
     i2c_16bit_addressing = false;
+    i2c_write_cycle_time = 0;
+    i2c_page_size = 0;
+    i2c_busy_until = 0;
+    i2c_program_start = 0;
+    i2c_deadline_missed = false;
+    i2c_simulated = false;
+    i2c_route.mux_type = I2C_MUX_NONE;
+    i2c_route.mux_addr = 0;
+    i2c_route.channel  = I2C_MUX_CHANNEL_NONE;
+    memset( &i2c_stats, 0, sizeof(i2c_stats) );
+    i2cDefaultRetryPolicy( &i2c_policy );
 }
 
 /*
@@ -207,7 +395,8 @@ i2cConnection::~i2cConnection()
  * int i2cConnection::int i2cOpen( int bus, int addr, 
  *                                 bool force, int flags )
  * ----------------------------------------------------
- * Open connection to i2c bus
+ * Open connection to i2c bus. Buses with simulated devices
+ * (see i2cSim.h) are not opened but answered by the simulation
  * ----------------------------------------------------
  * int bus    : bus to use
  * int addr   : slave addr to connect to
@@ -229,43 +418,76 @@ int i2cConnection::i2cOpen(int bus, int addr, bool force, int flags)
     }
     else
     {
-        sprintf(devName, "/dev/i2c-%d", bus);
-        devFd = open(devName, flags);
-fprintf(stderr, "Using device %s\n", devName);
-        if( devFd > 0 )
+        if( i2cSimIsBus( bus ) )
         {
-	    if((retVal = ioctl(devFd, I2C_FUNCS, &i2c_funcs) < 0))
-	    {
-perror("i2cOpen ioctl i2c funcs!");
-                i2c_lastErrno = errno;
-                retVal = E_I2C_IOCTL;
-	    }
+            // no adapter, /dev/null stands in for the descriptor
+            if( (devFd = open( "/dev/null", flags )) > 0 )
+            {
+                i2c_funcs = I2C_FUNC_I2C | I2C_FUNC_SMBUS_READ_BYTE |
+                            I2C_FUNC_SMBUS_QUICK;
+                i2c_devfd = devFd;
+                i2c_bus   = bus;
+                i2c_addr  = addr;
+                i2c_force = force;
+                i2c_flags = flags;
+                i2c_simulated = true;
+                i2c_lastErrno = retVal = E_I2C_SUCCESS;
+            }
             else
             {
-                if(ioctl(devFd, force ? I2C_SLAVE_FORCE : I2C_SLAVE, addr) < 0) 
+                i2c_lastErrno = errno;
+                retVal = E_I2C_NODEV;
+            }
+        }
+        else
+        {
+            sprintf(devName, "/dev/i2c-%d", bus);
+            devFd = open(devName, flags);
+I2C_DBG("Using device %s\n", devName);
+            if( devFd > 0 )
+            {
+                I2C_STAT_ADD( i2c_stats.ioctls, 1 );
+                if((retVal = ioctl(devFd, I2C_FUNCS, &i2c_funcs) < 0))
                 {
+perror("i2cOpen ioctl i2c funcs!");
                     i2c_lastErrno = errno;
                     retVal = E_I2C_IOCTL;
+                    close( devFd );
                 }
                 else
                 {
-                    i2c_devfd = devFd;
-                    i2c_bus   = bus;
-                    i2c_addr  = addr;
-                    i2c_force = force;
-                    i2c_flags = flags;
+                    I2C_STAT_ADD( i2c_stats.ioctls, 1 );
+                    if(ioctl(devFd, force ? I2C_SLAVE_FORCE : I2C_SLAVE, addr) < 0) 
+                    {
+                        i2c_lastErrno = errno;
+                        retVal = E_I2C_IOCTL;
+                        close( devFd );
+                    }
+                    else
+                    {
+                        i2c_devfd = devFd;
+                        i2c_bus   = bus;
+                        i2c_addr  = addr;
+                        i2c_force = force;
+                        i2c_flags = flags;
+
+                        applyAdapterPolicy();
     
-                    i2c_lastErrno = retVal = E_I2C_SUCCESS;
+                        i2c_lastErrno = retVal = E_I2C_SUCCESS;
+                    }
                 }
             }
-        }
-        else
-        {
-            i2c_lastErrno = errno;
-            retVal = E_I2C_NODEV;
+            else
+            {
+                i2c_lastErrno = errno;
+                retVal = E_I2C_NODEV;
+            }
         }
     }
 
+    I2C_TRACE( I2C_TRACE_OPS, I2C_EV_OPEN, I2C_TRACE_DEV( bus, addr ), 
+               bus, addr, retVal, 0 );
+
     return( retVal );
 }
 
@@ -321,6 +543,155 @@ fprintf(stderr, "oops: %s -> file %s line %d\n", __FUNCTION__, __FILE__, __LINE_
     return( retVal );
 }
 
+/*
+ ***************************************************************************
+ * void i2cConnection::reuse( void )
+ * ----------------------------------------------------
+ * bring an open connection back to the state of a new one for
+ * its next user, see i2cPool.h. Descriptor, slave address and
+ * the busy time of the chip are kept
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+void i2cConnection::reuse( void )
+{
+    struct _i2c_retry_policy defaults;
+
+    i2c_16bit_addressing  = false;
+    i2c_write_cycle_time  = 0;
+    i2c_page_size         = 0;
+    i2c_bus_frequency_1V8 = 0;
+    i2c_bus_frequency_4V5 = 0;
+    i2c_deadline_missed   = false;
+    i2c_lastErrno.value   = E_I2C_SUCCESS;
+
+    // the adapter only needs the ioctls if the policy was changed
+    i2cDefaultRetryPolicy( &defaults );
+
+    if( memcmp( &defaults, &i2c_policy, sizeof(defaults) ) != 0 )
+    {
+        setRetryPolicy( NULL );
+    }
+
+    resetStats();
+}
+
+/*
+ ***************************************************************************
+ * int i2cConnection::i2cSelect( int addr )
+ * ----------------------------------------------------
+ * talk to slave addr on the already opened bus, without
+ * opening the adapter again
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns an errorcode, E_I2C_SUCCESS on success,
+ * E_I2C_IN_USE if a kernel driver claims the address
+ ***************************************************************************
+*/
+int i2cConnection::i2cSelect( int addr )
+{
+    int retVal;
+
+    if( i2c_devfd > 0 && i2c_devfd != I2C_NULL_FD )
+    {
+        // the busy time belongs to the current slave
+        waitReady();
+
+        I2C_STAT_ADD( i2c_stats.ioctls, 1 );
+        if( !i2c_simulated &&
+            ioctl( i2c_devfd, i2c_force ? I2C_SLAVE_FORCE : I2C_SLAVE, 
+                   addr ) < 0 )
+        {
+            i2c_lastErrno = errno;
+            retVal = errno == EBUSY ? E_I2C_IN_USE : E_I2C_IOCTL;
+        }
+        else
+        {
+            i2c_addr = addr;
+            i2c_lastErrno = retVal = E_I2C_SUCCESS;
+        }
+    }
+    else
+    {
+        i2c_lastErrno = retVal = E_I2C_NULL_FD;
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * int i2cConnection::probe( void )
+ * ----------------------------------------------------
+ * check whether the selected slave answers. Like i2cdetect a
+ * receive byte is used, a quick write may corrupt some EEPROMs.
+ * Only if the adapter can not do that a quick write is sent
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns E_I2C_SUCCESS if the slave acknowledged,
+ * E_I2C_NODEV if not
+ ***************************************************************************
+*/
+int i2cConnection::probe( void )
+{
+    int retVal;
+    int res;
+
+    waitReady();
+
+    if( routeSelect() < 0 )
+    {
+        res = -1;
+    }
+    else
+    {
+        if( i2c_simulated )
+        {
+            res = i2cSimProbe( i2c_bus, i2c_addr );
+        }
+        else
+        {
+            if( i2c_funcs & I2C_FUNC_SMBUS_READ_BYTE )
+            {
+                res = i2c_smbus_read_byte( i2c_devfd );
+            }
+            else
+            {
+                if( i2c_funcs & I2C_FUNC_SMBUS_QUICK )
+                {
+                    res = i2c_smbus_write_quick( i2c_devfd, I2C_SMBUS_WRITE );
+                }
+                else
+                {
+                    res = -1;
+                    errno = EOPNOTSUPP;
+                }
+            }
+        }
+        routeRelease();
+    }
+
+    I2C_STAT_ADD( i2c_stats.ioctls, 1 );
+    I2C_STAT_ADD( i2c_stats.transactions, 1 );
+
+    if( res < 0 )
+    {
+        i2c_lastErrno = errno;
+        retVal = E_I2C_NODEV;
+    }
+    else
+    {
+        i2c_lastErrno = retVal = E_I2C_SUCCESS;
+    }
+
+    return( retVal );
+}
+
 /*
  ***************************************************************************
  * int i2cConnection::i2cClose( void )
@@ -338,6 +709,9 @@ int i2cConnection::i2cClose( void )
 
     if( i2c_devfd > 0 && i2c_devfd != I2C_NULL_FD )
     {
+        // let the last page write complete before the device is left
+        waitReady();
+
         if( (retVal = close( i2c_devfd )) == 0 )
         {
             i2c_lastErrno = retVal = E_I2C_SUCCESS;
@@ -352,6 +726,8 @@ int i2cConnection::i2cClose( void )
         i2c_bus   = I2C_NULL_BUS;
         i2c_force = false;
         i2c_flags = I2C_NULL_FLAGS;
+        i2c_simulated = false;
+        i2c_route.mux_type = I2C_MUX_NONE;
     }
     else
     {
@@ -387,19 +763,18 @@ int i2cConnection::setAddrPointer( int fd, uint16_t addr )
         {
 // 16 bit adressing
             bytes2Write = 2;
-            retVal = write( fd, dataBuf, bytes2Write);
+            retVal = busWrite( fd, dataBuf, bytes2Write);
         }
         else
         {
 // 8 bit adressing
             bytes2Write = 1;
-            retVal = write( fd, dataBuf, bytes2Write);
+            retVal = busWrite( fd, dataBuf, bytes2Write);
         }
 
         if( retVal != bytes2Write )
         {
-perror("setAddrPointer");
-            i2c_lastErrno = retVal = E_I2C_FAIL;
+            i2c_lastErrno = retVal = busFailure();
         }
         else
         {
@@ -428,75 +803,19 @@ perror("setAddrPointer");
 int i2cConnection::initID( uint16_t eeMagic, uint16_t eeType )
 {
     int retVal;
-    char wrBuffer[I2C_EEPROM_ID_LEN];
+    uint8_t wrBuffer[I2C_EEPROM_ID_LEN];
 
-    memcpy(&wrBuffer[0], &eeMagic, 2);
-    memcpy(&wrBuffer[2], &eeType, 2);
+    // magic and type are stored MSB first, see getWordFromBuffer()
+    wrBuffer[0] = (eeMagic >> 8) & 0x00ff;
+    wrBuffer[1] = eeMagic & 0x00ff;
+    wrBuffer[2] = (eeType >> 8) & 0x00ff;
+    wrBuffer[3] = eeType & 0x00ff;
 
-    if( byte_order_big_endian )
+    if( (retVal = writeBuf( 0, wrBuffer, I2C_EEPROM_ID_LEN )) < 0 )
     {
-        retVal = writeByte(0, wrBuffer[0] );
-        if( retVal < 0 )
-        {
-            perror("writeByte pos 0");
-        }
-        else
-        {
-            retVal = writeByte(1, wrBuffer[1] );
-            if( retVal < 0 )
-            {
-                perror("writeByte pos 1");
-            }
-            else
-            {
-                retVal = writeByte(2, wrBuffer[2] );
-                if( retVal < 0 )
-                {
-                    perror("writeByte pos 2");
-                }
-                else
-                {
-                    retVal = writeByte(3, wrBuffer[3] );
-                    if( retVal < 0 )
-                    {
-                        perror("writeByte pos 3");
-                    }
-                }
-            }
-        }
-    }
-    else
-    {
-        retVal = writeByte(0, wrBuffer[1] );
-        if( retVal < 0 )
-        {
-            perror("writeByte pos 0");
-        }
-        else
-        {
-            retVal = writeByte(1, wrBuffer[0] );
-            if( retVal < 0 )
-            {
-                perror("writeByte pos 1");
-            }
-            else
-            {
-                retVal = writeByte(2, wrBuffer[3] );
-                if( retVal < 0 )
-                {
-                    perror("writeByte pos 2");
-                }
-                else
-                {
-                    retVal = writeByte(3, wrBuffer[2] );
-                    if( retVal < 0 )
-                    {
-                        perror("writeByte pos 3");
-                    }
-                }
-            }
-        }
+        I2C_DBG_ERRNO("initID");
     }
+
     return( retVal );
 }
 
@@ -532,32 +851,11 @@ int i2cConnection::readByte( uint16_t addr, void* pData )
 */
 int i2cConnection::readByte( int fd, uint16_t addr, void* pData )
 {
-
-    __s32 res;
     int retVal;
-    char* pDataOut;
-    uint8_t rdByte;
 
-    if( (pDataOut = (char*) pData) != NULL )
+    if( pData != NULL )
     {
-        if( (retVal = setAddrPointer( fd, addr )) == E_I2C_SUCCESS )
-        {
-
-            res = read(fd, &rdByte, 1);
-            if (res < 0)
-            {
-perror("readByte: read failed!");
-                i2c_lastErrno = retVal = E_I2C_FAIL;
-            } 
-            else 
-            {
-                /* res contains the read byte */
-
-//                *pDataOut = res & 0xff;
-                *pDataOut = rdByte;
-                i2c_lastErrno = retVal = E_I2C_SUCCESS;
-            }
-        }
+        retVal = readBuf( fd, addr, (uint8_t*) pData, 1 );
     }
     else
     {
@@ -601,6 +899,9 @@ int i2cConnection::writeByte( int fd, uint16_t addr, uint8_t data )
     int retVal;
     int bytes2Write;
     uint8_t dataBuf[8];
+    uint64_t started;
+
+    started = i2cMonotonicUs();
 
     dataBuf[0] = (addr >> 8) & 0x00ff;
     dataBuf[1] = addr & 0x00ff;
@@ -610,29 +911,24 @@ int i2cConnection::writeByte( int fd, uint16_t addr, uint8_t data )
     {
         // 16 bit adressing
         bytes2Write = 3;
-        retVal = write( fd, dataBuf, bytes2Write);
+        retVal = busWrite( fd, dataBuf, bytes2Write);
     }
     else
     {
         // 8 bit adressing
         bytes2Write = 2;
-        retVal = write( fd, &dataBuf[1], bytes2Write);
+        retVal = busWrite( fd, &dataBuf[1], bytes2Write);
     }
 
     if(retVal != bytes2Write)
     {
-perror("writeByte failed!");
-        i2c_lastErrno = retVal = E_I2C_FAIL;
+        i2c_lastErrno = retVal = busFailure();
     } 
     else 
     {
 // fprintf(stderr, "wrote %d bytes of %d.\n", retVal, bytes2Write);
         i2c_lastErrno = retVal = E_I2C_SUCCESS;
-        if(i2c_write_cycle_time > 0 )
-        {
-// fprintf(stderr, "write cycle time = %d\n", i2c_write_cycle_time );
-            usleep(i2c_write_cycle_time * 1000);
-        }
+        pageWritten( started );
     }
 
     return( retVal );
@@ -669,32 +965,16 @@ int i2cConnection::readWord( uint16_t addr, void* pData )
 */
 int i2cConnection::readWord( int fd, uint16_t addr, void* pData )
 {
-
     int retVal;
-    char buf[2];
+    uint8_t buf[2];
     uint16_t* pDataOut;
 
     if( (pDataOut = (uint16_t*) pData) != NULL )
     {
-        if( byte_order_big_endian )
-        {
-            if( (retVal = readByte(fd, addr, &buf[0])) == E_I2C_SUCCESS )
-            {
-                if( (retVal = readByte(fd, addr+1, &buf[1])) == E_I2C_SUCCESS )
-                {
-                    *pDataOut = * (uint16_t*)&buf[0];
-                }
-            }
-        }
-        else
+        // both bytes in one transfer, stored MSB first like the header
+        if( (retVal = readBuf( fd, addr, buf, 2 )) == E_I2C_SUCCESS )
         {
-            if( (retVal = readByte(fd, addr, &buf[1])) == E_I2C_SUCCESS )
-            {
-                if( (retVal = readByte(fd, addr+1, &buf[0])) == E_I2C_SUCCESS )
-                {
-                    *pDataOut = * (uint16_t*)&buf[0];
-                }
-            }
+            getWordFromBuffer( buf, pDataOut );
         }
     }
     else
@@ -734,14 +1014,13 @@ int i2cConnection::writeWord( uint16_t addr, uint16_t data )
 */
 int i2cConnection::writeWord( int fd, uint16_t addr, uint16_t data )
 {
-    int retVal;
+    uint8_t buf[2];
 
-fprintf(stderr, "%s %s %d: fd=%d, addr=%4x, data=%4x\n",
-__FUNCTION__,__FILE__,__LINE__, fd, addr, data );
+    // MSB first, matches readWord
+    buf[0] = (data >> 8) & 0x00ff;
+    buf[1] = data & 0x00ff;
 
-    i2c_lastErrno = retVal = E_I2C_SUCCESS;
-fprintf(stderr, "write Word: %4x\n", data);
-    return( retVal );
+    return( writeBuf( fd, addr, buf, 2 ) );
 }
 
 
@@ -767,7 +1046,10 @@ int i2cConnection::readBuf( uint16_t addr, uint8_t* pBuffer, int amount )
  * ----------------------------------------------------
  * read amount number of bytes from stream fd from address addr 
  * ----------------------------------------------------
- * 
+ * the EEPROM increments its address counter by itself, so
+ * one address phase is followed by one sequential read. If the
+ * adapter supports plain I2C, both are sent as one combined
+ * transfer with a repeated start
  * ----------------------------------------------------
  * returns an errorcode, E_I2C_SUCCESS on success
  ***************************************************************************
@@ -775,14 +1057,72 @@ int i2cConnection::readBuf( uint16_t addr, uint8_t* pBuffer, int amount )
 int i2cConnection::readBuf( int fd, uint16_t addr, uint8_t* pBuffer, int amount )
 {
     int retVal;
-
-fprintf(stderr, "%s %s %d: fd=%d, addr=%4x, pBuffer=%4x, amount=%d\n",
-__FUNCTION__,__FILE__,__LINE__, fd, addr, (unsigned int) pBuffer, amount);
+    int chunk;
+    int res;
+    uint8_t addrBuf[2];
+    struct i2c_msg msgs[2];
+    uint64_t started;
 
     if( pBuffer != (uint8_t*) NULL )
     {
         if( amount > 0 )
         {
+            i2c_lastErrno = retVal = E_I2C_SUCCESS;
+            started = i2cMonotonicUs();
+
+            while( amount > 0 && retVal == E_I2C_SUCCESS )
+            {
+                chunk = amount > I2C_MAX_READ_LEN ? I2C_MAX_READ_LEN : amount;
+
+                if( addr != I2C_CURRENT_ADDRESS && 
+                    (i2c_funcs & I2C_FUNC_I2C) )
+                {
+                    // address phase and read in one combined transfer
+                    addrBuf[0] = (addr >> 8) & 0x00ff;
+                    addrBuf[1] = addr & 0x00ff;
+
+                    msgs[0].addr  = i2c_addr;
+                    msgs[0].flags = 0;
+                    msgs[0].len   = i2c_16bit_addressing ? 2 : 1;
+                    msgs[0].buf   = i2c_16bit_addressing ? &addrBuf[0] : 
+                                                           &addrBuf[1];
+                    msgs[1].addr  = i2c_addr;
+                    msgs[1].flags = I2C_M_RD;
+                    msgs[1].len   = chunk;
+                    msgs[1].buf   = pBuffer;
+
+                    if( (res = busTransfer( fd, msgs, 2 )) != 2 )
+                    {
+                        i2c_lastErrno = retVal = busFailure();
+                    }
+                }
+                else
+                {
+                    if( (retVal = setAddrPointer( fd, addr )) == 
+                        E_I2C_SUCCESS )
+                    {
+                        if( (res = busRead( fd, pBuffer, chunk )) != chunk )
+                        {
+                            i2c_lastErrno = retVal = busFailure();
+                        }
+                    }
+                }
+
+                if( retVal == E_I2C_SUCCESS )
+                {
+                    if( addr != I2C_CURRENT_ADDRESS )
+                    {
+                        addr += chunk;
+                    }
+                    pBuffer += chunk;
+                    amount  -= chunk;
+                }
+            }
+
+            if( retVal == E_I2C_SUCCESS )
+            {
+                i2c_hist[I2C_HIST_READ].record( i2cMonotonicUs() - started );
+            }
         }
         else
         {
@@ -821,7 +1161,10 @@ int i2cConnection::writeBuf( uint16_t addr, uint8_t* pBuffer, int amount )
  * write amount number of data bytes pointed by pBuffer to 
  * stream fd at address addr 
  * ----------------------------------------------------
- * 
+ * data is split at page boundaries, each part is written
+ * as one page write. The write cycle time is not waited for
+ * here but before the next transfer to the device, so the
+ * caller may use the bus for other devices meanwhile
  * ----------------------------------------------------
  * returns an errorcode, E_I2C_SUCCESS on success
  ***************************************************************************
@@ -829,14 +1172,63 @@ int i2cConnection::writeBuf( uint16_t addr, uint8_t* pBuffer, int amount )
 int i2cConnection::writeBuf( int fd, uint16_t addr, uint8_t* pBuffer, int amount )
 {
     int retVal;
-
-fprintf(stderr, "%s %s %d: fd=%d, addr=%4x, pBuffer=%4x, amount=%d\n",
-__FUNCTION__,__FILE__,__LINE__, fd, addr, (unsigned int) pBuffer, amount);
+    int pageSize;
+    int chunk;
+    int addrLen;
+    int bytes2Write;
+    uint8_t dataBuf[I2C_MAX_PAGE_LEN + 2];
+    uint64_t started;
 
     if( pBuffer != (uint8_t*) NULL )
     {
-        if( amount > 0 )
+        if( amount > 0 && addr != I2C_CURRENT_ADDRESS )
         {
+            // without a known page size only single bytes are safe
+            pageSize = i2c_page_size > 0 ? i2c_page_size : 1;
+            if( pageSize > I2C_MAX_PAGE_LEN )
+            {
+                pageSize = I2C_MAX_PAGE_LEN;
+            }
+
+            addrLen = i2c_16bit_addressing ? 2 : 1;
+            retVal = E_I2C_SUCCESS;
+
+            while( amount > 0 && retVal == E_I2C_SUCCESS )
+            {
+                // never cross a page boundary, the chip would wrap around
+                chunk = pageSize - (addr % pageSize);
+                if( chunk > amount )
+                {
+                    chunk = amount;
+                }
+
+                dataBuf[0] = (addr >> 8) & 0x00ff;
+                dataBuf[1] = addr & 0x00ff;
+                memcpy( &dataBuf[2], pBuffer, chunk );
+
+                bytes2Write = addrLen + chunk;
+                started = i2cMonotonicUs();
+
+                if( busWrite( fd, &dataBuf[2 - addrLen], bytes2Write ) != 
+                    bytes2Write )
+                {
+                    i2c_lastErrno = retVal = busFailure();
+                }
+                else
+                {
+                    // the write cycle is waited for before the next transfer
+                    pageWritten( started );
+
+                    addr    += chunk;
+                    pBuffer += chunk;
+                    amount  -= chunk;
+                }
+            }
+
+            if( retVal == E_I2C_SUCCESS )
+            {
+                i2c_lastErrno = E_I2C_SUCCESS;
+            }
         }
         else
         {
@@ -851,6 +1243,764 @@ __FUNCTION__,__FILE__,__LINE__, fd, addr, (unsigned int) pBuffer, amount);
     return( retVal );
 }
 
+/*
+ ***************************************************************************
+ * bool i2cConnection::isBusy( void )
+ * ----------------------------------------------------
+ * whether the device is still in the write cycle of the
+ * last page write and would not answer
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns true while busy
+ ***************************************************************************
+*/
+bool i2cConnection::isBusy( void )
+{
+    return( i2c_busy_until != 0 && i2cMonotonicUs() < i2c_busy_until );
+}
+
+/*
+ ***************************************************************************
+ * void i2cConnection::waitReady( void )
+ * ----------------------------------------------------
+ * sleep until the write cycle of the last page write is over.
+ * With ack_polling in the policy the chip is polled instead,
+ * the program time is measured then
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+void i2cConnection::waitReady( void )
+{
+    uint64_t now;
+    uint64_t waited;
+
+    if( i2c_busy_until != 0 )
+    {
+        if( (now = i2cMonotonicUs()) < i2c_busy_until )
+        {
+            if( i2c_policy.ack_polling && (i2c_funcs & I2C_FUNC_SMBUS_QUICK) )
+            {
+                while( ackPoll() != 0 )
+                {
+                    if( i2cMonotonicUs() + i2c_policy.busy_poll_us >= 
+                        i2c_busy_until )
+                    {
+                        // the chip must be ready at the end of tWR
+                        i2cSleepUntil( i2c_busy_until );
+                        break;
+                    }
+                    i2cSleepUntil( i2cMonotonicUs() + i2c_policy.busy_poll_us );
+                }
+
+                i2c_hist[I2C_HIST_PROGRAM].record( i2cMonotonicUs() - 
+                                                   i2c_program_start );
+            }
+            else
+            {
+                i2cSleepUntil( i2c_busy_until );
+            }
+
+            waited = i2cMonotonicUs() - now;
+
+            I2C_STAT_ADD( i2c_stats.wait_sleeps, 1 );
+            I2C_STAT_ADD( i2c_stats.wait_us, waited );
+            i2c_hist[I2C_HIST_WAIT].record( waited );
+            I2C_TRACE( I2C_TRACE_BUS, I2C_EV_WAIT, 
+                       I2C_TRACE_DEV( i2c_bus, i2c_addr ), 0, 0, 0, waited );
+        }
+        i2c_busy_until = 0;
+    }
+}
+
+/*
+ ***************************************************************************
+ * int i2cConnection::ackPoll( void )
+ * ----------------------------------------------------
+ * address the chip with a quick write, as the data sheets
+ * describe for acknowledge polling. No retries, no waiting
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns 0 if the chip acknowledged, -1 if not
+ ***************************************************************************
+*/
+int i2cConnection::ackPoll( void )
+{
+    int res;
+    int err = 0;
+
+    if( routeSelect() < 0 )
+    {
+        res = -1;
+    }
+    else
+    {
+        if( i2c_simulated )
+        {
+            res = i2cSimProbe( i2c_bus, i2c_addr );
+        }
+        else
+        {
+            res = i2c_smbus_write_quick( i2c_devfd, I2C_SMBUS_WRITE );
+        }
+        routeRelease();
+    }
+
+    if( res < 0 )
+    {
+        err = errno;
+    }
+
+    I2C_STAT_ADD( i2c_stats.ioctls, 1 );
+    busCount( res, err, 0, 0 );
+
+    return( res < 0 ? -1 : 0 );
+}
+
+/*
+ ***************************************************************************
+ * int i2cConnection::busWrite( int fd, uint8_t* pData, int len )
+ * ----------------------------------------------------
+ * low level write of len bytes to the slave selected on fd
+ * ----------------------------------------------------
+ * all plain writes to the bus go through here
+ * ----------------------------------------------------
+ * returns the number of bytes written or -1 on error
+ ***************************************************************************
+*/
+int i2cConnection::busWrite( int fd, uint8_t* pData, int len )
+{
+    int retVal;
+    int err = 0;
+    int attempt = 0;
+
+    do
+    {
+        if( (retVal = busReady( len )) == 0 )
+        {
+            if( (retVal = i2c_simulated ? 
+                          i2cSimWrite( i2c_bus, i2c_addr, pData, len ) :
+                          write( fd, pData, len )) < 0 )
+            {
+                err = errno;
+            }
+            busCount( retVal, err, len, 0 );
+            I2C_TRACE( I2C_TRACE_BUS, I2C_EV_BUS_WRITE, 
+                       I2C_TRACE_DEV( i2c_bus, i2c_addr ), len, 0, 
+                       retVal < 0 ? -err : retVal, 0 );
+            routeRelease();
+        }
+        else
+        {
+            err = errno;
+        }
+    } while( retVal < 0 && !i2c_deadline_missed && 
+             busRetry( err, attempt++ ) );
+
+    if( retVal < 0 )
+    {
+        i2c_lastErrno = err;
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * int i2cConnection::busRead( int fd, uint8_t* pData, int len )
+ * ----------------------------------------------------
+ * low level read of len bytes from the slave selected on fd
+ * ----------------------------------------------------
+ * all plain reads from the bus go through here
+ * ----------------------------------------------------
+ * returns the number of bytes read or -1 on error
+ ***************************************************************************
+*/
+int i2cConnection::busRead( int fd, uint8_t* pData, int len )
+{
+    int retVal;
+    int err = 0;
+    int attempt = 0;
+
+    do
+    {
+        if( (retVal = busReady( len )) == 0 )
+        {
+            if( (retVal = i2c_simulated ? 
+                          i2cSimRead( i2c_bus, i2c_addr, pData, len ) :
+                          read( fd, pData, len )) < 0 )
+            {
+                err = errno;
+            }
+            busCount( retVal, err, 0, len );
+            I2C_TRACE( I2C_TRACE_BUS, I2C_EV_BUS_READ, 
+                       I2C_TRACE_DEV( i2c_bus, i2c_addr ), len, 0, 
+                       retVal < 0 ? -err : retVal, 0 );
+            routeRelease();
+        }
+        else
+        {
+            err = errno;
+        }
+    } while( retVal < 0 && !i2c_deadline_missed && 
+             busRetry( err, attempt++ ) );
+
+    if( retVal < 0 )
+    {
+        i2c_lastErrno = err;
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * int i2cConnection::busTransfer( int fd, struct i2c_msg* pMsgs, int count )
+ * ----------------------------------------------------
+ * low level combined transfer of count messages, the messages
+ * are separated by repeated starts, no stop in between
+ * ----------------------------------------------------
+ * all combined transfers go through here
+ * ----------------------------------------------------
+ * returns the number of messages transferred or -1 on error
+ ***************************************************************************
+*/
+int i2cConnection::busTransfer( int fd, struct i2c_msg* pMsgs, int count )
+{
+    int retVal;
+    int err = 0;
+    int attempt = 0;
+    int len;
+    int readLen;
+    int i;
+    struct i2c_rdwr_ioctl_data rdwr;
+
+    rdwr.msgs  = pMsgs;
+    rdwr.nmsgs = count;
+
+    for( len = 0, readLen = 0, i = 0; i < count; i++ )
+    {
+        len += pMsgs[i].len;
+        if( pMsgs[i].flags & I2C_M_RD )
+        {
+            readLen += pMsgs[i].len;
+        }
+    }
+
+    do
+    {
+        if( (retVal = busReady( len )) == 0 )
+        {
+            if( (retVal = i2c_simulated ? 
+                          i2cSimTransfer( i2c_bus, pMsgs, count ) :
+                          ioctl( fd, I2C_RDWR, &rdwr )) < 0 )
+            {
+                err = errno;
+            }
+            I2C_STAT_ADD( i2c_stats.ioctls, 1 );
+            busCount( retVal, err, len - readLen, readLen );
+            I2C_TRACE( I2C_TRACE_BUS, I2C_EV_BUS_XFER, 
+                       I2C_TRACE_DEV( i2c_bus, i2c_addr ), len, count, 
+                       retVal < 0 ? -err : retVal, 0 );
+            routeRelease();
+        }
+        else
+        {
+            err = errno;
+        }
+    } while( retVal < 0 && !i2c_deadline_missed && 
+             busRetry( err, attempt++ ) );
+
+    if( retVal < 0 )
+    {
+        i2c_lastErrno = err;
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * int i2cConnection::busReady( int len )
+ * ----------------------------------------------------
+ * wait for the end of the write cycle before a transfer of
+ * len bytes. If the transfer can not be done before the
+ * deadline of the thread, fail at once instead
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns 0 if the transfer may start, -1 if the deadline
+ * can not be met or the mux channel can not be selected.
+ * On success routeRelease() must follow the transfer
+ ***************************************************************************
+*/
+int i2cConnection::busReady( int len )
+{
+    int retVal = 0;
+    int khz;
+    uint64_t start;
+    uint64_t deadline;
+
+    i2c_deadline_missed = false;
+
+    if( (deadline = i2cGetDeadline()) != 0 )
+    {
+        start = i2cMonotonicUs();
+        if( i2c_busy_until > start )
+        {
+            start = i2c_busy_until;
+        }
+
+        // address and data bytes, 9 clocks each, at the fastest rate
+        khz = i2c_bus_frequency_4V5 > 0 ? i2c_bus_frequency_4V5 : 
+                                          I2C_DEFAULT_BUS_KHZ;
+
+        if( start + (uint64_t) (len + 2) * 9 * 1000 / khz > deadline )
+        {
+            i2c_deadline_missed = true;
+            I2C_STAT_ADD( i2c_stats.deadline_misses, 1 );
+            I2C_TRACE( I2C_TRACE_ERROR, I2C_EV_DEADLINE, 
+                       I2C_TRACE_DEV( i2c_bus, i2c_addr ), len, 0, 
+                       E_I2C_DEADLINE, 0 );
+            errno = ETIME;
+            retVal = -1;
+        }
+    }
+
+    if( retVal == 0 )
+    {
+        waitReady();
+        retVal = routeSelect();
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * bool i2cConnection::busRetry( int err, int attempt )
+ * ----------------------------------------------------
+ * decide on a failed transfer following the retry policy and
+ * sleep before the next attempt. A NACK (ENXIO, EREMOTEIO)
+ * is a busy chip, polled again after busy_poll_us but at most
+ * the write cycle time, bus errors back off exponentially.
+ * Nothing is retried that can not finish before the deadline
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns true if the transfer is to be repeated
+ ***************************************************************************
+*/
+bool i2cConnection::busRetry( int err, int attempt )
+{
+    bool retVal = false;
+    uint64_t delay;
+    uint64_t deadline;
+    uint64_t now;
+
+    if( attempt < i2c_policy.max_retries )
+    {
+        switch( err )
+        {
+            case ENXIO:
+            case EREMOTEIO:
+                delay = i2c_policy.busy_poll_us;
+                if( i2c_write_cycle_time > 0 && 
+                    delay > (uint64_t) i2c_write_cycle_time * 1000 )
+                {
+                    delay = (uint64_t) i2c_write_cycle_time * 1000;
+                }
+                retVal = true;
+                break;
+            case EAGAIN:
+            case EIO:
+            case ETIMEDOUT:
+            case EPROTO:
+                delay = (uint64_t) i2c_policy.backoff_us << attempt;
+                if( delay > (uint64_t) i2c_policy.backoff_max_us )
+                {
+                    delay = i2c_policy.backoff_max_us;
+                }
+                retVal = true;
+                break;
+            default:
+                // bad descriptor, unsupported, ... no use to repeat
+                delay = 0;
+                break;
+        }
+
+        if( retVal )
+        {
+            deadline = i2cGetDeadline();
+            now      = i2cMonotonicUs();
+
+            if( deadline != 0 && now + delay >= deadline )
+            {
+                i2c_deadline_missed = true;
+                I2C_STAT_ADD( i2c_stats.deadline_misses, 1 );
+                I2C_TRACE( I2C_TRACE_ERROR, I2C_EV_DEADLINE, 
+                           I2C_TRACE_DEV( i2c_bus, i2c_addr ), 0, attempt, 
+                           E_I2C_DEADLINE, 0 );
+                retVal = false;
+            }
+            else
+            {
+                I2C_STAT_ADD( i2c_stats.retries, 1 );
+                I2C_TRACE( I2C_TRACE_BUS, I2C_EV_RETRY, 
+                           I2C_TRACE_DEV( i2c_bus, i2c_addr ), err, attempt, 
+                           0, delay );
+                i2cSleepUntil( now + delay );
+            }
+        }
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * int i2cConnection::busFailure( void )
+ * ----------------------------------------------------
+ * error code for a failed transfer
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns E_I2C_DEADLINE if the deadline was the reason,
+ * E_I2C_FAIL otherwise
+ ***************************************************************************
+*/
+int i2cConnection::busFailure( void )
+{
+    I2C_TRACE( I2C_TRACE_ERROR, I2C_EV_FAIL, 
+               I2C_TRACE_DEV( i2c_bus, i2c_addr ), i2c_lastErrno, 0,
+               i2c_deadline_missed ? E_I2C_DEADLINE : E_I2C_FAIL, 0 );
+
+    return( i2c_deadline_missed ? E_I2C_DEADLINE : E_I2C_FAIL );
+}
+
+/*
+ ***************************************************************************
+ * void i2cConnection::busCount( int res, int err, int written, int read )
+ * ----------------------------------------------------
+ * count a transfer attempt with result res and errno err
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+void i2cConnection::busCount( int res, int err, int written, int read )
+{
+    I2C_STAT_ADD( i2c_stats.transactions, 1 );
+
+    if( res >= 0 )
+    {
+        I2C_STAT_ADD( i2c_stats.bytes_written, written );
+        I2C_STAT_ADD( i2c_stats.bytes_read, read );
+    }
+    else
+    {
+        if( err == ENXIO || err == EREMOTEIO )
+        {
+            I2C_STAT_ADD( i2c_stats.nacks, 1 );
+        }
+        else
+        {
+            I2C_STAT_ADD( i2c_stats.bus_errors, 1 );
+        }
+    }
+}
+
+/*
+ ***************************************************************************
+ * int i2cConnection::routeSelect( void )
+ * void i2cConnection::routeRelease( void )
+ * ----------------------------------------------------
+ * connect the mux channel of the slave before a transfer and
+ * let other connections of the bus switch it afterwards.
+ * Nothing to do for a slave without a route
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns 0 if the slave can be addressed, -1 with errno set
+ * if the mux failed
+ ***************************************************************************
+*/
+int i2cConnection::routeSelect( void )
+{
+    int retVal;
+    int writes;
+    int err = 0;
+
+    if( i2c_route.mux_type == I2C_MUX_NONE )
+    {
+        return( 0 );
+    }
+
+    if( (retVal = i2cMuxSelect( i2c_bus, i2c_devfd, i2c_simulated, 
+                                &i2c_route, &writes )) < 0 )
+    {
+        err = errno;
+    }
+
+    if( writes > 0 )
+    {
+        I2C_STAT_ADD( i2c_stats.ioctls, writes );
+        I2C_STAT_ADD( i2c_stats.mux_writes, writes );
+        I2C_TRACE( I2C_TRACE_BUS, I2C_EV_MUX, 
+                   I2C_TRACE_DEV( i2c_bus, i2c_addr ), i2c_route.mux_addr,
+                   i2c_route.channel, retVal < 0 ? -err : writes, 0 );
+    }
+
+    if( retVal < 0 )
+    {
+        errno = err;
+    }
+
+    return( retVal );
+}
+
+void i2cConnection::routeRelease( void )
+{
+    if( i2c_route.mux_type != I2C_MUX_NONE )
+    {
+        i2cMuxRelease( i2c_bus );
+    }
+}
+
+/*
+ ***************************************************************************
+ * void i2cConnection::pageWritten( uint64_t started )
+ * ----------------------------------------------------
+ * a page write started at started went out: start its write
+ * cycle and count it
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+void i2cConnection::pageWritten( uint64_t started )
+{
+    uint64_t now;
+
+    now = i2cMonotonicUs();
+
+    I2C_STAT_ADD( i2c_stats.page_writes, 1 );
+    i2c_hist[I2C_HIST_WRITE].record( now - started );
+
+    if( i2c_write_cycle_time > 0 )
+    {
+        i2c_busy_until = now + i2c_write_cycle_time * 1000;
+    }
+
+    i2c_program_start = started;
+
+    if( !i2c_policy.ack_polling )
+    {
+        i2c_hist[I2C_HIST_PROGRAM].record( 
+                (i2c_busy_until > now ? i2c_busy_until : now) - started );
+    }
+}
+
+/*
+ ***************************************************************************
+ * void i2cConnection::getStats( struct _i2c_conn_stats* pStats,
+ *                               struct _i2c_hist_summary* pLatency )
+ * ----------------------------------------------------
+ * copy the counters and, if pLatency is given, summarize the
+ * I2C_HIST_KINDS latency histograms into pLatency[]. May be
+ * called while another thread does transfers
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+void i2cConnection::getStats( struct _i2c_conn_stats* pStats,
+                              struct _i2c_hist_summary* pLatency )
+{
+    uint64_t* pSrc;
+    uint64_t* pDst;
+    size_t i;
+    int kind;
+
+    if( pStats != NULL )
+    {
+        pSrc = (uint64_t*) &i2c_stats;
+        pDst = (uint64_t*) pStats;
+
+        for( i = 0; i < sizeof(i2c_stats) / sizeof(uint64_t); i++ )
+        {
+            pDst[i] = __atomic_load_n( &pSrc[i], __ATOMIC_RELAXED );
+        }
+    }
+
+    if( pLatency != NULL )
+    {
+        for( kind = 0; kind < I2C_HIST_KINDS; kind++ )
+        {
+            i2c_hist[kind].summary( &pLatency[kind] );
+        }
+    }
+}
+
+/*
+ ***************************************************************************
+ * void i2cConnection::resetStats( void )
+ * ----------------------------------------------------
+ * zero counters and histograms
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+void i2cConnection::resetStats( void )
+{
+    uint64_t* pField;
+    size_t i;
+    int kind;
+
+    pField = (uint64_t*) &i2c_stats;
+
+    for( i = 0; i < sizeof(i2c_stats) / sizeof(uint64_t); i++ )
+    {
+        __atomic_store_n( &pField[i], 0, __ATOMIC_RELAXED );
+    }
+
+    // a reused connection of i2cPool.h mostly has nothing to forget
+    for( kind = 0; kind < I2C_HIST_KINDS; kind++ )
+    {
+        if( !i2c_hist[kind].isEmpty() )
+        {
+            i2c_hist[kind].reset();
+        }
+    }
+}
+
+/*
+ ***************************************************************************
+ * void i2cConnection::printStats( FILE* pOut )
+ * ----------------------------------------------------
+ * counters and histograms in readable form
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+void i2cConnection::printStats( FILE* pOut )
+{
+    struct _i2c_conn_stats stats;
+
+    getStats( &stats );
+
+    fprintf( pOut, "i2c-%d 0x%02x: %llu transactions, %llu bytes read, "
+             "%llu bytes written, %llu ioctls\n", i2c_bus, i2c_addr,
+             (unsigned long long) stats.transactions,
+             (unsigned long long) stats.bytes_read,
+             (unsigned long long) stats.bytes_written,
+             (unsigned long long) stats.ioctls );
+    fprintf( pOut, "    %llu page writes, %llu write cycle sleeps "
+             "(%llu us), %llu retries, %llu nacks, %llu bus errors, "
+             "%llu deadline misses\n",
+             (unsigned long long) stats.page_writes,
+             (unsigned long long) stats.wait_sleeps,
+             (unsigned long long) stats.wait_us,
+             (unsigned long long) stats.retries,
+             (unsigned long long) stats.nacks,
+             (unsigned long long) stats.bus_errors,
+             (unsigned long long) stats.deadline_misses );
+
+    if( i2c_route.mux_type != I2C_MUX_NONE )
+    {
+        fprintf( pOut, "    behind mux 0x%02x channel %d, %llu mux writes\n",
+                 i2c_route.mux_addr, i2c_route.channel,
+                 (unsigned long long) stats.mux_writes );
+    }
+
+    i2c_hist[I2C_HIST_READ].print( pOut, "read" );
+    i2c_hist[I2C_HIST_WRITE].print( pOut, "write" );
+    i2c_hist[I2C_HIST_PROGRAM].print( pOut, "program" );
+    i2c_hist[I2C_HIST_WAIT].print( pOut, "wait" );
+}
+
+/*
+ ***************************************************************************
+ * int i2cConnection::setRetryPolicy( const struct _i2c_retry_policy* pPolicy )
+ * ----------------------------------------------------
+ * use pPolicy for failed transfers, NULL for the defaults.
+ * The adapter settings are applied at once if connected
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns an errorcode, E_I2C_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cConnection::setRetryPolicy( const struct _i2c_retry_policy* pPolicy )
+{
+    int retVal = E_I2C_SUCCESS;
+
+    if( pPolicy == NULL )
+    {
+        i2cDefaultRetryPolicy( &i2c_policy );
+    }
+    else
+    {
+        i2c_policy = *pPolicy;
+    }
+
+    if( i2c_devfd > 0 && i2c_devfd != I2C_NULL_FD )
+    {
+        retVal = applyAdapterPolicy();
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * int i2cConnection::applyAdapterPolicy( void )
+ * ----------------------------------------------------
+ * pass timeout and retries of the policy to the adapter.
+ * Note both are per adapter, not per device
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns an errorcode, E_I2C_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cConnection::applyAdapterPolicy( void )
+{
+    int retVal = E_I2C_SUCCESS;
+    unsigned long timeout;
+
+    // I2C_TIMEOUT is in units of 10 ms
+    timeout = (i2c_policy.adapter_timeout_ms + 9) / 10;
+    if( timeout < 1 )
+    {
+        timeout = 1;
+    }
+
+    I2C_STAT_ADD( i2c_stats.ioctls, 2 );
+
+    if( !i2c_simulated &&
+        (ioctl( i2c_devfd, I2C_TIMEOUT, timeout ) < 0 ||
+         ioctl( i2c_devfd, I2C_RETRIES, 
+                (unsigned long) i2c_policy.adapter_retries ) < 0) )
+    {
+        i2c_lastErrno = errno;
+        retVal = E_I2C_IOCTL;
+    }
+
+    return( retVal );
+}
+
 /*
  ***************************************************************************
  * int i2cConnection::check4Magic( uint16_t* pMagic, uint16_t* pType )
@@ -867,23 +2017,52 @@ __FUNCTION__,__FILE__,__LINE__, fd, addr, (unsigned int) pBuffer, amount);
 int i2cConnection::check4Magic( uint16_t* pMagic, uint16_t* pType )
 {
     int retVal = E_I2C_SUCCESS;
-    uint8_t i2cId[I2C_MAX_BLOCK_LEN];
+    uint8_t i2cId[I2C_EEPROM_ID_LEN];
 
     uint16_t eeMagic;
     uint16_t eeType;
 
+    uint8_t cmd = 0x00;
+    struct i2c_msg msgs[2];
+
     __s32 res;
-    res = i2c_smbus_read_i2c_block_data( i2c_devfd, 0x00, 
-                                         I2C_MAX_BLOCK_LEN, i2cId );
+
+    if( i2c_simulated )
+    {
+        // what the SMBus block read sends: command byte, repeated
+        // start and the data
+        msgs[0].addr  = i2c_addr;
+        msgs[0].flags = 0;
+        msgs[0].len   = 1;
+        msgs[0].buf   = &cmd;
+        msgs[1].addr  = i2c_addr;
+        msgs[1].flags = I2C_M_RD;
+        msgs[1].len   = I2C_EEPROM_ID_LEN;
+        msgs[1].buf   = i2cId;
+
+        res = busTransfer( i2c_devfd, msgs, 2 ) == 2 ? I2C_EEPROM_ID_LEN : -1;
+    }
+    else
+    {
+        // page writes return before tWR, the chip NACKs until it is over
+        waitReady();
+
+        if( (res = routeSelect()) == 0 )
+        {
+            res = i2c_smbus_read_i2c_block_data( i2c_devfd, 0x00, 
+                                                 I2C_EEPROM_ID_LEN, i2cId );
+            routeRelease();
+        }
+    }
 
     if( res < 0 )
     {
-perror("i2c_smbus_read_i2c_block_data");
+I2C_DBG_ERRNO("i2c_smbus_read_i2c_block_data");
         i2c_lastErrno = retVal = E_I2C_FAIL;
     }
     else
     {
-        if( res == I2C_MAX_BLOCK_LEN )
+        if( res == I2C_EEPROM_ID_LEN )
         {
 #ifdef TALK_2_ME
             for(int i = 0; i < res; i++ )
@@ -894,7 +2073,7 @@ perror("i2c_smbus_read_i2c_block_data");
 
             getWordFromBuffer( &i2cId[0], &eeMagic );
             getWordFromBuffer( &i2cId[2], &eeType );
-fprintf(stderr, "Initial read returns %x as magic and %u as type\n", eeMagic, eeType);
+I2C_DBG("Initial read returns %x as magic and %u as type\n", eeMagic, eeType);
 
             if( isIdValid( eeMagic ) )
             {
@@ -916,7 +2095,7 @@ fprintf(stderr, "Initial read returns %x as magic and %u as type\n", eeMagic, ee
         }
         else
         {
-perror("i2c_smbus_read_i2c_block_data");
+I2C_DBG_ERRNO("i2c_smbus_read_i2c_block_data");
             i2c_lastErrno = retVal = E_I2C_FAIL;
         }
     }
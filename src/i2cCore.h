@@ -34,11 +34,23 @@
 #define I2CCORE_H
 
 #include <stdint.h>
+#include <string.h>
+#include <linux/i2c.h>
+
+#include "i2cHistogram.h"
+#include "i2cTrace.h"
+#include "i2cMux.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define I2C_HOST_BIG_ENDIAN       true
+#else
+#define I2C_HOST_BIG_ENDIAN       false
+#endif
+
 
 #define I2C_TRACE_IN(f)	fprintf(stderr, "Enter: %s -> file %s line %d\n", __FUNCTION__, __FILE__, __LINE__);
 #define I2C_TRACE_OUT(f,r)	fprintf(stderr, "Leave: %s -> file %s line %d [rc=%d]\n", __FUNCTION__, __FILE__, __LINE__, r);
@@ -63,7 +75,20 @@ extern "C" {
 #define E_I2C_EE_INVAL_ID          -17
 #define E_I2C_EE_NOTSUPPORTED      -18
 #define E_I2C_INVAL_BUFLEN         -19
-
+#define E_I2C_DEADLINE             -20
+#define E_I2C_LOCK                 -21
+
+
+// debug output, compiled in with -DI2C_DEBUG only, so the transfer
+// paths do not print
+#ifdef I2C_DEBUG
+#include <stdio.h>
+#define I2C_DBG(...)            fprintf(stderr, __VA_ARGS__)
+#define I2C_DBG_ERRNO(msg)      perror(msg)
+#else
+#define I2C_DBG(...)            do { } while( 0 )
+#define I2C_DBG_ERRNO(msg)      do { } while( 0 )
+#endif
 
 #define I2C_MAX_DEVNAME_LEN         30
 #define I2C_NULL_FD                 -1
@@ -73,6 +98,8 @@ extern "C" {
 #define I2C_16BIT_ADDRESS           16
 #define I2C_8BIT_ADDRESS             8
 #define I2C_MAX_BLOCK_LEN           32
+#define I2C_MAX_PAGE_LEN           256
+#define I2C_MAX_READ_LEN          4096
 
 // #define I2C_EE_MAGIC            0xf4e1
 #define I2C_EE_NO_MAGIC         0xffff
@@ -81,26 +108,121 @@ extern "C" {
 
 #define I2C_PROTOCOL_VERSION    0b00010000
 #define I2C_PROTOCOL_RELEASE    0b00000001
+#define I2C_PROTOCOL_RELEASE_V2 0b00000010
 #define I2C_LIBRARY_VERSION     0b00010000
 #define I2C_LIBRARY_RELEASE     0b00000001
 
 #define I2C_EE_MAGIC   ((I2C_PROTOCOL_VERSION|I2C_PROTOCOL_RELEASE)<< 8) |\
                         (I2C_LIBRARY_VERSION|I2C_LIBRARY_RELEASE)
 
+// header of release 2: magic, type, serial and generation, MSB first.
+// The generation is incremented before the contents change, see
+// i2cImage.h
+#define I2C_EE_MAGIC_V2 ((I2C_PROTOCOL_VERSION|I2C_PROTOCOL_RELEASE_V2)<< 8) |\
+                        (I2C_LIBRARY_VERSION|I2C_LIBRARY_RELEASE)
+
 #define I2C_EEPROM_ID_LEN           4
+#define I2C_EEPROM_ID_V2_LEN       12
+#define I2C_EEPROM_SERIAL_OFFSET    4
+#define I2C_EEPROM_GEN_OFFSET       8
+
+// default retry policy, see struct _i2c_retry_policy
+#define I2C_DEFAULT_MAX_RETRIES        3
+#define I2C_DEFAULT_BUSY_POLL_US     500
+#define I2C_DEFAULT_BACKOFF_US       200
+#define I2C_DEFAULT_BACKOFF_MAX_US  5000
+#define I2C_DEFAULT_ADAPTER_TIMEOUT_MS 500
+#define I2C_DEFAULT_BUS_KHZ          100
+
+// how failed transfers are repeated. A NACK means the chip is busy
+// with a write cycle we do not know of, it is polled again after
+// busy_poll_us. Other errors (arbitration lost, timeout) are bus
+// errors, retried after an exponential backoff. The adapter itself
+// gets adapter_timeout_ms as I2C_TIMEOUT and adapter_retries as
+// I2C_RETRIES; we classify and retry here, so the default is none.
+// With ack_polling the end of a write cycle is not waited for but
+// asked for: the chip is polled every busy_poll_us until it
+// acknowledges, at most for the write cycle time of the data sheet
+struct _i2c_retry_policy {
+    int max_retries;
+    int busy_poll_us;
+    int backoff_us;
+    int backoff_max_us;
+    int adapter_timeout_ms;
+    int adapter_retries;
+    bool ack_polling;
+};
+
+// counters of a connection, bumped with relaxed atomics on the
+// transfer path. All fields are uint64_t, see getStats()
+struct _i2c_conn_stats {
+    uint64_t transactions;     // read(), write() and I2C_RDWR attempts
+    uint64_t bytes_read;
+    uint64_t bytes_written;    // including the address bytes
+    uint64_t ioctls;
+    uint64_t page_writes;
+    uint64_t wait_sleeps;      // sleeps for a write cycle
+    uint64_t wait_us;
+    uint64_t retries;
+    uint64_t nacks;            // ENXIO, EREMOTEIO: nobody answered
+    uint64_t bus_errors;       // all other failed transfers
+    uint64_t deadline_misses;
+    uint64_t mux_writes;       // channel selections sent to a mux
+};
+
+#define I2C_STAT_ADD(field,n)   __atomic_fetch_add( &(field), (n), \
+                                                    __ATOMIC_RELAXED )
+
+// latency histograms of a connection
+#define I2C_HIST_READ               0   // readBuf(), incl. waiting
+#define I2C_HIST_WRITE              1   // one page write on the bus
+#define I2C_HIST_PROGRAM            2   // page write until chip ready
+#define I2C_HIST_WAIT               3   // sleeps for a write cycle
+#define I2C_HIST_KINDS              4
 
 
 bool isBigEndian();
 uint16_t makeMagic( void );
+uint16_t makeMagicV2( void );
+int i2cLastError( void );
+void i2cSetLastError( int err );
+uint64_t i2cMonotonicUs( void );
+void i2cSleepUntil( uint64_t untilUs );
+void i2cSetDeadline( uint64_t deadlineUs );
+uint64_t i2cGetDeadline( void );
+void i2cDefaultRetryPolicy( struct _i2c_retry_policy* pPolicy );
 bool isIdValid( uint16_t eeMagic );
 void getWordFromBuffer( uint8_t* pBuf, uint16_t* pWord );
+uint16_t i2cCrc16( const uint8_t* pData, int len, uint16_t crc = 0xffff );
 
 
+// last error of a connection. Assigning it also records the value as
+// last error of the calling thread, see i2cLastError()
+class i2cErrno {
+
+    public:
+        int value;
+
+        i2cErrno() { value = 0; }
+        i2cErrno& operator=( int err ) 
+        {
+            value = err;
+            i2cSetLastError( err );
+            return( *this );
+        }
+        operator int() const { return( value ); }
+};
+
 class i2cConnection {
 
     public:
         bool i2c_16bit_addressing;
         int  i2c_write_cycle_time;
+        int  i2c_page_size;
+        // end of the write cycle in progress, CLOCK_MONOTONIC in us
+        uint64_t i2c_busy_until;
+        // start of the last page write
+        uint64_t i2c_program_start;
         int  i2c_bus_frequency_1V8;
         int  i2c_bus_frequency_4V5;
 
@@ -113,7 +235,18 @@ class i2cConnection {
         int  i2c_addr;
         bool i2c_force;
         int  i2c_flags;
-        int  i2c_lastErrno;
+        // transfers go to a device of i2cSim.h, not to the adapter
+        bool i2c_simulated;
+        i2cErrno i2c_lastErrno;
+        // the slave is behind a mux channel, see i2cMux.h
+        struct _i2c_route i2c_route;
+
+        struct _i2c_retry_policy i2c_policy;
+        // set if the last transfer failed because of the deadline
+        bool i2c_deadline_missed;
+
+        struct _i2c_conn_stats i2c_stats;
+        i2cHistogram i2c_hist[I2C_HIST_KINDS];
 
 // -------------------
 
@@ -149,13 +282,110 @@ class i2cConnection {
         int writeBuf( int fd, uint16_t addr, uint8_t* pBuffer, int amount );
         int writeBuf( uint16_t addr, uint8_t* pBuffer, int amount );
 
+        void reuse( void );
+        int i2cSelect( int addr );
+        int probe( void );
         int i2cClose( void );
 
+        bool isBusy( void );
+        void waitReady( void );
+        int ackPoll( void );
+        void pageWritten( uint64_t started );
+
+        int setRetryPolicy( const struct _i2c_retry_policy* pPolicy );
+        int applyAdapterPolicy( void );
+        int busFailure( void );
+
+        void getStats( struct _i2c_conn_stats* pStats,
+                       struct _i2c_hist_summary* pLatency = NULL );
+        void resetStats( void );
+        void printStats( FILE* pOut );
+
+// low level bus access, every transfer goes through these
+        int busWrite( int fd, uint8_t* pData, int len );
+        int busRead( int fd, uint8_t* pData, int len );
+        int busTransfer( int fd, struct i2c_msg* pMsgs, int count );
+        int busReady( int len );
+        bool busRetry( int err, int attempt );
+        void busCount( int res, int err, int written, int read );
+        int routeSelect( void );
+        void routeRelease( void );
+
 };
 
 
 #ifdef __cplusplus
 }
+
+/*
+ * deadline of the operations of the calling thread for the lifetime
+ * of the object, e.g.
+ *
+ *     {
+ *         i2cDeadline within( 20 );
+ *         retVal = pDevice->eeReadWord( PARAM_ADDR, &value );
+ *     }
+ *
+ * fails with E_I2C_DEADLINE instead of a late answer. Nested
+ * deadlines never extend an outer one
+ */
+class i2cDeadline {
+
+    private:
+        uint64_t previous;
+
+    public:
+        i2cDeadline( uint32_t timeoutMs )
+        {
+            uint64_t deadline = i2cMonotonicUs() + (uint64_t) timeoutMs * 1000;
+
+            previous = i2cGetDeadline();
+            i2cSetDeadline( previous != 0 && previous < deadline ? 
+                            previous : deadline );
+        }
+        ~i2cDeadline() { i2cSetDeadline( previous ); }
+};
+
+/*
+ * byte swapping for values of N bytes, mapped to single
+ * instructions by the compiler
+ */
+template<int N> struct i2cByteSwap;
+
+template<> struct i2cByteSwap<1> {
+    static inline void apply( uint8_t* ) { }
+};
+
+template<> struct i2cByteSwap<2> {
+    static inline void apply( uint8_t* p ) {
+        uint16_t v; memcpy( &v, p, 2 ); v = __builtin_bswap16( v ); memcpy( p, &v, 2 );
+    }
+};
+
+template<> struct i2cByteSwap<4> {
+    static inline void apply( uint8_t* p ) {
+        uint32_t v; memcpy( &v, p, 4 ); v = __builtin_bswap32( v ); memcpy( p, &v, 4 );
+    }
+};
+
+template<> struct i2cByteSwap<8> {
+    static inline void apply( uint8_t* p ) {
+        uint64_t v; memcpy( &v, p, 8 ); v = __builtin_bswap64( v ); memcpy( p, &v, 8 );
+    }
+};
+
+/*
+ * convert between host and storage order, a no-op unless 
+ * doSwap is true. doSwap is decided at compile time
+ */
+template<bool doSwap, int N> struct i2cByteOrder {
+    static inline void fix( uint8_t* ) { }
+};
+
+template<int N> struct i2cByteOrder<true, N> {
+    static inline void fix( uint8_t* p ) { i2cByteSwap<N>::apply( p ); }
+};
+
 #endif
 
 #endif /* I2CCORE_H */
@@ -36,9 +36,171 @@
 #include <errno.h>
 #include <stdint.h>
 #include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include <vector>
+#include <algorithm>
 
 #include "i2cEEPROM.h"
 
+// priority class of the calling thread, see eeSetPriority()
+static __thread int eeThreadPriority = EE_PRIO_NORMAL;
+
+// a transfer handed to the real-time worker, lives on the stack
+// of the caller
+struct _ee_rt_transfer {
+    i2cConnection* pBus;
+    bool     write;
+    uint16_t addr;
+    uint8_t* pBuffer;
+    int      amount;
+};
+
+/*
+ ***************************************************************************
+ * static int eeRtTransfer( void* pArg )
+ * ----------------------------------------------------
+ * do the transfer described by pArg
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns an errorcode of i2cConnection, E_I2C_SUCCESS on success
+ ***************************************************************************
+*/
+static int eeRtTransfer( void* pArg )
+{
+    struct _ee_rt_transfer* pXfer = (struct _ee_rt_transfer*) pArg;
+    int retVal;
+
+    if( pXfer->write )
+    {
+        retVal = pXfer->pBus->writeBuf( pXfer->addr, pXfer->pBuffer, 
+                                        pXfer->amount );
+    }
+    else
+    {
+        retVal = pXfer->pBus->readBuf( pXfer->addr, pXfer->pBuffer, 
+                                       pXfer->amount );
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * static uint32_t eeGet32( const uint8_t* pBuf )
+ * static void eePut32( uint8_t* pBuf, uint32_t value )
+ * ----------------------------------------------------
+ * 32 bit values of the header, MSB first
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns the value resp. nothing
+ ***************************************************************************
+*/
+static uint32_t eeGet32( const uint8_t* pBuf )
+{
+    return( ((uint32_t) pBuf[0] << 24) | ((uint32_t) pBuf[1] << 16) |
+            ((uint32_t) pBuf[2] << 8) | (uint32_t) pBuf[3] );
+}
+
+static void eePut32( uint8_t* pBuf, uint32_t value )
+{
+    pBuf[0] = (value >> 24) & 0x00ff;
+    pBuf[1] = (value >> 16) & 0x00ff;
+    pBuf[2] = (value >> 8) & 0x00ff;
+    pBuf[3] = value & 0x00ff;
+}
+
+/*
+ ***************************************************************************
+ * static uint32_t eeNewSerial( void )
+ * ----------------------------------------------------
+ * serial number for a chip initialized for the first time
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns the serial
+ ***************************************************************************
+*/
+static uint32_t eeNewSerial( void )
+{
+    uint32_t retVal = 0;
+    FILE* pRandom;
+
+    if( (pRandom = fopen( "/dev/urandom", "rb" )) != NULL )
+    {
+        if( fread( &retVal, sizeof(retVal), 1, pRandom ) != 1 )
+        {
+            retVal = 0;
+        }
+        fclose( pRandom );
+    }
+
+    if( retVal == 0 )
+    {
+        retVal = (uint32_t) (i2cMonotonicUs() ^ ((uint64_t) time( NULL ) << 20) 
+                             ^ ((uint64_t) getpid() << 8));
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * known EEPROM types
+ ***************************************************************************
+*/
+static const struct _ee_type_info eeKnownTypes[] = {
+    { EE_TYPE_24AA65, EE_NAMES_24AA65, ADRESSING_16_BIT_24AA65,
+      WRITE_CYCLE_TIME_24AA65, BUS_FREQUENCY_1V8_24AA65,
+      BUS_FREQUENCY_4V5_24AA65, PAGE_SIZE_24AA65, TOTAL_PAGES_24AA65,
+      BLOCK_SIZE_24AA65 },
+    { EE_TYPE_24LC65, EE_NAMES_24LC65, ADRESSING_16_BIT_24LC65,
+      WRITE_CYCLE_TIME_24LC65, BUS_FREQUENCY_1V8_24LC65,
+      BUS_FREQUENCY_4V5_24LC65, PAGE_SIZE_24LC65, TOTAL_PAGES_24LC65,
+      BLOCK_SIZE_24LC65 },
+    { EE_TYPE_24C65, EE_NAMES_24C65, ADRESSING_16_BIT_24C65,
+      WRITE_CYCLE_TIME_24C65, BUS_FREQUENCY_1V8_24C65,
+      BUS_FREQUENCY_4V5_24C65, PAGE_SIZE_24C65, TOTAL_PAGES_24C65,
+      BLOCK_SIZE_24C65 },
+    { EE_TYPE_24C16, EE_NAMES_24C16, ADRESSING_16_BIT_24C16,
+      WRITE_CYCLE_TIME_24C16, BUS_FREQUENCY_1V8_24C16,
+      BUS_FREQUENCY_4V5_24C16, PAGE_SIZE_24C16, TOTAL_PAGES_24C16,
+      BLOCK_SIZE_24C16 },
+};
+
+/*
+ ***************************************************************************
+ * const struct _ee_type_info* eeTypeInfo( uint16_t type )
+ * ----------------------------------------------------
+ * look up geometry and timing of EEPROM type <type>
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns a pointer to the type info, NULL for unknown types
+ ***************************************************************************
+*/
+const struct _ee_type_info* eeTypeInfo( uint16_t type )
+{
+    const struct _ee_type_info* retVal = NULL;
+    size_t i;
+
+    for( i = 0; i < sizeof(eeKnownTypes) / sizeof(eeKnownTypes[0]); i++ )
+    {
+        if( eeKnownTypes[i].type == type )
+        {
+            retVal = &eeKnownTypes[i];
+            break;
+        }
+    }
+
+    return( retVal );
+}
+
 
 /*
  ***************************************************************************
@@ -56,6 +218,36 @@ i2cEEPROM::i2cEEPROM()
     pBus = (i2cConnection*) NULL;
     byte_offset = 0;
     autoInit = false;
+    gap_threshold = EE_DEFAULT_GAP_THRESHOLD;
+    pMirror = (i2cMirror*) NULL;
+    pRemote = (i2cRemote*) NULL;
+    use_daemon = true;
+    pTypeInfo = (const struct _ee_type_info*) NULL;
+    use_arbiter = false;
+    pArbiter = (i2cArbiter*) NULL;
+    ee_type = 0;
+    ee_page_size = 0;
+    ee_total_pages = 0;
+    ee_block_size = 0;
+    thread_safe = false;
+    cache_enabled = false;
+    cache_config.budget        = I2C_CACHE_DEFAULT_BUDGET;
+    cache_config.policy        = I2C_CACHE_DEFAULT_POLICY;
+    cache_config.readahead_max = I2C_CACHE_DEFAULT_READAHEAD;
+    ra_next = -1;
+    ra_window = 0;
+    hdr_state = EE_HDR_UNKNOWN;
+    hdr_serial = 0;
+    hdr_generation = 0;
+    gen_bumped = false;
+    bus_no = I2C_NULL_BUS;
+    slave_addr = I2C_NULL_ADDR;
+    image_enabled = false;
+    image_dir[0] = '\0';
+
+    memset( &counters, 0, sizeof(counters) );
+    pthread_rwlock_init( &state_lock, NULL );
+    pthread_rwlock_init( &cache_lock, NULL );
 }
 
 /*
@@ -71,135 +263,3965 @@ i2cEEPROM::i2cEEPROM()
 */
 i2cEEPROM::~i2cEEPROM()
 {
-    if( pBus != (i2cConnection*) NULL )
+    eeMirrorWithdraw();
+
+    eeLockState( false );
+    eeLockBus();
+    eeImageSave();
+    eeUnlockBus();
+    eeUnlockState();
+
+    if( pRemote != (i2cRemote*) NULL )
+    {
+        pRemote->flush();
+        delete pRemote;
+    }
+
+    i2cPoolRelease( pBus );
+
+    pthread_rwlock_destroy( &cache_lock );
+    pthread_rwlock_destroy( &state_lock );
+}
+
+/*
+ ***************************************************************************
+ * bool i2cEEPROM::eeConnected( void )
+ * ----------------------------------------------------
+ * whether the device is reachable, directly or through eepromd
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns true if connected
+ ***************************************************************************
+*/
+bool i2cEEPROM::eeConnected( void )
+{
+    return( pBus != (i2cConnection*) NULL || pRemote != (i2cRemote*) NULL );
+}
+
+/*
+ ***************************************************************************
+ * int i2cEEPROM::eeRawRead( uint16_t addr, uint8_t* pBuffer, int amount )
+ * ----------------------------------------------------
+ * read amount bytes at device address addr, header offset
+ * already applied. In the bulk class the read is done in
+ * quanta of EE_BULK_READ_QUANTUM bytes, the bus is released
+ * between them. The latency is counted for the class
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns an errorcode, E_EE_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cEEPROM::eeRawRead( uint16_t addr, uint8_t* pBuffer, int amount )
+{
+    int retVal;
+    int prio;
+    int chunk;
+    int total;
+    uint16_t firstAddr;
+    uint64_t started;
+
+    prio      = eeThreadPriority;
+    started   = i2cMonotonicUs();
+    firstAddr = addr;
+    total     = amount;
+
+    I2C_STAT_ADD( counters.reads, 1 );
+
+    if( prio == EE_PRIO_BULK && addr != I2C_CURRENT_ADDRESS && 
+        pBuffer != NULL )
+    {
+        retVal = E_EE_SUCCESS;
+
+        while( amount > 0 && retVal == E_EE_SUCCESS )
+        {
+            chunk = amount > EE_BULK_READ_QUANTUM ? EE_BULK_READ_QUANTUM : 
+                                                    amount;
+
+            retVal = eeReadQuantum( addr, pBuffer, chunk );
+
+            addr    += chunk;
+            pBuffer += chunk;
+            amount  -= chunk;
+        }
+    }
+    else
+    {
+        retVal = eeReadQuantum( addr, pBuffer, amount );
+    }
+
+    eeRecordLatency( prio, started );
+    I2C_TRACE( I2C_TRACE_OPS, I2C_EV_EE_READ, eeTraceDev(), firstAddr, total,
+               retVal, i2cMonotonicUs() - started );
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * int i2cEEPROM::eeReadQuantum( uint16_t addr, uint8_t* pBuffer, 
+ *                               int amount )
+ * ----------------------------------------------------
+ * read amount bytes at device address addr in one piece.
+ * Goes to the cache, the daemon or to the bus. With the cache
+ * a miss reads whole pages plus a readahead window, which
+ * doubles while the misses are sequential and halves with
+ * every random one
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns an errorcode, E_EE_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cEEPROM::eeReadQuantum( uint16_t addr, uint8_t* pBuffer, int amount )
+{
+    int retVal;
+    int start;
+    int end;
+    int limit;
+    int window;
+    int pageSize;
+    bool sequential;
+
+    eeLockState( false );
+
+    // heuristics only, a race between threads costs no correctness
+    sequential = __atomic_exchange_n( &ra_next, addr + amount, 
+                                      __ATOMIC_RELAXED ) == addr;
+
+    if( eeCacheLookup( addr, pBuffer, amount ) )
+    {
+        // served from memory, even while another thread waits for tWR
+        retVal = E_EE_SUCCESS;
+        I2C_STAT_ADD( counters.cache_hits, 1 );
+    }
+    else
+    {
+        if( cache_enabled )
+        {
+            I2C_STAT_ADD( counters.cache_misses, 1 );
+        }
+
+        if( (retVal = eeLockBusTimed()) != E_EE_SUCCESS )
+        {
+            eeUnlockState();
+            return( retVal );
+        }
+
+        // read whole pages, so the cache learns them - an untyped
+        // device has no page size yet and bypasses the cache anyway
+        pageSize = ee_page_size > 0 ? ee_page_size : 1;
+        start    = addr - (addr % pageSize);
+        end      = addr + amount;
+        end     += (pageSize - (end % pageSize)) % pageSize;
+
+        if( cache_enabled && cache.isConfigured() && ee_page_size > 0 && 
+            addr != I2C_CURRENT_ADDRESS && amount > 0 && pBuffer != NULL && 
+            addr + amount <= eeCapacity() && 
+            end - start <= (int) cache_read_buf.size() )
+        {
+            window = __atomic_load_n( &ra_window, __ATOMIC_RELAXED );
+
+            if( sequential )
+            {
+                window = window == 0 ? 1 : window * 2;
+                if( window > cache_config.readahead_max )
+                {
+                    window = cache_config.readahead_max;
+                }
+            }
+            else
+            {
+                window /= 2;
+            }
+
+            __atomic_store_n( &ra_window, window, __ATOMIC_RELAXED );
+
+            // not beyond the chip, not more than the cache holds
+            limit = start + (int) cache_read_buf.size();
+            if( limit > eeCapacity() )
+            {
+                limit = eeCapacity();
+            }
+
+            if( end + window * ee_page_size < limit )
+            {
+                limit = end + window * ee_page_size;
+            }
+
+            // cache_read_buf is as large as the cache, no allocation
+            if( (retVal = eeBusRead( start, cache_read_buf.data(), 
+                                     limit - start )) == E_EE_SUCCESS )
+            {
+                eeCacheStore( start, cache_read_buf.data(), limit - start );
+                memcpy( pBuffer, &cache_read_buf[addr - start], amount );
+                I2C_STAT_ADD( counters.readahead_bytes, limit - end );
+            }
+        }
+        else
+        {
+            // larger than the cache, it would only evict everything
+            retVal = eeBusRead( addr, pBuffer, amount );
+        }
+
+        eeUnlockBus();
+    }
+
+    eeUnlockState();
+
+    if( retVal == E_EE_SUCCESS && amount > 0 )
+    {
+        I2C_STAT_ADD( counters.bytes_read, amount );
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * int i2cEEPROM::eeBusRead( uint16_t addr, uint8_t* pBuffer, int amount )
+ * ----------------------------------------------------
+ * read amount bytes at device address addr from the daemon
+ * or the bus, no caching
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns an errorcode, E_EE_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cEEPROM::eeBusRead( uint16_t addr, uint8_t* pBuffer, int amount )
+{
+    int retVal;
+
+    if( pRemote != (i2cRemote*) NULL )
+    {
+        retVal = pRemote->read( addr, pBuffer, amount );
+    }
+    else
+    {
+        if( pBus != (i2cConnection*) NULL )
+        {
+            if( pArbiter != (i2cArbiter*) NULL )
+            {
+                retVal = eeArbitrated( [=]() { 
+                    return( pBus->readBuf( addr, pBuffer, amount ) ); } );
+            }
+            else
+            {
+                retVal = eeTransfer( false, addr, pBuffer, amount );
+            }
+        }
+        else
+        {
+            retVal = E_EE_NO_CONNECTION;
+        }
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * int i2cEEPROM::eeBusWrite( uint16_t addr, uint8_t* pBuffer, int amount )
+ * ----------------------------------------------------
+ * write amount bytes to device address addr through the daemon
+ * or to the bus, cache and mirror are not touched
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns an errorcode, E_EE_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cEEPROM::eeBusWrite( uint16_t addr, uint8_t* pBuffer, int amount )
+{
+    int retVal;
+
+    if( pRemote != (i2cRemote*) NULL )
+    {
+        retVal = pRemote->write( addr, pBuffer, amount );
+    }
+    else
+    {
+        if( pBus != (i2cConnection*) NULL )
+        {
+            if( pArbiter != (i2cArbiter*) NULL )
+            {
+                retVal = eeArbitrated( [=]() { 
+                    int opRet = pBus->writeBuf( addr, pBuffer, amount );
+
+                    // other processes do not know when the chip is
+                    // ready again, keep the adapter until it is
+                    pBus->waitReady();
+
+                    return( opRet ); } );
+            }
+            else
+            {
+                retVal = eeTransfer( true, addr, pBuffer, amount );
+            }
+        }
+        else
+        {
+            retVal = E_EE_NO_CONNECTION;
+        }
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * int i2cEEPROM::eeTransfer( bool write, uint16_t addr, 
+ *                            uint8_t* pBuffer, int amount )
+ * ----------------------------------------------------
+ * one transfer on the bus without arbitration. In real-time
+ * mode it is done by the worker, else by the caller
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns an errorcode, E_EE_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cEEPROM::eeTransfer( bool write, uint16_t addr, uint8_t* pBuffer, 
+                           int amount )
+{
+    struct _ee_rt_transfer xfer;
+
+    xfer.pBus    = pBus;
+    xfer.write   = write;
+    xfer.addr    = addr;
+    xfer.pBuffer = pBuffer;
+    xfer.amount  = amount;
+
+    return( rt_worker.run( eeRtTransfer, &xfer ) );
+}
+
+/*
+ ***************************************************************************
+ * int i2cEEPROM::eeArbitrated( std::function<int(void)> op )
+ * ----------------------------------------------------
+ * run a bus operation under the adapter lock if arbitration
+ * is on. op may be run by another thread of the process, it
+ * must not take any of our locks
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns the result of op
+ ***************************************************************************
+*/
+int i2cEEPROM::eeArbitrated( std::function<int(void)> op )
+{
+    int retVal;
+
+    if( pArbiter != (i2cArbiter*) NULL )
+    {
+        retVal = pArbiter->run( op );
+    }
+    else
     {
-        pBus->i2cClose();
-        delete pBus;
+        retVal = op();
     }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * int i2cEEPROM::eeRawWrite( uint16_t addr, uint8_t* pBuffer, int amount )
+ * ----------------------------------------------------
+ * write amount bytes to device address addr, header offset
+ * already applied. In the bulk class every page is a quantum
+ * of its own, the bus is released after each page program.
+ * The latency is counted for the class
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns an errorcode, E_EE_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cEEPROM::eeRawWrite( uint16_t addr, uint8_t* pBuffer, int amount )
+{
+    int retVal;
+    int prio;
+    int chunk;
+    int pageSize;
+    int total;
+    uint16_t firstAddr;
+    uint64_t started;
+
+    prio      = eeThreadPriority;
+    started   = i2cMonotonicUs();
+    pageSize  = ee_page_size > 0 ? ee_page_size : 1;
+    firstAddr = addr;
+    total     = amount;
+
+    I2C_STAT_ADD( counters.writes, 1 );
+
+    if( prio == EE_PRIO_BULK && addr != I2C_CURRENT_ADDRESS && 
+        pBuffer != NULL )
+    {
+        retVal = E_EE_SUCCESS;
+
+        while( amount > 0 && retVal == E_EE_SUCCESS )
+        {
+            chunk = pageSize - (addr % pageSize);
+            if( chunk > amount )
+            {
+                chunk = amount;
+            }
+
+            retVal = eeWriteQuantum( addr, pBuffer, chunk );
+
+            addr    += chunk;
+            pBuffer += chunk;
+            amount  -= chunk;
+        }
+    }
+    else
+    {
+        retVal = eeWriteQuantum( addr, pBuffer, amount );
+    }
+
+    eeRecordLatency( prio, started );
+    I2C_TRACE( I2C_TRACE_OPS, I2C_EV_EE_WRITE, eeTraceDev(), firstAddr, 
+               total, retVal, i2cMonotonicUs() - started );
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * int i2cEEPROM::eeWriteQuantum( uint16_t addr, uint8_t* pBuffer, 
+ *                                int amount )
+ * ----------------------------------------------------
+ * write amount bytes to device address addr in one piece.
+ * Goes to the daemon or to the bus
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns an errorcode, E_EE_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cEEPROM::eeWriteQuantum( uint16_t addr, uint8_t* pBuffer, int amount )
+{
+    int retVal;
+
+    eeLockState( false );
+
+    if( (retVal = eeLockBusTimed()) != E_EE_SUCCESS )
+    {
+        eeUnlockState();
+        return( retVal );
+    }
+
+    if( (retVal = eeGenerationBump()) == E_EE_SUCCESS &&
+        (retVal = eeBusWrite( addr, pBuffer, amount )) == E_EE_SUCCESS )
+    {
+        eeCacheStore( addr, pBuffer, amount );
+        eeMirrorUpdate( addr, pBuffer, amount );
+        I2C_STAT_ADD( counters.bytes_written, amount );
+    }
+
+    eeUnlockBus();
+    eeUnlockState();
+
+    return( retVal );
+}
+
+
+/*
+ ***************************************************************************
+ * int i2cEEPROM::eeInit( void )
+ * ----------------------------------------------------
+ * initialize EEPROM with params set
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns an errorcode, E_I2C_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cEEPROM::eeInit( void )
+{
+    int retVal;
+    int hdrLen;
+    uint16_t magic;
+    uint8_t hdr[I2C_EEPROM_ID_V2_LEN];
+
+    if( eeConnected() )
+    {
+        if( eeBusRead( 0, hdr, sizeof(hdr) ) != E_EE_SUCCESS )
+        {
+            memset( hdr, 0xff, sizeof(hdr) );
+        }
+
+        getWordFromBuffer( &hdr[0], &magic );
+
+        // a chip of release 1 keeps its layout, so its data does not
+        // move. One of release 2 keeps its serial and gets a new
+        // generation, a new chip gets a serial
+        if( magic == makeMagic() )
+        {
+            hdrLen = EE_PRIVATE_HDR_LEN;
+        }
+        else
+        {
+            hdrLen = EE_PRIVATE_HDR_V2_LEN;
+
+            if( magic == makeMagicV2() )
+            {
+                hdr_serial     = eeGet32( &hdr[I2C_EEPROM_SERIAL_OFFSET] );
+                hdr_generation = eeGet32( &hdr[I2C_EEPROM_GEN_OFFSET] ) + 1;
+            }
+            else
+            {
+                hdr_serial     = eeNewSerial();
+                hdr_generation = 0;
+            }
+
+            magic = makeMagicV2();
+            eePut32( &hdr[I2C_EEPROM_SERIAL_OFFSET], hdr_serial );
+            eePut32( &hdr[I2C_EEPROM_GEN_OFFSET], hdr_generation );
+        }
+
+        // magic and type MSB first, same layout as i2cConnection::initID()
+        hdr[0] = (magic >> 8) & 0x00ff;
+        hdr[1] = magic & 0x00ff;
+        hdr[2] = (ee_type >> 8) & 0x00ff;
+        hdr[3] = ee_type & 0x00ff;
+
+        // the header carries its own generation
+        gen_bumped = true;
+
+        if( (retVal = eeRawWrite( 0, hdr, hdrLen )) == E_I2C_SUCCESS )
+        {
+            byte_offset = hdrLen;
+            autoInit = false;
+            hdr_state = hdrLen == EE_PRIVATE_HDR_LEN ? EE_HDR_V1 : EE_HDR_V2;
+
+            if( pMirror != (i2cMirror*) NULL )
+            {
+                pMirror->setDataOffset( byte_offset );
+            }
+        }
+        else
+        {
+            hdr_state  = EE_HDR_UNKNOWN;
+            gen_bumped = false;
+        }
+    }
+    else
+    {
+        retVal = E_I2C_FAIL;
+    }
+
+    return( retVal );
+}
+
+
+/*
+ ***************************************************************************
+ * void i2cEEPROM::eeClose( void )
+ * ----------------------------------------------------
+ * close handle to i2c device
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+void i2cEEPROM::eeClose( void )
+{
+    eeMirrorWithdraw();
+    recorder.stop();
+
+    eeLockState( false );
+    eeLockBus();
+    eeImageSave();
+    hdr_state  = EE_HDR_UNKNOWN;
+    gen_bumped = false;
+    eeUnlockBus();
+    eeUnlockState();
+
+    if( pRemote != (i2cRemote*) NULL )
+    {
+        pRemote->flush();
+        delete pRemote;
+        pRemote = (i2cRemote*) NULL;
+    }
+
+    // the connection stays open in the pool for a while
+    i2cPoolRelease( pBus );
+    pBus = (i2cConnection*) NULL;
+
+    pArbiter = (i2cArbiter*) NULL;
+}
+
+/*
+ ***************************************************************************
+ * void i2cEEPROM::eeSetDaemonUse( bool useDaemon )
+ * ----------------------------------------------------
+ * whether eeOpen() may go through eepromd. Default is true,
+ * the daemon itself of course turns it off. Setting the
+ * environment variable EEPROMD_DISABLE does the same for
+ * a whole process
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+void i2cEEPROM::eeSetDaemonUse( bool useDaemon )
+{
+    use_daemon = useDaemon;
+}
+
+/*
+ ***************************************************************************
+ * bool i2cEEPROM::eeIsRemote( void )
+ * ----------------------------------------------------
+ * whether the device is accessed through eepromd
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns true for daemon access, false for direct access
+ ***************************************************************************
+*/
+bool i2cEEPROM::eeIsRemote( void )
+{
+    return( pRemote != (i2cRemote*) NULL );
+}
+
+/*
+ ***************************************************************************
+ * int i2cEEPROM::eeFlush( void )
+ * ----------------------------------------------------
+ * wait until all writes are programmed. A direct write returns
+ * while the chip still programs its last page, through eepromd
+ * writes may still be collected in the daemon.
+ * This commits the writes: the host image is saved and the next
+ * write increments the generation again
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns an errorcode, E_EE_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cEEPROM::eeFlush( void )
+{
+    int retVal = E_EE_SUCCESS;
+
+    if( pRemote != (i2cRemote*) NULL )
+    {
+        retVal = pRemote->flush();
+    }
+    else
+    {
+        if( pBus == (i2cConnection*) NULL )
+        {
+            retVal = E_EE_NO_CONNECTION;
+        }
+        else
+        {
+            eeLockState( false );
+            eeLockBus();
+            pBus->waitReady();
+
+            if( gen_bumped )
+            {
+                eeImageSave();
+                gen_bumped = false;
+            }
+
+            eeUnlockBus();
+            eeUnlockState();
+        }
+    }
+
+    eeRecordCall( EE_REC_FLUSH, 0, 0, retVal );
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * int i2cEEPROM::eeOpen( int busNo, int slaveAddr )
+ * int i2cEEPROM::eeOpen( int busNo, int slaveAddr, 
+ *                        const struct _i2c_route* pRoute )
+ * ----------------------------------------------------
+ * open handle to an i2c device, behind the mux channel of
+ * pRoute if given. If eepromd is running the device is
+ * accessed through the daemon, otherwise directly. The
+ * daemon knows no muxes, a device behind one is always
+ * accessed directly
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns E_EE_SUCCESS or an error code
+ ***************************************************************************
+*/
+int i2cEEPROM::eeOpen( int busNo, int slaveAddr )
+{
+    return( eeOpen( busNo, slaveAddr, NULL ) );
+}
+
+int i2cEEPROM::eeOpen( int busNo, int slaveAddr, 
+                       const struct _i2c_route* pRoute )
+{
+    int retVal;
+
+    if( !i2cMuxRouteValid( pRoute ) )
+    {
+        return( E_EE_INVAL_PARAM );
+    }
+
+    eeClose();
+
+    bus_no     = busNo;
+    slave_addr = slaveAddr;
+
+    if( use_daemon && getenv( EEPROMD_DISABLE_ENV ) == NULL &&
+        i2cMuxSameRoute( pRoute, NULL ) )
+    {
+        if( (pRemote = new i2cRemote()) != NULL )
+        {
+            if( pRemote->connect( busNo, slaveAddr ) == E_REMOTE_SUCCESS )
+            {
+                if( pTypeInfo != NULL )
+                {
+                    pRemote->typeSet( ee_type );
+                }
+                eeRecordEnv( busNo, slaveAddr );
+                return( E_EE_SUCCESS );
+            }
+
+            // no daemon, fall back to direct access
+            delete pRemote;
+            pRemote = (i2cRemote*) NULL;
+        }
+    }
+
+    // an idle connection to this device or a new one, see i2cPool.h.
+    // retVal is the result of opening it
+    if( (pBus = i2cPoolAcquire( busNo, slaveAddr, &retVal, pRoute )) != NULL )
+    {
+        if( use_arbiter )
+        {
+            pArbiter = i2cArbiter::forBus( busNo );
+        }
+
+        if( pTypeInfo != NULL )
+        {
+            eeTypeSet( ee_type );
+        }
+
+        eeRecordEnv( busNo, slaveAddr );
+    }
+
+    return( retVal );
+}
+
+
+/*
+ ***************************************************************************
+ * int i2cEEPROM::eeTypeDetect( uint16_t* pMagic, uint16_t* pType )
+ * ----------------------------------------------------
+ * try to get info from EEPROM
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns an errorcode, E_I2C_SUCCESS on success
+ * the values pointed by pMagic and pType will contain the
+ * detected magic and EEPROM type in case of success
+ ***************************************************************************
+*/
+int i2cEEPROM::eeTypeDetect( uint16_t* pMagic, uint16_t* pType )
+{
+    int retVal;
+
+    if( eeConnected() )
+    {
+        if( pMagic == NULL || pType == NULL )
+        {
+            retVal = E_EE_DATA_NULLP;
+        }
+        else
+        {
+            if( pRemote != (i2cRemote*) NULL )
+            {
+                retVal = pRemote->typeDetect( pMagic, pType );
+            }
+            else
+            {
+                retVal = eeArbitrated( [=]() {
+                    return( pBus->check4Magic( pMagic, pType ) ); } );
+            }
+        }
+    }
+    else
+    {
+        retVal = E_EE_NO_CONNECTION;
+
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * int i2cEEPROM::eeTypeSet( uint16_t type )
+ * ----------------------------------------------------
+ * initialize internal data to match EEPROM type <type>
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns an errorcode, E_I2C_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cEEPROM::eeTypeSet( uint16_t type )
+{
+    int retVal;
+    const struct _ee_type_info* pInfo;
+
+    if( eeConnected() )
+    {
+        if( (pInfo = eeTypeInfo( type )) != NULL )
+        {
+I2C_DBG("Set EEPROM type to %s\n", pInfo->name);
+            eeLockState( true );
+
+            if( pInfo != pTypeInfo )
+            {
+                // the geometry changes, forget what is cached
+                cache.release();
+            }
+
+            pTypeInfo      = pInfo;
+            ee_type        = type;
+            ee_page_size   = pInfo->page_size;
+            ee_total_pages = pInfo->total_pages;
+            ee_block_size  = pInfo->block_size;
+
+            recorder.setGeometry( type, ee_page_size, 
+                                  ee_page_size * ee_total_pages );
+
+            if( pBus != (i2cConnection*) NULL )
+            {
+                pBus->i2c_16bit_addressing  = pInfo->addressing_16_bit;
+                pBus->i2c_page_size         = pInfo->page_size;
+                pBus->i2c_write_cycle_time  = pInfo->write_cycle_time;
+                pBus->i2c_bus_frequency_1V8 = pInfo->bus_frequency_1V8;
+                pBus->i2c_bus_frequency_4V5 = pInfo->bus_frequency_4V5;
+                retVal = E_EE_SUCCESS;
+            }
+            else
+            {
+                retVal = pRemote->typeSet( type );
+            }
+
+            if( cache_enabled && !cache.isConfigured() )
+            {
+                eeCacheSetup();
+            }
+
+            eeUnlockState();
+
+            if( retVal == E_EE_SUCCESS && image_enabled )
+            {
+                eeImageLoad();
+            }
+        }
+        else
+        {
+fprintf(stderr, "EEPROM type %4x INVALID!\n", type);
+            retVal = E_EE_INVAL_TYPE;
+        }
+    }
+    else
+    {
+        retVal = E_I2C_FAIL;
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * void i2cEEPROM::eeInfo( void )
+ * ----------------------------------------------------
+ * print geometry and timing of the current EEPROM type
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+void i2cEEPROM::eeInfo( void )
+{
+    if( pTypeInfo != NULL )
+    {
+fprintf(stderr, "EEPROM type %s\n", pTypeInfo->name);
+        fprintf(stderr, "Type ....,,.......: %4d\n", ee_type );
+        fprintf(stderr, "Page size ........: %4d byte\n", ee_page_size );
+        fprintf(stderr, "Total pages ......: %4d\n", ee_total_pages );
+        fprintf(stderr, "Block size .......: %4d byte\n", ee_block_size );
+
+        fprintf(stderr, "Addressing .......: %4d bit\n",
+                pTypeInfo->addressing_16_bit == true ? 16 : 8 );
+
+        fprintf(stderr, "Write cycle time .: %4d ms\n",
+                         pTypeInfo->write_cycle_time );
+        fprintf(stderr, "Bus frequency 1V8 : %4d kHz\n",
+                         pTypeInfo->bus_frequency_1V8 );
+        fprintf(stderr, "Bus frequency 4V5 : %4d kHz\n",
+                         pTypeInfo->bus_frequency_4V5 );
+        fprintf(stderr, "Access ...........: %s\n",
+                         pRemote != NULL ? "eepromd" : "direct" );
+    }
+    else
+    {
+fprintf(stderr, "INVALID EEPROM type %4x!\n", ee_type);
+    }
+}
+
+/*
+ ***************************************************************************
+ * int i2cEEPROM::eeRead( uint8_t* pBuffer, int amount, uint16_t addr )
+ * ----------------------------------------------------
+ * read amount of bytes from address addr into buffer pointed by pBuffer
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns an errorcode, E_I2C_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cEEPROM::eeRead( uint16_t addr, uint8_t* pBuffer, int amount )
+{
+    int retVal = 0;
+
+    if( eeConnected() )
+    {
+        if( addr != I2C_CURRENT_ADDRESS )
+        {
+            addr += byte_offset;
+        }
+
+        retVal = eeRawRead( addr, pBuffer, amount );
+        eeRecordCall( EE_REC_READ, addr, amount, retVal );
+    }
+    else
+    {
+        retVal = E_I2C_FAIL;
+    }
+
+    return( retVal );
+}
+
+
+int i2cEEPROM::eeReadByte( uint16_t addr, uint8_t* pByteValue )
+{
+    int retVal = 0;
+
+    if( eeConnected() )
+    {
+        if( addr != I2C_CURRENT_ADDRESS )
+        {
+            addr += byte_offset;
+        }
+
+        retVal = eeRawRead( addr, pByteValue, 1 );
+        eeRecordCall( EE_REC_READ_BYTE, addr, 1, retVal );
+    }
+    else
+    {
+        retVal = E_I2C_FAIL;
+    }
+
+    return( retVal );
+}
+
+int i2cEEPROM::eeReadWord( uint16_t addr, uint16_t* pWordValue )
+{
+    int retVal = 0;
+    uint8_t wordBuf[2];
+
+    if( eeConnected() )
+    {
+        if( addr != I2C_CURRENT_ADDRESS )
+        {
+            addr += byte_offset;
+        }
+
+        if( pWordValue == NULL )
+        {
+            retVal = E_EE_DATA_NULLP;
+        }
+        else
+        {
+            if( (retVal = eeRawRead( addr, wordBuf, 2 )) == E_EE_SUCCESS )
+            {
+                getWordFromBuffer( wordBuf, pWordValue );
+            }
+
+            eeRecordCall( EE_REC_READ_WORD, addr, 2, retVal );
+        }
+    }
+    else
+    {
+        retVal = E_I2C_FAIL;
+    }
+
+    return( retVal );
+}
+
+
+/*
+ ***************************************************************************
+ * int i2cEEPROM::eeWrite( uint8_t* pBuffer, int amount, uint16_t addr )
+ * ----------------------------------------------------
+ * write amount of bytes pointed by pBuffer to address addr
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns an errorcode, E_I2C_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cEEPROM::eeWrite( uint16_t addr, uint8_t* pBuffer, int amount )
+{
+    int retVal = 0;
+
+    if( eeConnected() )
+    {
+        if( addr != I2C_CURRENT_ADDRESS )
+        {
+            addr += byte_offset;
+        }
+
+        retVal = eeRawWrite( addr, pBuffer, amount );
+        eeRecordCall( EE_REC_WRITE, addr, amount, retVal );
+    }
+    else
+    {
+        retVal = E_I2C_FAIL;
+    }
+    return( retVal );
+}
+
+int i2cEEPROM::eeWriteByte( uint16_t addr, uint8_t byteValue )
+{
+    int retVal = 0;
+
+    if( eeConnected() )
+    {
+        if( addr != I2C_CURRENT_ADDRESS )
+        {
+            addr += byte_offset;
+        }
+
+        retVal = eeRawWrite( addr, &byteValue, 1 );
+        eeRecordCall( EE_REC_WRITE_BYTE, addr, 1, retVal );
+    }
+    else
+    {
+        retVal = E_I2C_FAIL;
+    }
+    return( retVal );
+}
+
+int i2cEEPROM::eeWriteWord( uint16_t addr, uint16_t wordValue )
+{
+    int retVal = 0;
+    uint8_t wordBuf[2];
+
+    if( eeConnected() )
+    {
+        if( addr != I2C_CURRENT_ADDRESS )
+        {
+            addr += byte_offset;
+        }
+
+        // MSB first, like i2cConnection::writeWord()
+        wordBuf[0] = (wordValue >> 8) & 0x00ff;
+        wordBuf[1] = wordValue & 0x00ff;
+
+        retVal = eeRawWrite( addr, wordBuf, 2 );
+        eeRecordCall( EE_REC_WRITE_WORD, addr, 2, retVal );
+    }
+    else
+    {
+        retVal = E_I2C_FAIL;
+    }
+    return( retVal );
+}
+
+
+/*
+ ***************************************************************************
+ * struct _ee_span
+ * ----------------------------------------------------
+ * a merged range of device addresses [start, end) and the
+ * positions [first, last] of its members in the sorted order
+ ***************************************************************************
+*/
+struct _ee_span {
+    int start;
+    int end;
+    int first;
+    int last;
+};
+
+/*
+ ***************************************************************************
+ * static int eeCoalesce( ... )
+ * ----------------------------------------------------
+ * sort a scatter/gather list by device address and merge
+ * ranges that overlap, touch or are at most gap bytes apart.
+ * For writes, ranges starting in the page the current span
+ * ends in are merged as well, since that page is programmed
+ * anyway.
+ * ----------------------------------------------------
+ * pVec     : the list as given by the caller
+ * count    : number of elements in pVec
+ * offset   : byte offset to add to each address
+ * capacity : size of the chip, nothing is accepted for 0
+ * gap      : largest hole that is read instead of splitting
+ * pageSize : page size for writes, 0 for reads
+ * order    : receives the indices of pVec sorted by address
+ * spans    : receives the merged ranges
+ * ----------------------------------------------------
+ * returns an errorcode, E_EE_SUCCESS on success
+ ***************************************************************************
+*/
+static int eeCoalesce( struct eeIoVec* pVec, int count, int offset, 
+                       int capacity, int gap, int pageSize, 
+                       std::vector<int>& order,
+                       std::vector<struct _ee_span>& spans )
+{
+    int retVal = E_EE_SUCCESS;
+    int i;
+    int start;
+    int end;
+    struct _ee_span span;
+
+    if( pVec == (struct eeIoVec*) NULL || count <= 0 )
+    {
+        return( E_EE_DATA_NULLP );
+    }
+
+    for( i = 0; i < count && retVal == E_EE_SUCCESS; i++ )
+    {
+        if( pVec[i].pBuffer == (uint8_t*) NULL )
+        {
+            retVal = E_EE_DATA_NULLP;
+        }
+        else
+        {
+            if( pVec[i].amount <= 0 ||
+                pVec[i].addr == I2C_CURRENT_ADDRESS ||
+                pVec[i].addr + offset + pVec[i].amount > capacity )
+            {
+                retVal = E_EE_INVAL_PARAM;
+            }
+        }
+    }
+
+    if( retVal == E_EE_SUCCESS )
+    {
+        order.resize( count );
+        for( i = 0; i < count; i++ )
+        {
+            order[i] = i;
+        }
+
+        // stable, so overlapping writes keep the order given by the caller
+        std::stable_sort( order.begin(), order.end(),
+                          [pVec]( int a, int b )
+                          { return( pVec[a].addr < pVec[b].addr ); } );
+
+        spans.clear();
+
+        for( i = 0; i < count; i++ )
+        {
+            start = pVec[order[i]].addr + offset;
+            end   = start + pVec[order[i]].amount;
+
+            if( i > 0 && 
+                ( start <= spans.back().end + gap ||
+                  ( pageSize > 0 &&
+                    start / pageSize == (spans.back().end - 1) / pageSize ) ) )
+            {
+                if( end > spans.back().end )
+                {
+                    spans.back().end = end;
+                }
+                spans.back().last = i;
+            }
+            else
+            {
+                span.start = start;
+                span.end   = end;
+                span.first = i;
+                span.last  = i;
+                spans.push_back( span );
+            }
+        }
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * int i2cEEPROM::eeSetGapThreshold( int gap )
+ * ----------------------------------------------------
+ * set the largest hole between two ranges of a scatter/gather
+ * list that is transferred instead of starting a new transfer
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns an errorcode, E_EE_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cEEPROM::eeSetGapThreshold( int gap )
+{
+    int retVal;
+
+    if( gap >= 0 )
+    {
+        gap_threshold = gap;
+        retVal = E_EE_SUCCESS;
+    }
+    else
+    {
+        retVal = E_EE_INVAL_PARAM;
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * int i2cEEPROM::eeReadV( struct eeIoVec* pVec, int count )
+ * ----------------------------------------------------
+ * read count ranges described by pVec. Ranges are sorted and
+ * merged, so nearby fields cost one sequential read
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns an errorcode, E_EE_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cEEPROM::eeReadV( struct eeIoVec* pVec, int count )
+{
+    int retVal;
+    size_t spanNo;
+    int i;
+    std::vector<int> order;
+    std::vector<struct _ee_span> spans;
+    std::vector<uint8_t> spanBuf;
+    struct eeIoVec* pElem;
+
+    if( eeConnected() )
+    {
+        if( (retVal = eeCoalesce( pVec, count, byte_offset, eeCapacity(),
+                                  gap_threshold, 0, order, spans )) == 
+            E_EE_SUCCESS )
+        {
+            for( spanNo = 0; spanNo < spans.size() && 
+                             retVal == E_EE_SUCCESS; spanNo++ )
+            {
+                spanBuf.resize( spans[spanNo].end - spans[spanNo].start );
+
+                if( (retVal = eeRawRead( spans[spanNo].start, 
+                                         spanBuf.data(), 
+                                         spanBuf.size() )) == 
+                    E_I2C_SUCCESS )
+                {
+                    for( i = spans[spanNo].first; i <= spans[spanNo].last; i++ )
+                    {
+                        pElem = &pVec[order[i]];
+                        memcpy( pElem->pBuffer, 
+                                &spanBuf[pElem->addr + byte_offset - 
+                                         spans[spanNo].start],
+                                pElem->amount );
+                    }
+                }
+            }
+        }
+
+        for( i = 0; i < count && pVec != NULL; i++ )
+        {
+            eeRecordCall( EE_REC_READV, pVec[i].addr + byte_offset, 
+                          pVec[i].amount, retVal,
+                          i == count - 1 ? EE_REC_FLAG_LAST : 0 );
+        }
+    }
+    else
+    {
+        retVal = E_I2C_FAIL;
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * int i2cEEPROM::eeWriteV( struct eeIoVec* pVec, int count )
+ * ----------------------------------------------------
+ * write count ranges described by pVec. Ranges are sorted and
+ * merged, holes inside a merged range are read back first, so
+ * an update of several fields in one page costs one page write.
+ * Where ranges overlap, the later element of pVec wins
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns an errorcode, E_EE_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cEEPROM::eeWriteV( struct eeIoVec* pVec, int count )
+{
+    int retVal;
+    size_t spanNo;
+    int i;
+    int covered;
+    bool hasHoles;
+    std::vector<int> order;
+    std::vector<int> members;
+    std::vector<struct _ee_span> spans;
+    std::vector<uint8_t> spanBuf;
+    struct eeIoVec* pElem;
+
+    if( eeConnected() )
+    {
+        I2C_STAT_ADD( counters.writes, 1 );
+
+        // holes are read and written back, nobody may write in between
+        eeLockState( false );
+
+        if( (retVal = eeLockBusTimed()) == E_EE_SUCCESS )
+        {
+            if( (retVal = eeCoalesce( pVec, count, byte_offset, eeCapacity(),
+                                      gap_threshold, ee_page_size, order, 
+                                      spans )) == 
+                E_EE_SUCCESS && (retVal = eeGenerationBump()) == E_EE_SUCCESS )
+            {
+                for( spanNo = 0; spanNo < spans.size() && 
+                                 retVal == E_EE_SUCCESS; spanNo++ )
+                {
+                    spanBuf.resize( spans[spanNo].end - spans[spanNo].start );
+
+                    members.clear();
+                    hasHoles = false;
+                    covered = spans[spanNo].start;
+
+                    for( i = spans[spanNo].first; i <= spans[spanNo].last; i++ )
+                    {
+                        pElem = &pVec[order[i]];
+                        if( pElem->addr + byte_offset > covered )
+                        {
+                            hasHoles = true;
+                        }
+                        if( pElem->addr + byte_offset + pElem->amount > 
+                            covered )
+                        {
+                            covered = pElem->addr + byte_offset + pElem->amount;
+                        }
+                        members.push_back( order[i] );
+                    }
+
+                    // patch in caller order, so later elements win
+                    std::sort( members.begin(), members.end() );
+
+                    // other processes may have written the holes, the
+                    // cache only knows about this one
+                    if( hasHoles && pArbiter == (i2cArbiter*) NULL &&
+                        eeCacheLookup( spans[spanNo].start, spanBuf.data(), 
+                                       spanBuf.size() ) )
+                    {
+                        hasHoles = false;
+                    }
+
+                    // read and write back in one go under the adapter lock,
+                    // so no other process writes the holes in between
+                    retVal = eeArbitrated( [&]() {
+                        int opRet = E_EE_SUCCESS;
+                        int n;
+
+                        if( hasHoles )
+                        {
+                            opRet = eeBusRead( spans[spanNo].start, 
+                                               spanBuf.data(), spanBuf.size() );
+                        }
+
+                        if( opRet == E_EE_SUCCESS )
+                        {
+                            for( n = 0; n < (int) members.size(); n++ )
+                            {
+                                memcpy( &spanBuf[pVec[members[n]].addr + 
+                                                 byte_offset - 
+                                                 spans[spanNo].start],
+                                        pVec[members[n]].pBuffer, 
+                                        pVec[members[n]].amount );
+                            }
+
+                            opRet = eeBusWrite( spans[spanNo].start, 
+                                                spanBuf.data(), 
+                                                spanBuf.size() );
+                        }
+
+                        return( opRet ); } );
+
+                    if( retVal == E_EE_SUCCESS )
+                    {
+                        I2C_STAT_ADD( counters.bytes_written, spanBuf.size() );
+                        eeCacheStore( spans[spanNo].start, spanBuf.data(), 
+                                      spanBuf.size() );
+                        eeMirrorUpdate( spans[spanNo].start, spanBuf.data(), 
+                                        spanBuf.size() );
+                    }
+                }
+            }
+
+            eeUnlockBus();
+        }
+
+        eeUnlockState();
+
+        for( i = 0; i < count && pVec != NULL; i++ )
+        {
+            eeRecordCall( EE_REC_WRITEV, pVec[i].addr + byte_offset, 
+                          pVec[i].amount, retVal,
+                          i == count - 1 ? EE_REC_FLAG_LAST : 0 );
+        }
+    }
+    else
+    {
+        retVal = E_I2C_FAIL;
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * int i2cEEPROM::eeCounterSlot( struct eeCounter* pCounter, int slot, 
+ *                               bool* pValid, uint16_t* pSeq, 
+ *                               uint32_t* pValue )
+ * ----------------------------------------------------
+ * read and check one slot of a counter. An erased slot and one
+ * with a wrong CRC, e.g. torn by a power loss, are not valid
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns an errorcode, E_EE_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cEEPROM::eeCounterSlot( struct eeCounter* pCounter, int slot, 
+                              bool* pValid, uint16_t* pSeq, 
+                              uint32_t* pValue )
+{
+    int retVal;
+    uint8_t raw[EE_COUNTER_SLOT_LEN];
+    uint16_t crc;
+    bool erased = true;
+    int i;
+
+    *pValid = false;
+
+    if( (retVal = eeRead( pCounter->first + slot * EE_COUNTER_SLOT_LEN, 
+                          raw, EE_COUNTER_SLOT_LEN )) == E_EE_SUCCESS )
+    {
+        for( i = 0; i < EE_COUNTER_SLOT_LEN; i++ )
+        {
+            if( raw[i] != 0xff )
+            {
+                erased = false;
+            }
+        }
+
+        getWordFromBuffer( &raw[4], pSeq );
+        getWordFromBuffer( &raw[6], &crc );
+        *pValue = eeGet32( raw );
+        *pValid = !erased && crc == i2cCrc16( raw, 6 );
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * int i2cEEPROM::eeCounterOpen( struct eeCounter* pCounter, uint16_t addr, 
+ *                               int length )
+ * ----------------------------------------------------
+ * use the length bytes at addr for a counter. Each change of
+ * the value is written to the next slot of the region, so the
+ * write cycles are spread over all its pages and a change costs
+ * one slot write. The slots are written in turn with sequence
+ * numbers counting up, so the slots up to the latest follow
+ * slot 0 without a gap: the latest one is found by a binary
+ * search, reading log2(slots) slots. A region never written
+ * holds 0.
+ * The region must not be used otherwise and belongs to one
+ * counter. The slots are aligned to their size within the chip,
+ * bytes of the region before the first and after the last slot
+ * stay unused
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns an errorcode, E_EE_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cEEPROM::eeCounterOpen( struct eeCounter* pCounter, uint16_t addr, 
+                              int length )
+{
+    int retVal;
+    int lead;
+    int low;
+    int high;
+    int mid;
+    bool valid;
+    uint16_t seq;
+    uint16_t seq0;
+    uint32_t value;
+
+    if( pCounter == NULL )
+    {
+        return( E_EE_DATA_NULLP );
+    }
+
+    if( !eeConnected() )
+    {
+        return( E_EE_NO_CONNECTION );
+    }
+
+    // the first slot at a multiple of the slot size on the chip
+    lead = (EE_COUNTER_SLOT_LEN - (addr + byte_offset) % 
+            EE_COUNTER_SLOT_LEN) % EE_COUNTER_SLOT_LEN;
+
+    pCounter->first = addr + lead;
+    pCounter->slots = length > lead ? 
+                      (length - lead) / EE_COUNTER_SLOT_LEN : 0;
+    pCounter->head  = -1;
+    pCounter->seq   = 0xffff;
+    pCounter->value = 0;
+
+    if( pCounter->slots < EE_COUNTER_MIN_SLOTS || 
+        (eeCapacity() > 0 && addr + byte_offset + length > eeCapacity()) )
+    {
+        pCounter->slots = 0;
+        return( E_EE_INVAL_PARAM );
+    }
+
+    if( (retVal = eeCounterSlot( pCounter, 0, &valid, &seq0, 
+                                 &value )) != E_EE_SUCCESS )
+    {
+        return( retVal );
+    }
+
+    if( valid )
+    {
+        // slot low is part of the current round, slot high not
+        low  = 0;
+        high = pCounter->slots;
+
+        while( high - low > 1 )
+        {
+            mid = low + (high - low) / 2;
+
+            if( (retVal = eeCounterSlot( pCounter, mid, &valid, &seq, 
+                                         &value )) != E_EE_SUCCESS )
+            {
+                return( retVal );
+            }
+
+            if( valid && seq == (uint16_t) (seq0 + mid) )
+            {
+                low = mid;
+            }
+            else
+            {
+                high = mid;
+            }
+        }
+    }
+    else
+    {
+        // slot 0 erased, or torn when the ring wrapped: then the
+        // last slot holds the latest value
+        low = pCounter->slots - 1;
+    }
+
+    if( (retVal = eeCounterSlot( pCounter, low, &valid, &seq, 
+                                 &value )) == E_EE_SUCCESS && valid )
+    {
+        pCounter->head  = low;
+        pCounter->seq   = seq;
+        pCounter->value = value;
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * int i2cEEPROM::eeCounterSet( struct eeCounter* pCounter, uint32_t value )
+ * int i2cEEPROM::eeCounterAdd( struct eeCounter* pCounter, uint32_t delta )
+ * ----------------------------------------------------
+ * store a new value of a counter opened by eeCounterOpen() in
+ * the next slot. pCounter is only updated if the write
+ * succeeded
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns an errorcode, E_EE_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cEEPROM::eeCounterSet( struct eeCounter* pCounter, uint32_t value )
+{
+    int retVal;
+    int next;
+    uint16_t seq;
+    uint16_t crc;
+    uint8_t raw[EE_COUNTER_SLOT_LEN];
+
+    if( pCounter == NULL )
+    {
+        return( E_EE_DATA_NULLP );
+    }
+
+    if( pCounter->slots < EE_COUNTER_MIN_SLOTS )
+    {
+        return( E_EE_INVAL_PARAM );
+    }
+
+    next = (pCounter->head + 1) % pCounter->slots;
+    seq  = pCounter->seq + 1;
+
+    eePut32( raw, value );
+    raw[4] = (seq >> 8) & 0x00ff;
+    raw[5] = seq & 0x00ff;
+    crc = i2cCrc16( raw, 6 );
+    raw[6] = (crc >> 8) & 0x00ff;
+    raw[7] = crc & 0x00ff;
+
+    if( (retVal = eeWrite( pCounter->first + next * EE_COUNTER_SLOT_LEN, 
+                           raw, EE_COUNTER_SLOT_LEN )) == E_EE_SUCCESS )
+    {
+        pCounter->head  = next;
+        pCounter->seq   = seq;
+        pCounter->value = value;
+    }
+
+    return( retVal );
+}
+
+int i2cEEPROM::eeCounterAdd( struct eeCounter* pCounter, uint32_t delta )
+{
+    if( pCounter == NULL )
+    {
+        return( E_EE_DATA_NULLP );
+    }
+
+    return( eeCounterSet( pCounter, pCounter->value + delta ) );
+}
+
+/*
+ ***************************************************************************
+ * bool i2cEEPROM::eeLogBlockValid( struct eeLog* pLog, 
+ *                                  const uint8_t* pBlock, uint32_t* pSeq )
+ * ----------------------------------------------------
+ * check a block of a log read from the chip. An erased block
+ * and one with a wrong CRC, e.g. torn by a power loss, are not
+ * valid
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns true if the block is valid, *pSeq is its sequence
+ * number then
+ ***************************************************************************
+*/
+bool i2cEEPROM::eeLogBlockValid( struct eeLog* pLog, const uint8_t* pBlock, 
+                                 uint32_t* pSeq )
+{
+    uint16_t used;
+    uint16_t crc;
+
+    getWordFromBuffer( (uint8_t*) &pBlock[0], &crc );
+    getWordFromBuffer( (uint8_t*) &pBlock[6], &used );
+
+    if( used == 0 || used > pLog->block_size - EE_LOG_HDR_LEN )
+    {
+        return( false );
+    }
+
+    // the CRC covers the rest of the header and the records
+    if( i2cCrc16( &pBlock[2], EE_LOG_HDR_LEN - 2 + used ) != crc )
+    {
+        return( false );
+    }
+
+    *pSeq = eeGet32( &pBlock[2] );
+
+    return( true );
+}
+
+/*
+ ***************************************************************************
+ * bool i2cEEPROM::eeLogRecordsWalk( struct eeLog* pLog, 
+ *                                   const uint8_t* pRecords, int used,
+ *                                   std::function<bool(const uint8_t*, 
+ *                                                      int)> visit )
+ * ----------------------------------------------------
+ * call visit for the used bytes of records of a block, the
+ * last one first
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns false if visit asked to stop
+ ***************************************************************************
+*/
+bool i2cEEPROM::eeLogRecordsWalk( struct eeLog* pLog, 
+                                  const uint8_t* pRecords, int used,
+                                  std::function<bool(const uint8_t*, 
+                                                     int)> visit )
+{
+    int offsets[EE_LOG_MAX_BLOCK / 2];
+    int count = 0;
+    int pos;
+
+    if( pLog->record_size > 0 )
+    {
+        for( pos = used - pLog->record_size; pos >= 0; 
+             pos -= pLog->record_size )
+        {
+            if( !visit( &pRecords[pos], pLog->record_size ) )
+            {
+                return( false );
+            }
+        }
+    }
+    else
+    {
+        // a length byte in front of each record, the records can
+        // only be found from the start
+        for( pos = 0; pos < used && pos + 1 + pRecords[pos] <= used && 
+             count < EE_LOG_MAX_BLOCK / 2; pos += 1 + pRecords[pos] )
+        {
+            offsets[count++] = pos;
+        }
+
+        while( count-- > 0 )
+        {
+            if( !visit( &pRecords[offsets[count] + 1], 
+                        pRecords[offsets[count]] ) )
+            {
+                return( false );
+            }
+        }
+    }
+
+    return( true );
+}
+
+/*
+ ***************************************************************************
+ * int i2cEEPROM::eeLogOpen( struct eeLog* pLog, uint16_t addr, int length,
+ *                           int recordSize, int blockSize )
+ * ----------------------------------------------------
+ * use the length bytes at addr for a log of the latest records.
+ * Records of recordSize bytes, or of 1 .. EE_LOG_MAX_RECORD
+ * bytes with recordSize 0, are collected in a block of
+ * blockSize bytes, EE_LOG_DEFAULT_BLOCK for 0, a multiple of
+ * the page size up to EE_LOG_MAX_BLOCK. A block is written when it is full or by
+ * eeLogFlush(), to the next block of the ring, with a sequence
+ * number one up and a CRC. So the blocks up to the latest
+ * follow block 0 without a gap and the latest one is found by
+ * a binary search, reading log2(blocks) blocks.
+ * The region must not be used otherwise and belongs to one log.
+ * The blocks are aligned to pages, bytes of the region before
+ * the first and after the last block stay unused
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns an errorcode, E_EE_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cEEPROM::eeLogOpen( struct eeLog* pLog, uint16_t addr, int length,
+                          int recordSize, int blockSize )
+{
+    int retVal;
+    int lead;
+    int low;
+    int high;
+    int mid;
+    uint32_t seq;
+    uint32_t seq0;
+    std::vector<uint8_t> block;
+
+    if( pLog == NULL )
+    {
+        return( E_EE_DATA_NULLP );
+    }
+
+    if( !eeConnected() )
+    {
+        return( E_EE_NO_CONNECTION );
+    }
+
+    if( eeCapacity() == 0 )
+    {
+        return( E_EE_INVAL_TYPE );
+    }
+
+    if( blockSize == 0 )
+    {
+        blockSize = (EE_LOG_DEFAULT_BLOCK + ee_page_size - 1) / 
+                    ee_page_size * ee_page_size;
+    }
+
+    if( blockSize % ee_page_size != 0 || 
+        blockSize <= EE_LOG_HDR_LEN || blockSize > EE_LOG_MAX_BLOCK ||
+        recordSize < 0 || recordSize > EE_LOG_MAX_RECORD ||
+        recordSize > blockSize - EE_LOG_HDR_LEN )
+    {
+        return( E_EE_INVAL_PARAM );
+    }
+
+    lead = (ee_page_size - (addr + byte_offset) % ee_page_size) % 
+           ee_page_size;
+
+    pLog->first       = addr + lead;
+    pLog->block_size  = blockSize;
+    pLog->blocks      = length > lead ? (length - lead) / blockSize : 0;
+    pLog->record_size = recordSize;
+    pLog->head        = -1;
+    pLog->seq         = 0xffffffff;
+    pLog->staging.clear();
+
+    if( pLog->blocks < EE_LOG_MIN_BLOCKS || 
+        addr + byte_offset + length > eeCapacity() )
+    {
+        pLog->blocks = 0;
+        return( E_EE_INVAL_PARAM );
+    }
+
+    block.resize( blockSize );
+
+    if( (retVal = eeRead( pLog->first, block.data(), 
+                          blockSize )) != E_EE_SUCCESS )
+    {
+        return( retVal );
+    }
+
+    if( eeLogBlockValid( pLog, block.data(), &seq0 ) )
+    {
+        // block low is part of the current round, block high not
+        low  = 0;
+        high = pLog->blocks;
+
+        while( high - low > 1 )
+        {
+            mid = low + (high - low) / 2;
+
+            if( (retVal = eeRead( pLog->first + mid * blockSize, 
+                                  block.data(), 
+                                  blockSize )) != E_EE_SUCCESS )
+            {
+                return( retVal );
+            }
+
+            if( eeLogBlockValid( pLog, block.data(), &seq ) && 
+                seq == seq0 + mid )
+            {
+                low = mid;
+            }
+            else
+            {
+                high = mid;
+            }
+        }
+
+        pLog->head = low;
+        pLog->seq  = seq0 + low;
+    }
+    else
+    {
+        // block 0 erased, or torn when the ring wrapped: then the
+        // last block is the latest
+        if( (retVal = eeRead( pLog->first + 
+                              (pLog->blocks - 1) * blockSize, 
+                              block.data(), blockSize )) != E_EE_SUCCESS )
+        {
+            return( retVal );
+        }
+
+        if( eeLogBlockValid( pLog, block.data(), &seq ) )
+        {
+            pLog->head = pLog->blocks - 1;
+            pLog->seq  = seq;
+        }
+    }
+
+    pLog->staging.reserve( blockSize );
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * int i2cEEPROM::eeLogAppend( struct eeLog* pLog, const uint8_t* pData, 
+ *                             int len )
+ * ----------------------------------------------------
+ * add a record to the block being collected. If it does not
+ * fit any more the block is written first
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns an errorcode, E_EE_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cEEPROM::eeLogAppend( struct eeLog* pLog, const uint8_t* pData, 
+                            int len )
+{
+    int retVal = E_EE_SUCCESS;
+    int need;
+
+    if( pLog == NULL || pData == NULL )
+    {
+        return( E_EE_DATA_NULLP );
+    }
+
+    if( pLog->blocks < EE_LOG_MIN_BLOCKS )
+    {
+        return( E_EE_INVAL_PARAM );
+    }
+
+    if( pLog->record_size > 0 )
+    {
+        need = len;
+
+        if( len != pLog->record_size )
+        {
+            return( E_EE_INVAL_PARAM );
+        }
+    }
+    else
+    {
+        need = 1 + len;
+
+        if( len < 1 || len > EE_LOG_MAX_RECORD || 
+            need > pLog->block_size - EE_LOG_HDR_LEN )
+        {
+            return( E_EE_INVAL_PARAM );
+        }
+    }
+
+    if( (int) pLog->staging.size() + need > 
+        pLog->block_size - EE_LOG_HDR_LEN )
+    {
+        retVal = eeLogFlush( pLog );
+    }
+
+    if( retVal == E_EE_SUCCESS )
+    {
+        if( pLog->record_size == 0 )
+        {
+            pLog->staging.push_back( (uint8_t) len );
+        }
+
+        pLog->staging.insert( pLog->staging.end(), pData, pData + len );
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * int i2cEEPROM::eeLogFlush( struct eeLog* pLog )
+ * ----------------------------------------------------
+ * write the records collected so far as the next block. Only
+ * the pages holding them are written. The next record starts
+ * a new block, so flushing after each record wastes the rest
+ * of the block
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns an errorcode, E_EE_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cEEPROM::eeLogFlush( struct eeLog* pLog )
+{
+    int retVal = E_EE_SUCCESS;
+    int next;
+    int used;
+    int len;
+    uint32_t seq;
+    uint16_t crc;
+    std::vector<uint8_t> block;
+
+    if( pLog == NULL )
+    {
+        return( E_EE_DATA_NULLP );
+    }
+
+    if( !pLog->staging.empty() )
+    {
+        next = (pLog->head + 1) % pLog->blocks;
+        seq  = pLog->seq + 1;
+        used = (int) pLog->staging.size();
+        len  = (EE_LOG_HDR_LEN + used + ee_page_size - 1) / ee_page_size * 
+               ee_page_size;
+
+        block.assign( len, 0xff );
+        eePut32( &block[2], seq );
+        block[6] = (used >> 8) & 0x00ff;
+        block[7] = used & 0x00ff;
+        memcpy( &block[EE_LOG_HDR_LEN], pLog->staging.data(), used );
+        crc = i2cCrc16( &block[2], EE_LOG_HDR_LEN - 2 + used );
+        block[0] = (crc >> 8) & 0x00ff;
+        block[1] = crc & 0x00ff;
+
+        if( (retVal = eeWrite( pLog->first + next * pLog->block_size, 
+                               block.data(), len )) == E_EE_SUCCESS )
+        {
+            pLog->head = next;
+            pLog->seq  = seq;
+            pLog->staging.clear();
+        }
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * int i2cEEPROM::eeLogWalk( struct eeLog* pLog, 
+ *                           std::function<bool(const uint8_t*, int)> visit )
+ * ----------------------------------------------------
+ * call visit for the records of the log, the latest first,
+ * starting with those not written yet, until visit returns
+ * false. Up to EE_LOG_READ_BLOCKS blocks are read with one
+ * transfer. The walk ends at the first block not belonging
+ * to the ring any more
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns an errorcode, E_EE_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cEEPROM::eeLogWalk( struct eeLog* pLog, 
+                          std::function<bool(const uint8_t*, int)> visit )
+{
+    int retVal = E_EE_SUCCESS;
+    int block;
+    int chunk;
+    int left;
+    int i;
+    uint16_t used;
+    uint32_t seq;
+    uint32_t expected;
+    std::vector<uint8_t> blocks;
+
+    if( pLog == NULL || !visit )
+    {
+        return( E_EE_DATA_NULLP );
+    }
+
+    if( !eeLogRecordsWalk( pLog, pLog->staging.data(), 
+                           (int) pLog->staging.size(), visit ) ||
+        pLog->head < 0 )
+    {
+        return( E_EE_SUCCESS );
+    }
+
+    blocks.resize( EE_LOG_READ_BLOCKS * pLog->block_size );
+    block    = pLog->head;
+    expected = pLog->seq;
+    left     = pLog->blocks;
+
+    while( left > 0 )
+    {
+        // the blocks up to this one, not across the start of the ring
+        chunk = block + 1 < EE_LOG_READ_BLOCKS ? block + 1 : 
+                                                 EE_LOG_READ_BLOCKS;
+        if( chunk > left )
+        {
+            chunk = left;
+        }
+
+        if( (retVal = eeRead( pLog->first + 
+                              (block - chunk + 1) * pLog->block_size,
+                              blocks.data(), 
+                              chunk * pLog->block_size )) != E_EE_SUCCESS )
+        {
+            return( retVal );
+        }
+
+        for( i = chunk - 1; i >= 0; i-- )
+        {
+            if( !eeLogBlockValid( pLog, &blocks[i * pLog->block_size], 
+                                  &seq ) || seq != expected )
+            {
+                return( E_EE_SUCCESS );
+            }
+
+            getWordFromBuffer( &blocks[i * pLog->block_size + 6], &used );
+
+            if( !eeLogRecordsWalk( pLog, &blocks[i * pLog->block_size + 
+                                                 EE_LOG_HDR_LEN],
+                                   used, visit ) )
+            {
+                return( E_EE_SUCCESS );
+            }
+
+            expected--;
+        }
+
+        left -= chunk;
+        block = (block - chunk + pLog->blocks) % pLog->blocks;
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * int i2cEEPROM::eeABHeader( struct eeABSlots* pSlots, int slot, 
+ *                            bool* pValid, uint32_t* pGeneration, 
+ *                            uint16_t* pLength, uint16_t* pDataCrc )
+ * ----------------------------------------------------
+ * read and check the header of slot A (0) or B (1). An erased
+ * header and one with a wrong CRC are not valid
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns an errorcode, E_EE_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cEEPROM::eeABHeader( struct eeABSlots* pSlots, int slot, bool* pValid,
+                           uint32_t* pGeneration, uint16_t* pLength, 
+                           uint16_t* pDataCrc )
+{
+    int retVal;
+    uint8_t raw[EE_AB_HDR_LEN];
+    uint16_t crc;
+
+    *pValid = false;
+
+    if( (retVal = eeRead( pSlots->header[slot], raw, 
+                          EE_AB_HDR_LEN )) == E_EE_SUCCESS )
+    {
+        getWordFromBuffer( &raw[0], &crc );
+        *pGeneration = eeGet32( &raw[2] );
+        getWordFromBuffer( &raw[6], pLength );
+        getWordFromBuffer( &raw[8], pDataCrc );
+
+        *pValid = crc == i2cCrc16( &raw[2], EE_AB_HDR_LEN - 2 ) &&
+                  *pLength <= pSlots->capacity;
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * int i2cEEPROM::eeABOpen( struct eeABSlots* pSlots, uint16_t addr, 
+ *                          int length )
+ * ----------------------------------------------------
+ * use the length bytes at addr for two slots A and B of the
+ * same size, each a header and the data. eeABWrite() writes
+ * the slot not in use and its header last, so an update torn
+ * by a power loss leaves the other slot valid. Only the two
+ * headers are read here to choose the slot of the newest
+ * generation, its data is checked by eeABRead().
+ * The slots are aligned to pages, bytes of the region before
+ * and after them stay unused
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns an errorcode, E_EE_SUCCESS on success, also if no
+ * slot is valid yet
+ ***************************************************************************
+*/
+int i2cEEPROM::eeABOpen( struct eeABSlots* pSlots, uint16_t addr, 
+                         int length )
+{
+    int retVal = E_EE_SUCCESS;
+    int lead;
+    int slotLen;
+    int slot;
+    bool valid;
+    uint32_t generation;
+    uint16_t len;
+    uint16_t crc;
+
+    if( pSlots == NULL )
+    {
+        return( E_EE_DATA_NULLP );
+    }
+
+    if( !eeConnected() )
+    {
+        return( E_EE_NO_CONNECTION );
+    }
+
+    if( eeCapacity() == 0 )
+    {
+        return( E_EE_INVAL_TYPE );
+    }
+
+    lead = (ee_page_size - (addr + byte_offset) % ee_page_size) % 
+           ee_page_size;
+    slotLen = length > lead ? 
+              (length - lead) / 2 / ee_page_size * ee_page_size : 0;
+
+    pSlots->header[0]  = addr + lead;
+    pSlots->header[1]  = addr + lead + slotLen;
+    pSlots->header_len = (EE_AB_HDR_LEN + ee_page_size - 1) / 
+                         ee_page_size * ee_page_size;
+    pSlots->capacity   = slotLen - pSlots->header_len;
+    pSlots->active     = -1;
+    pSlots->generation = 0;
+    pSlots->length     = 0;
+    pSlots->data_crc   = 0;
+
+    if( pSlots->capacity <= 0 || pSlots->capacity > 0xffff ||
+        addr + byte_offset + length > eeCapacity() )
+    {
+        pSlots->capacity = 0;
+        return( E_EE_INVAL_PARAM );
+    }
+
+    for( slot = 0; slot < 2 && retVal == E_EE_SUCCESS; slot++ )
+    {
+        if( (retVal = eeABHeader( pSlots, slot, &valid, &generation, 
+                                  &len, &crc )) == E_EE_SUCCESS && valid )
+        {
+            // generations compared across the wrap of the counter
+            if( pSlots->active < 0 || 
+                (int32_t) (generation - pSlots->generation) > 0 )
+            {
+                pSlots->active     = slot;
+                pSlots->generation = generation;
+                pSlots->length     = len;
+                pSlots->data_crc   = crc;
+            }
+        }
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * int i2cEEPROM::eeABRead( struct eeABSlots* pSlots, uint8_t* pBuffer, 
+ *                          int size, int* pLength )
+ * ----------------------------------------------------
+ * read the data of the active slot into pBuffer of size bytes.
+ * If its data does not match the CRC of its header the other
+ * slot is used if valid, it becomes the active one then.
+ * *pLength gets the number of bytes of the data
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns an errorcode, E_EE_SUCCESS on success, E_EE_VERIFY
+ * if no slot holds valid data
+ ***************************************************************************
+*/
+int i2cEEPROM::eeABRead( struct eeABSlots* pSlots, uint8_t* pBuffer, 
+                         int size, int* pLength )
+{
+    int retVal = E_EE_VERIFY;
+    int attempt;
+    int other;
+    bool valid;
+    uint32_t generation;
+    uint16_t len;
+    uint16_t crc;
+
+    if( pSlots == NULL || pBuffer == NULL || pLength == NULL )
+    {
+        return( E_EE_DATA_NULLP );
+    }
+
+    for( attempt = 0; attempt < 2 && pSlots->active >= 0; attempt++ )
+    {
+        if( pSlots->length > size )
+        {
+            return( E_EE_INVAL_PARAM );
+        }
+
+        if( (retVal = eeRead( pSlots->header[pSlots->active] + 
+                              pSlots->header_len, pBuffer, 
+                              pSlots->length )) != E_EE_SUCCESS )
+        {
+            return( retVal );
+        }
+
+        if( i2cCrc16( pBuffer, pSlots->length ) == pSlots->data_crc )
+        {
+            *pLength = pSlots->length;
+            return( E_EE_SUCCESS );
+        }
+
+        retVal = E_EE_VERIFY;
+        other  = 1 - pSlots->active;
+        pSlots->active = -1;
+
+        if( attempt == 0 &&
+            (retVal = eeABHeader( pSlots, other, &valid, &generation, 
+                                  &len, &crc )) == E_EE_SUCCESS )
+        {
+            retVal = E_EE_VERIFY;
+
+            if( valid )
+            {
+                pSlots->active     = other;
+                pSlots->generation = generation;
+                pSlots->length     = len;
+                pSlots->data_crc   = crc;
+            }
+        }
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * int i2cEEPROM::eeABWrite( struct eeABSlots* pSlots, const uint8_t* pData,
+ *                           int len )
+ * ----------------------------------------------------
+ * write len bytes of data to the slot not active and commit
+ * them by its header with the next generation. The header is
+ * written after the data is programmed, pSlots is updated only
+ * after that
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns an errorcode, E_EE_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cEEPROM::eeABWrite( struct eeABSlots* pSlots, const uint8_t* pData, 
+                          int len )
+{
+    int retVal = E_EE_SUCCESS;
+    int target;
+    uint32_t generation;
+    uint16_t dataCrc;
+    uint16_t crc;
+    uint8_t raw[EE_AB_HDR_LEN];
+
+    if( pSlots == NULL || (pData == NULL && len > 0) )
+    {
+        return( E_EE_DATA_NULLP );
+    }
+
+    if( pSlots->capacity <= 0 || len < 0 || len > pSlots->capacity )
+    {
+        return( E_EE_INVAL_PARAM );
+    }
+
+    target     = pSlots->active < 0 ? 0 : 1 - pSlots->active;
+    generation = pSlots->generation + 1;
+    dataCrc    = i2cCrc16( pData, len );
+
+    if( len > 0 )
+    {
+        retVal = eeWrite( pSlots->header[target] + pSlots->header_len,
+                          (uint8_t*) pData, len );
+    }
+
+    if( retVal == E_EE_SUCCESS )
+    {
+        eePut32( &raw[2], generation );
+        raw[6] = (len >> 8) & 0x00ff;
+        raw[7] = len & 0x00ff;
+        raw[8] = (dataCrc >> 8) & 0x00ff;
+        raw[9] = dataCrc & 0x00ff;
+        crc = i2cCrc16( &raw[2], EE_AB_HDR_LEN - 2 );
+        raw[0] = (crc >> 8) & 0x00ff;
+        raw[1] = crc & 0x00ff;
+
+        if( (retVal = eeWrite( pSlots->header[target], raw, 
+                               EE_AB_HDR_LEN )) == E_EE_SUCCESS )
+        {
+            pSlots->active     = target;
+            pSlots->generation = generation;
+            pSlots->length     = len;
+            pSlots->data_crc   = dataCrc;
+        }
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * static void eeDelta16( uint8_t* pData, int len, bool undo )
+ * ----------------------------------------------------
+ * replace the 16 bit values of pData, MSB first, by their
+ * difference to the value before resp. undo that. A last odd
+ * byte stays as it is
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+static void eeDelta16( uint8_t* pData, int len, bool undo )
+{
+    uint16_t previous = 0;
+    uint16_t current;
+    uint16_t value;
+    int i;
+
+    for( i = 0; i + 1 < len; i += 2 )
+    {
+        current = (pData[i] << 8) | pData[i + 1];
+
+        if( undo )
+        {
+            value = current + previous;
+            previous = value;
+        }
+        else
+        {
+            value = current - previous;
+            previous = current;
+        }
+
+        pData[i]     = (value >> 8) & 0x00ff;
+        pData[i + 1] = value & 0x00ff;
+    }
+}
+
+/*
+ ***************************************************************************
+ * int i2cEEPROM::eeBlobWrite( uint16_t addr, const uint8_t* pData, 
+ *                             int len, int room, int* pStored )
+ * ----------------------------------------------------
+ * store len bytes of data at addr, compressed by i2cLz.h if
+ * that makes them shorter, as they are or as differences of
+ * 16 bit values, whatever is shorter. A header in front holds the method,
+ * both lengths and a CRC over the rest of the header and the
+ * stored bytes. Fewer bytes stored are fewer bytes on the bus
+ * and fewer pages to program. room is the number of bytes
+ * reserved at addr, *pStored, if given, gets the number of
+ * bytes used of it
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns an errorcode, E_EE_SUCCESS on success, E_EE_MEM if
+ * the blob does not fit into room
+ ***************************************************************************
+*/
+int i2cEEPROM::eeBlobWrite( uint16_t addr, const uint8_t* pData, int len, 
+                            int room, int* pStored )
+{
+    int retVal;
+    int stored;
+    int res;
+    uint16_t crc;
+    std::vector<uint8_t> blob;
+    std::vector<uint8_t> delta;
+    std::vector<uint8_t> packed;
+
+    if( pData == NULL && len > 0 )
+    {
+        return( E_EE_DATA_NULLP );
+    }
+
+    if( len < 0 || len > 0xffff )
+    {
+        return( E_EE_INVAL_PARAM );
+    }
+
+    blob.resize( EE_BLOB_HDR_LEN + len );
+    stored = len;
+    blob[2] = EE_BLOB_STORED;
+
+    // compressed only if shorter, incompressible data stays as it is
+    if( len > 1 &&
+        (res = i2cLzCompress( pData, len, &blob[EE_BLOB_HDR_LEN], 
+                              len - 1 )) > 0 )
+    {
+        stored = res;
+        blob[2] = EE_BLOB_LZ;
+    }
+
+    // tables of 16 bit values mostly compress better as differences
+    if( len >= 4 )
+    {
+        delta.assign( pData, pData + len );
+        eeDelta16( delta.data(), len, false );
+        packed.resize( stored - 1 );
+
+        if( (res = i2cLzCompress( delta.data(), len, packed.data(), 
+                                  stored - 1 )) > 0 )
+        {
+            stored = res;
+            blob[2] = EE_BLOB_LZ_DELTA16;
+            memcpy( &blob[EE_BLOB_HDR_LEN], packed.data(), stored );
+        }
+    }
+
+    if( blob[2] == EE_BLOB_STORED && len > 0 )
+    {
+        memcpy( &blob[EE_BLOB_HDR_LEN], pData, len );
+    }
+
+    blob[3] = 0xff;
+    blob[4] = (len >> 8) & 0x00ff;
+    blob[5] = len & 0x00ff;
+    blob[6] = (stored >> 8) & 0x00ff;
+    blob[7] = stored & 0x00ff;
+    crc = i2cCrc16( &blob[2], EE_BLOB_HDR_LEN - 2 + stored );
+    blob[0] = (crc >> 8) & 0x00ff;
+    blob[1] = crc & 0x00ff;
+
+    if( pStored != NULL )
+    {
+        *pStored = EE_BLOB_HDR_LEN + stored;
+    }
+
+    if( EE_BLOB_HDR_LEN + stored > room )
+    {
+        return( E_EE_MEM );
+    }
+
+    retVal = eeWrite( addr, blob.data(), EE_BLOB_HDR_LEN + stored );
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * int i2cEEPROM::eeBlobRead( uint16_t addr, uint8_t* pBuffer, int size, 
+ *                            int* pLength )
+ * ----------------------------------------------------
+ * read a blob of eeBlobWrite() into pBuffer of size bytes.
+ * Compressed data is read EE_BLOB_READ_CHUNK bytes at a time
+ * and decoded while it comes in, no buffer for all of it is
+ * needed. *pLength gets the length of the data, also if size
+ * is too small
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns an errorcode, E_EE_SUCCESS on success, E_EE_MEM if
+ * pBuffer is too small, E_EE_VERIFY if the blob is damaged
+ ***************************************************************************
+*/
+int i2cEEPROM::eeBlobRead( uint16_t addr, uint8_t* pBuffer, int size, 
+                           int* pLength )
+{
+    int retVal;
+    int len;
+    int stored;
+    int done;
+    int chunk;
+    uint16_t crc;
+    uint16_t word;
+    uint8_t hdr[EE_BLOB_HDR_LEN];
+    uint8_t buf[EE_BLOB_READ_CHUNK];
+    struct _i2c_lz_decoder decoder;
+
+    if( pBuffer == NULL || pLength == NULL )
+    {
+        return( E_EE_DATA_NULLP );
+    }
+
+    if( (retVal = eeRead( addr, hdr, EE_BLOB_HDR_LEN )) != E_EE_SUCCESS )
+    {
+        return( retVal );
+    }
+
+    getWordFromBuffer( &hdr[4], &word );
+    len = word;
+    getWordFromBuffer( &hdr[6], &word );
+    stored = word;
+
+    if( hdr[2] > EE_BLOB_LZ_DELTA16 ||
+        (hdr[2] == EE_BLOB_STORED && stored != len) ||
+        addr + byte_offset + EE_BLOB_HDR_LEN + stored > eeCapacity() )
+    {
+        return( E_EE_VERIFY );
+    }
+
+    *pLength = len;
+
+    if( len > size )
+    {
+        return( E_EE_MEM );
+    }
+
+    crc = i2cCrc16( &hdr[2], EE_BLOB_HDR_LEN - 2 );
+    addr += EE_BLOB_HDR_LEN;
+
+    if( hdr[2] == EE_BLOB_STORED )
+    {
+        if( (retVal = eeRead( addr, pBuffer, stored )) != E_EE_SUCCESS )
+        {
+            return( retVal );
+        }
+
+        crc = i2cCrc16( pBuffer, stored, crc );
+    }
+    else
+    {
+        i2cLzDecodeInit( &decoder, pBuffer, len );
+
+        for( done = 0; done < stored; done += chunk )
+        {
+            chunk = stored - done < EE_BLOB_READ_CHUNK ? 
+                    stored - done : EE_BLOB_READ_CHUNK;
+
+            if( (retVal = eeRead( addr + done, buf, chunk )) != 
+                E_EE_SUCCESS )
+            {
+                return( retVal );
+            }
+
+            crc = i2cCrc16( buf, chunk, crc );
+
+            if( i2cLzDecode( &decoder, buf, chunk ) != E_LZ_SUCCESS )
+            {
+                return( E_EE_VERIFY );
+            }
+        }
+
+        if( decoder.out_len != len )
+        {
+            return( E_EE_VERIFY );
+        }
+
+        if( hdr[2] == EE_BLOB_LZ_DELTA16 )
+        {
+            eeDelta16( pBuffer, len, true );
+        }
+    }
+
+    getWordFromBuffer( &hdr[0], &word );
+
+    return( crc == word ? E_EE_SUCCESS : E_EE_VERIFY );
+}
+
+/*
+ ***************************************************************************
+ * int i2cEEPROM::eeQueueCheck( uint16_t addr, int amount )
+ * ----------------------------------------------------
+ * whether amount bytes at addr may be queued on a scheduler:
+ * within the chip, and nothing else uses the connection or
+ * the cache while the scheduler runs
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns an errorcode, E_EE_SUCCESS if it may be queued
+ ***************************************************************************
+*/
+int i2cEEPROM::eeQueueCheck( uint16_t addr, int amount )
+{
+    int retVal = E_EE_SUCCESS;
+
+    if( thread_safe || pArbiter != (i2cArbiter*) NULL || 
+        rt_worker.isRunning() )
+    {
+        retVal = E_EE_SUPP;
+    }
+    else
+    {
+        if( amount <= 0 || addr + byte_offset + amount > eeCapacity() )
+        {
+            retVal = E_EE_INVAL_PARAM;
+        }
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * int i2cEEPROM::eeQueueWrite( i2cBusScheduler* pSched, uint16_t addr, 
+ *                              uint8_t* pBuffer, int amount,
+ *                              std::function<void(int)> complete )
+ * ----------------------------------------------------
+ * queue a write on the scheduler of the bus instead of writing
+ * at once. pSched->run() then writes the pages of all queued
+ * devices interleaved, so their write cycles overlap and calls
+ * complete, if given, with the result.
+ * Direct access only, the daemon schedules on its own. The
+ * scheduler uses the connection and calls complete on its own,
+ * so it is not available with thread safe mode, arbitration or
+ * the real-time worker
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns an errorcode, E_EE_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cEEPROM::eeQueueWrite( i2cBusScheduler* pSched, uint16_t addr, 
+                             uint8_t* pBuffer, int amount,
+                             std::function<void(int)> complete )
+{
+    int retVal;
+    uint16_t devAddr;
+
+    if( pSched == NULL || pBuffer == NULL )
+    {
+        retVal = E_EE_DATA_NULLP;
+    }
+    else
+    {
+        if( pBus == (i2cConnection*) NULL )
+        {
+            retVal = pRemote != NULL ? E_EE_SUPP : E_EE_NO_CONNECTION;
+        }
+        else
+        {
+            if( (retVal = eeQueueCheck( addr, amount )) != E_EE_SUCCESS )
+            {
+                return( retVal );
+            }
+
+            devAddr = addr + byte_offset;
+
+            eeLockState( false );
+            eeLockBus();
+            retVal = eeGenerationBump();
+            eeUnlockBus();
+            eeUnlockState();
+
+            if( retVal != E_EE_SUCCESS )
+            {
+                return( retVal );
+            }
+
+            // cache and mirror learn the data once it is written
+            if( pSched->queueWrite( pBus, devAddr, pBuffer, amount,
+                                    [=]( int result ) {
+                                        if( result == E_I2C_SUCCESS )
+                                        {
+                                            eeCacheStore( devAddr, pBuffer, 
+                                                          amount );
+                                            eeMirrorUpdate( devAddr, pBuffer,
+                                                            amount );
+                                        }
+                                        if( complete )
+                                        {
+                                            complete( result );
+                                        } } ) == E_SCHED_SUCCESS )
+            {
+                retVal = E_EE_SUCCESS;
+            }
+            else
+            {
+                retVal = E_EE_INVAL_PARAM;
+            }
+        }
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * int i2cEEPROM::eeQueueRead( i2cBusScheduler* pSched, uint16_t addr, 
+ *                             uint8_t* pBuffer, int amount,
+ *                             std::function<void(int)> complete )
+ * ----------------------------------------------------
+ * queue a read on the scheduler of the bus, it is sent as soon
+ * as the device is ready while others still program pages.
+ * Not available where eeQueueWrite() is not
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns an errorcode, E_EE_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cEEPROM::eeQueueRead( i2cBusScheduler* pSched, uint16_t addr, 
+                            uint8_t* pBuffer, int amount,
+                            std::function<void(int)> complete )
+{
+    int retVal;
+
+    if( pSched == NULL || pBuffer == NULL )
+    {
+        retVal = E_EE_DATA_NULLP;
+    }
+    else
+    {
+        if( pBus == (i2cConnection*) NULL )
+        {
+            retVal = pRemote != NULL ? E_EE_SUPP : E_EE_NO_CONNECTION;
+        }
+        else
+        {
+            if( (retVal = eeQueueCheck( addr, amount )) == E_EE_SUCCESS )
+            {
+                if( pSched->queueRead( pBus, addr + byte_offset, pBuffer, 
+                                       amount, complete ) != E_SCHED_SUCCESS )
+                {
+                    retVal = E_EE_INVAL_PARAM;
+                }
+            }
+        }
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * int i2cEEPROM::eeCapacity( void )
+ * ----------------------------------------------------
+ * size of the EEPROM in bytes, known after eeTypeSet()
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns the size in bytes, 0 if the type is not set
+ ***************************************************************************
+*/
+int i2cEEPROM::eeCapacity( void )
+{
+    int retVal = 0;
+
+    if( pTypeInfo != NULL )
+    {
+        retVal = ee_page_size * ee_total_pages;
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * int i2cEEPROM::eeMirrorPublish( void )
+ * ----------------------------------------------------
+ * make this process the owner of a shared memory mirror of the
+ * device (see i2cMirror.h). The whole image is read once, from
+ * then on every write of this instance updates the mirror, so
+ * other processes read parameters without touching the bus
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns an errorcode, E_EE_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cEEPROM::eeMirrorPublish( void )
+{
+    int retVal;
+    int size;
+    std::vector<uint8_t> image;
+
+    if( pBus == (i2cConnection*) NULL )
+    {
+        // through eepromd the daemon is the one to publish
+        return( pRemote != NULL ? E_EE_SUPP : E_EE_NO_CONNECTION );
+    }
+
+    if( (size = eeCapacity()) <= 0 )
+    {
+        return( E_EE_INVAL_TYPE );
+    }
+
+    // no write may slip in between the image and setValid()
+    eeLockState( false );
+    eeLockBus();
+
+    eeMirrorWithdraw();
+
+    if( (pMirror = new i2cMirror()) == (i2cMirror*) NULL )
+    {
+        retVal = E_EE_MEM;
+    }
+    else
+    {
+        if( pMirror->create( pBus->i2c_bus, pBus->i2c_addr, size ) != 
+            E_MIRROR_SUCCESS )
+        {
+            retVal = E_EE_MIRROR;
+        }
+        else
+        {
+            image.resize( size );
+
+            if( (retVal = eeBusRead( 0, image.data(), size )) == 
+                E_I2C_SUCCESS )
+            {
+                pMirror->update( 0, image.data(), size );
+                pMirror->setDataOffset( byte_offset );
+                pMirror->setValid( true );
+            }
+        }
+    }
+
+    if( retVal != E_EE_SUCCESS )
+    {
+        eeMirrorWithdraw();
+    }
+
+    eeUnlockBus();
+    eeUnlockState();
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * void i2cEEPROM::eeMirrorWithdraw( void )
+ * ----------------------------------------------------
+ * remove the shared memory mirror, if any
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+void i2cEEPROM::eeMirrorWithdraw( void )
+{
+    if( pMirror != (i2cMirror*) NULL )
+    {
+        delete pMirror;
+        pMirror = (i2cMirror*) NULL;
+    }
+}
+
+/*
+ ***************************************************************************
+ * void i2cEEPROM::eeMirrorUpdate( uint16_t addr, const uint8_t* pData,
+ *                                 int amount )
+ * ----------------------------------------------------
+ * pass data just written to device address addr on to the
+ * mirror, if one is published
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+void i2cEEPROM::eeMirrorUpdate( uint16_t addr, const uint8_t* pData, 
+                                int amount )
+{
+    if( pMirror != (i2cMirror*) NULL && addr != I2C_CURRENT_ADDRESS )
+    {
+        pMirror->update( addr, pData, amount );
+    }
+}
+
+/*
+ ***************************************************************************
+ * void i2cEEPROM::eeSetThreadSafe( bool threadSafe )
+ * ----------------------------------------------------
+ * turn locking on or off. With locking on, one instance may
+ * be shared by several threads: transfers are serialized,
+ * while reads served from the cache run concurrently, also
+ * during the write cycle of another thread.
+ * Call it before the instance is shared
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+void i2cEEPROM::eeSetThreadSafe( bool threadSafe )
+{
+    thread_safe = threadSafe;
+}
+
+/*
+ ***************************************************************************
+ * int i2cEEPROM::eeLastError( void )
+ * ----------------------------------------------------
+ * last error of the calling thread, see i2cLastError()
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns the last errorcode
+ ***************************************************************************
+*/
+int i2cEEPROM::eeLastError( void )
+{
+    return( i2cLastError() );
+}
+
+/*
+ ***************************************************************************
+ * eePriority i2cEEPROM::eeSetPriority( eePriority prio )
+ * ----------------------------------------------------
+ * set the priority class of the operations of the calling
+ * thread, for all instances. Waiting for the bus, interactive
+ * goes before normal before bulk. Bulk transfers are cut into
+ * pages, so e.g. a background reflash lets a parameter read
+ * through after the page being programmed.
+ * Only matters in thread safe mode, where several threads
+ * share an instance
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns the previous class
+ ***************************************************************************
+*/
+eePriority i2cEEPROM::eeSetPriority( eePriority prio )
+{
+    eePriority retVal = (eePriority) eeThreadPriority;
+
+    if( prio >= EE_PRIO_INTERACTIVE && prio <= EE_PRIO_BULK )
+    {
+        eeThreadPriority = prio;
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * eePriority i2cEEPROM::eeGetPriority( void )
+ * ----------------------------------------------------
+ * priority class of the calling thread
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns the class
+ ***************************************************************************
+*/
+eePriority i2cEEPROM::eeGetPriority( void )
+{
+    return( (eePriority) eeThreadPriority );
+}
+
+/*
+ ***************************************************************************
+ * uint16_t i2cEEPROM::eeTraceDev( void )
+ * ----------------------------------------------------
+ * device id for trace events, see i2cTrace.h
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns bus and address, 0 without direct connection
+ ***************************************************************************
+*/
+uint16_t i2cEEPROM::eeTraceDev( void )
+{
+    return( pBus != (i2cConnection*) NULL ? 
+            I2C_TRACE_DEV( pBus->i2c_bus, pBus->i2c_addr ) : 0 );
+}
+
+/*
+ ***************************************************************************
+ * void i2cEEPROM::eeRecordLatency( int prio, uint64_t started )
+ * ----------------------------------------------------
+ * count the time since started for class prio
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+void i2cEEPROM::eeRecordLatency( int prio, uint64_t started )
+{
+    latency[prio].record( i2cMonotonicUs() - started );
+}
+
+/*
+ ***************************************************************************
+ * int i2cEEPROM::eeLatencyStats( eePriority prio, 
+ *                                struct _i2c_hist_summary* pSummary )
+ * ----------------------------------------------------
+ * latency of the reads and writes of class prio, from the
+ * call to the return, including waiting for the bus
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns an errorcode, E_EE_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cEEPROM::eeLatencyStats( eePriority prio, 
+                               struct _i2c_hist_summary* pSummary )
+{
+    int retVal = E_EE_SUCCESS;
+
+    if( pSummary == NULL )
+    {
+        retVal = E_EE_DATA_NULLP;
+    }
+    else
+    {
+        if( prio < EE_PRIO_INTERACTIVE || prio > EE_PRIO_BULK )
+        {
+            retVal = E_EE_INVAL_PARAM;
+        }
+        else
+        {
+            latency[prio].summary( pSummary );
+        }
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * void i2cEEPROM::eeLatencyReset( void )
+ * ----------------------------------------------------
+ * clear the latency statistics of all classes
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+void i2cEEPROM::eeLatencyReset( void )
+{
+    int prio;
+
+    for( prio = 0; prio < I2C_PRIO_CLASSES; prio++ )
+    {
+        latency[prio].reset();
+    }
+}
+
+/*
+ ***************************************************************************
+ * int i2cEEPROM::eeGetStats( struct eeStats* pStats )
+ * ----------------------------------------------------
+ * counters of the device, counters and latency histograms of
+ * its bus connection and the latency per priority class. Cheap
+ * enough to poll while other threads do transfers
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns an errorcode, E_EE_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cEEPROM::eeGetStats( struct eeStats* pStats )
+{
+    int retVal = E_EE_SUCCESS;
+    int prio;
+
+    if( pStats == NULL )
+    {
+        retVal = E_EE_DATA_NULLP;
+    }
+    else
+    {
+        memset( pStats, 0, sizeof(*pStats) );
+
+        pStats->device.reads = 
+            __atomic_load_n( &counters.reads, __ATOMIC_RELAXED );
+        pStats->device.writes = 
+            __atomic_load_n( &counters.writes, __ATOMIC_RELAXED );
+        pStats->device.bytes_read = 
+            __atomic_load_n( &counters.bytes_read, __ATOMIC_RELAXED );
+        pStats->device.bytes_written = 
+            __atomic_load_n( &counters.bytes_written, __ATOMIC_RELAXED );
+        pStats->device.cache_hits = 
+            __atomic_load_n( &counters.cache_hits, __ATOMIC_RELAXED );
+        pStats->device.cache_misses = 
+            __atomic_load_n( &counters.cache_misses, __ATOMIC_RELAXED );
+        pStats->device.cache_evictions = 
+            __atomic_load_n( &counters.cache_evictions, __ATOMIC_RELAXED );
+        pStats->device.readahead_bytes = 
+            __atomic_load_n( &counters.readahead_bytes, __ATOMIC_RELAXED );
+        pStats->device.image_pages = 
+            __atomic_load_n( &counters.image_pages, __ATOMIC_RELAXED );
+
+        if( pBus != (i2cConnection*) NULL )
+        {
+            pBus->getStats( &pStats->bus, pStats->bus_latency );
+        }
+
+        for( prio = 0; prio < I2C_PRIO_CLASSES; prio++ )
+        {
+            latency[prio].summary( &pStats->prio_latency[prio] );
+        }
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * void i2cEEPROM::eeResetStats( void )
+ * ----------------------------------------------------
+ * zero all counters and histograms of the device
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+void i2cEEPROM::eeResetStats( void )
+{
+    __atomic_store_n( &counters.reads, 0, __ATOMIC_RELAXED );
+    __atomic_store_n( &counters.writes, 0, __ATOMIC_RELAXED );
+    __atomic_store_n( &counters.bytes_read, 0, __ATOMIC_RELAXED );
+    __atomic_store_n( &counters.bytes_written, 0, __ATOMIC_RELAXED );
+    __atomic_store_n( &counters.cache_hits, 0, __ATOMIC_RELAXED );
+    __atomic_store_n( &counters.cache_misses, 0, __ATOMIC_RELAXED );
+    __atomic_store_n( &counters.cache_evictions, 0, __ATOMIC_RELAXED );
+    __atomic_store_n( &counters.readahead_bytes, 0, __ATOMIC_RELAXED );
+    __atomic_store_n( &counters.image_pages, 0, __ATOMIC_RELAXED );
+
+    if( pBus != (i2cConnection*) NULL )
+    {
+        pBus->resetStats();
+    }
+
+    eeLatencyReset();
+}
+
+/*
+ ***************************************************************************
+ * void i2cEEPROM::eePrintStats( FILE* pOut )
+ * ----------------------------------------------------
+ * statistics in readable form
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+void i2cEEPROM::eePrintStats( FILE* pOut )
+{
+    struct eeStats stats;
+    static const char* prioNames[I2C_PRIO_CLASSES] = 
+        { "interactive", "normal", "bulk" };
+    int prio;
+
+    eeGetStats( &stats );
+
+    fprintf( pOut, "device: %llu reads (%llu bytes), %llu writes "
+             "(%llu bytes), cache %llu hits %llu misses %llu evictions, "
+             "%llu bytes read ahead, %llu pages from the image\n",
+             (unsigned long long) stats.device.reads,
+             (unsigned long long) stats.device.bytes_read,
+             (unsigned long long) stats.device.writes,
+             (unsigned long long) stats.device.bytes_written,
+             (unsigned long long) stats.device.cache_hits,
+             (unsigned long long) stats.device.cache_misses,
+             (unsigned long long) stats.device.cache_evictions,
+             (unsigned long long) stats.device.readahead_bytes,
+             (unsigned long long) stats.device.image_pages );
+
+    for( prio = 0; prio < I2C_PRIO_CLASSES; prio++ )
+    {
+        if( stats.prio_latency[prio].count > 0 )
+        {
+            latency[prio].print( pOut, prioNames[prio] );
+        }
+    }
+
+    if( pBus != (i2cConnection*) NULL )
+    {
+        pBus->printStats( pOut );
+    }
+}
+
+/*
+ ***************************************************************************
+ * int i2cEEPROM::eeSetRetryPolicy( const struct _i2c_retry_policy* pPolicy )
+ * ----------------------------------------------------
+ * how failed transfers are repeated, NULL for the defaults,
+ * see struct _i2c_retry_policy. Timeout and retries of the
+ * adapter are set from it as well.
+ * Deadlines are set per thread with an i2cDeadline object,
+ * operations that can not make it fail with E_EE_DEADLINE
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns an errorcode, E_EE_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cEEPROM::eeSetRetryPolicy( const struct _i2c_retry_policy* pPolicy )
+{
+    int retVal;
+
+    if( pBus == (i2cConnection*) NULL )
+    {
+        retVal = pRemote != NULL ? E_EE_SUPP : E_EE_NO_CONNECTION;
+    }
+    else
+    {
+        eeLockBus();
+
+        if( (retVal = pBus->setRetryPolicy( pPolicy )) != E_I2C_SUCCESS )
+        {
+            retVal = E_EE_IOCTL;
+        }
+
+        eeUnlockBus();
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * unsigned long i2cEEPROM::eeRetryCount( void )
+ * ----------------------------------------------------
+ * number of transfers repeated so far
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns the count, 0 if not connected directly
+ ***************************************************************************
+*/
+unsigned long i2cEEPROM::eeRetryCount( void )
+{
+    return( pBus != (i2cConnection*) NULL ? 
+            __atomic_load_n( &pBus->i2c_stats.retries, __ATOMIC_RELAXED ) : 
+            0 );
+}
+
+/*
+ ***************************************************************************
+ * int i2cEEPROM::eeSetArbitration( bool enable )
+ * ----------------------------------------------------
+ * coordinate bus access with other processes using the
+ * library on the same adapter. Each logical operation runs
+ * under an advisory lock of the adapter (see i2cArbiter.h),
+ * so e.g. address pointer and read or the read-modify-write
+ * of eeWriteV() are not split by foreign traffic.
+ * All processes on the adapter have to turn it on.
+ * Through eepromd the daemon serializes access anyway.
+ * Operations that can not take the adapter lock fail with
+ * E_EE_ADAPTER_LOCK
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns an errorcode, E_EE_SUCCESS on success, E_EE_LOCK
+ * if the lock file of an open adapter can not be used
+ ***************************************************************************
+*/
+int i2cEEPROM::eeSetArbitration( bool enable )
+{
+    int retVal = E_EE_SUCCESS;
+
+    if( pRemote != (i2cRemote*) NULL || 
+        (enable && rt_worker.isRunning()) )
+    {
+        retVal = E_EE_SUPP;
+    }
+    else
+    {
+        use_arbiter = enable;
+
+        if( pBus != (i2cConnection*) NULL )
+        {
+            eeLockState( true );
+
+            if( enable )
+            {
+                if( (pArbiter = i2cArbiter::forBus( pBus->i2c_bus )) == 
+                    (i2cArbiter*) NULL )
+                {
+                    retVal = E_EE_INVAL_PARAM;
+                }
+                else
+                {
+                    // without the lock file there is no exclusion
+                    if( pArbiter->prepare() != E_ARB_SUCCESS )
+                    {
+                        pArbiter    = (i2cArbiter*) NULL;
+                        use_arbiter = false;
+                        retVal      = E_EE_LOCK;
+                    }
+                }
+            }
+            else
+            {
+                pArbiter = (i2cArbiter*) NULL;
+            }
+
+            eeUnlockState();
+        }
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * int i2cEEPROM::eeArbitrationStats( struct _i2c_arbiter_stats* pStats )
+ * ----------------------------------------------------
+ * counters of the adapter lock, shared by all instances on
+ * the same adapter within the process
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns an errorcode, E_EE_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cEEPROM::eeArbitrationStats( struct _i2c_arbiter_stats* pStats )
+{
+    int retVal = E_EE_SUCCESS;
+
+    if( pStats == NULL )
+    {
+        retVal = E_EE_DATA_NULLP;
+    }
+    else
+    {
+        if( pArbiter == (i2cArbiter*) NULL )
+        {
+            retVal = E_EE_SUPP;
+        }
+        else
+        {
+            pArbiter->getStats( pStats );
+        }
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * int i2cEEPROM::eeSetRealtime( const struct _i2c_rt_config* pConfig )
+ * ----------------------------------------------------
+ * real-time mode: the bus transfers are done by a worker thread
+ * pinned to pConfig->cpu with SCHED_FIFO pConfig->priority and
+ * the process memory is locked (see i2cRealtime.h). Cache reads
+ * stay on the caller. Waits for the write cycle sleep to an
+ * absolute time. Debug output must be off (no -DI2C_DEBUG).
+ * Not with the daemon or arbitration, both go through other
+ * processes. pConfig NULL ends the mode
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns an errorcode, E_EE_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cEEPROM::eeSetRealtime( const struct _i2c_rt_config* pConfig )
+{
+    int retVal = E_EE_SUCCESS;
+
+    // no transfer may be on its way to the worker meanwhile
+    eeLockState( true );
+
+    if( pConfig == NULL )
+    {
+        rt_worker.stop();
+    }
+    else
+    {
+        if( pRemote != (i2cRemote*) NULL || use_arbiter )
+        {
+            retVal = E_EE_SUPP;
+        }
+        else
+        {
+            if( rt_worker.isRunning() )
+            {
+                rt_worker.stop();
+            }
+
+            if( rt_worker.start( pConfig ) != E_RT_SUCCESS )
+            {
+                retVal = E_EE_REALTIME;
+            }
+        }
+    }
+
+    eeUnlockState();
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * int i2cEEPROM::eeRealtimeStats( struct _i2c_rt_stats* pStats )
+ * ----------------------------------------------------
+ * latency and wakeup jitter of the transfers done by the
+ * real-time worker
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns an errorcode, E_EE_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cEEPROM::eeRealtimeStats( struct _i2c_rt_stats* pStats )
+{
+    int retVal = E_EE_SUCCESS;
+
+    if( pStats == NULL )
+    {
+        retVal = E_EE_DATA_NULLP;
+    }
+    else
+    {
+        rt_worker.getStats( pStats );
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * int i2cEEPROM::eeRecordStart( const char* pPath )
+ * ----------------------------------------------------
+ * record every read, write and flush of this instance into
+ * pPath for eeReplay, see i2cRecord.h. A recording in progress
+ * is completed first
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns an errorcode, E_EE_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cEEPROM::eeRecordStart( const char* pPath )
+{
+    int retVal = E_EE_SUCCESS;
+
+    if( pPath == NULL )
+    {
+        retVal = E_EE_DATA_NULLP;
+    }
+    else
+    {
+        if( recorder.start( pPath, pTypeInfo != NULL ? ee_type : 0,
+                            ee_page_size, eeCapacity() ) != E_REC_SUCCESS )
+        {
+            retVal = E_EE_RECORD;
+        }
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * int i2cEEPROM::eeRecordStop( void )
+ * ----------------------------------------------------
+ * complete the recording, also done by eeClose()
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns an errorcode, E_EE_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cEEPROM::eeRecordStop( void )
+{
+    return( recorder.stop() == E_REC_SUCCESS ? E_EE_SUCCESS : E_EE_RECORD );
+}
+
+/*
+ ***************************************************************************
+ * void i2cEEPROM::eeRecordEnv( int busNo, int slaveAddr )
+ * ----------------------------------------------------
+ * start recording after eeOpen() if I2C_RECORD_DIR is set
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+void i2cEEPROM::eeRecordEnv( int busNo, int slaveAddr )
+{
+    const char* pDir;
+    char path[I2C_RECORD_PATH_LEN];
+
+    if( (pDir = getenv( I2C_RECORD_DIR_ENV )) != NULL && *pDir != '\0' )
+    {
+        snprintf( path, sizeof(path), I2C_RECORD_FILE_FMT, pDir, busNo,
+                  slaveAddr, (int) getpid() );
+        eeRecordStart( path );
+    }
+}
+
+/*
+ ***************************************************************************
+ * void i2cEEPROM::eeRecordCall( uint8_t op, uint16_t addr, int amount,
+ *                               int result, uint8_t flags )
+ * ----------------------------------------------------
+ * add a call to the recording, if there is one
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+void i2cEEPROM::eeRecordCall( uint8_t op, uint16_t addr, int amount, 
+                              int result, uint8_t flags )
+{
+    if( recorder.isRecording() )
+    {
+        recorder.record( op, addr, amount, result, flags );
+    }
+}
+
+/*
+ ***************************************************************************
+ * void i2cEEPROM::eeLockState( bool exclusive )
+ * void i2cEEPROM::eeUnlockState( void )
+ * void i2cEEPROM::eeLockBus( void )
+ * int i2cEEPROM::eeLockBusTimed( void )
+ * void i2cEEPROM::eeUnlockBus( void )
+ * ----------------------------------------------------
+ * locking helpers, no-ops unless thread safe mode is on.
+ * Order is state before bus before cache. eeLockBusTimed()
+ * gives up when the deadline of the thread passes
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * eeLockBusTimed() returns E_EE_SUCCESS or E_EE_DEADLINE,
+ * the others nothing
+ ***************************************************************************
+*/
+void i2cEEPROM::eeLockState( bool exclusive )
+{
+    if( thread_safe )
+    {
+        if( exclusive )
+        {
+            pthread_rwlock_wrlock( &state_lock );
+        }
+        else
+        {
+            pthread_rwlock_rdlock( &state_lock );
+        }
+    }
+}
+
+void i2cEEPROM::eeUnlockState( void )
+{
+    if( thread_safe )
+    {
+        pthread_rwlock_unlock( &state_lock );
+    }
+}
+
+void i2cEEPROM::eeLockBus( void )
+{
+    if( thread_safe )
+    {
+        bus_gate.enter( eeThreadPriority );
+    }
+}
+
+int i2cEEPROM::eeLockBusTimed( void )
+{
+    int retVal = E_EE_SUCCESS;
+
+    if( thread_safe && !bus_gate.enter( eeThreadPriority, i2cGetDeadline() ) )
+    {
+        i2cSetLastError( E_I2C_DEADLINE );
+        retVal = E_EE_DEADLINE;
+    }
+
+    return( retVal );
+}
+
+void i2cEEPROM::eeUnlockBus( void )
+{
+    if( thread_safe )
+    {
+        bus_gate.leave();
+    }
+}
+
+/*
+ ***************************************************************************
+ * int i2cEEPROM::eeCacheEnable( bool enable )
+ * ----------------------------------------------------
+ * keep pages read or written in memory and serve reads from
+ * there, within the budget set by eeCacheConfig(). Only for
+ * direct access, through eepromd the daemon caches
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns an errorcode, E_EE_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cEEPROM::eeCacheEnable( bool enable )
+{
+    int retVal = E_EE_SUCCESS;
+
+    if( enable && pRemote != (i2cRemote*) NULL )
+    {
+        return( E_EE_SUPP );
+    }
+
+    eeLockState( true );
+
+    cache_enabled = enable;
+    cache.release();
+    std::vector<uint8_t>().swap( cache_read_buf );
+
+    if( enable && pTypeInfo != NULL )
+    {
+        eeCacheSetup();
+    }
+
+    eeUnlockState();
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * int i2cEEPROM::eeCacheConfig( const struct _i2c_cache_config* pConfig )
+ * ----------------------------------------------------
+ * memory budget, eviction policy and readahead of the page
+ * cache, see i2cPageCache.h. A cache in use is emptied
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns an errorcode, E_EE_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cEEPROM::eeCacheConfig( const struct _i2c_cache_config* pConfig )
+{
+    int retVal = E_EE_SUCCESS;
+
+    if( pConfig == NULL )
+    {
+        retVal = E_EE_DATA_NULLP;
+    }
+    else
+    {
+        if( pConfig->budget < 0 || pConfig->readahead_max < 0 ||
+            (pConfig->policy != I2C_CACHE_LRU && 
+             pConfig->policy != I2C_CACHE_CLOCK) )
+        {
+            retVal = E_EE_INVAL_PARAM;
+        }
+        else
+        {
+            eeLockState( true );
+
+            cache_config = *pConfig;
+
+            if( cache_enabled && pTypeInfo != NULL )
+            {
+                eeCacheSetup();
+            }
+
+            eeUnlockState();
+        }
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * void i2cEEPROM::eeCacheSetup( void )
+ * ----------------------------------------------------
+ * allocate the cache for the current type and configuration,
+ * state lock held exclusively
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+void i2cEEPROM::eeCacheSetup( void )
+{
+    cache.configure( ee_page_size, ee_total_pages, cache_config.budget,
+                     cache_config.policy );
+    cache_read_buf.assign( cache.capacity(), 0 );
+    ra_next   = -1;
+    ra_window = 0;
 }
 
-
 /*
  ***************************************************************************
- * int i2cEEPROM::eeInit( void )
+ * bool i2cEEPROM::eeCacheLookup( uint16_t addr, uint8_t* pBuffer, 
+ *                                int amount )
  * ----------------------------------------------------
- * initialize EEPROM with params set
+ * copy amount bytes at device address addr from the cache,
+ * if all pages involved are cached
  * ----------------------------------------------------
  * 
  * ----------------------------------------------------
- * returns an errorcode, E_I2C_SUCCESS on success
+ * returns true if the read was served from the cache
  ***************************************************************************
 */
-int i2cEEPROM::eeInit( void )
+bool i2cEEPROM::eeCacheLookup( uint16_t addr, uint8_t* pBuffer, int amount )
 {
-    int retVal;
+    bool retVal = false;
 
-    if( pBus != (i2cConnection*) NULL )
+    if( !cache_enabled || !cache.isConfigured() || pBuffer == NULL ||
+        addr == I2C_CURRENT_ADDRESS || amount <= 0 )
+    {
+        return( false );
+    }
+
+    // a CLOCK hit only sets a bit, an LRU hit reorders the list
+    if( thread_safe )
     {
-        if( (retVal = pBus->initID( makeMagic(), ee_type )) == E_I2C_SUCCESS )
+        if( cache.concurrentLookup() )
         {
-            byte_offset = EE_PRIVATE_HDR_LEN;
-            autoInit = false;
+            pthread_rwlock_rdlock( &cache_lock );
+        }
+        else
+        {
+            pthread_rwlock_wrlock( &cache_lock );
         }
+    }
 
-//
-//        if( (retVal = pBus->writeWord( 0, makeMagic() )) == E_I2C_SUCCESS )
-//        {
-//            retVal = pBus->writeWord( 2, ee_type );
-//            byte_offset = EE_PRIVATE_HDR_LEN;
-//            autoInit = false;
-//        }
+    retVal = cache.lookup( addr, pBuffer, amount );
 
-    }
-    else
+    if( thread_safe )
     {
-        retVal = E_I2C_FAIL;
+        pthread_rwlock_unlock( &cache_lock );
     }
 
     return( retVal );
 }
 
-
 /*
  ***************************************************************************
- * void i2cEEPROM::eeClose( void )
+ * void i2cEEPROM::eeCacheStore( uint16_t addr, const uint8_t* pData, 
+ *                               int amount )
  * ----------------------------------------------------
- * close handle to i2c device
+ * take amount bytes at device address addr into the cache,
+ * after they were read from or written to the device. Pages
+ * covered completely are cached, evicting others if needed
  * ----------------------------------------------------
  * 
  * ----------------------------------------------------
  * returns nothing
  ***************************************************************************
 */
-void i2cEEPROM::eeClose( void )
+void i2cEEPROM::eeCacheStore( uint16_t addr, const uint8_t* pData, 
+                              int amount )
 {
-    if( pBus != (i2cConnection*) NULL )
+    int evicted;
+
+    if( !cache_enabled || !cache.isConfigured() || pData == NULL ||
+        addr == I2C_CURRENT_ADDRESS || amount <= 0 )
+    {
+        return;
+    }
+
+    if( thread_safe )
+    {
+        pthread_rwlock_wrlock( &cache_lock );
+    }
+
+    if( (evicted = cache.store( addr, pData, amount )) > 0 )
+    {
+        I2C_STAT_ADD( counters.cache_evictions, evicted );
+    }
+
+    if( thread_safe )
     {
-        pBus->i2cClose();
+        pthread_rwlock_unlock( &cache_lock );
     }
 }
 
 /*
  ***************************************************************************
- * int i2cEEPROM::eeOpen( int busNo, int slaveAddr )
+ * int i2cEEPROM::eeHeaderRead( void )
  * ----------------------------------------------------
- * open handle to an i2c device
+ * read the header of the chip into hdr_state, hdr_serial and
+ * hdr_generation. Bus lock held
  * ----------------------------------------------------
  * 
  * ----------------------------------------------------
- * returns E_EE_SUCCESS or an error code
+ * returns an errorcode, E_EE_SUCCESS on success
  ***************************************************************************
 */
-int i2cEEPROM::eeOpen( int busNo, int slaveAddr )
+int i2cEEPROM::eeHeaderRead( void )
 {
     int retVal;
+    uint16_t magic;
+    uint8_t hdr[I2C_EEPROM_ID_V2_LEN];
 
-    if( (pBus = new i2cConnection( busNo, slaveAddr, false, O_RDWR )) != NULL )
+    if( (retVal = eeBusRead( 0, hdr, sizeof(hdr) )) == E_EE_SUCCESS )
     {
-        // retVal = pBus->i2cOpen( busNo, slaveAddr, false, O_RDWR );
-        retVal = pBus->i2cOpen();
-    }
-    else
-    {
-        retVal = E_I2C_FAIL;
+        getWordFromBuffer( &hdr[0], &magic );
+
+        if( magic == makeMagicV2() )
+        {
+            hdr_state      = EE_HDR_V2;
+            hdr_serial     = eeGet32( &hdr[I2C_EEPROM_SERIAL_OFFSET] );
+            hdr_generation = eeGet32( &hdr[I2C_EEPROM_GEN_OFFSET] );
+        }
+        else
+        {
+            hdr_state = EE_HDR_V1;
+        }
     }
 
     return( retVal );
 }
 
-
 /*
  ***************************************************************************
- * int i2cEEPROM::eeTypeDetect( uint16_t* pMagic, uint16_t* pType )
+ * int i2cEEPROM::eeGenerationBump( void )
  * ----------------------------------------------------
- * try to get info from EEPROM
+ * increment the generation of the chip before the first write
+ * since eeOpen() or the last eeFlush(), so a host image saved
+ * before no longer matches. If another writer moved the
+ * generation on meanwhile, the cache is dropped. Chips without
+ * a generation are left alone. Direct access only, state and
+ * bus lock held
  * ----------------------------------------------------
  * 
  * ----------------------------------------------------
- * returns an errorcode, E_I2C_SUCCESS on success
- * the values pointed by pMagic and pType will contain the
- * detected magic and EEPROM type in case of success
+ * returns an errorcode, E_EE_SUCCESS on success
  ***************************************************************************
 */
-int i2cEEPROM::eeTypeDetect( uint16_t* pMagic, uint16_t* pType )
+int i2cEEPROM::eeGenerationBump( void )
 {
     int retVal;
+    bool known;
+    uint32_t cached;
+    uint8_t gen[4];
 
-    if( pBus != (i2cConnection*) NULL )
+    if( gen_bumped || hdr_state == EE_HDR_V1 || pBus == (i2cConnection*) NULL ||
+        pTypeInfo == NULL )
     {
-        if( pMagic == NULL || pType == NULL )
+        return( E_EE_SUCCESS );
+    }
+
+    // the generation the cache was filled under
+    known  = hdr_state == EE_HDR_V2;
+    cached = hdr_generation;
+
+    // read and write back in one go, another process may bump as well
+    retVal = eeArbitrated( [&]() {
+        int opRet;
+
+        if( (opRet = eeHeaderRead()) == E_EE_SUCCESS && 
+            hdr_state == EE_HDR_V2 )
         {
-            retVal = E_EE_DATA_NULLP;
+            hdr_generation++;
+            eePut32( gen, hdr_generation );
+            opRet = eeBusWrite( I2C_EEPROM_GEN_OFFSET, gen, sizeof(gen) );
         }
-        else
+
+        return( opRet ); } );
+
+    if( retVal == E_EE_SUCCESS )
+    {
+        if( hdr_state == EE_HDR_V2 )
         {
-            retVal = pBus->check4Magic( pMagic, pType );
+            // another writer was here, the cached pages may be stale
+            // and must not go into the image with this generation
+            if( !known || hdr_generation != cached + 1 )
+            {
+                if( thread_safe )
+                {
+                    pthread_rwlock_wrlock( &cache_lock );
+                }
+
+                cache.clear();
+
+                if( thread_safe )
+                {
+                    pthread_rwlock_unlock( &cache_lock );
+                }
+            }
+
+            eeCacheStore( I2C_EEPROM_GEN_OFFSET, gen, sizeof(gen) );
+            eeMirrorUpdate( I2C_EEPROM_GEN_OFFSET, gen, sizeof(gen) );
         }
-    }
-    else
-    {
-        retVal = E_EE_NO_CONNECTION;
 
+        gen_bumped = true;
     }
 
     return( retVal );
@@ -207,82 +4229,63 @@ int i2cEEPROM::eeTypeDetect( uint16_t* pMagic, uint16_t* pType )
 
 /*
  ***************************************************************************
- * int i2cEEPROM::eeTypeSet( uint16_t type )
+ * int i2cEEPROM::eeImageCacheEnable( bool enable, const char* pDir )
  * ----------------------------------------------------
- * initialize internal data to match EEPROM type <type>
+ * keep a copy of the chip on the host, see i2cImage.h. The
+ * page cache is turned on for the whole chip and filled from
+ * the image when the type is set, if the generation of the
+ * chip is still the one of the image. pDir NULL takes the
+ * directory from I2C_IMAGE_DIR or I2C_IMAGE_DEFAULT_DIR.
+ * Direct access only
  * ----------------------------------------------------
  * 
  * ----------------------------------------------------
- * returns an errorcode, E_I2C_SUCCESS on success
+ * returns an errorcode, E_EE_SUCCESS on success
  ***************************************************************************
 */
-int i2cEEPROM::eeTypeSet( uint16_t type )
+int i2cEEPROM::eeImageCacheEnable( bool enable, const char* pDir )
 {
-    int retVal;
+    int retVal = E_EE_SUCCESS;
 
-    if( pBus != (i2cConnection*) NULL )
+    if( !enable )
     {
-        switch( type )
-        {
-            case EE_TYPE_24AA65:
-fprintf(stderr, "Set EEPROM type to %s\n", EE_NAMES_24AA65);
-                ee_type        = type;
-                ee_page_size   = PAGE_SIZE_24AA65;
-                ee_total_pages = TOTAL_PAGES_24AA65;
-                ee_block_size  = BLOCK_SIZE_24AA65;
-                pBus->i2c_16bit_addressing  = ADRESSING_16_BIT_24AA65;
-                pBus->i2c_write_cycle_time  = WRITE_CYCLE_TIME_24AA65;
-                pBus->i2c_bus_frequency_1V8 = BUS_FREQUENCY_1V8_24AA65;
-                pBus->i2c_bus_frequency_4V5 = BUS_FREQUENCY_4V5_24AA65;
-                retVal = E_EE_SUCCESS;
-                break;
-            case EE_TYPE_24LC65:
-fprintf(stderr, "Set EEPROM type to %s\n", EE_NAMES_24LC65);
-                ee_type        = type;
-                ee_page_size   = PAGE_SIZE_24LC65;
-                ee_total_pages = TOTAL_PAGES_24LC65;
-                ee_block_size  = BLOCK_SIZE_24LC65;
-                pBus->i2c_16bit_addressing  = ADRESSING_16_BIT_24LC65;
-                pBus->i2c_write_cycle_time  = WRITE_CYCLE_TIME_24LC65;
-                pBus->i2c_bus_frequency_1V8 = BUS_FREQUENCY_1V8_24LC65;
-                pBus->i2c_bus_frequency_4V5 = BUS_FREQUENCY_4V5_24LC65;
-                retVal = E_EE_SUCCESS;
-                break;
-            case EE_TYPE_24C65:
-fprintf(stderr, "Set EEPROM type to %s\n", EE_NAMES_24C65);
-                ee_type        = type;
-                ee_page_size   = PAGE_SIZE_24C65;
-                ee_total_pages = TOTAL_PAGES_24C65;
-                ee_block_size  = BLOCK_SIZE_24C65;
-                pBus->i2c_16bit_addressing  = ADRESSING_16_BIT_24C65;
-                pBus->i2c_write_cycle_time  = WRITE_CYCLE_TIME_24C65;
-                pBus->i2c_bus_frequency_1V8 = BUS_FREQUENCY_1V8_24C65;
-                pBus->i2c_bus_frequency_4V5 = BUS_FREQUENCY_4V5_24C65;
-                retVal = E_EE_SUCCESS;
-                break;
-            case EE_TYPE_24C16:
-fprintf(stderr, "Set EEPROM type to %s\n", EE_NAMES_24C16);
-                ee_type        = type;
-                ee_page_size   = PAGE_SIZE_24C16;
-                ee_total_pages = TOTAL_PAGES_24C16;
-                ee_block_size  = BLOCK_SIZE_24C16;
-                pBus->i2c_16bit_addressing  = ADRESSING_16_BIT_24C16;
-                pBus->i2c_write_cycle_time  = WRITE_CYCLE_TIME_24C16;
-                pBus->i2c_bus_frequency_1V8 = BUS_FREQUENCY_1V8_24C16;
-                pBus->i2c_bus_frequency_4V5 = BUS_FREQUENCY_4V5_24C16;
-                retVal = E_EE_SUCCESS;
-                break;
-            default:
-fprintf(stderr, "EEPROM type %4x INVALID!\n", type);
-                retVal = E_EE_INVAL_TYPE;
-                break;
+        eeLockState( true );
+        image_enabled = false;
+        eeUnlockState();
 
-        }
+        return( retVal );
+    }
 
+    if( pRemote != (i2cRemote*) NULL )
+    {
+        return( E_EE_SUPP );
     }
-    else
+
+    if( pDir == NULL && (pDir = getenv( I2C_IMAGE_DIR_ENV )) == NULL )
     {
-        retVal = E_I2C_FAIL;
+        pDir = I2C_IMAGE_DEFAULT_DIR;
+    }
+
+    if( strlen( pDir ) >= sizeof(image_dir) - 32 )
+    {
+        return( E_EE_INVAL_PARAM );
+    }
+
+    if( (mkdir( pDir, 0755 ) != 0 && errno != EEXIST) || 
+        access( pDir, R_OK | W_OK | X_OK ) != 0 )
+    {
+        return( E_EE_IMAGE );
+    }
+
+    eeLockState( true );
+    strcpy( image_dir, pDir );
+    image_enabled = true;
+    cache_config.budget = 0;
+    eeUnlockState();
+
+    if( (retVal = eeCacheEnable( true )) == E_EE_SUCCESS )
+    {
+        retVal = eeImageLoad();
     }
 
     return( retVal );
@@ -290,240 +4293,377 @@ fprintf(stderr, "EEPROM type %4x INVALID!\n", type);
 
 /*
  ***************************************************************************
- * int i2cEEPROM::eeTypeSet( uint16_t type )
+ * int i2cEEPROM::eeImageLoad( void )
  * ----------------------------------------------------
- * initialize internal data to match EEPROM type <type>
+ * read the header of the chip and, if the host image has its
+ * generation, put the pages of the image into the cache.
+ * A missing or outdated image is no error
  * ----------------------------------------------------
  * 
  * ----------------------------------------------------
- * returns an errorcode, E_I2C_SUCCESS on success
+ * returns an errorcode, E_EE_SUCCESS on success
  ***************************************************************************
 */
-void i2cEEPROM::eeInfo( void )
+int i2cEEPROM::eeImageLoad( void )
 {
-    bool validType = true;
+    int retVal = E_EE_SUCCESS;
+    int page;
+    int loaded = 0;
+    char path[I2C_IMAGE_PATH_LEN];
+    struct _ee_image_hdr imgHdr;
+    std::vector<uint8_t> valid;
+    std::vector<uint8_t> data;
 
-    switch( ee_type )
+    if( !image_enabled || pBus == (i2cConnection*) NULL || pTypeInfo == NULL )
     {
-        case EE_TYPE_24AA65:
-fprintf(stderr, "EEPROM type %s\n", EE_NAMES_24AA65);
-            break;
-        case EE_TYPE_24LC65:
-fprintf(stderr, "EEPROM type %s\n", EE_NAMES_24LC65);
-            break;
-        case EE_TYPE_24C65:
-fprintf(stderr, "EEPROM type %s\n", EE_NAMES_24C65);
-            break;
-        case EE_TYPE_24C16:
-fprintf(stderr, "EEPROM type %s\n", EE_NAMES_24C16);
-            break;
-        default:
-            validType = false;
-fprintf(stderr, "INVALID EEPROM type %4x!\n", ee_type);
-            break;
-
+        return( E_EE_SUCCESS );
     }
 
-    if( validType )
+    eeLockState( false );
+    eeLockBus();
+
+    if( !gen_bumped )
     {
-        fprintf(stderr, "Type ....,,.......: %4d\n", ee_type );
-        fprintf(stderr, "Page size ........: %4d byte\n", ee_page_size );
-        fprintf(stderr, "Total pages ......: %4d\n", ee_total_pages );
-        fprintf(stderr, "Block size .......: %4d byte\n", ee_block_size );
+        retVal = eeHeaderRead();
+    }
 
-        if( pBus != NULL )
+    if( retVal == E_EE_SUCCESS && hdr_state == EE_HDR_V2 && 
+        cache_enabled && cache.isConfigured() &&
+        i2cImagePath( path, image_dir, bus_no, slave_addr, 
+                      hdr_serial ) == E_IMG_SUCCESS &&
+        i2cImageRead( path, &imgHdr, valid, data ) == E_IMG_SUCCESS &&
+        imgHdr.bus == bus_no && imgHdr.addr == slave_addr &&
+        imgHdr.serial == hdr_serial && imgHdr.generation == hdr_generation &&
+        imgHdr.type == ee_type && imgHdr.page_size == ee_page_size &&
+        imgHdr.total_pages == ee_total_pages )
+    {
+        if( thread_safe )
         {
-//            fprintf(stderr, "16 bit addressing : %s\n", 
-//                    pBus->i2c_16bit_addressing == true ? "true" : "false" );
+            pthread_rwlock_wrlock( &cache_lock );
+        }
 
-            fprintf(stderr, "Addressing .......: %4d bit\n", 
-                    pBus->i2c_16bit_addressing == true ? 16 : 8 );
+        for( page = 0; page < ee_total_pages; page++ )
+        {
+            if( valid[page] )
+            {
+                cache.store( page * ee_page_size, 
+                             &data[page * ee_page_size], ee_page_size );
+                loaded++;
+            }
+        }
 
-            fprintf(stderr, "Write cycle time .: %4d ms\n", 
-                             pBus->i2c_write_cycle_time );
-            fprintf(stderr, "Bus frequency 1V8 : %4d kHz\n", 
-                             pBus->i2c_bus_frequency_1V8 );
-            fprintf(stderr, "Bus frequency 4V5 : %4d kHz\n", 
-                             pBus->i2c_bus_frequency_4V5 );
+        if( thread_safe )
+        {
+            pthread_rwlock_unlock( &cache_lock );
         }
+
+        I2C_STAT_ADD( counters.image_pages, loaded );
     }
+
+    eeUnlockBus();
+    eeUnlockState();
+
+    return( retVal );
 }
 
 /*
  ***************************************************************************
- * int i2cEEPROM::eeRead( uint8_t* pBuffer, int amount, uint16_t addr )
+ * int i2cEEPROM::eeImageSave( void )
  * ----------------------------------------------------
- * read amount of bytes from address addr into buffer pointed by pBuffer
+ * write the pages in the cache to the host image, labelled
+ * with the generation of the chip. State and bus lock held
  * ----------------------------------------------------
  * 
  * ----------------------------------------------------
- * returns an errorcode, E_I2C_SUCCESS on success
+ * returns an errorcode, E_EE_SUCCESS on success
  ***************************************************************************
 */
-int i2cEEPROM::eeRead( uint16_t addr, uint8_t* pBuffer, int amount )
+int i2cEEPROM::eeImageSave( void )
 {
-    int retVal = 0;
+    int retVal = E_EE_SUCCESS;
+    int page;
+    char path[I2C_IMAGE_PATH_LEN];
+    struct _ee_image_hdr imgHdr;
+    std::vector<uint8_t> valid;
+    std::vector<uint8_t> data;
 
-    if( pBus != (i2cConnection*) NULL )
+    if( !image_enabled || pBus == (i2cConnection*) NULL || 
+        pTypeInfo == NULL || hdr_state != EE_HDR_V2 || 
+        !cache_enabled || !cache.isConfigured() )
     {
-fprintf(stderr, "called i2cEEPROM::eeRead\n"); 
-fprintf(stderr, "addr = %4x [%u]\n", addr, addr);
+        return( E_EE_SUCCESS );
+    }
 
-        if( addr != I2C_CURRENT_ADDRESS )
-        {
-            addr += byte_offset;
-        }
+    memset( &imgHdr, 0, sizeof(imgHdr) );
+    memcpy( imgHdr.magic, I2C_IMAGE_MAGIC, sizeof(imgHdr.magic) );
+    imgHdr.version     = I2C_IMAGE_VERSION;
+    imgHdr.bus         = bus_no;
+    imgHdr.addr        = slave_addr;
+    imgHdr.serial      = hdr_serial;
+    imgHdr.generation  = hdr_generation;
+    imgHdr.type        = ee_type;
+    imgHdr.page_size   = ee_page_size;
+    imgHdr.total_pages = ee_total_pages;
 
-fprintf(stderr, "addr = %4x [%u]\n", addr, addr);
+    valid.assign( ee_total_pages, 0 );
+    data.assign( ee_total_pages * ee_page_size, 0xff );
 
-        retVal = pBus->readBuf( addr, pBuffer, amount );
-    }
-    else
+    if( thread_safe )
     {
-        retVal = E_I2C_FAIL;
+        pthread_rwlock_rdlock( &cache_lock );
     }
 
-    return( retVal );
-}
-
-
-int i2cEEPROM::eeReadByte( uint16_t addr, uint8_t* pByteValue )
-{
-    int retVal = 0;
-
-    if( pBus != (i2cConnection*) NULL )
+    for( page = 0; page < ee_total_pages; page++ )
     {
-fprintf(stderr, "called i2cEEPROM::eeReadByte\n"); 
-fprintf(stderr, "addr = %4x [%u]\n", addr, addr);
-
-        if( addr != I2C_CURRENT_ADDRESS )
-        {
-            addr += byte_offset;
-        }
-
-fprintf(stderr, "addr = %4x [%u]\n", addr, addr);
+        valid[page] = cache.peek( page, &data[page * ee_page_size] ) ? 1 : 0;
+    }
 
-        retVal = pBus->readByte( addr, pByteValue );
+    if( thread_safe )
+    {
+        pthread_rwlock_unlock( &cache_lock );
     }
-    else
+
+    if( i2cImagePath( path, image_dir, bus_no, slave_addr, 
+                      hdr_serial ) != E_IMG_SUCCESS ||
+        i2cImageWrite( path, &imgHdr, valid, data ) != E_IMG_SUCCESS )
     {
-        retVal = E_I2C_FAIL;
+I2C_DBG("can not save image of %d-%02x\n", bus_no, slave_addr);
+        retVal = E_EE_IMAGE;
     }
 
     return( retVal );
 }
 
-int i2cEEPROM::eeReadWord( uint16_t addr, uint16_t* pWordValue )
+/*
+ ***************************************************************************
+ * int i2cEEPROM::eeSerial( uint32_t* pSerial, uint32_t* pGeneration )
+ * ----------------------------------------------------
+ * serial number and generation from the header of the chip,
+ * chips initialized before release 2 of the header have none
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns an errorcode, E_EE_SUCCESS on success, E_EE_SUPP for
+ * a chip without serial
+ ***************************************************************************
+*/
+int i2cEEPROM::eeSerial( uint32_t* pSerial, uint32_t* pGeneration )
 {
-    int retVal = 0;
+    int retVal;
 
-    if( pBus != (i2cConnection*) NULL )
+    if( pSerial == NULL || pGeneration == NULL )
     {
-fprintf(stderr, "called i2cEEPROM::eeReadWord\n"); 
-fprintf(stderr, "addr = %4x [%u]\n", addr, addr);
+        return( E_EE_DATA_NULLP );
+    }
 
-        if( addr != I2C_CURRENT_ADDRESS )
-        {
-            addr += byte_offset;
-        }
+    if( !eeConnected() )
+    {
+        return( E_EE_NO_CONNECTION );
+    }
 
-fprintf(stderr, "addr = %4x [%u]\n", addr, addr);
+    eeLockState( false );
+    eeLockBus();
 
-        retVal = pBus->readWord( addr, pWordValue );
-    }
-    else
+    if( (retVal = eeHeaderRead()) == E_EE_SUCCESS )
     {
-        retVal = E_I2C_FAIL;
+        if( hdr_state == EE_HDR_V2 )
+        {
+            *pSerial     = hdr_serial;
+            *pGeneration = hdr_generation;
+        }
+        else
+        {
+            retVal = E_EE_SUPP;
+        }
     }
 
+    eeUnlockBus();
+    eeUnlockState();
+
     return( retVal );
 }
 
+/*
+ ***************************************************************************
+ * bus scan
+ ***************************************************************************
+*/
+struct _ee_scan_job {
+    int       bus;
+    int       firstAddr;
+    int       lastAddr;
+    pthread_t thread;
+    bool      started;
+    std::vector<struct eeScanResult> found;
+};
 
 /*
  ***************************************************************************
- * int i2cEEPROM::eeWrite( uint8_t* pBuffer, int amount, uint16_t addr )
+ * static void* eeScanBus( void* pArg )
  * ----------------------------------------------------
- * write amount of bytes pointed by pBuffer to address addr
+ * probe the addresses of one adapter, the adapter is opened
+ * once and only the slave address is switched. Only devices
+ * that answer the probe are asked for the header
  * ----------------------------------------------------
  * 
  * ----------------------------------------------------
- * returns an errorcode, E_I2C_SUCCESS on success
+ * returns NULL
  ***************************************************************************
 */
-int i2cEEPROM::eeWrite( uint16_t addr, uint8_t* pBuffer, int amount )
+static void* eeScanBus( void* pArg )
 {
-    int retVal = 0;
+    struct _ee_scan_job* pJob = (struct _ee_scan_job*) pArg;
+    struct eeScanResult found;
+    i2cConnection conn;
+    bool opened = false;
+    int addr;
+    int res;
 
-    if( pBus != (i2cConnection*) NULL )
+    // valid 7 bit addresses only
+    for( addr = 0x03; addr <= 0x77; addr++ )
     {
-fprintf(stderr, "called i2cEEPROM::eeWrite\n"); 
-fprintf(stderr, "addr = %4x [%u]\n", addr, addr);
+        if( !(addr >= EE_SCAN_FIRST_ADDR && addr <= EE_SCAN_LAST_ADDR) &&
+            !(addr >= pJob->firstAddr && addr <= pJob->lastAddr) )
+        {
+            continue;
+        }
 
-        if( addr != I2C_CURRENT_ADDRESS )
+        if( !opened )
         {
-            addr += byte_offset;
+            if( (res = conn.i2cOpen( pJob->bus, addr, false, O_RDWR )) ==
+                E_I2C_SUCCESS )
+            {
+                opened = true;
+            }
+            else
+            {
+                if( res == E_I2C_NODEV )
+                {
+                    break;
+                }
+                // I2C_SLAVE refused, kernel driver bound to addr
+                res = conn.i2c_lastErrno == EBUSY ? E_I2C_IN_USE : res;
+            }
+        }
+        else
+        {
+            res = conn.i2cSelect( addr );
         }
 
-fprintf(stderr, "addr = %4x [%u]\n", addr, addr);
+        found.bus   = pJob->bus;
+        found.addr  = addr;
+        found.magic = 0;
+        found.type  = 0;
+        found.pInfo = NULL;
 
-        retVal = pBus->writeBuf( addr, pBuffer, amount );
-    }
-    else
-    {
-        retVal = E_I2C_FAIL;
+        if( res == E_I2C_IN_USE )
+        {
+            found.state = EE_SCAN_IN_USE;
+            pJob->found.push_back( found );
+        }
+        else
+        {
+            if( res == E_I2C_SUCCESS && conn.probe() == E_I2C_SUCCESS )
+            {
+                if( conn.check4Magic( &found.magic, &found.type ) == 
+                    E_I2C_SUCCESS )
+                {
+                    found.state = EE_SCAN_FOUND;
+                    found.pInfo = eeTypeInfo( found.type );
+                }
+                else
+                {
+                    found.state = EE_SCAN_NO_HEADER;
+                }
+                pJob->found.push_back( found );
+            }
+        }
     }
-    return( retVal );
+
+    conn.i2cClose();
+
+    return( NULL );
 }
 
-int i2cEEPROM::eeWriteByte( uint16_t addr, uint8_t byteValue )
+/*
+ ***************************************************************************
+ * int i2cEEPROM::eeScan( std::vector<struct eeScanResult>& results,
+ *                        int firstAddr, int lastAddr )
+ * ----------------------------------------------------
+ * look for EEPROMs on all adapters /dev/i2c-*, all adapters
+ * are scanned at the same time. Probed are EE_SCAN_FIRST_ADDR
+ * to EE_SCAN_LAST_ADDR and, if given, firstAddr to lastAddr.
+ * results lists every device that answered, sorted by bus
+ * and address
+ * ----------------------------------------------------
+ * 
+ * ----------------------------------------------------
+ * returns an errorcode, E_EE_SUCCESS on success,
+ * E_EE_NODEV if there is no adapter at all
+ ***************************************************************************
+*/
+int i2cEEPROM::eeScan( std::vector<struct eeScanResult>& results,
+                       int firstAddr, int lastAddr )
 {
-    int retVal = 0;
+    int retVal = E_EE_SUCCESS;
+    int bus;
+    int len;
+    size_t i;
+    DIR* pDir;
+    struct dirent* pEntry;
+    std::vector<int> buses;
+    std::vector<struct _ee_scan_job> jobs;
 
-    if( pBus != (i2cConnection*) NULL )
+    results.clear();
+
+    if( (pDir = opendir( "/dev" )) == NULL )
     {
-fprintf(stderr, "called i2cEEPROM::eeWriteByte\n"); 
-fprintf(stderr, "addr = %4x [%u]\n", addr, addr);
+        return( E_EE_NODEV );
+    }
 
-        if( addr != I2C_CURRENT_ADDRESS )
+    while( (pEntry = readdir( pDir )) != NULL )
+    {
+        if( sscanf( pEntry->d_name, "i2c-%d%n", &bus, &len ) == 1 &&
+            pEntry->d_name[len] == '\0' )
         {
-            addr += byte_offset;
+            buses.push_back( bus );
         }
+    }
 
-fprintf(stderr, "addr = %4x [%u]\n", addr, addr);
+    closedir( pDir );
 
-        retVal = pBus->writeByte( addr, byteValue );
-    }
-    else
+    if( buses.empty() )
     {
-        retVal = E_I2C_FAIL;
+        return( E_EE_NODEV );
     }
-    return( retVal );
-}
 
-int i2cEEPROM::eeWriteWord( uint16_t addr, uint16_t wordValue )
-{
-    int retVal = 0;
+    std::sort( buses.begin(), buses.end() );
 
-    if( pBus != (i2cConnection*) NULL )
-    {
-fprintf(stderr, "called i2cEEPROM::eeWriteWord\n"); 
-fprintf(stderr, "addr = %4x [%u]\n", addr, addr);
+    jobs.resize( buses.size() );
 
-        if( addr != I2C_CURRENT_ADDRESS )
+    for( i = 0; i < jobs.size(); i++ )
+    {
+        jobs[i].bus       = buses[i];
+        jobs[i].firstAddr = firstAddr;
+        jobs[i].lastAddr  = lastAddr;
+        jobs[i].started   = pthread_create( &jobs[i].thread, NULL, 
+                                            eeScanBus, &jobs[i] ) == 0;
+        if( !jobs[i].started )
         {
-            addr += byte_offset;
+            eeScanBus( &jobs[i] );
         }
-
-fprintf(stderr, "addr = %4x [%u]\n", addr, addr);
-
-        retVal = pBus->writeWord( addr, wordValue );
     }
-    else
+
+    for( i = 0; i < jobs.size(); i++ )
     {
-        retVal = E_I2C_FAIL;
+        if( jobs[i].started )
+        {
+            pthread_join( jobs[i].thread, NULL );
+        }
+
+        results.insert( results.end(), jobs[i].found.begin(), 
+                        jobs[i].found.end() );
     }
+
     return( retVal );
 }
-
-
@@ -34,7 +34,28 @@
 #define I2CEEPROM_H
 
 #include <stdint.h>
+#include <string.h>
 #include "i2cCore.h"
+#include "i2cMirror.h"
+#include "i2cRemote.h"
+#include "i2cArbiter.h"
+#include "i2cScheduler.h"
+#include "i2cPriority.h"
+#include "i2cHistogram.h"
+#include "i2cRealtime.h"
+#include "i2cRecord.h"
+#include "i2cPageCache.h"
+#include "i2cImage.h"
+#include "i2cPool.h"
+#include "i2cLz.h"
+
+#include <pthread.h>
+
+#ifdef __cplusplus
+#include <type_traits>
+#include <vector>
+#include <functional>
+#endif
 
 #ifdef __cplusplus
 extern "C" {
@@ -52,8 +73,69 @@ extern "C" {
 #define E_EE_INVAL_TYPE            -9
 #define E_EE_NO_CONNECTION        -10
 #define E_EE_DATA_NULLP           -11
+#define E_EE_INVAL_PARAM          -12
+#define E_EE_MIRROR               -13
+#define E_EE_REMOTE               -14
+#define E_EE_LOCK                 -15
+#define E_EE_REALTIME             -16
+#define E_EE_RECORD               -17
+#define E_EE_IMAGE                -18
+// transfers fail with E_I2C_DEADLINE, passed through unchanged
+#define E_EE_DEADLINE             E_I2C_DEADLINE
+// the adapter lock of arbitration can not be taken, passed through as well
+#define E_EE_ADAPTER_LOCK         E_I2C_LOCK
 
 #define EE_PRIVATE_HDR_LEN          4
+#define EE_PRIVATE_HDR_V2_LEN      I2C_EEPROM_ID_V2_LEN
+
+// what is known about the header of the chip, see eeGenerationBump()
+#define EE_HDR_UNKNOWN              0
+#define EE_HDR_V1                   1   // no serial and generation
+#define EE_HDR_V2                   2
+
+// ranges closer than this are merged into one transfer by eeReadV/eeWriteV
+#define EE_DEFAULT_GAP_THRESHOLD    8
+
+// bulk transfers are cut into pieces of at most this size for reads,
+// writes into single pages, so urgent operations get in between
+#define EE_BULK_READ_QUANTUM       32
+
+// a counter slot: value, sequence number and CRC, MSB first.
+// Slots are aligned to their size, so a slot never crosses a page
+#define EE_COUNTER_SLOT_LEN         8
+#define EE_COUNTER_MIN_SLOTS        2
+
+// a log block: CRC, sequence number, bytes of records and the
+// records, see eeLogOpen(). Blocks are whole pages
+#define EE_LOG_HDR_LEN              8
+#define EE_LOG_DEFAULT_BLOCK       64
+#define EE_LOG_MAX_BLOCK          512
+#define EE_LOG_MIN_BLOCKS           2
+#define EE_LOG_MAX_RECORD         255
+// blocks read with one transfer by eeLogWalk()
+#define EE_LOG_READ_BLOCKS          4
+
+// header of an A/B slot: CRC of the header, generation, length and
+// CRC of the data, see eeABOpen(). Rounded up to whole pages
+#define EE_AB_HDR_LEN              10
+
+// a blob: CRC, method, length of the data and of what is stored,
+// then the stored bytes, see eeBlobWrite()
+#define EE_BLOB_HDR_LEN             8
+#define EE_BLOB_STORED              0   // as it is
+#define EE_BLOB_LZ                  1   // compressed, see i2cLz.h
+#define EE_BLOB_LZ_DELTA16          2   // 16 bit differences compressed
+// stored bytes read with one transfer by eeBlobRead()
+#define EE_BLOB_READ_CHUNK         64
+
+// addresses probed by eeScan(), a 24C16 occupies all of them
+#define EE_SCAN_FIRST_ADDR       0x50
+#define EE_SCAN_LAST_ADDR        0x57
+
+// state of a device found by eeScan()
+#define EE_SCAN_FOUND               0
+#define EE_SCAN_NO_HEADER           1
+#define EE_SCAN_IN_USE              2
 
 #define EE_TYPE_24AA65              1
 #define EE_NAMES_24AA65             "24AA65"
@@ -62,7 +144,7 @@ extern "C" {
 #define BUS_FREQUENCY_1V8_24AA65  100
 #define BUS_FREQUENCY_4V5_24AA65  400
 #define PAGE_SIZE_24AA65            8
-#define TOTAL_PAGES_24AA65        (8 * 1024)
+#define TOTAL_PAGES_24AA65        (8 * 1024 / PAGE_SIZE_24AA65)
 #define BLOCK_SIZE_24AA65         I2C_MAX_BLOCK_LEN
 
 #define EE_TYPE_24LC65              2
@@ -72,7 +154,7 @@ extern "C" {
 #define BUS_FREQUENCY_1V8_24LC65  100
 #define BUS_FREQUENCY_4V5_24LC65  400
 #define PAGE_SIZE_24LC65            8
-#define TOTAL_PAGES_24LC65        (8 * 1024)
+#define TOTAL_PAGES_24LC65        (8 * 1024 / PAGE_SIZE_24LC65)
 #define BLOCK_SIZE_24LC65         I2C_MAX_BLOCK_LEN
 
 #define EE_TYPE_24C65               3
@@ -82,7 +164,7 @@ extern "C" {
 #define BUS_FREQUENCY_1V8_24C65   100
 #define BUS_FREQUENCY_4V5_24C65   400
 #define PAGE_SIZE_24C65             8
-#define TOTAL_PAGES_24C65         (8 * 1024)
+#define TOTAL_PAGES_24C65         (8 * 1024 / PAGE_SIZE_24C65)
 #define BLOCK_SIZE_24C65          I2C_MAX_BLOCK_LEN
 
 #define EE_TYPE_24C16               4
@@ -92,7 +174,7 @@ extern "C" {
 #define BUS_FREQUENCY_1V8_24C16   100
 #define BUS_FREQUENCY_4V5_24C16   400
 #define PAGE_SIZE_24C16             8
-#define TOTAL_PAGES_24C16         (2 * 1024)
+#define TOTAL_PAGES_24C16         (2 * 1024 / PAGE_SIZE_24C16)
 #define BLOCK_SIZE_24C16          I2C_MAX_BLOCK_LEN
 
 #define EE_TYPE_MAX_TYPE          99
@@ -101,12 +183,204 @@ extern "C" {
 // 24C65 -> 0x51
 // 24C16 -> 0x50-0x57 broadcast
 
+#ifdef __cplusplus
+}
+#endif
+
+// geometry and timing of a known EEPROM type
+struct _ee_type_info {
+    uint16_t    type;
+    const char* name;
+    bool        addressing_16_bit;
+    int         write_cycle_time;
+    int         bus_frequency_1V8;
+    int         bus_frequency_4V5;
+    uint16_t    page_size;
+    uint16_t    total_pages;
+    uint16_t    block_size;
+};
+
+const struct _ee_type_info* eeTypeInfo( uint16_t type );
+
+// byte order of multi byte values in the EEPROM, the header is
+// stored MSB first, so that is the default
+enum eeByteOrder {
+    EE_BIG_ENDIAN,
+    EE_LITTLE_ENDIAN
+};
+
+// counters of a device, bumped with relaxed atomics
+struct _ee_counters {
+    uint64_t reads;          // eeRead*() calls and eeReadV() ranges
+    uint64_t writes;         // eeWrite*() calls
+    uint64_t bytes_read;
+    uint64_t bytes_written;
+    uint64_t cache_hits;
+    uint64_t cache_misses;
+    uint64_t cache_evictions;
+    uint64_t readahead_bytes;  // read beyond what was asked for
+    uint64_t image_pages;      // taken from the host image, see i2cImage.h
+};
+
+// statistics of a device, see eeGetStats()
+struct eeStats {
+    struct _ee_counters     device;
+    struct _i2c_conn_stats  bus;     // zero through the daemon
+    struct _i2c_hist_summary bus_latency[I2C_HIST_KINDS];
+    struct _i2c_hist_summary prio_latency[I2C_PRIO_CLASSES];
+};
+
+// priority class of the operations of a thread, see eeSetPriority()
+enum eePriority {
+    EE_PRIO_INTERACTIVE = 0,
+    EE_PRIO_NORMAL      = 1,
+    EE_PRIO_BULK        = 2
+};
+
+// one element of a scatter/gather list for eeReadV/eeWriteV
+struct eeIoVec {
+    uint16_t addr;
+    uint8_t* pBuffer;
+    int      amount;
+};
+
+// a counter kept in a ring of slots, see eeCounterOpen(). value is
+// the current value once opened
+struct eeCounter {
+    uint16_t first;          // address of slot 0
+    int      slots;
+    int      head;           // slot of value, -1 if none written yet
+    uint16_t seq;            // sequence number of head
+    uint32_t value;
+};
+
+// a log kept in a ring of blocks, see eeLogOpen(). Appended records
+// are staged until a block is full or eeLogFlush() is called
+struct eeLog {
+    uint16_t first;          // address of block 0
+    int      block_size;
+    int      blocks;
+    int      record_size;    // 0 for records of any size
+    int      head;           // block written last, -1 if none
+    uint32_t seq;            // sequence number of head
+    std::vector<uint8_t> staging;
+};
+
+// two slots of which the newer valid one holds the data, see
+// eeABOpen()
+struct eeABSlots {
+    uint16_t header[2];      // address of the header of slot A resp. B
+    int      header_len;     // EE_AB_HDR_LEN rounded up to pages
+    int      capacity;       // bytes of data a slot holds
+    int      active;         // slot of the data, -1 if none is valid
+    uint32_t generation;     // of the active slot
+    uint16_t length;         // bytes of data in the active slot
+    uint16_t data_crc;
+};
+
+// a device found by eeScan(), pInfo is NULL for unknown types
+struct eeScanResult {
+    int      bus;
+    int      addr;
+    int      state;
+    uint16_t magic;
+    uint16_t type;
+    const struct _ee_type_info* pInfo;
+};
+
 class i2cEEPROM {
 
     private:
         i2cConnection *pBus;
         bool autoInit;
         int byte_offset;
+        int gap_threshold;
+        i2cMirror *pMirror;
+        i2cRemote *pRemote;
+        bool use_daemon;
+        const struct _ee_type_info *pTypeInfo;
+        bool use_arbiter;
+        i2cArbiter *pArbiter;
+
+        // thread safe mode: state_lock guards type and cache geometry,
+        // bus_gate serializes transfers by priority, cache_lock guards
+        // the cache. Counters and histograms need no lock
+        bool thread_safe;
+        pthread_rwlock_t state_lock;
+        i2cPriorityGate  bus_gate;
+        pthread_rwlock_t cache_lock;
+
+        i2cHistogram latency[I2C_PRIO_CLASSES];
+        struct _ee_counters counters;
+
+        // transfers of the real-time mode, see eeSetRealtime()
+        i2cRtWorker rt_worker;
+
+        // calls of the application, see eeRecordStart()
+        i2cRecorder recorder;
+
+        // page cache, see eeCacheConfig(). A miss reads the missing
+        // pages and up to ra_window pages behind them into
+        // cache_read_buf. ra_next is where a sequential read goes on
+        bool cache_enabled;
+        struct _i2c_cache_config cache_config;
+        i2cPageCache cache;
+        std::vector<uint8_t> cache_read_buf;
+        int ra_next;
+        int ra_window;
+
+        // header of the chip and host image, see eeImageCacheEnable().
+        // gen_bumped is set once the generation was incremented for
+        // the writes since eeOpen() or the last eeFlush()
+        int hdr_state;
+        uint32_t hdr_serial;
+        uint32_t hdr_generation;
+        bool gen_bumped;
+        int bus_no;
+        int slave_addr;
+        bool image_enabled;
+        char image_dir[I2C_IMAGE_PATH_LEN];
+
+        void eeLockState( bool exclusive );
+        void eeUnlockState( void );
+        void eeLockBus( void );
+        int eeLockBusTimed( void );
+        void eeUnlockBus( void );
+        void eeCacheSetup( void );
+        bool eeCacheLookup( uint16_t addr, uint8_t* pBuffer, int amount );
+        void eeCacheStore( uint16_t addr, const uint8_t* pData, int amount );
+        int eeHeaderRead( void );
+        int eeGenerationBump( void );
+        int eeQueueCheck( uint16_t addr, int amount );
+        int eeImageLoad( void );
+        int eeImageSave( void );
+        int eeBusRead( uint16_t addr, uint8_t* pBuffer, int amount );
+        int eeBusWrite( uint16_t addr, uint8_t* pBuffer, int amount );
+        int eeArbitrated( std::function<int(void)> op );
+        int eeTransfer( bool write, uint16_t addr, uint8_t* pBuffer, 
+                        int amount );
+        int eeCounterSlot( struct eeCounter* pCounter, int slot, 
+                           bool* pValid, uint16_t* pSeq, uint32_t* pValue );
+        bool eeLogBlockValid( struct eeLog* pLog, const uint8_t* pBlock, 
+                              uint32_t* pSeq );
+        int eeABHeader( struct eeABSlots* pSlots, int slot, bool* pValid,
+                        uint32_t* pGeneration, uint16_t* pLength, 
+                        uint16_t* pDataCrc );
+        bool eeLogRecordsWalk( struct eeLog* pLog, const uint8_t* pRecords,
+                               int used, 
+                               std::function<bool(const uint8_t*, int)> visit );
+
+        void eeMirrorUpdate( uint16_t addr, const uint8_t* pData, int amount );
+        bool eeConnected( void );
+        int eeRawRead( uint16_t addr, uint8_t* pBuffer, int amount );
+        int eeRawWrite( uint16_t addr, uint8_t* pBuffer, int amount );
+        int eeReadQuantum( uint16_t addr, uint8_t* pBuffer, int amount );
+        int eeWriteQuantum( uint16_t addr, uint8_t* pBuffer, int amount );
+        void eeRecordLatency( int prio, uint64_t started );
+        uint16_t eeTraceDev( void );
+        void eeRecordEnv( int busNo, int slaveAddr );
+        void eeRecordCall( uint8_t op, uint16_t addr, int amount, int result,
+                           uint8_t flags = 0 );
 
     public:
         uint16_t ee_type;
@@ -118,12 +392,50 @@ class i2cEEPROM {
         ~i2cEEPROM();
 
         int eeOpen( int busNo, int slaveAddr );
+        int eeOpen( int busNo, int slaveAddr, 
+                    const struct _i2c_route* pRoute );
+        void eeSetDaemonUse( bool useDaemon );
+        bool eeIsRemote( void );
+        int eeFlush( void );
+
+        void eeSetThreadSafe( bool threadSafe );
+        int eeCacheEnable( bool enable );
+        int eeCacheConfig( const struct _i2c_cache_config* pConfig );
+        int eeImageCacheEnable( bool enable, const char* pDir = NULL );
+        int eeSerial( uint32_t* pSerial, uint32_t* pGeneration );
+        int eeLastError( void );
+
+        static eePriority eeSetPriority( eePriority prio );
+        static eePriority eeGetPriority( void );
+        int eeLatencyStats( eePriority prio, 
+                            struct _i2c_hist_summary* pSummary );
+        void eeLatencyReset( void );
+
+        int eeGetStats( struct eeStats* pStats );
+        void eeResetStats( void );
+        void eePrintStats( FILE* pOut );
+
+        int eeSetRetryPolicy( const struct _i2c_retry_policy* pPolicy );
+        unsigned long eeRetryCount( void );
+
+        int eeSetArbitration( bool enable );
+        int eeArbitrationStats( struct _i2c_arbiter_stats* pStats );
+
+        int eeSetRealtime( const struct _i2c_rt_config* pConfig );
+        int eeRealtimeStats( struct _i2c_rt_stats* pStats );
+
+        int eeRecordStart( const char* pPath );
+        int eeRecordStop( void );
 
         int eeTypeSet( uint16_t type );
         int eeInit( void );
 
         int eeTypeDetect( uint16_t* pMagic, uint16_t* pType );
         void eeInfo( void );
+        int eeCapacity( void );
+
+        int eeMirrorPublish( void );
+        void eeMirrorWithdraw( void );
 
         void eeClose( void );
 
@@ -134,12 +446,122 @@ class i2cEEPROM {
         int eeWriteByte( uint16_t addr, uint8_t byteValue );
         int eeWriteWord( uint16_t addr, uint16_t wordValue );
         int eeWrite( uint16_t addr, uint8_t* pBuffer, int amount );
+
+        int eeSetGapThreshold( int gap );
+        int eeReadV( struct eeIoVec* pVec, int count );
+        int eeWriteV( struct eeIoVec* pVec, int count );
+
+        int eeCounterOpen( struct eeCounter* pCounter, uint16_t addr, 
+                           int length );
+        int eeCounterAdd( struct eeCounter* pCounter, uint32_t delta = 1 );
+        int eeCounterSet( struct eeCounter* pCounter, uint32_t value );
+
+        int eeLogOpen( struct eeLog* pLog, uint16_t addr, int length,
+                       int recordSize = 0, int blockSize = 0 );
+        int eeLogAppend( struct eeLog* pLog, const uint8_t* pData, int len );
+        int eeLogFlush( struct eeLog* pLog );
+        int eeLogWalk( struct eeLog* pLog, 
+                       std::function<bool(const uint8_t*, int)> visit );
+
+        int eeABOpen( struct eeABSlots* pSlots, uint16_t addr, int length );
+        int eeABRead( struct eeABSlots* pSlots, uint8_t* pBuffer, int size,
+                      int* pLength );
+        int eeABWrite( struct eeABSlots* pSlots, const uint8_t* pData, 
+                       int len );
+
+        int eeBlobWrite( uint16_t addr, const uint8_t* pData, int len, 
+                         int room, int* pStored = NULL );
+        int eeBlobRead( uint16_t addr, uint8_t* pBuffer, int size, 
+                        int* pLength );
+
+        static int eeScan( std::vector<struct eeScanResult>& results,
+                           int firstAddr = -1, int lastAddr = -1 );
+
+        int eeQueueWrite( i2cBusScheduler* pSched, uint16_t addr, 
+                          uint8_t* pBuffer, int amount,
+                          std::function<void(int)> complete = nullptr );
+        int eeQueueRead( i2cBusScheduler* pSched, uint16_t addr, 
+                         uint8_t* pBuffer, int amount,
+                         std::function<void(int)> complete = nullptr );
+
+        template<typename T, eeByteOrder order = EE_BIG_ENDIAN>
+        int eeRead( uint16_t addr, T* pValue );
+
+        template<typename T, eeByteOrder order = EE_BIG_ENDIAN>
+        int eeWrite( uint16_t addr, const T& value );
 };
 
+/*
+ ***************************************************************************
+ * typed access
+ * ----------------------------------------------------
+ * integers, enums and floats are converted between host and
+ * storage byte order, other trivially copyable types (structs)
+ * are stored as they are in memory. Whether bytes are swapped
+ * is decided at compile time, each value is moved in one
+ * transfer
+ ***************************************************************************
+*/
+template<typename T> struct eeNeedsSwap {
+    static const bool value = std::is_arithmetic<T>::value || 
+                              std::is_enum<T>::value;
+};
 
-#ifdef __cplusplus
+// only values of 1, 2, 4 and 8 bytes can be swapped, see i2cByteSwap
+template<typename T> struct eeSwappable {
+    static const bool value = !eeNeedsSwap<T>::value || sizeof(T) == 1 || 
+                              sizeof(T) == 2 || sizeof(T) == 4 || 
+                              sizeof(T) == 8;
+};
+
+template<typename T, eeByteOrder order>
+int i2cEEPROM::eeRead( uint16_t addr, T* pValue )
+{
+    int retVal;
+    uint8_t raw[sizeof(T)];
+
+    static_assert( std::is_trivially_copyable<T>::value,
+                   "eeRead<T> needs a trivially copyable type" );
+    static_assert( eeSwappable<T>::value,
+                   "eeRead<T> converts numbers of 1, 2, 4 or 8 bytes only, "
+                   "e.g. not long double" );
+
+    if( pValue != NULL )
+    {
+        if( (retVal = eeRead( addr, raw, sizeof(T) )) == E_EE_SUCCESS )
+        {
+            i2cByteOrder<eeNeedsSwap<T>::value && 
+                         ((order == EE_BIG_ENDIAN) != I2C_HOST_BIG_ENDIAN),
+                         sizeof(T)>::fix( raw );
+            memcpy( pValue, raw, sizeof(T) );
+        }
+    }
+    else
+    {
+        retVal = E_EE_DATA_NULLP;
+    }
+
+    return( retVal );
+}
+
+template<typename T, eeByteOrder order>
+int i2cEEPROM::eeWrite( uint16_t addr, const T& value )
+{
+    uint8_t raw[sizeof(T)];
+
+    static_assert( std::is_trivially_copyable<T>::value,
+                   "eeWrite<T> needs a trivially copyable type" );
+    static_assert( eeSwappable<T>::value,
+                   "eeWrite<T> converts numbers of 1, 2, 4 or 8 bytes only, "
+                   "e.g. not long double" );
+
+    memcpy( raw, &value, sizeof(T) );
+    i2cByteOrder<eeNeedsSwap<T>::value && 
+                 ((order == EE_BIG_ENDIAN) != I2C_HOST_BIG_ENDIAN),
+                 sizeof(T)>::fix( raw );
+
+    return( eeWrite( addr, raw, sizeof(T) ) );
 }
-#endif
 
 #endif /* I2CEEPROM_H */
 
@@ -0,0 +1,293 @@
+/*
+ ***********************************************************************
+ *
+ *  i2cHistogram.cpp - part of eeprom access project
+ *
+ *  Copyright (C) 2013-2019 Dreamshader (aka Dirk Schanz)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ *
+ ***********************************************************************
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "i2cHistogram.h"
+
+/*
+ ***************************************************************************
+ * i2cHistogram::i2cHistogram()
+ * ----------------------------------------------------
+ * create an empty histogram
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+i2cHistogram::i2cHistogram()
+{
+    reset();
+}
+
+/*
+ ***************************************************************************
+ * void i2cHistogram::reset( void )
+ * ----------------------------------------------------
+ * forget all values
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+void i2cHistogram::reset( void )
+{
+    int bucket;
+
+    for( bucket = 0; bucket < I2C_HIST_BUCKETS; bucket++ )
+    {
+        __atomic_store_n( &buckets[bucket], 0, __ATOMIC_RELAXED );
+    }
+    __atomic_store_n( &count, 0, __ATOMIC_RELAXED );
+    __atomic_store_n( &sum, 0, __ATOMIC_RELAXED );
+    __atomic_store_n( &min, UINT64_MAX, __ATOMIC_RELAXED );
+    __atomic_store_n( &max, 0, __ATOMIC_RELAXED );
+}
+
+/*
+ ***************************************************************************
+ * int i2cHistogram::bucketOf( uint64_t us )
+ * uint64_t i2cHistogram::bucketTop( int bucket )
+ * ----------------------------------------------------
+ * bucket of a value, largest value counted in a bucket
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns the bucket index, the value in us
+ ***************************************************************************
+*/
+int i2cHistogram::bucketOf( uint64_t us )
+{
+    int retVal;
+    int msb;
+
+    if( us < I2C_HIST_LINEAR )
+    {
+        retVal = (int) us;
+    }
+    else
+    {
+        msb = 63 - __builtin_clzll( us );
+
+        if( msb >= I2C_HIST_MAX_BITS )
+        {
+            retVal = I2C_HIST_BUCKETS - 1;
+        }
+        else
+        {
+            // power of two, then the next SUB_BITS bits below the msb
+            retVal = I2C_HIST_LINEAR + 
+                     (msb - I2C_HIST_SUB_BITS - 1) * I2C_HIST_SUB_COUNT +
+                     (int) ((us >> (msb - I2C_HIST_SUB_BITS)) & 
+                            (I2C_HIST_SUB_COUNT - 1));
+        }
+    }
+
+    return( retVal );
+}
+
+uint64_t i2cHistogram::bucketTop( int bucket )
+{
+    uint64_t retVal;
+    int shift;
+    int sub;
+
+    if( bucket < I2C_HIST_LINEAR )
+    {
+        retVal = bucket;
+    }
+    else
+    {
+        shift = (bucket - I2C_HIST_LINEAR) / I2C_HIST_SUB_COUNT + 1;
+        sub   = (bucket - I2C_HIST_LINEAR) % I2C_HIST_SUB_COUNT;
+
+        retVal = ((uint64_t) (I2C_HIST_SUB_COUNT + sub + 1) << shift) - 1;
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * void i2cHistogram::record( uint64_t us )
+ * ----------------------------------------------------
+ * count one value
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+void i2cHistogram::record( uint64_t us )
+{
+    uint64_t seen;
+
+    __atomic_fetch_add( &buckets[bucketOf( us )], 1, __ATOMIC_RELAXED );
+    __atomic_fetch_add( &count, 1, __ATOMIC_RELAXED );
+    __atomic_fetch_add( &sum, us, __ATOMIC_RELAXED );
+
+    seen = __atomic_load_n( &min, __ATOMIC_RELAXED );
+    while( us < seen && 
+           !__atomic_compare_exchange_n( &min, &seen, us, true, 
+                                         __ATOMIC_RELAXED, __ATOMIC_RELAXED ) )
+    {
+        ;
+    }
+
+    seen = __atomic_load_n( &max, __ATOMIC_RELAXED );
+    while( us > seen && 
+           !__atomic_compare_exchange_n( &max, &seen, us, true, 
+                                         __ATOMIC_RELAXED, __ATOMIC_RELAXED ) )
+    {
+        ;
+    }
+}
+
+/*
+ ***************************************************************************
+ * uint64_t i2cHistogram::percentile( double pct )
+ * ----------------------------------------------------
+ * value below which pct percent of the values are, as upper
+ * bound of the bucket, but never above the maximum seen
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns the value in us, 0 if empty
+ ***************************************************************************
+*/
+uint64_t i2cHistogram::percentile( double pct )
+{
+    uint64_t retVal = 0;
+    uint64_t total;
+    uint64_t highest;
+    uint64_t wanted;
+    uint64_t seen;
+    int bucket;
+
+    if( (total = __atomic_load_n( &count, __ATOMIC_RELAXED )) > 0 )
+    {
+        wanted = (uint64_t) (total * pct / 100.0 + 0.5);
+        if( wanted < 1 )
+        {
+            wanted = 1;
+        }
+
+        seen = 0;
+
+        for( bucket = 0; bucket < I2C_HIST_BUCKETS; bucket++ )
+        {
+            seen += __atomic_load_n( &buckets[bucket], __ATOMIC_RELAXED );
+
+            if( seen >= wanted )
+            {
+                retVal = bucketTop( bucket );
+                break;
+            }
+        }
+
+        if( retVal > (highest = __atomic_load_n( &max, __ATOMIC_RELAXED )) )
+        {
+            retVal = highest;
+        }
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * void i2cHistogram::summary( struct _i2c_hist_summary* pSummary )
+ * ----------------------------------------------------
+ * count, extremes, mean and the usual percentiles
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+void i2cHistogram::summary( struct _i2c_hist_summary* pSummary )
+{
+    uint64_t total;
+
+    if( pSummary != NULL )
+    {
+        total = __atomic_load_n( &count, __ATOMIC_RELAXED );
+
+        pSummary->count   = total;
+        pSummary->min_us  = total > 0 ? 
+                            __atomic_load_n( &min, __ATOMIC_RELAXED ) : 0;
+        pSummary->max_us  = __atomic_load_n( &max, __ATOMIC_RELAXED );
+        pSummary->mean_us = total > 0 ? 
+                            __atomic_load_n( &sum, __ATOMIC_RELAXED ) / total :
+                            0;
+        pSummary->p50_us  = percentile( 50.0 );
+        pSummary->p99_us  = percentile( 99.0 );
+        pSummary->p999_us = percentile( 99.9 );
+    }
+}
+
+/*
+ ***************************************************************************
+ * void i2cHistogram::print( FILE* pOut, const char* pTitle )
+ * ----------------------------------------------------
+ * one line summary followed by the non empty buckets
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+void i2cHistogram::print( FILE* pOut, const char* pTitle )
+{
+    struct _i2c_hist_summary sum;
+    uint64_t n;
+    int bucket;
+
+    summary( &sum );
+
+    fprintf( pOut, "%-12s n=%llu min=%llu mean=%llu p50=%llu p99=%llu "
+             "p99.9=%llu max=%llu us\n", pTitle,
+             (unsigned long long) sum.count, (unsigned long long) sum.min_us,
+             (unsigned long long) sum.mean_us,
+             (unsigned long long) sum.p50_us,
+             (unsigned long long) sum.p99_us,
+             (unsigned long long) sum.p999_us,
+             (unsigned long long) sum.max_us );
+
+    for( bucket = 0; bucket < I2C_HIST_BUCKETS; bucket++ )
+    {
+        if( (n = __atomic_load_n( &buckets[bucket], __ATOMIC_RELAXED )) > 0 )
+        {
+            fprintf( pOut, "    <= %10llu us: %llu\n",
+                     (unsigned long long) bucketTop( bucket ),
+                     (unsigned long long) n );
+        }
+    }
+}
+
@@ -0,0 +1,86 @@
+/*
+ ***********************************************************************
+ *
+ *  i2cHistogram.h - part of eeprom access project
+ *
+ *  Copyright (C) 2013-2019 Dreamshader (aka Dirk Schanz)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ *
+ ***********************************************************************
+ *
+ * Latency histogram in microseconds, HDR style: values below
+ * I2C_HIST_LINEAR us have a bucket each, above that every power of
+ * two is split into I2C_HIST_SUB_COUNT buckets, so percentiles are
+ * exact to 1/8 of the value. Values from 2^I2C_HIST_MAX_BITS us on
+ * go to the last bucket.
+ *
+ * record() uses relaxed atomics and no lock, it may be called from
+ * several threads while others read. A reader may see the fields
+ * of a record() in progress partly updated.
+ *
+ ***********************************************************************
+ */
+
+#ifndef I2CHISTOGRAM_H
+#define I2CHISTOGRAM_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define I2C_HIST_SUB_BITS           3
+#define I2C_HIST_SUB_COUNT         (1 << I2C_HIST_SUB_BITS)
+#define I2C_HIST_LINEAR            (2 * I2C_HIST_SUB_COUNT)
+#define I2C_HIST_MAX_BITS          40
+#define I2C_HIST_BUCKETS           (I2C_HIST_LINEAR + (I2C_HIST_MAX_BITS - \
+                                    I2C_HIST_SUB_BITS - 1) * I2C_HIST_SUB_COUNT)
+
+struct _i2c_hist_summary {
+    uint64_t count;
+    uint64_t min_us;
+    uint64_t max_us;
+    uint64_t mean_us;
+    uint64_t p50_us;
+    uint64_t p99_us;
+    uint64_t p999_us;
+};
+
+class i2cHistogram {
+
+    private:
+        uint64_t buckets[I2C_HIST_BUCKETS];
+        uint64_t count;
+        uint64_t sum;
+        uint64_t min;
+        uint64_t max;
+
+        static int bucketOf( uint64_t us );
+        static uint64_t bucketTop( int bucket );
+
+    public:
+        i2cHistogram();
+
+        void reset( void );
+        bool isEmpty( void ) 
+            { return( __atomic_load_n( &count, __ATOMIC_RELAXED ) == 0 ); }
+        void record( uint64_t us );
+        uint64_t percentile( double pct );
+        void summary( struct _i2c_hist_summary* pSummary );
+        void print( FILE* pOut, const char* pTitle );
+};
+
+#endif /* I2CHISTOGRAM_H */
+
@@ -0,0 +1,208 @@
+/*
+ ***********************************************************************
+ *
+ *  i2cImage.cpp - part of eeprom access project
+ *
+ *  Copyright (C) 2013-2019 Dreamshader (aka Dirk Schanz)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ *
+ ***********************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "i2cImage.h"
+
+/*
+ ***************************************************************************
+ * int i2cImagePath( char* pPath, const char* pDir, int bus, int addr,
+ *                   uint32_t serial )
+ * ----------------------------------------------------
+ * name of the image of a device in directory pDir, pPath
+ * must hold I2C_IMAGE_PATH_LEN bytes
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns an errorcode, E_IMG_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cImagePath( char* pPath, const char* pDir, int bus, int addr,
+                  uint32_t serial )
+{
+    int retVal = E_IMG_SUCCESS;
+    int len;
+
+    if( pPath == NULL || pDir == NULL )
+    {
+        retVal = E_IMG_NULL;
+    }
+    else
+    {
+        len = snprintf( pPath, I2C_IMAGE_PATH_LEN, I2C_IMAGE_FILE_FMT,
+                        pDir, bus, addr, serial );
+
+        if( len < 0 || len >= I2C_IMAGE_PATH_LEN )
+        {
+            retVal = E_IMG_FAIL;
+        }
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * int i2cImageRead( const char* pPath, struct _ee_image_hdr* pHdr,
+ *                   std::vector<uint8_t>& valid, 
+ *                   std::vector<uint8_t>& data )
+ * ----------------------------------------------------
+ * read an image file. valid gets one byte per page, data the
+ * contents of all pages. Whether the image belongs to the
+ * chip is up to the caller
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns an errorcode, E_IMG_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cImageRead( const char* pPath, struct _ee_image_hdr* pHdr,
+                  std::vector<uint8_t>& valid, std::vector<uint8_t>& data )
+{
+    int retVal = E_IMG_SUCCESS;
+    FILE* pIn;
+
+    if( pPath == NULL || pHdr == NULL )
+    {
+        return( E_IMG_NULL );
+    }
+
+    if( (pIn = fopen( pPath, "rb" )) == NULL )
+    {
+        return( E_IMG_FILE );
+    }
+
+    if( fread( pHdr, sizeof(*pHdr), 1, pIn ) != 1 ||
+        memcmp( pHdr->magic, I2C_IMAGE_MAGIC, sizeof(pHdr->magic) ) != 0 ||
+        pHdr->version != I2C_IMAGE_VERSION || pHdr->page_size == 0 ||
+        pHdr->total_pages == 0 || pHdr->total_pages > 65536 )
+    {
+        retVal = E_IMG_FORMAT;
+    }
+    else
+    {
+        valid.resize( pHdr->total_pages );
+        data.resize( pHdr->total_pages * pHdr->page_size );
+
+        if( fread( valid.data(), 1, valid.size(), pIn ) != valid.size() ||
+            fread( data.data(), 1, data.size(), pIn ) != data.size() )
+        {
+            retVal = E_IMG_FORMAT;
+        }
+    }
+
+    fclose( pIn );
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * int i2cImageWrite( const char* pPath, const struct _ee_image_hdr* pHdr,
+ *                    const std::vector<uint8_t>& valid,
+ *                    const std::vector<uint8_t>& data )
+ * ----------------------------------------------------
+ * replace the image file at pPath. The directory is created
+ * if it does not exist, its parent must
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns an errorcode, E_IMG_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cImageWrite( const char* pPath, const struct _ee_image_hdr* pHdr,
+                   const std::vector<uint8_t>& valid,
+                   const std::vector<uint8_t>& data )
+{
+    int retVal = E_IMG_SUCCESS;
+    char dir[I2C_IMAGE_PATH_LEN];
+    char tmpPath[I2C_IMAGE_PATH_LEN + 16];
+    char* pSlash;
+    FILE* pOut;
+
+    if( pPath == NULL || pHdr == NULL )
+    {
+        return( E_IMG_NULL );
+    }
+
+    if( valid.size() != pHdr->total_pages ||
+        data.size() != (size_t) pHdr->total_pages * pHdr->page_size )
+    {
+        return( E_IMG_FORMAT );
+    }
+
+    snprintf( dir, sizeof(dir), "%s", pPath );
+
+    if( (pSlash = strrchr( dir, '/' )) != NULL && pSlash != dir )
+    {
+        *pSlash = '\0';
+
+        if( mkdir( dir, 0755 ) != 0 && errno != EEXIST )
+        {
+            return( E_IMG_FILE );
+        }
+    }
+
+    snprintf( tmpPath, sizeof(tmpPath), "%s.%d", pPath, (int) getpid() );
+
+    if( (pOut = fopen( tmpPath, "wb" )) == NULL )
+    {
+        return( E_IMG_FILE );
+    }
+
+    if( fwrite( pHdr, sizeof(*pHdr), 1, pOut ) != 1 ||
+        fwrite( valid.data(), 1, valid.size(), pOut ) != valid.size() ||
+        fwrite( data.data(), 1, data.size(), pOut ) != data.size() ||
+        fflush( pOut ) != 0 || fsync( fileno( pOut ) ) != 0 )
+    {
+        retVal = E_IMG_FILE;
+    }
+
+    if( fclose( pOut ) != 0 )
+    {
+        retVal = E_IMG_FILE;
+    }
+
+    if( retVal == E_IMG_SUCCESS && rename( tmpPath, pPath ) != 0 )
+    {
+        retVal = E_IMG_FILE;
+    }
+
+    if( retVal != E_IMG_SUCCESS )
+    {
+        unlink( tmpPath );
+    }
+
+    return( retVal );
+}
+
@@ -0,0 +1,88 @@
+/*
+ ***********************************************************************
+ *
+ *  i2cImage.h - part of eeprom access project
+ *
+ *  Copyright (C) 2013-2019 Dreamshader (aka Dirk Schanz)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ *
+ ***********************************************************************
+ *
+ * Copy of an EEPROM on the host filesystem, so the contents need not
+ * be read over the bus each time the device is opened.
+ *
+ * A chip initialized by eeInit() carries a serial number and a
+ * generation in its header (see i2cCore.h). The generation is
+ * incremented by the first write after opening and after each
+ * eeFlush(), before the data is written. An image file is named
+ * after bus, address and serial and holds the generation it was
+ * saved at: if that is still the generation of the chip, the image
+ * is what the chip contains.
+ *
+ * A file is a struct _ee_image_hdr followed by one byte per page,
+ * non-zero for the pages known, and the contents of all pages,
+ * 0xff where they are not known. Files are written to a temporary
+ * name and renamed, so readers see either the old or the new one.
+ *
+ * The directory is given to i2cEEPROM::eeImageCacheEnable() or
+ * taken from I2C_IMAGE_DIR, /var/cache/i2cEEPROM if neither is set.
+ *
+ ***********************************************************************
+ */
+
+#ifndef I2CIMAGE_H
+#define I2CIMAGE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+
+#define E_IMG_SUCCESS               0
+#define E_IMG_FAIL                 -1
+#define E_IMG_NULL                 -2
+#define E_IMG_FILE                 -3
+#define E_IMG_FORMAT               -4
+
+#define I2C_IMAGE_DIR_ENV        "I2C_IMAGE_DIR"
+#define I2C_IMAGE_DEFAULT_DIR    "/var/cache/i2cEEPROM"
+#define I2C_IMAGE_FILE_FMT       "%s/ee-%d-%02x-%08x.img"
+#define I2C_IMAGE_PATH_LEN        256
+#define I2C_IMAGE_MAGIC          "EEIMAGE1"
+#define I2C_IMAGE_VERSION           1
+
+struct _ee_image_hdr {
+    char     magic[8];
+    uint32_t version;
+    uint16_t bus;
+    uint16_t addr;
+    uint32_t serial;
+    uint32_t generation;
+    uint16_t type;
+    uint16_t page_size;
+    uint32_t total_pages;
+};
+
+int i2cImagePath( char* pPath, const char* pDir, int bus, int addr,
+                  uint32_t serial );
+int i2cImageRead( const char* pPath, struct _ee_image_hdr* pHdr,
+                  std::vector<uint8_t>& valid, std::vector<uint8_t>& data );
+int i2cImageWrite( const char* pPath, const struct _ee_image_hdr* pHdr,
+                   const std::vector<uint8_t>& valid,
+                   const std::vector<uint8_t>& data );
+
+#endif /* I2CIMAGE_H */
+
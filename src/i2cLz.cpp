@@ -0,0 +1,270 @@
+/*
+ ***********************************************************************
+ *
+ *  i2cLz.cpp - part of eeprom access project
+ *
+ *  Copyright (C) 2013-2019 Dreamshader (aka Dirk Schanz)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ *
+ ***********************************************************************
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "i2cLz.h"
+
+#define LZ_HASH_BITS               12
+#define LZ_HASH_SIZE               (1 << LZ_HASH_BITS)
+
+/*
+ ***************************************************************************
+ * static int lzHash( const uint8_t* pData )
+ * ----------------------------------------------------
+ * hash of the I2C_LZ_MIN_MATCH bytes at pData
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns the hash
+ ***************************************************************************
+*/
+static int lzHash( const uint8_t* pData )
+{
+    return( ((pData[0] << 8 ^ pData[1] << 4 ^ pData[2]) * 2654435761U) >> 
+            (32 - LZ_HASH_BITS) );
+}
+
+/*
+ ***************************************************************************
+ * int i2cLzCompress( const uint8_t* pIn, int inLen, uint8_t* pOut, 
+ *                    int outSize )
+ * ----------------------------------------------------
+ * compress inLen bytes at pIn into pOut of outSize bytes. For
+ * each position the longest match of the last I2C_LZ_MAX_CHAIN
+ * positions with the same hash is taken, if any
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns the length of the compressed data, E_LZ_OVERFLOW if
+ * it does not fit into outSize bytes
+ ***************************************************************************
+*/
+int i2cLzCompress( const uint8_t* pIn, int inLen, uint8_t* pOut, 
+                   int outSize )
+{
+    std::vector<int> head( LZ_HASH_SIZE, -1 );
+    std::vector<int> prev( inLen > 0 ? inLen : 1 );
+    int pos = 0;
+    int outLen = 0;
+    int flagsAt = -1;
+    int items = 0;
+    int bestLen;
+    int bestDist;
+    int candidate;
+    int chain;
+    int len;
+    int limit;
+    int value;
+    int end;
+
+    while( pos < inLen )
+    {
+        if( items == 0 )
+        {
+            if( outLen >= outSize )
+            {
+                return( E_LZ_OVERFLOW );
+            }
+
+            flagsAt = outLen++;
+            pOut[flagsAt] = 0;
+        }
+
+        bestLen  = 0;
+        bestDist = 0;
+
+        if( pos + I2C_LZ_MIN_MATCH <= inLen )
+        {
+            limit = inLen - pos < I2C_LZ_MAX_MATCH ? inLen - pos : 
+                                                     I2C_LZ_MAX_MATCH;
+
+            for( candidate = head[lzHash( &pIn[pos] )], chain = 0;
+                 candidate >= 0 && pos - candidate <= I2C_LZ_WINDOW &&
+                 chain < I2C_LZ_MAX_CHAIN && bestLen < limit;
+                 candidate = prev[candidate], chain++ )
+            {
+                len = 0;
+                while( len < limit && pIn[candidate + len] == pIn[pos + len] )
+                {
+                    len++;
+                }
+
+                if( len > bestLen )
+                {
+                    bestLen  = len;
+                    bestDist = pos - candidate;
+                }
+            }
+        }
+
+        if( bestLen >= I2C_LZ_MIN_MATCH )
+        {
+            if( outLen + 2 > outSize )
+            {
+                return( E_LZ_OVERFLOW );
+            }
+
+            value = ((bestDist - 1) << 4) | (bestLen - I2C_LZ_MIN_MATCH);
+            pOut[outLen++] = (value >> 8) & 0x00ff;
+            pOut[outLen++] = value & 0x00ff;
+            pOut[flagsAt] |= 1 << items;
+        }
+        else
+        {
+            if( outLen + 1 > outSize )
+            {
+                return( E_LZ_OVERFLOW );
+            }
+
+            bestLen = 1;
+            pOut[outLen++] = pIn[pos];
+        }
+
+        // every position covered goes into the hash chains
+        for( end = pos + bestLen; pos < end; pos++ )
+        {
+            if( pos + I2C_LZ_MIN_MATCH <= inLen )
+            {
+                value = lzHash( &pIn[pos] );
+                prev[pos] = head[value];
+                head[value] = pos;
+            }
+        }
+
+        items = (items + 1) % 8;
+    }
+
+    return( outLen );
+}
+
+/*
+ ***************************************************************************
+ * void i2cLzDecodeInit( struct _i2c_lz_decoder* pDec, uint8_t* pOut, 
+ *                       int outSize )
+ * ----------------------------------------------------
+ * start decoding into pOut of outSize bytes
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+void i2cLzDecodeInit( struct _i2c_lz_decoder* pDec, uint8_t* pOut, 
+                      int outSize )
+{
+    pDec->pOut      = pOut;
+    pDec->out_size  = outSize;
+    pDec->out_len   = 0;
+    pDec->flags     = 0;
+    pDec->items     = 0;
+    pDec->have_high = 0;
+    pDec->high      = 0;
+}
+
+/*
+ ***************************************************************************
+ * int i2cLzDecode( struct _i2c_lz_decoder* pDec, const uint8_t* pIn, 
+ *                  int inLen )
+ * ----------------------------------------------------
+ * decode the next inLen bytes of compressed data. A match may
+ * be split between two calls. pDec->out_len is the number of
+ * bytes decoded so far
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns an errorcode, E_LZ_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cLzDecode( struct _i2c_lz_decoder* pDec, const uint8_t* pIn, 
+                 int inLen )
+{
+    int value;
+    int dist;
+    int len;
+    int i;
+
+    while( inLen-- > 0 )
+    {
+        if( pDec->items == 0 )
+        {
+            pDec->flags = *pIn++;
+            pDec->items = 8;
+            continue;
+        }
+
+        if( (pDec->flags & 1) == 0 )
+        {
+            if( pDec->out_len >= pDec->out_size )
+            {
+                return( E_LZ_OVERFLOW );
+            }
+
+            pDec->pOut[pDec->out_len++] = *pIn++;
+        }
+        else
+        {
+            if( !pDec->have_high )
+            {
+                pDec->high = *pIn++;
+                pDec->have_high = 1;
+                continue;
+            }
+
+            value = (pDec->high << 8) | *pIn++;
+            pDec->have_high = 0;
+            dist = (value >> 4) + 1;
+            len  = (value & 0x0f) + I2C_LZ_MIN_MATCH;
+
+            if( dist > pDec->out_len )
+            {
+                return( E_LZ_CORRUPT );
+            }
+
+            if( pDec->out_len + len > pDec->out_size )
+            {
+                return( E_LZ_OVERFLOW );
+            }
+
+            // byte by byte, the copy may overlap what it writes
+            for( i = 0; i < len; i++ )
+            {
+                pDec->pOut[pDec->out_len] = 
+                    pDec->pOut[pDec->out_len - dist];
+                pDec->out_len++;
+            }
+        }
+
+        pDec->flags >>= 1;
+        pDec->items--;
+    }
+
+    return( E_LZ_SUCCESS );
+}
+
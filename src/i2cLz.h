@@ -0,0 +1,76 @@
+/*
+ ***********************************************************************
+ *
+ *  i2cLz.h - part of eeprom access project
+ *
+ *  Copyright (C) 2013-2019 Dreamshader (aka Dirk Schanz)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ *
+ ***********************************************************************
+ *
+ *
+ * Small LZ77 codec for data stored on the EEPROM, see
+ * i2cEEPROM::eeBlobWrite().
+ *
+ * The compressed data is a sequence of groups: a flag byte and up to
+ * eight items, bit 0 of the flags for the first one. An item with
+ * its flag bit clear is a literal byte. One with the bit set is a
+ * match of two bytes, MSB first: 12 bits of distance - 1 and 4 bits
+ * of length - I2C_LZ_MIN_MATCH. It repeats length bytes starting
+ * distance bytes back in the output, the copy may overlap.
+ *
+ * The decoder works on pieces of the input as they are read and
+ * needs no memory but the output and a few bytes of state, matches
+ * refer to what was decoded already.
+ *
+ ***********************************************************************
+ */
+
+#ifndef I2CLZ_H
+#define I2CLZ_H
+
+#include <stdint.h>
+
+#define E_LZ_SUCCESS                0
+#define E_LZ_OVERFLOW              -1   // output does not fit
+#define E_LZ_CORRUPT               -2   // distance before the start
+
+#define I2C_LZ_WINDOW            4096
+#define I2C_LZ_MIN_MATCH            3
+#define I2C_LZ_MAX_MATCH           (I2C_LZ_MIN_MATCH + 15)
+// candidates tried per position by the encoder
+#define I2C_LZ_MAX_CHAIN           32
+
+struct _i2c_lz_decoder {
+    uint8_t* pOut;
+    int      out_size;
+    int      out_len;
+    uint8_t  flags;
+    int      items;          // left in the current group, 0: flags next
+    int      have_high;      // first byte of a match was seen
+    uint8_t  high;
+};
+
+int i2cLzCompress( const uint8_t* pIn, int inLen, uint8_t* pOut, 
+                   int outSize );
+void i2cLzDecodeInit( struct _i2c_lz_decoder* pDec, uint8_t* pOut, 
+                      int outSize );
+int i2cLzDecode( struct _i2c_lz_decoder* pDec, const uint8_t* pIn, 
+                 int inLen );
+
+#endif /* I2CLZ_H */
+
@@ -0,0 +1,555 @@
+/*
+ ***********************************************************************
+ *
+ *  i2cMirror.cpp - part of eeprom access project
+ *
+ *  Copyright (C) 2013-2019 Dreamshader (aka Dirk Schanz)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ *
+ ***********************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "i2cMirror.h"
+
+
+/*
+ ***************************************************************************
+ * i2cMirror::i2cMirror()
+ * ----------------------------------------------------
+ * create an unmapped mirror instance
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+i2cMirror::i2cMirror()
+{
+    shm_fd  = -1;
+    pHdr    = (struct _i2c_mirror_hdr*) NULL;
+    pImage  = (uint8_t*) NULL;
+    map_len = 0;
+    owner   = false;
+    shm_name[0] = '\0';
+}
+
+/*
+ ***************************************************************************
+ * i2cMirror::~i2cMirror()
+ * ----------------------------------------------------
+ * unmap, the owner removes the segment as well
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+i2cMirror::~i2cMirror()
+{
+    detach();
+}
+
+/*
+ ***************************************************************************
+ * bool i2cMirror::ownerAlive( void )
+ * ----------------------------------------------------
+ * whether the segment shm_name exists and the process that
+ * created it is still running
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns true if the owner is alive
+ ***************************************************************************
+*/
+bool i2cMirror::ownerAlive( void )
+{
+    bool retVal = false;
+    int fd;
+    struct stat shmStat;
+    struct _i2c_mirror_hdr* pOld;
+
+    if( (fd = shm_open( shm_name, O_RDONLY, 0 )) >= 0 )
+    {
+        if( fstat( fd, &shmStat ) == 0 &&
+            shmStat.st_size >= (off_t) sizeof(struct _i2c_mirror_hdr) &&
+            (pOld = (struct _i2c_mirror_hdr*) mmap( NULL, 
+                            sizeof(struct _i2c_mirror_hdr), PROT_READ, 
+                            MAP_SHARED, fd, 0 )) != MAP_FAILED )
+        {
+            // EPERM: alive, but of another user
+            retVal = pOld->magic == I2C_MIRROR_MAGIC && 
+                     pOld->owner_pid > 0 &&
+                     (kill( pOld->owner_pid, 0 ) == 0 || errno == EPERM);
+
+            munmap( pOld, sizeof(struct _i2c_mirror_hdr) );
+        }
+
+        close( fd );
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * int i2cMirror::create( int bus, int addr, int size )
+ * ----------------------------------------------------
+ * create the shared segment for the device at bus/addr as
+ * its owner. The image is marked invalid until the owner
+ * has loaded it and calls setValid(). A segment whose owner
+ * is still running is not taken over
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns an errorcode, E_MIRROR_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cMirror::create( int bus, int addr, int size )
+{
+    int retVal = E_MIRROR_SUCCESS;
+    void* pMap;
+
+    if( pHdr != (struct _i2c_mirror_hdr*) NULL )
+    {
+        return( E_MIRROR_INVAL );
+    }
+
+    if( size <= 0 )
+    {
+        return( E_MIRROR_RANGE );
+    }
+
+    snprintf( shm_name, sizeof(shm_name), I2C_MIRROR_NAME_FMT, bus, addr );
+    map_len = sizeof(struct _i2c_mirror_hdr) + size;
+
+    if( ownerAlive() )
+    {
+        return( E_MIRROR_INVAL );
+    }
+
+    // a segment left behind by a dead owner is simply replaced
+    shm_unlink( shm_name );
+
+    if( (shm_fd = shm_open( shm_name, O_RDWR | O_CREAT | O_EXCL, 0644 )) < 0 )
+    {
+        perror("i2cMirror shm_open");
+        retVal = E_MIRROR_SHM;
+    }
+    else
+    {
+        if( ftruncate( shm_fd, map_len ) < 0 )
+        {
+            perror("i2cMirror ftruncate");
+            retVal = E_MIRROR_SHM;
+        }
+        else
+        {
+            if( (pMap = mmap( NULL, map_len, PROT_READ | PROT_WRITE,
+                              MAP_SHARED, shm_fd, 0 )) == MAP_FAILED )
+            {
+                perror("i2cMirror mmap");
+                retVal = E_MIRROR_SHM;
+            }
+            else
+            {
+                pHdr   = (struct _i2c_mirror_hdr*) pMap;
+                pImage = (uint8_t*) pMap + sizeof(struct _i2c_mirror_hdr);
+                owner  = true;
+
+                pHdr->seq.store( 0, std::memory_order_relaxed );
+                pHdr->valid       = 0;
+                pHdr->size        = size;
+                pHdr->data_offset = 0;
+                pHdr->bus         = bus;
+                pHdr->addr        = addr;
+                pHdr->owner_pid   = getpid();
+                pHdr->version     = I2C_MIRROR_VERSION;
+                std::atomic_thread_fence( std::memory_order_release );
+                // readers check the magic last
+                pHdr->magic       = I2C_MIRROR_MAGIC;
+            }
+        }
+
+        if( retVal != E_MIRROR_SUCCESS )
+        {
+            close( shm_fd );
+            shm_unlink( shm_name );
+            shm_fd = -1;
+        }
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * int i2cMirror::attach( int bus, int addr )
+ * ----------------------------------------------------
+ * map the mirror of the device at bus/addr read-only
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns an errorcode, E_MIRROR_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cMirror::attach( int bus, int addr )
+{
+    int retVal = E_MIRROR_SUCCESS;
+    struct stat shmStat;
+    void* pMap;
+
+    if( pHdr != (struct _i2c_mirror_hdr*) NULL )
+    {
+        return( E_MIRROR_INVAL );
+    }
+
+    snprintf( shm_name, sizeof(shm_name), I2C_MIRROR_NAME_FMT, bus, addr );
+
+    if( (shm_fd = shm_open( shm_name, O_RDONLY, 0 )) < 0 )
+    {
+        retVal = E_MIRROR_SHM;
+    }
+    else
+    {
+        if( fstat( shm_fd, &shmStat ) < 0 ||
+            shmStat.st_size < (off_t) sizeof(struct _i2c_mirror_hdr) )
+        {
+            retVal = E_MIRROR_SHM;
+        }
+        else
+        {
+            map_len = shmStat.st_size;
+
+            if( (pMap = mmap( NULL, map_len, PROT_READ, MAP_SHARED,
+                              shm_fd, 0 )) == MAP_FAILED )
+            {
+                perror("i2cMirror mmap");
+                retVal = E_MIRROR_SHM;
+            }
+            else
+            {
+                pHdr   = (struct _i2c_mirror_hdr*) pMap;
+                pImage = (uint8_t*) pMap + sizeof(struct _i2c_mirror_hdr);
+                owner  = false;
+
+                if( pHdr->magic != I2C_MIRROR_MAGIC ||
+                    pHdr->version != I2C_MIRROR_VERSION ||
+                    sizeof(struct _i2c_mirror_hdr) + pHdr->size > map_len )
+                {
+                    munmap( pMap, map_len );
+                    pHdr   = (struct _i2c_mirror_hdr*) NULL;
+                    pImage = (uint8_t*) NULL;
+                    retVal = E_MIRROR_INVAL;
+                }
+            }
+        }
+
+        // the mapping stays valid without the descriptor
+        close( shm_fd );
+        shm_fd = -1;
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * void i2cMirror::detach( void )
+ * ----------------------------------------------------
+ * unmap the mirror, the owner also removes the segment
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+void i2cMirror::detach( void )
+{
+    if( pHdr != (struct _i2c_mirror_hdr*) NULL )
+    {
+        if( owner )
+        {
+            pHdr->valid = 0;
+            shm_unlink( shm_name );
+        }
+        munmap( (void*) pHdr, map_len );
+    }
+
+    if( shm_fd >= 0 )
+    {
+        close( shm_fd );
+    }
+
+    shm_fd  = -1;
+    pHdr    = (struct _i2c_mirror_hdr*) NULL;
+    pImage  = (uint8_t*) NULL;
+    map_len = 0;
+    owner   = false;
+}
+
+/*
+ ***************************************************************************
+ * int i2cMirror::setValid( bool valid )
+ * ----------------------------------------------------
+ * owner only: mark the image as (in)complete
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns an errorcode, E_MIRROR_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cMirror::setValid( bool valid )
+{
+    uint32_t seq;
+
+    if( pHdr == (struct _i2c_mirror_hdr*) NULL )
+    {
+        return( E_MIRROR_NULL );
+    }
+
+    if( !owner )
+    {
+        return( E_MIRROR_NOT_OWNER );
+    }
+
+    seq = pHdr->seq.load( std::memory_order_relaxed );
+    pHdr->seq.store( seq + 1, std::memory_order_relaxed );
+    std::atomic_thread_fence( std::memory_order_release );
+    pHdr->valid = valid ? 1 : 0;
+    pHdr->seq.store( seq + 2, std::memory_order_release );
+
+    return( E_MIRROR_SUCCESS );
+}
+
+/*
+ ***************************************************************************
+ * int i2cMirror::setDataOffset( int offset )
+ * ----------------------------------------------------
+ * owner only: set the length of the private header, read()
+ * adds it to each address just like eeRead() does
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns an errorcode, E_MIRROR_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cMirror::setDataOffset( int offset )
+{
+    uint32_t seq;
+
+    if( pHdr == (struct _i2c_mirror_hdr*) NULL )
+    {
+        return( E_MIRROR_NULL );
+    }
+
+    if( !owner )
+    {
+        return( E_MIRROR_NOT_OWNER );
+    }
+
+    seq = pHdr->seq.load( std::memory_order_relaxed );
+    pHdr->seq.store( seq + 1, std::memory_order_relaxed );
+    std::atomic_thread_fence( std::memory_order_release );
+    pHdr->data_offset = offset;
+    pHdr->seq.store( seq + 2, std::memory_order_release );
+
+    return( E_MIRROR_SUCCESS );
+}
+
+/*
+ ***************************************************************************
+ * int i2cMirror::update( uint16_t addr, const uint8_t* pData, int amount )
+ * ----------------------------------------------------
+ * owner only: copy amount bytes to device address addr of
+ * the image. Readers never see a half done update
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns an errorcode, E_MIRROR_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cMirror::update( uint16_t addr, const uint8_t* pData, int amount )
+{
+    uint32_t seq;
+
+    if( pHdr == (struct _i2c_mirror_hdr*) NULL || pData == NULL )
+    {
+        return( E_MIRROR_NULL );
+    }
+
+    if( !owner )
+    {
+        return( E_MIRROR_NOT_OWNER );
+    }
+
+    if( amount <= 0 || addr + amount > (int) pHdr->size )
+    {
+        return( E_MIRROR_RANGE );
+    }
+
+    seq = pHdr->seq.load( std::memory_order_relaxed );
+    pHdr->seq.store( seq + 1, std::memory_order_relaxed );
+    std::atomic_thread_fence( std::memory_order_release );
+    memcpy( &pImage[addr], pData, amount );
+    pHdr->seq.store( seq + 2, std::memory_order_release );
+
+    return( E_MIRROR_SUCCESS );
+}
+
+/*
+ ***************************************************************************
+ * bool i2cMirror::isValid( void )
+ * ----------------------------------------------------
+ * whether the owner has completely loaded the image
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns true if the image may be read
+ ***************************************************************************
+*/
+bool i2cMirror::isValid( void )
+{
+    return( pHdr != (struct _i2c_mirror_hdr*) NULL && pHdr->valid != 0 );
+}
+
+/*
+ ***************************************************************************
+ * int i2cMirror::size( void )
+ * ----------------------------------------------------
+ * size of the mirrored image in bytes
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns the size, 0 if not mapped
+ ***************************************************************************
+*/
+int i2cMirror::size( void )
+{
+    return( pHdr != (struct _i2c_mirror_hdr*) NULL ? pHdr->size : 0 );
+}
+
+/*
+ ***************************************************************************
+ * int i2cMirror::copyOut( uint16_t addr, uint8_t* pBuffer, int amount,
+ *                         bool userData )
+ * ----------------------------------------------------
+ * copy amount bytes at addr of the image, relative to the
+ * user data if userData is set. No syscall, no lock: the copy
+ * is retried if the owner updated the image meanwhile
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns an errorcode, E_MIRROR_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cMirror::copyOut( uint16_t addr, uint8_t* pBuffer, int amount, 
+                        bool userData )
+{
+    int retVal;
+    int start;
+    uint32_t seqBefore;
+    uint32_t seqAfter;
+
+    if( pHdr == (struct _i2c_mirror_hdr*) NULL || pBuffer == NULL )
+    {
+        return( E_MIRROR_NULL );
+    }
+
+    do
+    {
+        seqBefore = pHdr->seq.load( std::memory_order_acquire );
+
+        if( (seqBefore & 1) != 0 )
+        {
+            // owner is in the middle of an update
+            seqAfter = seqBefore + 1;
+            continue;
+        }
+
+        // the offset is covered by the sequence like the image
+        start = addr + (userData ? (int) pHdr->data_offset : 0);
+
+        if( pHdr->valid == 0 )
+        {
+            retVal = E_MIRROR_NOT_VALID;
+        }
+        else
+        {
+            if( amount <= 0 || start + amount > (int) pHdr->size )
+            {
+                retVal = E_MIRROR_RANGE;
+            }
+            else
+            {
+                memcpy( pBuffer, &pImage[start], amount );
+                retVal = E_MIRROR_SUCCESS;
+            }
+        }
+
+        std::atomic_thread_fence( std::memory_order_acquire );
+        seqAfter = pHdr->seq.load( std::memory_order_relaxed );
+
+    } while( seqBefore != seqAfter );
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * int i2cMirror::readRaw( uint16_t addr, uint8_t* pBuffer, int amount )
+ * ----------------------------------------------------
+ * read amount bytes from device address addr of the image
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns an errorcode, E_MIRROR_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cMirror::readRaw( uint16_t addr, uint8_t* pBuffer, int amount )
+{
+    return( copyOut( addr, pBuffer, amount, false ) );
+}
+
+/*
+ ***************************************************************************
+ * int i2cMirror::read( uint16_t addr, uint8_t* pBuffer, int amount )
+ * ----------------------------------------------------
+ * same as readRaw() but addr is relative to the user data,
+ * i.e. it is addressed like eeRead() of the owner
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns an errorcode, E_MIRROR_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cMirror::read( uint16_t addr, uint8_t* pBuffer, int amount )
+{
+    return( copyOut( addr, pBuffer, amount, true ) );
+}
+
@@ -0,0 +1,102 @@
+/*
+ ***********************************************************************
+ *
+ *  i2cMirror.h - part of eeprom access project
+ *
+ *  Copyright (C) 2013-2019 Dreamshader (aka Dirk Schanz)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ *
+ ***********************************************************************
+ *
+ * A copy of the EEPROM image in POSIX shared memory.
+ *
+ * One owner process (the one that talks to the bus) creates the
+ * mirror and keeps it up to date on every write. Any number of
+ * reader processes attach read-only and read from memory without
+ * syscalls or locks. Consistency is guaranteed by a sequence
+ * counter that is odd while the owner is updating (seqlock).
+ *
+ ***********************************************************************
+ */
+
+#ifndef I2CMIRROR_H
+#define I2CMIRROR_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <atomic>
+
+#define E_MIRROR_SUCCESS            0
+#define E_MIRROR_FAIL              -1
+#define E_MIRROR_NULL              -3
+#define E_MIRROR_SHM               -4
+#define E_MIRROR_INVAL             -5
+#define E_MIRROR_NOT_VALID         -6
+#define E_MIRROR_RANGE             -7
+#define E_MIRROR_NOT_OWNER         -8
+
+#define I2C_MIRROR_MAGIC           0x45454d52
+#define I2C_MIRROR_VERSION         1
+#define I2C_MIRROR_NAME_LEN        40
+#define I2C_MIRROR_NAME_FMT        "/i2cEEPROM-%d-%02x"
+
+struct _i2c_mirror_hdr {
+    uint32_t              magic;
+    uint32_t              version;
+    std::atomic<uint32_t> seq;        // odd while the owner updates
+    uint32_t              valid;      // image completely loaded
+    uint32_t              size;       // bytes in the image
+    uint32_t              data_offset;// private header in front of user data
+    int32_t               bus;
+    int32_t               addr;
+    pid_t                 owner_pid;
+};
+
+class i2cMirror {
+
+    private:
+        int                     shm_fd;
+        struct _i2c_mirror_hdr *pHdr;
+        uint8_t                *pImage;
+        size_t                  map_len;
+        bool                    owner;
+        char                    shm_name[I2C_MIRROR_NAME_LEN];
+
+        bool ownerAlive( void );
+        int copyOut( uint16_t addr, uint8_t* pBuffer, int amount, 
+                     bool userData );
+
+    public:
+        i2cMirror();
+        ~i2cMirror();
+
+        int create( int bus, int addr, int size );
+        int attach( int bus, int addr );
+        void detach( void );
+
+        int setValid( bool valid );
+        int setDataOffset( int offset );
+        int update( uint16_t addr, const uint8_t* pData, int amount );
+
+        bool isValid( void );
+        int  size( void );
+        int readRaw( uint16_t addr, uint8_t* pBuffer, int amount );
+        int read( uint16_t addr, uint8_t* pBuffer, int amount );
+};
+
+#endif /* I2CMIRROR_H */
+
@@ -0,0 +1,536 @@
+/*
+ ***********************************************************************
+ *
+ *  i2cMux.cpp - part of eeprom access project
+ *
+ *  Copyright (C) 2013-2019 Dreamshader (aka Dirk Schanz)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ *
+ ***********************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+
+#include <map>
+#include <vector>
+
+#include "i2cCore.h"
+#include "i2cSim.h"
+#include "i2cMux.h"
+
+struct _i2c_mux_state {
+    int addr;
+    int type;
+    int current;             // channel, I2C_MUX_CHANNEL_NONE or _UNKNOWN
+    struct _i2c_mux_stats stats;
+};
+
+// the muxes of a bus seen so far. lock is held from selecting a
+// channel to the end of the transfer
+struct _i2c_mux_bus {
+    pthread_mutex_t lock;
+    std::vector<struct _i2c_mux_state> muxes;
+};
+
+static pthread_mutex_t muxBusesLock = PTHREAD_MUTEX_INITIALIZER;
+static std::map<int, struct _i2c_mux_bus*> muxBuses;
+
+/*
+ ***************************************************************************
+ * static struct _i2c_mux_bus* muxBus( int bus, bool create )
+ * ----------------------------------------------------
+ * the muxes of bus <bus>. Buses are never freed
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns the bus, NULL if no mux was used on it and create
+ * is not set
+ ***************************************************************************
+*/
+static struct _i2c_mux_bus* muxBus( int bus, bool create )
+{
+    struct _i2c_mux_bus* retVal = NULL;
+    std::map<int, struct _i2c_mux_bus*>::iterator it;
+
+    pthread_mutex_lock( &muxBusesLock );
+
+    if( (it = muxBuses.find( bus )) != muxBuses.end() )
+    {
+        retVal = it->second;
+    }
+    else
+    {
+        if( create )
+        {
+            retVal = new struct _i2c_mux_bus;
+            pthread_mutex_init( &retVal->lock, NULL );
+            muxBuses[bus] = retVal;
+        }
+    }
+
+    pthread_mutex_unlock( &muxBusesLock );
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * static struct _i2c_mux_state* muxState( struct _i2c_mux_bus* pBus,
+ *                                         int muxAddr, int muxType )
+ * ----------------------------------------------------
+ * the state of the mux at muxAddr, created on first use with
+ * an unknown channel. Bus locked
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns the state, NULL if muxType is I2C_MUX_NONE and the
+ * mux is not known
+ ***************************************************************************
+*/
+static struct _i2c_mux_state* muxState( struct _i2c_mux_bus* pBus,
+                                        int muxAddr, int muxType )
+{
+    struct _i2c_mux_state state;
+    size_t i;
+
+    for( i = 0; i < pBus->muxes.size(); i++ )
+    {
+        if( pBus->muxes[i].addr == muxAddr )
+        {
+            return( &pBus->muxes[i] );
+        }
+    }
+
+    if( muxType == I2C_MUX_NONE )
+    {
+        return( NULL );
+    }
+
+    memset( &state, 0, sizeof(state) );
+    state.addr    = muxAddr;
+    state.type    = muxType;
+    state.current = I2C_MUX_CHANNEL_UNKNOWN;
+    pBus->muxes.push_back( state );
+
+    return( &pBus->muxes.back() );
+}
+
+/*
+ ***************************************************************************
+ * static int muxWrite( int bus, int fd, bool simulated, int muxAddr,
+ *                      uint8_t control )
+ * ----------------------------------------------------
+ * write the control register of a mux, without touching the
+ * slave address of fd
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns 0 on success, -1 with errno set on error
+ ***************************************************************************
+*/
+static int muxWrite( int bus, int fd, bool simulated, int muxAddr,
+                     uint8_t control )
+{
+    int retVal;
+    struct i2c_msg msg;
+    struct i2c_rdwr_ioctl_data rdwr;
+
+    msg.addr  = muxAddr;
+    msg.flags = 0;
+    msg.len   = 1;
+    msg.buf   = &control;
+
+    if( simulated )
+    {
+        retVal = i2cSimTransfer( bus, &msg, 1 );
+    }
+    else
+    {
+        rdwr.msgs  = &msg;
+        rdwr.nmsgs = 1;
+        retVal = ioctl( fd, I2C_RDWR, &rdwr );
+    }
+
+    return( retVal < 0 ? -1 : 0 );
+}
+
+/*
+ ***************************************************************************
+ * int i2cMuxChannels( int muxType )
+ * ----------------------------------------------------
+ * number of channels of a mux type
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns the number of channels, 0 for an unknown type
+ ***************************************************************************
+*/
+int i2cMuxChannels( int muxType )
+{
+    int retVal;
+
+    switch( muxType )
+    {
+        case I2C_MUX_PCA9548:
+            retVal = 8;
+            break;
+        case I2C_MUX_PCA9546:
+        case I2C_MUX_PCA9544:
+            retVal = 4;
+            break;
+        case I2C_MUX_PCA9542:
+            retVal = 2;
+            break;
+        default:
+            retVal = 0;
+            break;
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * int i2cMuxControl( int muxType, int channel )
+ * ----------------------------------------------------
+ * the value of the control register to select channel, 
+ * I2C_MUX_CHANNEL_NONE for all channels off
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns the value, -1 for an invalid type or channel
+ ***************************************************************************
+*/
+int i2cMuxControl( int muxType, int channel )
+{
+    int retVal = -1;
+
+    if( channel == I2C_MUX_CHANNEL_NONE && i2cMuxChannels( muxType ) > 0 )
+    {
+        retVal = 0;
+    }
+    else
+    {
+        if( channel >= 0 && channel < i2cMuxChannels( muxType ) )
+        {
+            // the PCA9544 and PCA9542 have an enable bit and the
+            // channel number, the others a bit per channel
+            if( muxType == I2C_MUX_PCA9544 || muxType == I2C_MUX_PCA9542 )
+            {
+                retVal = 0x04 | channel;
+            }
+            else
+            {
+                retVal = 1 << channel;
+            }
+        }
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * bool i2cMuxEnabled( int muxType, uint8_t control, int channel )
+ * ----------------------------------------------------
+ * whether control, written to a mux of muxType, connects
+ * channel to the bus
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns true if the channel is connected
+ ***************************************************************************
+*/
+bool i2cMuxEnabled( int muxType, uint8_t control, int channel )
+{
+    bool retVal = false;
+
+    if( channel >= 0 && channel < i2cMuxChannels( muxType ) )
+    {
+        if( muxType == I2C_MUX_PCA9544 || muxType == I2C_MUX_PCA9542 )
+        {
+            retVal = (control & 0x04) != 0 && 
+                     (control & 0x03) == channel;
+        }
+        else
+        {
+            retVal = (control & (1 << channel)) != 0;
+        }
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * bool i2cMuxRouteValid( const struct _i2c_route* pRoute )
+ * ----------------------------------------------------
+ * check a route, NULL and I2C_MUX_NONE are no route
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns true if the route can be used
+ ***************************************************************************
+*/
+bool i2cMuxRouteValid( const struct _i2c_route* pRoute )
+{
+    return( pRoute == NULL || pRoute->mux_type == I2C_MUX_NONE ||
+            (i2cMuxControl( pRoute->mux_type, pRoute->channel ) > 0 &&
+             pRoute->mux_addr >= I2C_MUX_FIRST_ADDR && 
+             pRoute->mux_addr <= I2C_MUX_LAST_ADDR) );
+}
+
+/*
+ ***************************************************************************
+ * bool i2cMuxSameRoute( const struct _i2c_route* pRoute1, 
+ *                       const struct _i2c_route* pRoute2 )
+ * ----------------------------------------------------
+ * compare routes, NULL is the same as I2C_MUX_NONE
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns true if both lead the same way
+ ***************************************************************************
+*/
+bool i2cMuxSameRoute( const struct _i2c_route* pRoute1, 
+                      const struct _i2c_route* pRoute2 )
+{
+    bool direct1 = pRoute1 == NULL || pRoute1->mux_type == I2C_MUX_NONE;
+    bool direct2 = pRoute2 == NULL || pRoute2->mux_type == I2C_MUX_NONE;
+
+    if( direct1 || direct2 )
+    {
+        return( direct1 == direct2 );
+    }
+
+    return( pRoute1->mux_addr == pRoute2->mux_addr &&
+            pRoute1->channel == pRoute2->channel );
+}
+
+/*
+ ***************************************************************************
+ * int i2cMuxSelect( int bus, int fd, bool simulated, 
+ *                   const struct _i2c_route* pRoute, int* pWrites )
+ * ----------------------------------------------------
+ * connect the channel of pRoute to the bus, other muxes of the
+ * bus are turned off first. Nothing is written for a channel
+ * selected already. On success the bus stays locked for the
+ * transfer, i2cMuxRelease() unlocks it. *pWrites gets the
+ * number of control writes sent
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns 0 on success, -1 with errno set on error
+ ***************************************************************************
+*/
+int i2cMuxSelect( int bus, int fd, bool simulated, 
+                  const struct _i2c_route* pRoute, int* pWrites )
+{
+    struct _i2c_mux_bus* pBus;
+    struct _i2c_mux_state* pMux;
+    int err;
+    size_t i;
+
+    *pWrites = 0;
+
+    if( (pBus = muxBus( bus, true )) == NULL )
+    {
+        errno = ENOMEM;
+        return( -1 );
+    }
+
+    pthread_mutex_lock( &pBus->lock );
+
+    pMux = muxState( pBus, pRoute->mux_addr, pRoute->mux_type );
+
+    for( i = 0; i < pBus->muxes.size(); i++ )
+    {
+        if( &pBus->muxes[i] != pMux &&
+            pBus->muxes[i].current != I2C_MUX_CHANNEL_NONE )
+        {
+            (*pWrites)++;
+
+            if( muxWrite( bus, fd, simulated, pBus->muxes[i].addr, 0 ) < 0 )
+            {
+                err = errno;
+                pthread_mutex_unlock( &pBus->lock );
+                errno = err;
+                return( -1 );
+            }
+
+            pBus->muxes[i].current = I2C_MUX_CHANNEL_NONE;
+            pBus->muxes[i].stats.deselects++;
+        }
+    }
+
+    if( pMux->current == pRoute->channel )
+    {
+        pMux->stats.skipped++;
+    }
+    else
+    {
+        (*pWrites)++;
+
+        if( muxWrite( bus, fd, simulated, pMux->addr, 
+                      i2cMuxControl( pMux->type, pRoute->channel ) ) < 0 )
+        {
+            err = errno;
+            pMux->current = I2C_MUX_CHANNEL_UNKNOWN;
+            pthread_mutex_unlock( &pBus->lock );
+            errno = err;
+            return( -1 );
+        }
+
+        pMux->current = pRoute->channel;
+        pMux->stats.selects++;
+    }
+
+    return( 0 );
+}
+
+/*
+ ***************************************************************************
+ * void i2cMuxRelease( int bus )
+ * ----------------------------------------------------
+ * the transfer after i2cMuxSelect() is done
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+void i2cMuxRelease( int bus )
+{
+    struct _i2c_mux_bus* pBus;
+
+    if( (pBus = muxBus( bus, false )) != NULL )
+    {
+        pthread_mutex_unlock( &pBus->lock );
+    }
+}
+
+/*
+ ***************************************************************************
+ * void i2cMuxForget( int bus )
+ * ----------------------------------------------------
+ * another process may have written the muxes of bus, select
+ * the channels anew
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+void i2cMuxForget( int bus )
+{
+    struct _i2c_mux_bus* pBus;
+    size_t i;
+
+    if( (pBus = muxBus( bus, false )) != NULL )
+    {
+        pthread_mutex_lock( &pBus->lock );
+
+        for( i = 0; i < pBus->muxes.size(); i++ )
+        {
+            pBus->muxes[i].current = I2C_MUX_CHANNEL_UNKNOWN;
+            pBus->muxes[i].stats.forgotten++;
+        }
+
+        pthread_mutex_unlock( &pBus->lock );
+    }
+}
+
+/*
+ ***************************************************************************
+ * int i2cMuxCurrent( int bus, int muxAddr )
+ * ----------------------------------------------------
+ * the channel selected last on the mux at muxAddr
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns the channel, I2C_MUX_CHANNEL_NONE or 
+ * I2C_MUX_CHANNEL_UNKNOWN
+ ***************************************************************************
+*/
+int i2cMuxCurrent( int bus, int muxAddr )
+{
+    int retVal = I2C_MUX_CHANNEL_UNKNOWN;
+    struct _i2c_mux_bus* pBus;
+    struct _i2c_mux_state* pMux;
+
+    if( (pBus = muxBus( bus, false )) != NULL )
+    {
+        pthread_mutex_lock( &pBus->lock );
+
+        if( (pMux = muxState( pBus, muxAddr, I2C_MUX_NONE )) != NULL )
+        {
+            retVal = pMux->current;
+        }
+
+        pthread_mutex_unlock( &pBus->lock );
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * int i2cMuxGetStats( int bus, int muxAddr, struct _i2c_mux_stats* pStats )
+ * ----------------------------------------------------
+ * copy the counters of a mux
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns an errorcode, E_MUX_SUCCESS on success, E_MUX_FAIL
+ * for a mux not used yet
+ ***************************************************************************
+*/
+int i2cMuxGetStats( int bus, int muxAddr, struct _i2c_mux_stats* pStats )
+{
+    int retVal = E_MUX_FAIL;
+    struct _i2c_mux_bus* pBus;
+    struct _i2c_mux_state* pMux;
+
+    if( pStats == NULL )
+    {
+        return( E_MUX_INVAL_PARAM );
+    }
+
+    if( (pBus = muxBus( bus, false )) != NULL )
+    {
+        pthread_mutex_lock( &pBus->lock );
+
+        if( (pMux = muxState( pBus, muxAddr, I2C_MUX_NONE )) != NULL )
+        {
+            *pStats = pMux->stats;
+            retVal = E_MUX_SUCCESS;
+        }
+
+        pthread_mutex_unlock( &pBus->lock );
+    }
+
+    return( retVal );
+}
+
@@ -0,0 +1,98 @@
+/*
+ ***********************************************************************
+ *
+ *  i2cMux.h - part of eeprom access project
+ *
+ *  Copyright (C) 2013-2019 Dreamshader (aka Dirk Schanz)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ *
+ ***********************************************************************
+ *
+ * Devices behind PCA954x i2c multiplexers.
+ *
+ * A route leads from the bus through a channel of a mux to the slave,
+ * e.g. to one of eight EEPROMs at 0x50, each on its own channel of a
+ * PCA9548 at 0x70. Before each transfer of a connection with a route
+ * the channel is selected by writing the control register of the mux.
+ *
+ * The channel selected last is remembered per mux, a transfer on the
+ * channel already selected sends nothing to the mux. Selecting a
+ * channel turns off the other muxes of the bus first, so devices
+ * with the same address on different muxes do not answer together.
+ * Devices on the bus itself must not use addresses found behind a mux.
+ *
+ * Within a process transfers of a bus with muxes are serialized
+ * from selecting the channel to the end of the transfer. What other
+ * processes write to a mux is only noticed with arbitration (see
+ * i2cArbiter.h): the channels are selected anew whenever the adapter
+ * lock was taken. Without it the process must own the muxes.
+ *
+ ***********************************************************************
+ */
+
+#ifndef I2CMUX_H
+#define I2CMUX_H
+
+#include <stdint.h>
+
+#define E_MUX_SUCCESS               0
+#define E_MUX_FAIL                 -1
+#define E_MUX_INVAL_PARAM          -2
+
+// mux types
+#define I2C_MUX_NONE                0   // the device is on the bus itself
+#define I2C_MUX_PCA9548             1   // 8 channels, one bit each
+#define I2C_MUX_PCA9546             2   // 4 channels, one bit each
+#define I2C_MUX_PCA9544             3   // 4 channels, enable bit and number
+#define I2C_MUX_PCA9542             4   // 2 channels, enable bit and number
+
+#define I2C_MUX_MAX_CHANNELS        8
+#define I2C_MUX_FIRST_ADDR       0x70
+#define I2C_MUX_LAST_ADDR        0x77
+
+// remembered channel of a mux
+#define I2C_MUX_CHANNEL_NONE       -1   // all channels off
+#define I2C_MUX_CHANNEL_UNKNOWN    -2   // not written yet or forgotten
+
+struct _i2c_route {
+    int mux_type;            // I2C_MUX_NONE for no mux
+    int mux_addr;
+    int channel;
+};
+
+struct _i2c_mux_stats {
+    uint64_t selects;        // control writes to switch the channel
+    uint64_t skipped;        // transfers on the channel selected already
+    uint64_t deselects;      // control writes to turn the mux off
+    uint64_t forgotten;      // times the channel was forgotten
+};
+
+int i2cMuxChannels( int muxType );
+int i2cMuxControl( int muxType, int channel );
+bool i2cMuxEnabled( int muxType, uint8_t control, int channel );
+bool i2cMuxRouteValid( const struct _i2c_route* pRoute );
+bool i2cMuxSameRoute( const struct _i2c_route* pRoute1, 
+                      const struct _i2c_route* pRoute2 );
+int i2cMuxSelect( int bus, int fd, bool simulated, 
+                  const struct _i2c_route* pRoute, int* pWrites );
+void i2cMuxRelease( int bus );
+void i2cMuxForget( int bus );
+int i2cMuxCurrent( int bus, int muxAddr );
+int i2cMuxGetStats( int bus, int muxAddr, struct _i2c_mux_stats* pStats );
+
+#endif /* I2CMUX_H */
+
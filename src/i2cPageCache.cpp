@@ -0,0 +1,441 @@
+/*
+ ***********************************************************************
+ *
+ *  i2cPageCache.cpp - part of eeprom access project
+ *
+ *  Copyright (C) 2013-2019 Dreamshader (aka Dirk Schanz)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ *
+ ***********************************************************************
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <algorithm>
+
+#include "i2cPageCache.h"
+
+/*
+ ***************************************************************************
+ * i2cPageCache::i2cPageCache()
+ * ----------------------------------------------------
+ * create an empty cache, configure() gives it memory
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+i2cPageCache::i2cPageCache()
+{
+    page_size = 0;
+    slots     = 0;
+    used      = 0;
+    policy    = I2C_CACHE_DEFAULT_POLICY;
+    lru_head  = -1;
+    lru_tail  = -1;
+    hand      = 0;
+}
+
+/*
+ ***************************************************************************
+ * int i2cPageCache::configure( int pageSize, int totalPages, int budget,
+ *                              int cachePolicy )
+ * ----------------------------------------------------
+ * (re)allocate the cache for a chip of totalPages pages with
+ * budget bytes, at least one page, at most the whole chip.
+ * All pages are forgotten
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns an errorcode, E_CACHE_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cPageCache::configure( int pageSize, int totalPages, int budget,
+                             int cachePolicy )
+{
+    int retVal = E_CACHE_SUCCESS;
+
+    if( pageSize <= 0 || totalPages <= 0 || budget < 0 ||
+        (cachePolicy != I2C_CACHE_LRU && cachePolicy != I2C_CACHE_CLOCK) )
+    {
+        retVal = E_CACHE_INVAL_PARAM;
+    }
+    else
+    {
+        page_size = pageSize;
+        policy    = cachePolicy;
+        slots     = budget / pageSize;
+
+        if( budget == 0 || slots > totalPages )
+        {
+            slots = totalPages;
+        }
+
+        if( slots < 1 )
+        {
+            slots = 1;
+        }
+
+        data.assign( slots * page_size, 0xff );
+        slot_page.resize( slots );
+        page_slot.resize( totalPages );
+        lru_prev.resize( slots );
+        lru_next.resize( slots );
+        referenced.resize( slots );
+
+        clear();
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * void i2cPageCache::clear( void )
+ * ----------------------------------------------------
+ * forget all pages, the memory is kept
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+void i2cPageCache::clear( void )
+{
+    std::fill( slot_page.begin(), slot_page.end(), -1 );
+    std::fill( page_slot.begin(), page_slot.end(), -1 );
+    std::fill( referenced.begin(), referenced.end(), 0 );
+    used     = 0;
+    lru_head = -1;
+    lru_tail = -1;
+    hand     = 0;
+}
+
+/*
+ ***************************************************************************
+ * void i2cPageCache::release( void )
+ * ----------------------------------------------------
+ * forget all pages and free the memory
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+void i2cPageCache::release( void )
+{
+    std::vector<uint8_t>().swap( data );
+    std::vector<int>().swap( slot_page );
+    std::vector<int>().swap( page_slot );
+    std::vector<int>().swap( lru_prev );
+    std::vector<int>().swap( lru_next );
+    std::vector<uint8_t>().swap( referenced );
+    slots = 0;
+    clear();
+}
+
+/*
+ ***************************************************************************
+ * void i2cPageCache::unlink( int slot )
+ * void i2cPageCache::linkHead( int slot )
+ * ----------------------------------------------------
+ * take a slot out of the LRU list resp. put it in front
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+void i2cPageCache::unlink( int slot )
+{
+    if( lru_prev[slot] >= 0 )
+    {
+        lru_next[lru_prev[slot]] = lru_next[slot];
+    }
+    else
+    {
+        lru_head = lru_next[slot];
+    }
+
+    if( lru_next[slot] >= 0 )
+    {
+        lru_prev[lru_next[slot]] = lru_prev[slot];
+    }
+    else
+    {
+        lru_tail = lru_prev[slot];
+    }
+}
+
+void i2cPageCache::linkHead( int slot )
+{
+    lru_prev[slot] = -1;
+    lru_next[slot] = lru_head;
+
+    if( lru_head >= 0 )
+    {
+        lru_prev[lru_head] = slot;
+    }
+
+    lru_head = slot;
+
+    if( lru_tail < 0 )
+    {
+        lru_tail = slot;
+    }
+}
+
+/*
+ ***************************************************************************
+ * void i2cPageCache::touch( int slot )
+ * ----------------------------------------------------
+ * the page in slot was used
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+void i2cPageCache::touch( int slot )
+{
+    if( policy == I2C_CACHE_LRU )
+    {
+        if( lru_head != slot )
+        {
+            unlink( slot );
+            linkHead( slot );
+        }
+    }
+    else
+    {
+        // lookups of other threads may set it at the same time
+        __atomic_store_n( &referenced[slot], 1, __ATOMIC_RELAXED );
+    }
+}
+
+/*
+ ***************************************************************************
+ * int i2cPageCache::victim( void )
+ * ----------------------------------------------------
+ * choose the slot to evict, all slots are used
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns the slot
+ ***************************************************************************
+*/
+int i2cPageCache::victim( void )
+{
+    int retVal;
+
+    if( policy == I2C_CACHE_LRU )
+    {
+        retVal = lru_tail;
+        unlink( retVal );
+    }
+    else
+    {
+        // second chance: a referenced slot loses its bit and stays
+        while( referenced[hand] )
+        {
+            referenced[hand] = 0;
+            hand = (hand + 1) % slots;
+        }
+
+        retVal = hand;
+        hand = (hand + 1) % slots;
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * int i2cPageCache::slotFor( int page, int* pEvicted )
+ * ----------------------------------------------------
+ * the slot of page, a free or evicted one if it is not
+ * cached yet. *pEvicted is incremented for an eviction
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns the slot
+ ***************************************************************************
+*/
+int i2cPageCache::slotFor( int page, int* pEvicted )
+{
+    int retVal;
+
+    if( (retVal = page_slot[page]) < 0 )
+    {
+        if( used < slots )
+        {
+            retVal = used++;
+        }
+        else
+        {
+            retVal = victim();
+            page_slot[slot_page[retVal]] = -1;
+            (*pEvicted)++;
+        }
+
+        slot_page[retVal] = page;
+        page_slot[page]   = retVal;
+        referenced[retVal] = 0;
+
+        if( policy == I2C_CACHE_LRU )
+        {
+            linkHead( retVal );
+        }
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * bool i2cPageCache::lookup( int addr, uint8_t* pBuffer, int amount )
+ * ----------------------------------------------------
+ * copy amount bytes at addr, if all pages involved are cached
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns true if the bytes were copied
+ ***************************************************************************
+*/
+bool i2cPageCache::lookup( int addr, uint8_t* pBuffer, int amount )
+{
+    bool retVal = true;
+    int page;
+    int first;
+    int last;
+    int offset;
+    int chunk;
+
+    if( slots == 0 || amount <= 0 || addr < 0 ||
+        addr + amount > (int) page_slot.size() * page_size )
+    {
+        return( false );
+    }
+
+    first = addr / page_size;
+    last  = (addr + amount - 1) / page_size;
+
+    for( page = first; page <= last && retVal; page++ )
+    {
+        retVal = page_slot[page] >= 0;
+    }
+
+    for( page = first; page <= last && retVal; page++ )
+    {
+        offset = addr % page_size;
+        chunk  = page_size - offset < amount ? page_size - offset : amount;
+
+        memcpy( pBuffer, &data[page_slot[page] * page_size + offset], chunk );
+        touch( page_slot[page] );
+
+        addr    += chunk;
+        pBuffer += chunk;
+        amount  -= chunk;
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * int i2cPageCache::store( int addr, const uint8_t* pData, int amount )
+ * ----------------------------------------------------
+ * take amount bytes at addr, read from or written to the
+ * device. Pages covered completely are cached, pages covered
+ * partly are only updated if they are cached already
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns the number of pages evicted
+ ***************************************************************************
+*/
+int i2cPageCache::store( int addr, const uint8_t* pData, int amount )
+{
+    int retVal = 0;
+    int page;
+    int slot;
+    int offset;
+    int chunk;
+
+    if( slots == 0 || amount <= 0 || addr < 0 ||
+        addr + amount > (int) page_slot.size() * page_size )
+    {
+        return( 0 );
+    }
+
+    while( amount > 0 )
+    {
+        page   = addr / page_size;
+        offset = addr % page_size;
+        chunk  = page_size - offset < amount ? page_size - offset : amount;
+
+        if( chunk == page_size )
+        {
+            slot = slotFor( page, &retVal );
+        }
+        else
+        {
+            slot = page_slot[page];
+        }
+
+        if( slot >= 0 )
+        {
+            memcpy( &data[slot * page_size + offset], pData, chunk );
+            touch( slot );
+        }
+
+        addr   += chunk;
+        pData  += chunk;
+        amount -= chunk;
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * bool i2cPageCache::peek( int page, uint8_t* pData )
+ * ----------------------------------------------------
+ * copy a cached page without counting it as used
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns true if the page is cached
+ ***************************************************************************
+*/
+bool i2cPageCache::peek( int page, uint8_t* pData )
+{
+    bool retVal = false;
+
+    if( slots > 0 && page >= 0 && page < (int) page_slot.size() &&
+        page_slot[page] >= 0 )
+    {
+        memcpy( pData, &data[page_slot[page] * page_size], page_size );
+        retVal = true;
+    }
+
+    return( retVal );
+}
+
@@ -0,0 +1,109 @@
+/*
+ ***********************************************************************
+ *
+ *  i2cPageCache.h - part of eeprom access project
+ *
+ *  Copyright (C) 2013-2019 Dreamshader (aka Dirk Schanz)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ *
+ ***********************************************************************
+ *
+ * Page cache with a fixed memory budget. The budget is split into
+ * slots of one page each, a page not cached takes no memory apart
+ * from its entry in the page table. When all slots are used, storing
+ * a page evicts one:
+ *
+ * I2C_CACHE_LRU    the page used least recently. A hit moves the
+ *                  page in the list, so lookups need the cache for
+ *                  themselves.
+ * I2C_CACHE_CLOCK  a page not used since the hand passed it last.
+ *                  A hit only sets the reference bit, so lookups of
+ *                  several threads may run at the same time.
+ *
+ * The cache does no locking, see i2cEEPROM.
+ *
+ ***********************************************************************
+ */
+
+#ifndef I2CPAGECACHE_H
+#define I2CPAGECACHE_H
+
+#include <stdint.h>
+#include <vector>
+
+#define E_CACHE_SUCCESS             0
+#define E_CACHE_INVAL_PARAM        -1
+
+#define I2C_CACHE_LRU               0
+#define I2C_CACHE_CLOCK             1
+
+// eeCacheEnable() without eeCacheConfig()
+#define I2C_CACHE_DEFAULT_BUDGET       4096   // bytes of page data
+#define I2C_CACHE_DEFAULT_POLICY       I2C_CACHE_CLOCK
+#define I2C_CACHE_DEFAULT_READAHEAD    16     // pages, at most
+
+struct _i2c_cache_config {
+    int budget;              // bytes of page data, 0 for the whole chip
+    int policy;              // I2C_CACHE_LRU or I2C_CACHE_CLOCK
+    int readahead_max;       // pages read ahead at most, 0 for none
+};
+
+class i2cPageCache {
+
+    private:
+        int page_size;
+        int slots;
+        int used;
+        int policy;
+        std::vector<uint8_t> data;
+        std::vector<int> slot_page;     // -1 for a free slot
+        std::vector<int> page_slot;     // -1 for a page not cached
+
+        // I2C_CACHE_LRU: list of the slots, most recent first
+        std::vector<int> lru_prev;
+        std::vector<int> lru_next;
+        int lru_head;
+        int lru_tail;
+
+        // I2C_CACHE_CLOCK
+        std::vector<uint8_t> referenced;
+        int hand;
+
+        void touch( int slot );
+        void unlink( int slot );
+        void linkHead( int slot );
+        int victim( void );
+        int slotFor( int page, int* pEvicted );
+
+    public:
+        i2cPageCache();
+
+        int configure( int pageSize, int totalPages, int budget,
+                       int cachePolicy );
+        void clear( void );
+        void release( void );
+        bool isConfigured( void ) { return( slots > 0 ); }
+        bool concurrentLookup( void ) { return( policy == I2C_CACHE_CLOCK ); }
+        int capacity( void ) { return( slots * page_size ); }
+
+        bool lookup( int addr, uint8_t* pBuffer, int amount );
+        int store( int addr, const uint8_t* pData, int amount );
+        bool peek( int page, uint8_t* pData );
+};
+
+#endif /* I2CPAGECACHE_H */
+
@@ -0,0 +1,320 @@
+/*
+ ***********************************************************************
+ *
+ *  i2cPool.cpp - part of eeprom access project
+ *
+ *  Copyright (C) 2013-2019 Dreamshader (aka Dirk Schanz)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ *
+ ***********************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <pthread.h>
+
+#include <vector>
+
+#include "i2cCore.h"
+#include "i2cPool.h"
+
+struct _i2c_pool_entry {
+    i2cConnection* pConn;
+    int      bus;
+    int      addr;
+    bool     in_use;
+    uint64_t idle_since;     // CLOCK_MONOTONIC in us, not in use
+};
+
+static pthread_mutex_t poolLock = PTHREAD_MUTEX_INITIALIZER;
+static std::vector<struct _i2c_pool_entry> pool;
+static struct _i2c_pool_stats poolStats;
+// idle time in us, < 0 until taken from the environment
+static int64_t poolIdleUs = -1;
+
+/*
+ ***************************************************************************
+ * static int64_t poolIdle( void )
+ * ----------------------------------------------------
+ * the idle time, pool locked
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns the idle time in us
+ ***************************************************************************
+*/
+static int64_t poolIdle( void )
+{
+    const char* pEnv;
+
+    if( poolIdleUs < 0 )
+    {
+        if( (pEnv = getenv( I2C_POOL_IDLE_ENV )) != NULL && atoi( pEnv ) >= 0 )
+        {
+            poolIdleUs = (int64_t) atoi( pEnv ) * 1000;
+        }
+        else
+        {
+            poolIdleUs = (int64_t) I2C_POOL_DEFAULT_IDLE_MS * 1000;
+        }
+    }
+
+    return( poolIdleUs );
+}
+
+/*
+ ***************************************************************************
+ * static int poolSweep( bool all )
+ * ----------------------------------------------------
+ * close the connections idle for longer than the idle time,
+ * all idle ones if all is set. Pool locked
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns the number of connections closed
+ ***************************************************************************
+*/
+static int poolSweep( bool all )
+{
+    int retVal = 0;
+    size_t i;
+    uint64_t now;
+
+    now = i2cMonotonicUs();
+
+    for( i = 0; i < pool.size(); )
+    {
+        if( !pool[i].in_use && 
+            (all || now - pool[i].idle_since >= (uint64_t) poolIdle()) )
+        {
+            delete pool[i].pConn;
+            pool[i] = pool.back();
+            pool.pop_back();
+            poolStats.reaped++;
+            poolStats.idle--;
+            retVal++;
+        }
+        else
+        {
+            i++;
+        }
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * i2cConnection* i2cPoolAcquire( int bus, int addr, int* pResult,
+ *                                const struct _i2c_route* pRoute )
+ * ----------------------------------------------------
+ * a connection to slave addr on bus, behind the mux channel of
+ * pRoute if given. An idle one of that device, or a new one, it
+ * is never shared. *pResult, if given, gets the result of
+ * i2cConnection::i2cOpen()
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns the connection, NULL if it can not be opened
+ ***************************************************************************
+*/
+i2cConnection* i2cPoolAcquire( int bus, int addr, int* pResult,
+                               const struct _i2c_route* pRoute )
+{
+    i2cConnection* retVal = NULL;
+    struct _i2c_pool_entry entry;
+    int result = E_I2C_SUCCESS;
+    size_t i;
+
+    pthread_mutex_lock( &poolLock );
+
+    poolSweep( false );
+
+    for( i = 0; i < pool.size() && retVal == NULL; i++ )
+    {
+        if( !pool[i].in_use && pool[i].bus == bus && pool[i].addr == addr &&
+            i2cMuxSameRoute( &pool[i].pConn->i2c_route, pRoute ) )
+        {
+            pool[i].in_use = true;
+            pool[i].pConn->reuse();
+            poolStats.reused++;
+            poolStats.idle--;
+            poolStats.in_use++;
+
+            retVal = pool[i].pConn;
+        }
+    }
+
+    if( retVal == NULL )
+    {
+        if( (entry.pConn = new i2cConnection( bus, addr, false, O_RDWR )) == 
+            NULL )
+        {
+            result = E_I2C_FAIL;
+        }
+        else
+        {
+            if( pRoute != NULL )
+            {
+                entry.pConn->i2c_route = *pRoute;
+            }
+
+            if( (result = entry.pConn->i2cOpen()) == E_I2C_SUCCESS )
+            {
+                entry.bus        = bus;
+                entry.addr       = addr;
+                entry.in_use     = true;
+                entry.idle_since = 0;
+                pool.push_back( entry );
+
+                poolStats.opened++;
+                poolStats.in_use++;
+                retVal = entry.pConn;
+            }
+            else
+            {
+                delete entry.pConn;
+            }
+        }
+    }
+
+    if( retVal != NULL )
+    {
+        poolStats.acquired++;
+    }
+
+    pthread_mutex_unlock( &poolLock );
+
+    if( pResult != NULL )
+    {
+        *pResult = result;
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * void i2cPoolRelease( i2cConnection* pConn )
+ * ----------------------------------------------------
+ * give back a connection of i2cPoolAcquire(). A write in
+ * progress is waited for, as closing did, then the connection
+ * is idle
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+void i2cPoolRelease( i2cConnection* pConn )
+{
+    size_t i;
+
+    if( pConn == NULL )
+    {
+        return;
+    }
+
+    // outside the pool lock, it may take a write cycle
+    pConn->waitReady();
+
+    pthread_mutex_lock( &poolLock );
+
+    for( i = 0; i < pool.size(); i++ )
+    {
+        if( pool[i].pConn == pConn && pool[i].in_use )
+        {
+            pool[i].in_use     = false;
+            pool[i].idle_since = i2cMonotonicUs();
+            poolStats.in_use--;
+            poolStats.idle++;
+            break;
+        }
+    }
+
+    poolSweep( false );
+
+    pthread_mutex_unlock( &poolLock );
+}
+
+/*
+ ***************************************************************************
+ * void i2cPoolSetIdle( int idleMs )
+ * ----------------------------------------------------
+ * keep released connections open for idleMs milliseconds,
+ * < 0 for the default. Takes effect with the next use
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+void i2cPoolSetIdle( int idleMs )
+{
+    pthread_mutex_lock( &poolLock );
+    poolIdleUs = (int64_t) (idleMs >= 0 ? idleMs : I2C_POOL_DEFAULT_IDLE_MS) *
+                 1000;
+    pthread_mutex_unlock( &poolLock );
+}
+
+/*
+ ***************************************************************************
+ * int i2cPoolReap( bool all )
+ * ----------------------------------------------------
+ * close the idle connections past their time, all idle ones
+ * if all is set, e.g. before a long sleep
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns the number of connections closed
+ ***************************************************************************
+*/
+int i2cPoolReap( bool all )
+{
+    int retVal;
+
+    pthread_mutex_lock( &poolLock );
+    retVal = poolSweep( all );
+    pthread_mutex_unlock( &poolLock );
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * void i2cPoolGetStats( struct _i2c_pool_stats* pStats )
+ * ----------------------------------------------------
+ * copy the counters of the pool
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+void i2cPoolGetStats( struct _i2c_pool_stats* pStats )
+{
+    if( pStats != NULL )
+    {
+        pthread_mutex_lock( &poolLock );
+        *pStats = poolStats;
+        pthread_mutex_unlock( &poolLock );
+    }
+}
+
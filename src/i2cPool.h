@@ -0,0 +1,76 @@
+/*
+ ***********************************************************************
+ *
+ *  i2cPool.h - part of eeprom access project
+ *
+ *  Copyright (C) 2013-2019 Dreamshader (aka Dirk Schanz)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ *
+ ***********************************************************************
+ *
+ * Process wide pool of the connections to i2c devices.
+ *
+ * Opening a device costs an open() of the adapter and the ioctls
+ * for the adapter functions, the slave address and the timeouts.
+ * i2cEEPROM::eeOpen() takes its connection from the pool instead.
+ * A connection belongs to one instance at a time: when it is
+ * released it stays open for the idle time and is handed out again
+ * by the next eeOpen() of the same bus, slave address and mux
+ * channel. Instances open at the same time get connections of their
+ * own, as the busy time, statistics and geometry of a connection are
+ * guarded by the locks of its instance only. Idle connections older
+ * than the idle time are closed whenever the pool is used, or by
+ * i2cPoolReap().
+ *
+ * A connection taken from the idle ones is reset to the state of a
+ * new one, see i2cConnection::reuse().
+ *
+ * The idle time is I2C_POOL_DEFAULT_IDLE_MS. The environment variable
+ * I2C_POOL_IDLE_MS or i2cPoolSetIdle() change it, 0 closes connections
+ * as soon as they are released.
+ *
+ ***********************************************************************
+ */
+
+#ifndef I2CPOOL_H
+#define I2CPOOL_H
+
+#include <stdint.h>
+
+#include "i2cCore.h"
+
+#define I2C_POOL_DEFAULT_IDLE_MS 10000
+#define I2C_POOL_IDLE_ENV        "I2C_POOL_IDLE_MS"
+
+struct _i2c_pool_stats {
+    uint64_t acquired;       // connections handed out
+    uint64_t reused;         // ... of which idle
+    uint64_t opened;         // connections opened
+    uint64_t reaped;         // idle connections closed
+    uint32_t in_use;         // connections now in use
+    uint32_t idle;           // connections now idle
+};
+
+i2cConnection* i2cPoolAcquire( int bus, int addr, int* pResult,
+                               const struct _i2c_route* pRoute = NULL );
+void i2cPoolRelease( i2cConnection* pConn );
+void i2cPoolSetIdle( int idleMs );
+int i2cPoolReap( bool all );
+void i2cPoolGetStats( struct _i2c_pool_stats* pStats );
+
+#endif /* I2CPOOL_H */
+
@@ -0,0 +1,184 @@
+/*
+ ***********************************************************************
+ *
+ *  i2cPriority.cpp - part of eeprom access project
+ *
+ *  Copyright (C) 2013-2019 Dreamshader (aka Dirk Schanz)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ *
+ ***********************************************************************
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#include "i2cPriority.h"
+
+/*
+ ***************************************************************************
+ * i2cPriorityGate::i2cPriorityGate()
+ * ----------------------------------------------------
+ * create an open gate
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+i2cPriorityGate::i2cPriorityGate()
+{
+    pthread_condattr_t attr;
+
+    busy  = false;
+    depth = 0;
+    memset( waiting, 0, sizeof(waiting) );
+    pthread_mutex_init( &gate_lock, NULL );
+
+    // deadlines are taken from the monotonic clock
+    pthread_condattr_init( &attr );
+    pthread_condattr_setclock( &attr, CLOCK_MONOTONIC );
+    pthread_cond_init( &gate_cond, &attr );
+    pthread_condattr_destroy( &attr );
+}
+
+/*
+ ***************************************************************************
+ * i2cPriorityGate::~i2cPriorityGate()
+ * ----------------------------------------------------
+ * destructor
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+i2cPriorityGate::~i2cPriorityGate()
+{
+    pthread_cond_destroy( &gate_cond );
+    pthread_mutex_destroy( &gate_lock );
+}
+
+/*
+ ***************************************************************************
+ * bool i2cPriorityGate::enter( int prio, uint64_t deadlineUs )
+ * ----------------------------------------------------
+ * wait until the gate is free and no more urgent class waits,
+ * but not past deadlineUs unless it is 0
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns true if the gate was entered, false if the deadline
+ * passed first
+ ***************************************************************************
+*/
+bool i2cPriorityGate::enter( int prio, uint64_t deadlineUs )
+{
+    int p;
+    bool blocked;
+    bool retVal = true;
+    struct timespec until;
+
+    until.tv_sec  = deadlineUs / 1000000;
+    until.tv_nsec = (deadlineUs % 1000000) * 1000;
+
+    if( prio < 0 || prio >= I2C_PRIO_CLASSES )
+    {
+        prio = I2C_PRIO_CLASSES - 1;
+    }
+
+    pthread_mutex_lock( &gate_lock );
+
+    if( busy && pthread_equal( owner, pthread_self() ) )
+    {
+        depth++;
+    }
+    else
+    {
+        waiting[prio]++;
+
+        do
+        {
+            blocked = busy;
+
+            for( p = 0; p < prio && !blocked; p++ )
+            {
+                blocked = waiting[p] > 0;
+            }
+
+            if( blocked )
+            {
+                if( deadlineUs == 0 )
+                {
+                    pthread_cond_wait( &gate_cond, &gate_lock );
+                }
+                else
+                {
+                    if( pthread_cond_timedwait( &gate_cond, &gate_lock, 
+                                                &until ) == ETIMEDOUT )
+                    {
+                        retVal = false;
+                        break;
+                    }
+                }
+            }
+        } while( blocked );
+
+        waiting[prio]--;
+
+        if( retVal )
+        {
+            busy  = true;
+            owner = pthread_self();
+            depth = 1;
+        }
+        else
+        {
+            // less urgent waiters may have waited for this one
+            pthread_cond_broadcast( &gate_cond );
+        }
+    }
+
+    pthread_mutex_unlock( &gate_lock );
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * void i2cPriorityGate::leave( void )
+ * ----------------------------------------------------
+ * release the gate, called by the thread that entered
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+void i2cPriorityGate::leave( void )
+{
+    pthread_mutex_lock( &gate_lock );
+
+    if( --depth == 0 )
+    {
+        busy = false;
+        pthread_cond_broadcast( &gate_cond );
+    }
+
+    pthread_mutex_unlock( &gate_lock );
+}
+
@@ -0,0 +1,61 @@
+/*
+ ***********************************************************************
+ *
+ *  i2cPriority.h - part of eeprom access project
+ *
+ *  Copyright (C) 2013-2019 Dreamshader (aka Dirk Schanz)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ *
+ ***********************************************************************
+ *
+ * Lock with priority classes. Class 0 is the most urgent. When the
+ * lock is released, waiters of the most urgent class waiting get it
+ * first, a new waiter never passes a more urgent one. The owning
+ * thread may enter again. A waiter with a deadline (CLOCK_MONOTONIC
+ * in us, see i2cMonotonicUs()) gives up when it passes.
+ *
+ ***********************************************************************
+ */
+
+#ifndef I2CPRIORITY_H
+#define I2CPRIORITY_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#define I2C_PRIO_CLASSES            3
+
+class i2cPriorityGate {
+
+    private:
+        pthread_mutex_t gate_lock;
+        pthread_cond_t  gate_cond;
+        bool      busy;
+        pthread_t owner;
+        int       depth;
+        int       waiting[I2C_PRIO_CLASSES];
+
+    public:
+        i2cPriorityGate();
+        ~i2cPriorityGate();
+
+        bool enter( int prio, uint64_t deadlineUs = 0 );
+        void leave( void );
+};
+
+#endif /* I2CPRIORITY_H */
+
@@ -0,0 +1,462 @@
+/*
+ ***********************************************************************
+ *
+ *  i2cRealtime.cpp - part of eeprom access project
+ *
+ *  Copyright (C) 2013-2019 Dreamshader (aka Dirk Schanz)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ *
+ ***********************************************************************
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "i2cCore.h"
+#include "i2cRealtime.h"
+
+/*
+ ***************************************************************************
+ * i2cRtWorker::i2cRtWorker()
+ * ----------------------------------------------------
+ * create a stopped worker
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+i2cRtWorker::i2cRtWorker()
+{
+    pthread_mutexattr_t attr;
+
+    config.cpu         = I2C_RT_ANY_CPU;
+    config.priority    = I2C_RT_DEFAULT_PRIORITY;
+    config.lock_memory = true;
+
+    running     = false;
+    stopping    = false;
+    slot_busy   = false;
+    req_pending = false;
+    req_done    = false;
+    req_fn      = NULL;
+    req_ctx     = NULL;
+    requests    = 0;
+
+    // a normal thread holding the lock must not keep the worker waiting
+    pthread_mutexattr_init( &attr );
+    pthread_mutexattr_setprotocol( &attr, PTHREAD_PRIO_INHERIT );
+    pthread_mutex_init( &rt_lock, &attr );
+    pthread_mutexattr_destroy( &attr );
+
+    pthread_cond_init( &rt_cond, NULL );
+}
+
+/*
+ ***************************************************************************
+ * i2cRtWorker::~i2cRtWorker()
+ * ----------------------------------------------------
+ * stop the worker if still running
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+i2cRtWorker::~i2cRtWorker()
+{
+    stop();
+    pthread_cond_destroy( &rt_cond );
+    pthread_mutex_destroy( &rt_lock );
+}
+
+/*
+ ***************************************************************************
+ * int i2cRtWorker::start( const struct _i2c_rt_config* pConfig )
+ * ----------------------------------------------------
+ * lock the memory if configured and start the worker pinned
+ * to the cpu with SCHED_FIFO. Returns when the worker is ready
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns an errorcode, E_RT_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cRtWorker::start( const struct _i2c_rt_config* pConfig )
+{
+    int retVal = E_RT_SUCCESS;
+    int err;
+    pthread_attr_t attr;
+    struct sched_param param;
+    cpu_set_t cpus;
+
+    if( pConfig == NULL )
+    {
+        return( E_RT_NULL );
+    }
+
+    if( isRunning() )
+    {
+        return( E_RT_RUNNING );
+    }
+
+    config = *pConfig;
+
+    if( config.priority < sched_get_priority_min( SCHED_FIFO ) ||
+        config.priority > sched_get_priority_max( SCHED_FIFO ) )
+    {
+        config.priority = I2C_RT_DEFAULT_PRIORITY;
+    }
+
+    if( config.lock_memory && mlockall( MCL_CURRENT | MCL_FUTURE ) < 0 )
+    {
+        perror("i2cRtWorker mlockall");
+        return( E_RT_MLOCK );
+    }
+
+    pthread_attr_init( &attr );
+    pthread_attr_setinheritsched( &attr, PTHREAD_EXPLICIT_SCHED );
+    pthread_attr_setschedpolicy( &attr, SCHED_FIFO );
+    param.sched_priority = config.priority;
+    pthread_attr_setschedparam( &attr, &param );
+
+    if( config.cpu != I2C_RT_ANY_CPU )
+    {
+        CPU_ZERO( &cpus );
+        CPU_SET( config.cpu, &cpus );
+
+        if( pthread_attr_setaffinity_np( &attr, sizeof(cpus), &cpus ) != 0 )
+        {
+            retVal = E_RT_AFFINITY;
+        }
+    }
+
+    if( retVal == E_RT_SUCCESS )
+    {
+        stopping = false;
+
+        if( (err = pthread_create( &worker, &attr, workerMain, this )) != 0 )
+        {
+            errno = err;
+            perror("i2cRtWorker start");
+
+            if( err == EPERM )
+            {
+                retVal = E_RT_SCHED;
+            }
+            else
+            {
+                if( err == EINVAL && config.cpu != I2C_RT_ANY_CPU )
+                {
+                    retVal = E_RT_AFFINITY;
+                }
+                else
+                {
+                    retVal = E_RT_FAIL;
+                }
+            }
+        }
+        else
+        {
+            pthread_mutex_lock( &rt_lock );
+            while( !running )
+            {
+                pthread_cond_wait( &rt_cond, &rt_lock );
+            }
+            pthread_mutex_unlock( &rt_lock );
+        }
+    }
+
+    pthread_attr_destroy( &attr );
+
+    if( retVal != E_RT_SUCCESS && config.lock_memory )
+    {
+        munlockall();
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * int i2cRtWorker::stop( void )
+ * ----------------------------------------------------
+ * let the worker finish the request it has and join it. The
+ * memory stays locked if the process locked it
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns an errorcode, E_RT_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cRtWorker::stop( void )
+{
+    int retVal;
+
+    if( isRunning() )
+    {
+        pthread_mutex_lock( &rt_lock );
+        stopping = true;
+        pthread_cond_broadcast( &rt_cond );
+        pthread_mutex_unlock( &rt_lock );
+
+        pthread_join( worker, NULL );
+
+        // callers that saw the worker running call fn themselves now
+        pthread_mutex_lock( &rt_lock );
+        __atomic_store_n( &running, false, __ATOMIC_RELEASE );
+        pthread_cond_broadcast( &rt_cond );
+        pthread_mutex_unlock( &rt_lock );
+
+        retVal = E_RT_SUCCESS;
+    }
+    else
+    {
+        retVal = E_RT_NOT_RUNNING;
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * bool i2cRtWorker::isRunning( void )
+ * bool i2cRtWorker::isWorkerThread( void )
+ * ----------------------------------------------------
+ * state of the worker, whether the caller is the worker
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns true or false
+ ***************************************************************************
+*/
+bool i2cRtWorker::isRunning( void )
+{
+    return( __atomic_load_n( &running, __ATOMIC_ACQUIRE ) );
+}
+
+bool i2cRtWorker::isWorkerThread( void )
+{
+    return( isRunning() && pthread_equal( worker, pthread_self() ) );
+}
+
+/*
+ ***************************************************************************
+ * int i2cRtWorker::run( int (*fn)( void* ), void* ctx )
+ * ----------------------------------------------------
+ * have the worker call fn( ctx ) and wait for the result.
+ * Callers queue for the one request slot. If the worker is not
+ * running, is being stopped or the caller is the worker, fn is
+ * called directly
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns the result of fn
+ ***************************************************************************
+*/
+int i2cRtWorker::run( int (*fn)( void* ), void* ctx )
+{
+    int retVal;
+    int lastError;
+
+    if( !isRunning() || isWorkerThread() )
+    {
+        return( fn( ctx ) );
+    }
+
+    pthread_mutex_lock( &rt_lock );
+
+    while( slot_busy && running && !stopping )
+    {
+        pthread_cond_wait( &rt_cond, &rt_lock );
+    }
+
+    // the worker may have left meanwhile, nobody would take the request
+    if( !running || stopping )
+    {
+        pthread_mutex_unlock( &rt_lock );
+        return( fn( ctx ) );
+    }
+
+    slot_busy    = true;
+    req_fn       = fn;
+    req_ctx      = ctx;
+    req_deadline = i2cGetDeadline();
+    req_posted   = i2cMonotonicUs();
+    req_done     = false;
+    req_pending  = true;
+    pthread_cond_broadcast( &rt_cond );
+
+    while( !req_done )
+    {
+        pthread_cond_wait( &rt_cond, &rt_lock );
+    }
+
+    retVal    = req_result;
+    lastError = req_error;
+
+    latency.record( i2cMonotonicUs() - req_posted );
+
+    slot_busy = false;
+    pthread_cond_broadcast( &rt_cond );
+
+    pthread_mutex_unlock( &rt_lock );
+
+    i2cSetLastError( lastError );
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * void* i2cRtWorker::workerMain( void* pArg )
+ * ----------------------------------------------------
+ * thread entry, touch the stack and serve requests
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns NULL
+ ***************************************************************************
+*/
+void* i2cRtWorker::workerMain( void* pArg )
+{
+    i2cRtWorker* pWorker = (i2cRtWorker*) pArg;
+    volatile uint8_t stack[I2C_RT_STACK_PREFAULT];
+
+    // fault the stack in now, with mlockall() it stays resident
+    memset( (void*) stack, 0, sizeof(stack) );
+
+#if I2C_TRACE_LEVEL > 0
+    // the trace ring is allocated now, not at the first transfer
+    i2cTraceThreadInit();
+#endif
+
+    pWorker->workerLoop();
+
+    return( NULL );
+}
+
+/*
+ ***************************************************************************
+ * void i2cRtWorker::workerLoop( void )
+ * ----------------------------------------------------
+ * wait for requests and run them until stopped
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+void i2cRtWorker::workerLoop( void )
+{
+    int (*fn)( void* );
+    void* ctx;
+    int result;
+    int lastError;
+
+    pthread_mutex_lock( &rt_lock );
+
+    __atomic_store_n( &running, true, __ATOMIC_RELEASE );
+    pthread_cond_broadcast( &rt_cond );
+
+    while( true )
+    {
+        while( !req_pending && !stopping )
+        {
+            pthread_cond_wait( &rt_cond, &rt_lock );
+        }
+
+        if( !req_pending )
+        {
+            break;
+        }
+
+        req_pending = false;
+        fn  = req_fn;
+        ctx = req_ctx;
+        jitter.record( i2cMonotonicUs() - req_posted );
+        i2cSetDeadline( req_deadline );
+
+        pthread_mutex_unlock( &rt_lock );
+
+        i2cSetLastError( E_I2C_SUCCESS );
+        result    = fn( ctx );
+        lastError = i2cLastError();
+
+        pthread_mutex_lock( &rt_lock );
+
+        req_result = result;
+        req_error  = lastError;
+        req_done   = true;
+        requests++;
+        pthread_cond_broadcast( &rt_cond );
+    }
+
+    pthread_mutex_unlock( &rt_lock );
+}
+
+/*
+ ***************************************************************************
+ * void i2cRtWorker::getStats( struct _i2c_rt_stats* pStats )
+ * void i2cRtWorker::resetStats( void )
+ * void i2cRtWorker::printStats( FILE* pOut )
+ * ----------------------------------------------------
+ * latency and wakeup jitter of the requests
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+void i2cRtWorker::getStats( struct _i2c_rt_stats* pStats )
+{
+    if( pStats != NULL )
+    {
+        pthread_mutex_lock( &rt_lock );
+        pStats->requests = requests;
+        latency.summary( &pStats->latency );
+        jitter.summary( &pStats->jitter );
+        pthread_mutex_unlock( &rt_lock );
+    }
+}
+
+void i2cRtWorker::resetStats( void )
+{
+    pthread_mutex_lock( &rt_lock );
+    requests = 0;
+    latency.reset();
+    jitter.reset();
+    pthread_mutex_unlock( &rt_lock );
+}
+
+void i2cRtWorker::printStats( FILE* pOut )
+{
+    pthread_mutex_lock( &rt_lock );
+    latency.print( pOut, "rt latency" );
+    jitter.print( pOut, "rt jitter" );
+    pthread_mutex_unlock( &rt_lock );
+}
+
@@ -0,0 +1,123 @@
+/*
+ ***********************************************************************
+ *
+ *  i2cRealtime.h - part of eeprom access project
+ *
+ *  Copyright (C) 2013-2019 Dreamshader (aka Dirk Schanz)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ *
+ ***********************************************************************
+ *
+ * Real-time worker for the i2c transfers.
+ *
+ * One thread, pinned to a cpu and scheduled SCHED_FIFO, does the
+ * transfers handed to it by run(). Its stack is touched and the
+ * process memory locked at start(), so neither the worker nor run()
+ * allocates, prints or faults afterwards. The deadline of the
+ * calling thread travels with the request, the last error comes
+ * back with the result.
+ *
+ * Two histograms are kept: the latency of a request from run() to
+ * its result and the wakeup jitter, the delay until the worker
+ * started it.
+ *
+ * SCHED_FIFO and mlockall() need CAP_SYS_NICE and CAP_IPC_LOCK or
+ * matching rlimits.
+ *
+ ***********************************************************************
+ */
+
+#ifndef I2CREALTIME_H
+#define I2CREALTIME_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "i2cHistogram.h"
+
+#define E_RT_SUCCESS                0
+#define E_RT_FAIL                  -1
+#define E_RT_NULL                  -2
+#define E_RT_RUNNING               -3
+#define E_RT_NOT_RUNNING           -4
+#define E_RT_SCHED                 -5
+#define E_RT_AFFINITY              -6
+#define E_RT_MLOCK                 -7
+
+#define I2C_RT_DEFAULT_PRIORITY    50
+#define I2C_RT_ANY_CPU             -1
+// stack touched by the worker before it takes requests
+#define I2C_RT_STACK_PREFAULT      (64 * 1024)
+
+struct _i2c_rt_config {
+    int  cpu;          // cpu to pin the worker to, I2C_RT_ANY_CPU for none
+    int  priority;     // SCHED_FIFO priority, 1 .. 99
+    bool lock_memory;  // mlockall() current and future pages
+};
+
+struct _i2c_rt_stats {
+    uint64_t requests;
+    struct _i2c_hist_summary latency;  // run() until the result is back
+    struct _i2c_hist_summary jitter;   // run() until the worker started
+};
+
+class i2cRtWorker {
+
+    private:
+        struct _i2c_rt_config config;
+        pthread_t       worker;
+        bool            running;
+        bool            stopping;
+        pthread_mutex_t rt_lock;
+        pthread_cond_t  rt_cond;
+
+        // the one request slot
+        bool      slot_busy;
+        bool      req_pending;
+        bool      req_done;
+        int       (*req_fn)( void* );
+        void*     req_ctx;
+        uint64_t  req_deadline;
+        uint64_t  req_posted;
+        int       req_result;
+        int       req_error;
+
+        uint64_t     requests;
+        i2cHistogram latency;
+        i2cHistogram jitter;
+
+        static void* workerMain( void* pArg );
+        void workerLoop( void );
+
+    public:
+        i2cRtWorker();
+        ~i2cRtWorker();
+
+        int start( const struct _i2c_rt_config* pConfig );
+        int stop( void );
+        bool isRunning( void );
+        bool isWorkerThread( void );
+
+        int run( int (*fn)( void* ), void* ctx );
+
+        void getStats( struct _i2c_rt_stats* pStats );
+        void resetStats( void );
+        void printStats( FILE* pOut );
+};
+
+#endif /* I2CREALTIME_H */
+
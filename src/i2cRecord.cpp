@@ -0,0 +1,287 @@
+/*
+ ***********************************************************************
+ *
+ *  i2cRecord.cpp - part of eeprom access project
+ *
+ *  Copyright (C) 2013-2019 Dreamshader (aka Dirk Schanz)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ *
+ ***********************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "i2cCore.h"
+#include "i2cRecord.h"
+
+static const char* recordOpNames[EE_REC_MAX] = {
+    "?", "read", "readbyte", "readword", "write", "writebyte", "writeword",
+    "readv", "writev", "flush"
+};
+
+/*
+ ***************************************************************************
+ * i2cRecorder::i2cRecorder()
+ * ----------------------------------------------------
+ * create a recorder, not recording
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+i2cRecorder::i2cRecorder()
+{
+    pFile   = NULL;
+    last_us = 0;
+    memset( &hdr, 0, sizeof(hdr) );
+    pthread_mutex_init( &lock, NULL );
+}
+
+/*
+ ***************************************************************************
+ * i2cRecorder::~i2cRecorder()
+ * ----------------------------------------------------
+ * a recording in progress is completed
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+i2cRecorder::~i2cRecorder()
+{
+    stop();
+    pthread_mutex_destroy( &lock );
+}
+
+/*
+ ***************************************************************************
+ * int i2cRecorder::start( const char* pPath, uint16_t type,
+ *                         uint16_t pageSize, uint32_t capacity )
+ * ----------------------------------------------------
+ * record into pPath, a recording in progress is completed first
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns an errorcode, E_REC_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cRecorder::start( const char* pPath, uint16_t type, uint16_t pageSize,
+                        uint32_t capacity )
+{
+    int retVal = E_REC_SUCCESS;
+
+    if( pPath == NULL )
+    {
+        return( E_REC_NULL );
+    }
+
+    stop();
+
+    pthread_mutex_lock( &lock );
+
+    memset( &hdr, 0, sizeof(hdr) );
+    memcpy( hdr.magic, I2C_RECORD_MAGIC, sizeof(hdr.magic) );
+    hdr.version   = I2C_RECORD_VERSION;
+    hdr.type      = type;
+    hdr.page_size = pageSize;
+    hdr.capacity  = capacity;
+    hdr.start_us  = 0;
+
+    if( (pFile = fopen( pPath, "wb" )) == NULL )
+    {
+        perror("i2cRecorder");
+        retVal = E_REC_FILE;
+    }
+    else
+    {
+        // rewritten with the final values by stop()
+        if( fwrite( &hdr, sizeof(hdr), 1, pFile ) != 1 )
+        {
+            fclose( pFile );
+            pFile = NULL;
+            retVal = E_REC_FILE;
+        }
+    }
+
+    pthread_mutex_unlock( &lock );
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * void i2cRecorder::setGeometry( uint16_t type, uint16_t pageSize,
+ *                                uint32_t capacity )
+ * ----------------------------------------------------
+ * the type was set after the recording started
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+void i2cRecorder::setGeometry( uint16_t type, uint16_t pageSize,
+                               uint32_t capacity )
+{
+    pthread_mutex_lock( &lock );
+    hdr.type      = type;
+    hdr.page_size = pageSize;
+    hdr.capacity  = capacity;
+    pthread_mutex_unlock( &lock );
+}
+
+/*
+ ***************************************************************************
+ * void i2cRecorder::record( uint8_t op, uint16_t addr, int amount,
+ *                           int result, uint8_t flags )
+ * ----------------------------------------------------
+ * append an entry. Goes to the stdio buffer, so a call costs
+ * a lock and a copy, not a system call
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+void i2cRecorder::record( uint8_t op, uint16_t addr, int amount, int result,
+                          uint8_t flags )
+{
+    struct _ee_record entry;
+    uint64_t now;
+
+    now = i2cMonotonicUs();
+
+    pthread_mutex_lock( &lock );
+
+    if( pFile != NULL )
+    {
+        if( hdr.entries == 0 )
+        {
+            hdr.start_us = last_us = now;
+        }
+
+        entry.delta_us = now - last_us > UINT32_MAX ? UINT32_MAX :
+                         (uint32_t) (now - last_us);
+        entry.addr     = addr;
+        entry.amount   = amount < 0 ? 0 : amount > UINT16_MAX ? UINT16_MAX :
+                         (uint16_t) amount;
+        entry.op       = op;
+        entry.flags    = flags;
+        entry.result   = (int16_t) result;
+
+        if( fwrite( &entry, sizeof(entry), 1, pFile ) == 1 )
+        {
+            hdr.entries++;
+            last_us = now;
+        }
+    }
+
+    pthread_mutex_unlock( &lock );
+}
+
+/*
+ ***************************************************************************
+ * int i2cRecorder::stop( void )
+ * ----------------------------------------------------
+ * complete the header and close the file
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns an errorcode, E_REC_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cRecorder::stop( void )
+{
+    int retVal = E_REC_SUCCESS;
+
+    pthread_mutex_lock( &lock );
+
+    if( pFile != NULL )
+    {
+        if( fseek( pFile, 0, SEEK_SET ) != 0 ||
+            fwrite( &hdr, sizeof(hdr), 1, pFile ) != 1 )
+        {
+            retVal = E_REC_FILE;
+        }
+
+        if( fclose( pFile ) != 0 )
+        {
+            retVal = E_REC_FILE;
+        }
+
+        pFile = NULL;
+    }
+
+    pthread_mutex_unlock( &lock );
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * int i2cRecordRead( FILE* pIn, struct _ee_record_hdr* pHdr )
+ * ----------------------------------------------------
+ * read and check the header of a recording, the entries follow
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns an errorcode, E_REC_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cRecordRead( FILE* pIn, struct _ee_record_hdr* pHdr )
+{
+    int retVal = E_REC_SUCCESS;
+
+    if( pIn == NULL || pHdr == NULL )
+    {
+        retVal = E_REC_NULL;
+    }
+    else
+    {
+        if( fread( pHdr, sizeof(*pHdr), 1, pIn ) != 1 ||
+            memcmp( pHdr->magic, I2C_RECORD_MAGIC, sizeof(pHdr->magic) ) != 0 ||
+            pHdr->version != I2C_RECORD_VERSION )
+        {
+            retVal = E_REC_FORMAT;
+        }
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * const char* i2cRecordOpName( uint8_t op )
+ * ----------------------------------------------------
+ * name of a recorded call
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns the name, "?" for unknown ones
+ ***************************************************************************
+*/
+const char* i2cRecordOpName( uint8_t op )
+{
+    return( op < EE_REC_MAX ? recordOpNames[op] : recordOpNames[0] );
+}
+
@@ -0,0 +1,120 @@
+/*
+ ***********************************************************************
+ *
+ *  i2cRecord.h - part of eeprom access project
+ *
+ *  Copyright (C) 2013-2019 Dreamshader (aka Dirk Schanz)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ *
+ ***********************************************************************
+ *
+ * Recording of the calls made to an i2cEEPROM, to replay them
+ * later with eeReplay.
+ *
+ * Unlike the trace (i2cTrace.h) this is about what the application
+ * asks for, not what the library does on the bus: one entry of 12
+ * bytes per public read, write and flush with the device address
+ * (header offset applied), the length, the result and the time
+ * since the entry before. The data itself is not recorded.
+ *
+ * Recording is started with i2cEEPROM::eeRecordStart() or, for a
+ * whole process, by setting I2C_RECORD_DIR: every eeOpen() then
+ * records into <dir>/ee-<bus>-<addr>-<pid>.rec
+ *
+ ***********************************************************************
+ */
+
+#ifndef I2CRECORD_H
+#define I2CRECORD_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#define E_REC_SUCCESS               0
+#define E_REC_FAIL                 -1
+#define E_REC_NULL                 -2
+#define E_REC_FILE                 -3
+#define E_REC_FORMAT               -4
+
+#define I2C_RECORD_DIR_ENV       "I2C_RECORD_DIR"
+#define I2C_RECORD_FILE_FMT      "%s/ee-%d-%02x-%d.rec"
+#define I2C_RECORD_PATH_LEN       256
+#define I2C_RECORD_MAGIC         "EERECORD"
+#define I2C_RECORD_VERSION          1
+
+// recorded calls
+#define EE_REC_READ                 1   // eeRead(), eeRead<T>()
+#define EE_REC_READ_BYTE            2
+#define EE_REC_READ_WORD            3
+#define EE_REC_WRITE                4   // eeWrite(), eeWrite<T>()
+#define EE_REC_WRITE_BYTE           5
+#define EE_REC_WRITE_WORD           6
+#define EE_REC_READV                7   // one entry per element
+#define EE_REC_WRITEV               8   // one entry per element
+#define EE_REC_FLUSH                9
+#define EE_REC_MAX                 10
+
+// the last element of an eeReadV() / eeWriteV()
+#define EE_REC_FLAG_LAST         0x01
+
+struct _ee_record_hdr {
+    char     magic[8];
+    uint32_t version;
+    uint16_t type;           // EEPROM type, 0 if none was set
+    uint16_t page_size;
+    uint32_t capacity;
+    uint32_t entries;
+    uint64_t start_us;       // CLOCK_MONOTONIC of the first entry
+};
+
+struct _ee_record {
+    uint32_t delta_us;       // since the entry before, saturated
+    uint16_t addr;
+    uint16_t amount;         // saturated at 65535
+    uint8_t  op;
+    uint8_t  flags;
+    int16_t  result;
+};
+
+class i2cRecorder {
+
+    private:
+        FILE*    pFile;
+        pthread_mutex_t lock;
+        struct _ee_record_hdr hdr;
+        uint64_t last_us;
+
+    public:
+        i2cRecorder();
+        ~i2cRecorder();
+
+        int start( const char* pPath, uint16_t type, uint16_t pageSize,
+                   uint32_t capacity );
+        void setGeometry( uint16_t type, uint16_t pageSize,
+                          uint32_t capacity );
+        void record( uint8_t op, uint16_t addr, int amount, int result,
+                     uint8_t flags = 0 );
+        int stop( void );
+        bool isRecording( void ) { return( pFile != NULL ); }
+};
+
+int i2cRecordRead( FILE* pIn, struct _ee_record_hdr* pHdr );
+const char* i2cRecordOpName( uint8_t op );
+
+#endif /* I2CRECORD_H */
+
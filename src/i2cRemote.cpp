@@ -0,0 +1,443 @@
+/*
+ ***********************************************************************
+ *
+ *  i2cRemote.cpp - part of eeprom access project
+ *
+ *  Copyright (C) 2013-2019 Dreamshader (aka Dirk Schanz)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ *
+ ***********************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+
+#include "i2cRemote.h"
+
+
+/*
+ ***************************************************************************
+ * i2cRemote::i2cRemote()
+ * ----------------------------------------------------
+ * create an unconnected client instance
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+i2cRemote::i2cRemote()
+{
+    sock_fd = -1;
+    shm_fd  = -1;
+    pShm    = (uint8_t*) NULL;
+    remote_bus   = -1;
+    remote_slave = -1;
+}
+
+/*
+ ***************************************************************************
+ * i2cRemote::~i2cRemote()
+ * ----------------------------------------------------
+ * close connection to the daemon, if any
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+i2cRemote::~i2cRemote()
+{
+    disconnect();
+}
+
+/*
+ ***************************************************************************
+ * int i2cRemote::connect( int bus, int slave )
+ * ----------------------------------------------------
+ * connect to eepromd, hand over the payload buffer and open
+ * the device at bus/slave through the daemon
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns an errorcode, E_REMOTE_SUCCESS on success and
+ * E_REMOTE_NO_DAEMON if no daemon is running
+ ***************************************************************************
+*/
+int i2cRemote::connect( int bus, int slave )
+{
+    int retVal = E_REMOTE_SUCCESS;
+    struct sockaddr_un sockAddr;
+    const char* pPath;
+    struct _eepromd_request req;
+    struct _eepromd_reply reply;
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *pCmsg;
+    char ctrlBuf[CMSG_SPACE(sizeof(int))];
+    void* pMap;
+
+    if( sock_fd >= 0 )
+    {
+        disconnect();
+    }
+
+    if( (pPath = getenv( EEPROMD_SOCKET_ENV )) == NULL )
+    {
+        pPath = EEPROMD_SOCKET_PATH;
+    }
+
+    memset( &sockAddr, 0, sizeof(sockAddr) );
+    sockAddr.sun_family = AF_UNIX;
+    strncpy( sockAddr.sun_path, pPath, sizeof(sockAddr.sun_path) - 1 );
+
+    if( (sock_fd = socket( AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0 )) < 0 )
+    {
+        return( E_REMOTE_NO_DAEMON );
+    }
+
+    if( ::connect( sock_fd, (struct sockaddr*) &sockAddr,
+                   sizeof(sockAddr) ) < 0 )
+    {
+        // no daemon, the caller falls back to direct access
+        close( sock_fd );
+        sock_fd = -1;
+        return( E_REMOTE_NO_DAEMON );
+    }
+
+    // sealed against shrinking, the daemon refuses the buffer otherwise
+    if( (shm_fd = memfd_create( "eepromd-client", 
+                                MFD_CLOEXEC | MFD_ALLOW_SEALING )) < 0 ||
+        ftruncate( shm_fd, EEPROMD_SHM_SIZE ) < 0 ||
+        fcntl( shm_fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_SEAL ) < 0 ||
+        (pMap = mmap( NULL, EEPROMD_SHM_SIZE, PROT_READ | PROT_WRITE,
+                      MAP_SHARED, shm_fd, 0 )) == MAP_FAILED )
+    {
+        perror("i2cRemote shared buffer");
+        disconnect();
+        return( E_REMOTE_MEM );
+    }
+
+    pShm = (uint8_t*) pMap;
+
+    // HELLO carries the descriptor of the payload buffer
+    memset( &req, 0, sizeof(req) );
+    req.op     = EEPROMD_OP_HELLO;
+    req.amount = EEPROMD_SHM_SIZE;
+    req.type   = EEPROMD_PROTOCOL_VERSION;
+
+    iov.iov_base = &req;
+    iov.iov_len  = sizeof(req);
+
+    memset( &msg, 0, sizeof(msg) );
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = ctrlBuf;
+    msg.msg_controllen = sizeof(ctrlBuf);
+
+    pCmsg = CMSG_FIRSTHDR( &msg );
+    pCmsg->cmsg_level = SOL_SOCKET;
+    pCmsg->cmsg_type  = SCM_RIGHTS;
+    pCmsg->cmsg_len   = CMSG_LEN(sizeof(int));
+    memcpy( CMSG_DATA(pCmsg), &shm_fd, sizeof(int) );
+
+    if( sendmsg( sock_fd, &msg, 0 ) != sizeof(req) ||
+        recv( sock_fd, &reply, sizeof(reply), 0 ) != sizeof(reply) ||
+        reply.status != E_REMOTE_SUCCESS )
+    {
+        disconnect();
+        return( E_REMOTE_PROTOCOL );
+    }
+
+    memset( &req, 0, sizeof(req) );
+    req.op    = EEPROMD_OP_OPEN;
+    req.bus   = bus;
+    req.slave = slave;
+
+    if( (retVal = request( &req, &reply )) == E_REMOTE_SUCCESS )
+    {
+        remote_bus   = bus;
+        remote_slave = slave;
+    }
+    else
+    {
+        disconnect();
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * void i2cRemote::disconnect( void )
+ * ----------------------------------------------------
+ * drop the connection and the payload buffer
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+void i2cRemote::disconnect( void )
+{
+    if( pShm != (uint8_t*) NULL )
+    {
+        munmap( pShm, EEPROMD_SHM_SIZE );
+        pShm = (uint8_t*) NULL;
+    }
+
+    if( shm_fd >= 0 )
+    {
+        close( shm_fd );
+        shm_fd = -1;
+    }
+
+    if( sock_fd >= 0 )
+    {
+        close( sock_fd );
+        sock_fd = -1;
+    }
+
+    remote_bus   = -1;
+    remote_slave = -1;
+}
+
+/*
+ ***************************************************************************
+ * int i2cRemote::request( struct _eepromd_request* pReq,
+ *                         struct _eepromd_reply* pReply )
+ * ----------------------------------------------------
+ * send one request and wait for its reply
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns the status of the reply or E_REMOTE_IO
+ ***************************************************************************
+*/
+int i2cRemote::request( struct _eepromd_request* pReq,
+                        struct _eepromd_reply* pReply )
+{
+    if( sock_fd < 0 )
+    {
+        return( E_REMOTE_NO_DAEMON );
+    }
+
+    if( send( sock_fd, pReq, sizeof(*pReq), MSG_NOSIGNAL ) !=
+        sizeof(*pReq) )
+    {
+        return( E_REMOTE_IO );
+    }
+
+    if( recv( sock_fd, pReply, sizeof(*pReply), 0 ) != sizeof(*pReply) )
+    {
+        return( E_REMOTE_IO );
+    }
+
+    return( pReply->status );
+}
+
+/*
+ ***************************************************************************
+ * int i2cRemote::typeSet( uint16_t type )
+ * ----------------------------------------------------
+ * tell the daemon the EEPROM type, it needs the geometry
+ * for caching and page writes
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns an errorcode, E_REMOTE_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cRemote::typeSet( uint16_t type )
+{
+    struct _eepromd_request req;
+    struct _eepromd_reply reply;
+
+    memset( &req, 0, sizeof(req) );
+    req.op    = EEPROMD_OP_TYPE;
+    req.bus   = remote_bus;
+    req.slave = remote_slave;
+    req.type  = type;
+
+    return( request( &req, &reply ) );
+}
+
+/*
+ ***************************************************************************
+ * int i2cRemote::typeDetect( uint16_t* pMagic, uint16_t* pType )
+ * ----------------------------------------------------
+ * let the daemon read magic and type from the header
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns an errorcode, E_REMOTE_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cRemote::typeDetect( uint16_t* pMagic, uint16_t* pType )
+{
+    int retVal;
+    struct _eepromd_request req;
+    struct _eepromd_reply reply;
+
+    if( pMagic == NULL || pType == NULL )
+    {
+        return( E_REMOTE_NULL );
+    }
+
+    memset( &req, 0, sizeof(req) );
+    req.op    = EEPROMD_OP_DETECT;
+    req.bus   = remote_bus;
+    req.slave = remote_slave;
+
+    if( (retVal = request( &req, &reply )) == E_REMOTE_SUCCESS )
+    {
+        *pMagic = reply.magic;
+        *pType  = reply.type;
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * int i2cRemote::read( uint16_t addr, uint8_t* pBuffer, int amount )
+ * ----------------------------------------------------
+ * read amount bytes from device address addr, the daemon
+ * places the data in the shared buffer
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns an errorcode, E_REMOTE_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cRemote::read( uint16_t addr, uint8_t* pBuffer, int amount )
+{
+    int retVal = E_REMOTE_SUCCESS;
+    int chunk;
+    struct _eepromd_request req;
+    struct _eepromd_reply reply;
+
+    if( pBuffer == NULL )
+    {
+        return( E_REMOTE_NULL );
+    }
+
+    while( amount > 0 && retVal == E_REMOTE_SUCCESS )
+    {
+        chunk = amount > EEPROMD_SHM_SIZE ? EEPROMD_SHM_SIZE : amount;
+
+        memset( &req, 0, sizeof(req) );
+        req.op     = EEPROMD_OP_READ;
+        req.bus    = remote_bus;
+        req.slave  = remote_slave;
+        req.addr   = addr;
+        req.amount = chunk;
+
+        if( (retVal = request( &req, &reply )) == E_REMOTE_SUCCESS )
+        {
+            memcpy( pBuffer, pShm, chunk );
+            addr    += chunk;
+            pBuffer += chunk;
+            amount  -= chunk;
+        }
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * int i2cRemote::write( uint16_t addr, const uint8_t* pBuffer, int amount )
+ * ----------------------------------------------------
+ * write amount bytes to device address addr. The daemon
+ * collects writes of all clients and programs whole pages
+ * later, use flush() to wait until the data is on the chip
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns an errorcode, E_REMOTE_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cRemote::write( uint16_t addr, const uint8_t* pBuffer, int amount )
+{
+    int retVal = E_REMOTE_SUCCESS;
+    int chunk;
+    struct _eepromd_request req;
+    struct _eepromd_reply reply;
+
+    if( pBuffer == NULL )
+    {
+        return( E_REMOTE_NULL );
+    }
+
+    while( amount > 0 && retVal == E_REMOTE_SUCCESS )
+    {
+        chunk = amount > EEPROMD_SHM_SIZE ? EEPROMD_SHM_SIZE : amount;
+
+        memcpy( pShm, pBuffer, chunk );
+
+        memset( &req, 0, sizeof(req) );
+        req.op     = EEPROMD_OP_WRITE;
+        req.bus    = remote_bus;
+        req.slave  = remote_slave;
+        req.addr   = addr;
+        req.amount = chunk;
+
+        if( (retVal = request( &req, &reply )) == E_REMOTE_SUCCESS )
+        {
+            addr    += chunk;
+            pBuffer += chunk;
+            amount  -= chunk;
+        }
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * int i2cRemote::flush( void )
+ * ----------------------------------------------------
+ * wait until all pending writes to the device are programmed
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns an errorcode, E_REMOTE_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cRemote::flush( void )
+{
+    struct _eepromd_request req;
+    struct _eepromd_reply reply;
+
+    memset( &req, 0, sizeof(req) );
+    req.op    = EEPROMD_OP_FLUSH;
+    req.bus   = remote_bus;
+    req.slave = remote_slave;
+
+    return( request( &req, &reply ) );
+}
+
@@ -0,0 +1,110 @@
+/*
+ ***********************************************************************
+ *
+ *  i2cRemote.h - part of eeprom access project
+ *
+ *  Copyright (C) 2013-2019 Dreamshader (aka Dirk Schanz)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ *
+ ***********************************************************************
+ *
+ * Client side of the eepromd protocol.
+ *
+ * eepromd owns the buses. Clients talk to it over a unix domain
+ * socket with fixed size request and reply records. Payloads are
+ * not sent over the socket: each client creates a shared memory
+ * buffer (memfd) on connect and passes its descriptor to the
+ * daemon, read data is placed there by the daemon and write data
+ * is picked up from there.
+ *
+ * All addresses are device addresses, the private header offset
+ * is applied by the client.
+ *
+ ***********************************************************************
+ */
+
+#ifndef I2CREMOTE_H
+#define I2CREMOTE_H
+
+#include <stdint.h>
+
+#define E_REMOTE_SUCCESS            0
+#define E_REMOTE_FAIL              -1
+#define E_REMOTE_NO_DAEMON         -2
+#define E_REMOTE_NULL              -3
+#define E_REMOTE_MEM               -4
+#define E_REMOTE_PROTOCOL          -5
+#define E_REMOTE_IO                -6
+
+#define EEPROMD_SOCKET_PATH        "/run/eepromd.sock"
+#define EEPROMD_SOCKET_ENV         "EEPROMD_SOCKET"
+#define EEPROMD_DISABLE_ENV        "EEPROMD_DISABLE"
+#define EEPROMD_SHM_SIZE           (64 * 1024)
+#define EEPROMD_PROTOCOL_VERSION   1
+
+#define EEPROMD_OP_HELLO            1
+#define EEPROMD_OP_OPEN             2
+#define EEPROMD_OP_TYPE             3
+#define EEPROMD_OP_DETECT           4
+#define EEPROMD_OP_READ             5
+#define EEPROMD_OP_WRITE            6
+#define EEPROMD_OP_FLUSH            7
+
+struct _eepromd_request {
+    uint32_t op;
+    int32_t  bus;
+    int32_t  slave;
+    uint32_t addr;
+    uint32_t amount;
+    uint32_t type;
+};
+
+struct _eepromd_reply {
+    int32_t  status;
+    uint32_t amount;
+    uint16_t magic;
+    uint16_t type;
+};
+
+class i2cRemote {
+
+    private:
+        int      sock_fd;
+        int      shm_fd;
+        uint8_t *pShm;
+        int      remote_bus;
+        int      remote_slave;
+
+        int request( struct _eepromd_request* pReq,
+                     struct _eepromd_reply* pReply );
+
+    public:
+        i2cRemote();
+        ~i2cRemote();
+
+        int  connect( int bus, int slave );
+        void disconnect( void );
+
+        int typeSet( uint16_t type );
+        int typeDetect( uint16_t* pMagic, uint16_t* pType );
+        int read( uint16_t addr, uint8_t* pBuffer, int amount );
+        int write( uint16_t addr, const uint8_t* pBuffer, int amount );
+        int flush( void );
+};
+
+#endif /* I2CREMOTE_H */
+
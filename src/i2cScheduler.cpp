@@ -0,0 +1,392 @@
+/*
+ ***********************************************************************
+ *
+ *  i2cScheduler.cpp - part of eeprom access project
+ *
+ *  Copyright (C) 2013-2019 Dreamshader (aka Dirk Schanz)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ *
+ ***********************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <vector>
+#include <algorithm>
+
+#include "i2cScheduler.h"
+
+/*
+ ***************************************************************************
+ * i2cBusScheduler::i2cBusScheduler( int bus )
+ * ----------------------------------------------------
+ * create a scheduler for the devices on /dev/i2c-<bus>
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+i2cBusScheduler::i2cBusScheduler( int bus )
+{
+    sched_bus = bus;
+    memset( &stats, 0, sizeof(stats) );
+}
+
+/*
+ ***************************************************************************
+ * i2cBusScheduler::~i2cBusScheduler()
+ * ----------------------------------------------------
+ * operations still queued are dropped
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+i2cBusScheduler::~i2cBusScheduler()
+{
+    jobs.clear();
+}
+
+/*
+ ***************************************************************************
+ * int i2cBusScheduler::queueWrite( i2cConnection* pConn, uint16_t addr,
+ *                                  uint8_t* pBuffer, int amount,
+ *                                  std::function<void(int)> complete )
+ * ----------------------------------------------------
+ * queue writing amount bytes to address addr of the device of
+ * pConn. The buffer must stay valid until the write is done,
+ * complete is called with the result then
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns an errorcode, E_SCHED_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cBusScheduler::queueWrite( i2cConnection* pConn, uint16_t addr,
+                                 uint8_t* pBuffer, int amount,
+                                 std::function<void(int)> complete )
+{
+    int retVal;
+    struct _i2c_sched_job job;
+
+    if( pConn == NULL || pBuffer == NULL )
+    {
+        retVal = E_SCHED_NULL;
+    }
+    else
+    {
+        if( pConn->i2c_bus != sched_bus )
+        {
+            retVal = E_SCHED_BUS;
+        }
+        else
+        {
+            if( amount <= 0 || addr == I2C_CURRENT_ADDRESS )
+            {
+                retVal = E_SCHED_INVAL_PARAM;
+            }
+            else
+            {
+                job.pConn    = pConn;
+                job.write    = true;
+                job.addr     = addr;
+                job.pBuffer  = pBuffer;
+                job.amount   = amount;
+                job.done     = 0;
+                job.complete = complete;
+
+                jobs.push_back( job );
+                retVal = E_SCHED_SUCCESS;
+            }
+        }
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * int i2cBusScheduler::queueRead( i2cConnection* pConn, uint16_t addr,
+ *                                 uint8_t* pBuffer, int amount,
+ *                                 std::function<void(int)> complete )
+ * ----------------------------------------------------
+ * queue reading amount bytes from address addr of the device
+ * of pConn into pBuffer
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns an errorcode, E_SCHED_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cBusScheduler::queueRead( i2cConnection* pConn, uint16_t addr,
+                                uint8_t* pBuffer, int amount,
+                                std::function<void(int)> complete )
+{
+    int retVal;
+
+    if( (retVal = queueWrite( pConn, addr, pBuffer, amount, complete )) ==
+        E_SCHED_SUCCESS )
+    {
+        jobs.back().write = false;
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * int i2cBusScheduler::pending( void )
+ * ----------------------------------------------------
+ * number of operations not yet done
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns the number of queued operations
+ ***************************************************************************
+*/
+int i2cBusScheduler::pending( void )
+{
+    return( (int) jobs.size() );
+}
+
+/*
+ ***************************************************************************
+ * int i2cBusScheduler::step( struct _i2c_sched_job* pJob )
+ * ----------------------------------------------------
+ * send the next transfer of a job: one page of a write or a
+ * whole read
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns an errorcode of i2cConnection, E_I2C_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cBusScheduler::step( struct _i2c_sched_job* pJob )
+{
+    int retVal;
+    int pageSize;
+    int chunk;
+    uint16_t addr;
+
+    addr = pJob->addr + pJob->done;
+
+    if( pJob->write )
+    {
+        pageSize = pJob->pConn->i2c_page_size > 0 ?
+                   pJob->pConn->i2c_page_size : 1;
+        if( pageSize > I2C_MAX_PAGE_LEN )
+        {
+            pageSize = I2C_MAX_PAGE_LEN;
+        }
+
+        chunk = pageSize - (addr % pageSize);
+        if( chunk > pJob->amount - pJob->done )
+        {
+            chunk = pJob->amount - pJob->done;
+        }
+
+        if( (retVal = pJob->pConn->writeBuf( addr,
+                                             pJob->pBuffer + pJob->done,
+                                             chunk )) == E_I2C_SUCCESS )
+        {
+            pJob->done += chunk;
+            stats.pages_written++;
+        }
+    }
+    else
+    {
+        if( (retVal = pJob->pConn->readBuf( addr, pJob->pBuffer,
+                                            pJob->amount )) == E_I2C_SUCCESS )
+        {
+            pJob->done = pJob->amount;
+            stats.reads++;
+        }
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * uint64_t i2cBusScheduler::routeOrder( i2cConnection* pConn )
+ * ----------------------------------------------------
+ * sort key of a device within a pass: devices without a mux
+ * first, then those behind the channel a mux has selected,
+ * then the others by mux and channel
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns the key
+ ***************************************************************************
+*/
+uint64_t i2cBusScheduler::routeOrder( i2cConnection* pConn )
+{
+    uint64_t retVal = 0;
+
+    if( pConn->i2c_route.mux_type != I2C_MUX_NONE )
+    {
+        retVal = ((uint64_t) pConn->i2c_route.mux_addr << 8) | 
+                 (pConn->i2c_route.channel + 1);
+
+        if( i2cMuxCurrent( sched_bus, pConn->i2c_route.mux_addr ) != 
+            pConn->i2c_route.channel )
+        {
+            retVal |= 1ULL << 32;
+        }
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * int i2cBusScheduler::run( void )
+ * ----------------------------------------------------
+ * work off all queued operations. Each pass sends one transfer
+ * to every device that is ready, oldest operation first. The
+ * devices are taken in the order of routeOrder(), so a mux
+ * switches channels once per pass at most. Only if all devices
+ * are in their write cycle the bus stays idle until the first
+ * one is ready again
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns the first error that occured, E_I2C_SUCCESS if all
+ * operations succeeded
+ ***************************************************************************
+*/
+int i2cBusScheduler::run( void )
+{
+    int retVal = E_I2C_SUCCESS;
+    int res;
+    bool progressed;
+    uint64_t earliest;
+    uint64_t now;
+    struct _i2c_sched_head head;
+    std::vector<struct _i2c_sched_head> heads;
+    std::vector<struct _i2c_sched_head>::iterator pHead;
+    std::vector<i2cConnection*> seen;
+    std::list<struct _i2c_sched_job>::iterator it;
+    std::list<struct _i2c_sched_job>::iterator other;
+
+    while( !jobs.empty() )
+    {
+        progressed = false;
+        earliest = UINT64_MAX;
+        seen.clear();
+        heads.clear();
+
+        for( it = jobs.begin(); it != jobs.end(); ++it )
+        {
+            if( std::find( seen.begin(), seen.end(), it->pConn ) !=
+                seen.end() )
+            {
+                // an older operation of this device comes first
+                continue;
+            }
+
+            seen.push_back( it->pConn );
+            head.job   = it;
+            head.order = routeOrder( it->pConn );
+            heads.push_back( head );
+        }
+
+        // devices behind the same mux channel one after the other
+        std::stable_sort( heads.begin(), heads.end(), 
+                          []( const struct _i2c_sched_head& a, 
+                              const struct _i2c_sched_head& b ) {
+                              return( a.order < b.order ); } );
+
+        for( pHead = heads.begin(); pHead != heads.end(); ++pHead )
+        {
+            it = pHead->job;
+
+            if( it->pConn->isBusy() )
+            {
+                earliest = std::min( earliest, it->pConn->i2c_busy_until );
+                continue;
+            }
+
+            for( other = jobs.begin(); other != jobs.end(); ++other )
+            {
+                if( other->pConn != it->pConn && other->pConn->isBusy() )
+                {
+                    stats.interleaved++;
+                    break;
+                }
+            }
+
+            res = step( &(*it) );
+            progressed = true;
+
+            if( res != E_I2C_SUCCESS || it->done >= it->amount )
+            {
+                if( res != E_I2C_SUCCESS && retVal == E_I2C_SUCCESS )
+                {
+                    retVal = res;
+                }
+
+                if( it->complete )
+                {
+                    it->complete( res );
+                }
+
+                jobs.erase( it );
+            }
+        }
+
+        if( !progressed && earliest != UINT64_MAX )
+        {
+            // every device with work is programming a page
+            stats.idle_waits++;
+
+            if( (now = i2cMonotonicUs()) < earliest )
+            {
+                stats.idle_us += earliest - now;
+                i2cSleepUntil( earliest );
+            }
+        }
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * void i2cBusScheduler::getStats( struct _i2c_sched_stats* pStats )
+ * ----------------------------------------------------
+ * copy the counters
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+void i2cBusScheduler::getStats( struct _i2c_sched_stats* pStats )
+{
+    if( pStats != NULL )
+    {
+        *pStats = stats;
+    }
+}
+
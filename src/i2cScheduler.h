@@ -0,0 +1,108 @@
+/*
+ ***********************************************************************
+ *
+ *  i2cScheduler.h - part of eeprom access project
+ *
+ *  Copyright (C) 2013-2019 Dreamshader (aka Dirk Schanz)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ *
+ ***********************************************************************
+ *
+ * Interleaving of transfers to several devices on one bus.
+ *
+ * After a page write a chip does not answer for its write cycle
+ * time, but the bus itself is free. The scheduler queues reads
+ * and writes for the devices of one bus and, while one chip is
+ * programming a page, sends the next page or read to another
+ * chip that is ready. Per device the queued operations keep
+ * their order. Devices behind a mux (i2cMux.h) are served grouped
+ * by channel, saving the channel switches in between.
+ *
+ * The connections must not be used otherwise while run() works
+ * on them.
+ *
+ ***********************************************************************
+ */
+
+#ifndef I2CSCHEDULER_H
+#define I2CSCHEDULER_H
+
+#include <stdint.h>
+
+#include <list>
+#include <functional>
+
+#include "i2cCore.h"
+
+#define E_SCHED_SUCCESS             0
+#define E_SCHED_FAIL               -1
+#define E_SCHED_NULL               -2
+#define E_SCHED_BUS                -3
+#define E_SCHED_INVAL_PARAM        -4
+
+struct _i2c_sched_stats {
+    uint64_t pages_written;  // page writes sent
+    uint64_t reads;          // reads sent
+    uint64_t interleaved;    // transfers sent while another chip was busy
+    uint64_t idle_waits;     // times all queued devices were busy
+    uint64_t idle_us;        // time the bus was idle for that
+};
+
+struct _i2c_sched_job {
+    i2cConnection* pConn;
+    bool     write;
+    uint16_t addr;
+    uint8_t* pBuffer;
+    int      amount;
+    int      done;
+    std::function<void(int)> complete;
+};
+
+struct _i2c_sched_head {
+    std::list<struct _i2c_sched_job>::iterator job;
+    uint64_t order;          // see routeOrder()
+};
+
+class i2cBusScheduler {
+
+    private:
+        int sched_bus;
+        std::list<struct _i2c_sched_job> jobs;
+        struct _i2c_sched_stats stats;
+
+        int step( struct _i2c_sched_job* pJob );
+        uint64_t routeOrder( i2cConnection* pConn );
+
+    public:
+        i2cBusScheduler( int bus );
+        ~i2cBusScheduler();
+
+        int queueWrite( i2cConnection* pConn, uint16_t addr,
+                        uint8_t* pBuffer, int amount,
+                        std::function<void(int)> complete = nullptr );
+        int queueRead( i2cConnection* pConn, uint16_t addr,
+                       uint8_t* pBuffer, int amount,
+                       std::function<void(int)> complete = nullptr );
+
+        int pending( void );
+        int run( void );
+
+        void getStats( struct _i2c_sched_stats* pStats );
+};
+
+#endif /* I2CSCHEDULER_H */
+
@@ -0,0 +1,714 @@
+/*
+ ***********************************************************************
+ *
+ *  i2cSim.cpp - part of eeprom access project
+ *
+ *  Copyright (C) 2013-2019 Dreamshader (aka Dirk Schanz)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ *
+ ***********************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include <map>
+#include <vector>
+
+#include "i2cCore.h"
+#include "i2cSim.h"
+
+struct _i2c_sim_device {
+    struct _i2c_sim_config config;
+    std::vector<uint8_t> memory;
+    int      pointer;
+    uint64_t busy_until;
+    std::vector<uint32_t> wear;     // write cycles per page
+    struct _i2c_sim_stats stats;
+};
+
+struct _i2c_sim_mux {
+    int      type;
+    uint8_t  control;
+};
+
+struct _i2c_sim_bus {
+    pthread_mutex_t lock;
+    int      bus_khz;
+    std::map<int, struct _i2c_sim_device*> devices;
+    std::map<int, struct _i2c_sim_mux> muxes;
+};
+
+static pthread_mutex_t simBusesLock = PTHREAD_MUTEX_INITIALIZER;
+static std::map<int, struct _i2c_sim_bus*> simBuses;
+
+/*
+ ***************************************************************************
+ * static struct _i2c_sim_bus* simBus( int bus )
+ * ----------------------------------------------------
+ * the simulated bus <bus>. Buses are never freed, a bus without
+ * devices is not simulated
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns the bus, NULL if nothing was attached to it yet
+ ***************************************************************************
+*/
+static struct _i2c_sim_bus* simBus( int bus )
+{
+    struct _i2c_sim_bus* retVal = NULL;
+    std::map<int, struct _i2c_sim_bus*>::iterator it;
+
+    pthread_mutex_lock( &simBusesLock );
+
+    if( (it = simBuses.find( bus )) != simBuses.end() )
+    {
+        retVal = it->second;
+    }
+
+    pthread_mutex_unlock( &simBusesLock );
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * static bool isPowerOf2( int value )
+ * ----------------------------------------------------
+ * geometry check
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns true if value is a power of two
+ ***************************************************************************
+*/
+static bool isPowerOf2( int value )
+{
+    return( value > 0 && (value & (value - 1)) == 0 );
+}
+
+/*
+ ***************************************************************************
+ * int i2cSimAttach( int bus, int addr,
+ *                   const struct _i2c_sim_config* pConfig )
+ * ----------------------------------------------------
+ * attach an erased device to slave address addr of bus. The bus
+ * clock is that of the device attached last
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns an errorcode, E_SIM_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cSimAttach( int bus, int addr, const struct _i2c_sim_config* pConfig )
+{
+    int retVal;
+    struct _i2c_sim_bus* pBus;
+    struct _i2c_sim_device* pDev;
+
+    if( pConfig == NULL )
+    {
+        return( E_SIM_NULL );
+    }
+
+    if( !isPowerOf2( pConfig->size ) || pConfig->size > I2C_SIM_MAX_SIZE ||
+        !isPowerOf2( pConfig->page_size ) ||
+        pConfig->page_size > pConfig->size ||
+        (!pConfig->addr16 && pConfig->size > 256) ||
+        pConfig->write_cycle_us < 0 || pConfig->bus_khz < 0 )
+    {
+        return( E_SIM_INVAL_PARAM );
+    }
+
+    pthread_mutex_lock( &simBusesLock );
+
+    if( (pBus = simBuses[bus]) == NULL )
+    {
+        pBus = new struct _i2c_sim_bus;
+        pthread_mutex_init( &pBus->lock, NULL );
+        simBuses[bus] = pBus;
+    }
+
+    pthread_mutex_unlock( &simBusesLock );
+
+    pthread_mutex_lock( &pBus->lock );
+
+    if( pBus->devices.count( addr ) > 0 )
+    {
+        retVal = E_SIM_IN_USE;
+    }
+    else
+    {
+        pDev = new struct _i2c_sim_device;
+        pDev->config     = *pConfig;
+        pDev->memory.assign( pConfig->size, 0xff );
+        pDev->pointer    = 0;
+        pDev->busy_until = 0;
+        pDev->wear.assign( pConfig->size / pConfig->page_size, 0 );
+        memset( &pDev->stats, 0, sizeof(pDev->stats) );
+
+        pBus->devices[addr] = pDev;
+        pBus->bus_khz = pConfig->bus_khz;
+        retVal = E_SIM_SUCCESS;
+    }
+
+    pthread_mutex_unlock( &pBus->lock );
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * int i2cSimAttachMux( int bus, int muxAddr, int muxType )
+ * ----------------------------------------------------
+ * attach a mux of muxType with all channels off. The bus is
+ * simulated once a device is attached, too
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns an errorcode, E_SIM_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cSimAttachMux( int bus, int muxAddr, int muxType )
+{
+    int retVal;
+    struct _i2c_sim_bus* pBus;
+    struct _i2c_sim_mux mux;
+
+    if( i2cMuxChannels( muxType ) == 0 ||
+        muxAddr < I2C_MUX_FIRST_ADDR || muxAddr > I2C_MUX_LAST_ADDR )
+    {
+        return( E_SIM_INVAL_PARAM );
+    }
+
+    pthread_mutex_lock( &simBusesLock );
+
+    if( (pBus = simBuses[bus]) == NULL )
+    {
+        pBus = new struct _i2c_sim_bus;
+        pthread_mutex_init( &pBus->lock, NULL );
+        pBus->bus_khz = 0;
+        simBuses[bus] = pBus;
+    }
+
+    pthread_mutex_unlock( &simBusesLock );
+
+    pthread_mutex_lock( &pBus->lock );
+
+    if( pBus->muxes.count( muxAddr ) > 0 || 
+        pBus->devices.count( muxAddr ) > 0 )
+    {
+        retVal = E_SIM_IN_USE;
+    }
+    else
+    {
+        mux.type    = muxType;
+        mux.control = 0;
+        pBus->muxes[muxAddr] = mux;
+        retVal = E_SIM_SUCCESS;
+    }
+
+    pthread_mutex_unlock( &pBus->lock );
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * int i2cSimDetach( int bus, int addr )
+ * ----------------------------------------------------
+ * remove a device, its contents are lost. Connections to it must
+ * not be used any more
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns an errorcode, E_SIM_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cSimDetach( int bus, int addr )
+{
+    int retVal = E_SIM_NODEV;
+    struct _i2c_sim_bus* pBus;
+    std::map<int, struct _i2c_sim_device*>::iterator it;
+
+    if( (pBus = simBus( bus )) != NULL )
+    {
+        pthread_mutex_lock( &pBus->lock );
+
+        if( (it = pBus->devices.find( addr )) != pBus->devices.end() )
+        {
+            delete it->second;
+            pBus->devices.erase( it );
+            retVal = E_SIM_SUCCESS;
+        }
+        else
+        {
+            if( pBus->muxes.erase( addr ) > 0 )
+            {
+                retVal = E_SIM_SUCCESS;
+            }
+        }
+
+        pthread_mutex_unlock( &pBus->lock );
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * bool i2cSimIsBus( int bus )
+ * ----------------------------------------------------
+ * whether connections to bus are simulated
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns true if a device is attached to bus
+ ***************************************************************************
+*/
+bool i2cSimIsBus( int bus )
+{
+    bool retVal = false;
+    struct _i2c_sim_bus* pBus;
+
+    if( (pBus = simBus( bus )) != NULL )
+    {
+        pthread_mutex_lock( &pBus->lock );
+        retVal = !pBus->devices.empty();
+        pthread_mutex_unlock( &pBus->lock );
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * int i2cSimLoad( int bus, int addr, int offset, const uint8_t* pData,
+ *                 int len )
+ * ----------------------------------------------------
+ * set the contents of a device directly, without a write cycle
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns an errorcode, E_SIM_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cSimLoad( int bus, int addr, int offset, const uint8_t* pData, int len )
+{
+    int retVal = E_SIM_NODEV;
+    struct _i2c_sim_bus* pBus;
+    std::map<int, struct _i2c_sim_device*>::iterator it;
+
+    if( pData == NULL )
+    {
+        return( E_SIM_NULL );
+    }
+
+    if( (pBus = simBus( bus )) != NULL )
+    {
+        pthread_mutex_lock( &pBus->lock );
+
+        if( (it = pBus->devices.find( addr )) != pBus->devices.end() )
+        {
+            if( offset < 0 || len < 0 ||
+                offset + len > it->second->config.size )
+            {
+                retVal = E_SIM_INVAL_PARAM;
+            }
+            else
+            {
+                memcpy( &it->second->memory[offset], pData, len );
+                retVal = E_SIM_SUCCESS;
+            }
+        }
+
+        pthread_mutex_unlock( &pBus->lock );
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * static struct _i2c_sim_device* simResolve( struct _i2c_sim_bus* pBus,
+ *                                            int addr )
+ * ----------------------------------------------------
+ * the device answering at addr: the one attached directly and
+ * those behind a connected mux channel. Bus locked
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns the device, NULL with errno set to ENXIO if none
+ * answers and to EIO if several do
+ ***************************************************************************
+*/
+static struct _i2c_sim_device* simResolve( struct _i2c_sim_bus* pBus,
+                                           int addr )
+{
+    struct _i2c_sim_device* retVal = NULL;
+    std::map<int, struct _i2c_sim_device*>::iterator it;
+    std::map<int, struct _i2c_sim_mux>::iterator itMux;
+    int found = 0;
+    int channel;
+
+    if( (it = pBus->devices.find( addr )) != pBus->devices.end() )
+    {
+        retVal = it->second;
+        found++;
+    }
+
+    for( itMux = pBus->muxes.begin(); itMux != pBus->muxes.end(); itMux++ )
+    {
+        for( channel = 0; channel < i2cMuxChannels( itMux->second.type ); 
+             channel++ )
+        {
+            if( i2cMuxEnabled( itMux->second.type, itMux->second.control,
+                               channel ) &&
+                (it = pBus->devices.find( I2C_SIM_MUXED( itMux->first, 
+                                          channel, addr ) )) != 
+                pBus->devices.end() )
+            {
+                retVal = it->second;
+                found++;
+            }
+        }
+    }
+
+    if( found != 1 )
+    {
+        errno = found == 0 ? ENXIO : EIO;
+        retVal = NULL;
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * static int simMessage( struct _i2c_sim_bus* pBus, int addr, bool read,
+ *                        uint8_t* pData, int len, uint64_t now,
+ *                        uint64_t* pBits )
+ * ----------------------------------------------------
+ * one message from start to stop or repeated start, called with
+ * the bus locked. The bits sent are added to *pBits
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns 0 on success, -1 with errno set if not acknowledged
+ ***************************************************************************
+*/
+static int simMessage( struct _i2c_sim_bus* pBus, int addr, bool read,
+                       uint8_t* pData, int len, uint64_t now,
+                       uint64_t* pBits )
+{
+    struct _i2c_sim_device* pDev;
+    std::map<int, struct _i2c_sim_mux>::iterator itMux;
+    int addrLen;
+    int pageBase;
+    int i;
+
+    // the slave address byte
+    *pBits += I2C_SIM_BITS_PER_BYTE;
+
+    if( (itMux = pBus->muxes.find( addr )) != pBus->muxes.end() )
+    {
+        // the control register, the last byte written counts
+        *pBits += (uint64_t) len * I2C_SIM_BITS_PER_BYTE;
+
+        for( i = 0; i < len; i++ )
+        {
+            if( read )
+            {
+                pData[i] = itMux->second.control;
+            }
+            else
+            {
+                itMux->second.control = pData[i];
+            }
+        }
+
+        return( 0 );
+    }
+
+    if( (pDev = simResolve( pBus, addr )) == NULL )
+    {
+        return( -1 );
+    }
+
+    pDev->stats.messages++;
+    pDev->stats.bus_bits += I2C_SIM_BITS_PER_BYTE;
+
+    if( now < pDev->busy_until )
+    {
+        pDev->stats.nacks++;
+        errno = ENXIO;
+        return( -1 );
+    }
+
+    *pBits += (uint64_t) len * I2C_SIM_BITS_PER_BYTE;
+    pDev->stats.bus_bits += (uint64_t) len * I2C_SIM_BITS_PER_BYTE;
+
+    if( read )
+    {
+        for( i = 0; i < len; i++ )
+        {
+            pData[i] = pDev->memory[pDev->pointer];
+            pDev->pointer = (pDev->pointer + 1) & (pDev->config.size - 1);
+        }
+    }
+    else
+    {
+        addrLen = pDev->config.addr16 ? 2 : 1;
+
+        if( len > 0 )
+        {
+            // fewer address bytes than expected, e.g. an SMBus
+            // command byte, set what was sent
+            pDev->pointer = 0;
+            for( i = 0; i < len && i < addrLen; i++ )
+            {
+                pDev->pointer = (pDev->pointer << 8) | pData[i];
+            }
+            pDev->pointer &= pDev->config.size - 1;
+        }
+
+        if( len > addrLen )
+        {
+            pageBase = pDev->pointer & ~(pDev->config.page_size - 1);
+
+            for( i = addrLen; i < len; i++ )
+            {
+                pDev->memory[pDev->pointer] = pData[i];
+                pDev->pointer = pageBase | ((pDev->pointer + 1) &
+                                            (pDev->config.page_size - 1));
+            }
+
+            if( ++pDev->wear[pageBase / pDev->config.page_size] == 1 )
+            {
+                pDev->stats.pages_written++;
+            }
+            if( pDev->wear[pageBase / pDev->config.page_size] > 
+                pDev->stats.max_page_wear )
+            {
+                pDev->stats.max_page_wear = 
+                    pDev->wear[pageBase / pDev->config.page_size];
+            }
+            pDev->stats.write_cycles++;
+            pDev->stats.bytes_programmed += len - addrLen;
+
+            // programming starts with the stop condition
+            pDev->busy_until = now +
+                               (pBus->bus_khz > 0 ?
+                                *pBits * 1000 / pBus->bus_khz : 0) +
+                               pDev->config.write_cycle_us;
+        }
+    }
+
+    return( 0 );
+}
+
+/*
+ ***************************************************************************
+ * static void simBusTime( struct _i2c_sim_bus* pBus, uint64_t start,
+ *                         uint64_t bits )
+ * ----------------------------------------------------
+ * let the time for bits pass, called with the bus locked so
+ * the other transfers of the bus wait for it
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+static void simBusTime( struct _i2c_sim_bus* pBus, uint64_t start,
+                        uint64_t bits )
+{
+    if( pBus->bus_khz > 0 )
+    {
+        i2cSleepUntil( start + bits * 1000 / pBus->bus_khz );
+    }
+}
+
+/*
+ ***************************************************************************
+ * int i2cSimWrite( int bus, int addr, const uint8_t* pData, int len )
+ * int i2cSimRead( int bus, int addr, uint8_t* pData, int len )
+ * ----------------------------------------------------
+ * a plain write or read to slave addr
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns len, -1 with errno set on error
+ ***************************************************************************
+*/
+int i2cSimWrite( int bus, int addr, const uint8_t* pData, int len )
+{
+    struct i2c_msg msg;
+
+    msg.addr  = addr;
+    msg.flags = 0;
+    msg.len   = len;
+    msg.buf   = (uint8_t*) pData;
+
+    return( i2cSimTransfer( bus, &msg, 1 ) < 0 ? -1 : len );
+}
+
+int i2cSimRead( int bus, int addr, uint8_t* pData, int len )
+{
+    struct i2c_msg msg;
+
+    msg.addr  = addr;
+    msg.flags = I2C_M_RD;
+    msg.len   = len;
+    msg.buf   = pData;
+
+    return( i2cSimTransfer( bus, &msg, 1 ) < 0 ? -1 : len );
+}
+
+/*
+ ***************************************************************************
+ * int i2cSimTransfer( int bus, struct i2c_msg* pMsgs, int count )
+ * ----------------------------------------------------
+ * count messages separated by repeated starts. Like an adapter
+ * the transfer ends at the first message not acknowledged
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns count, -1 with errno set on error
+ ***************************************************************************
+*/
+int i2cSimTransfer( int bus, struct i2c_msg* pMsgs, int count )
+{
+    int retVal = count;
+    struct _i2c_sim_bus* pBus;
+    uint64_t start;
+    uint64_t bits = 0;
+    int err = 0;
+    int i;
+
+    if( (pBus = simBus( bus )) == NULL || pMsgs == NULL )
+    {
+        errno = pBus == NULL ? ENODEV : EINVAL;
+        return( -1 );
+    }
+
+    pthread_mutex_lock( &pBus->lock );
+
+    start = i2cMonotonicUs();
+
+    for( i = 0; i < count && retVal >= 0; i++ )
+    {
+        if( simMessage( pBus, pMsgs[i].addr,
+                        (pMsgs[i].flags & I2C_M_RD) != 0,
+                        pMsgs[i].buf, pMsgs[i].len, start, &bits ) < 0 )
+        {
+            err = errno;
+            retVal = -1;
+        }
+    }
+
+    simBusTime( pBus, start, bits );
+
+    pthread_mutex_unlock( &pBus->lock );
+
+    if( retVal < 0 )
+    {
+        errno = err;
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * int i2cSimProbe( int bus, int addr )
+ * ----------------------------------------------------
+ * address only, like a quick write
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns 0 if the device acknowledged, -1 with errno set if not
+ ***************************************************************************
+*/
+int i2cSimProbe( int bus, int addr )
+{
+    int retVal;
+    struct _i2c_sim_bus* pBus;
+    uint64_t start;
+    uint64_t bits = 0;
+
+    if( (pBus = simBus( bus )) == NULL )
+    {
+        errno = ENODEV;
+        return( -1 );
+    }
+
+    pthread_mutex_lock( &pBus->lock );
+
+    start = i2cMonotonicUs();
+    retVal = simMessage( pBus, addr, true, NULL, 0, start, &bits );
+    simBusTime( pBus, start, bits );
+
+    pthread_mutex_unlock( &pBus->lock );
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * int i2cSimGetStats( int bus, int addr, struct _i2c_sim_stats* pStats )
+ * ----------------------------------------------------
+ * copy the counters of a device
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns an errorcode, E_SIM_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cSimGetStats( int bus, int addr, struct _i2c_sim_stats* pStats )
+{
+    int retVal = E_SIM_NODEV;
+    struct _i2c_sim_bus* pBus;
+    std::map<int, struct _i2c_sim_device*>::iterator it;
+
+    if( pStats == NULL )
+    {
+        return( E_SIM_NULL );
+    }
+
+    if( (pBus = simBus( bus )) != NULL )
+    {
+        pthread_mutex_lock( &pBus->lock );
+
+        if( (it = pBus->devices.find( addr )) != pBus->devices.end() )
+        {
+            *pStats = it->second->stats;
+            pStats->bus_us = pBus->bus_khz > 0 ? 
+                             pStats->bus_bits * 1000 / pBus->bus_khz : 0;
+            retVal = E_SIM_SUCCESS;
+        }
+
+        pthread_mutex_unlock( &pBus->lock );
+    }
+
+    return( retVal );
+}
+
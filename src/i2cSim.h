@@ -0,0 +1,106 @@
+/*
+ ***********************************************************************
+ *
+ *  i2cSim.h - part of eeprom access project
+ *
+ *  Copyright (C) 2013-2019 Dreamshader (aka Dirk Schanz)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ *
+ ***********************************************************************
+ *
+ * Simulated EEPROMs, e.g. for benchmarks without hardware.
+ *
+ * A bus with at least one attached device is simulated: i2cOpen()
+ * does not use /dev/i2c-<bus> then and all transfers of the
+ * connection are answered here. A device behaves like a 24xx chip:
+ * the first one or two bytes written set the address pointer, more
+ * bytes are written into the page of the pointer, wrapping at the
+ * page end, and start a write cycle. During the write cycle the
+ * device does not acknowledge (ENXIO). Reads continue at the address
+ * pointer, wrapping at the end of the chip.
+ *
+ * With bus_khz set every transfer takes the time of its bits on a
+ * bus of that clock, transfers of one bus are serialized.
+ *
+ * Each device counts what it saw, including the write cycles of
+ * every page, see i2cSimGetStats().
+ *
+ * A mux attached with i2cSimAttachMux() answers at its own address
+ * with its control register. A device attached at I2C_SIM_MUXED()
+ * is only reachable while the mux connects its channel, two
+ * reachable devices of the same address collide (EIO).
+ *
+ ***********************************************************************
+ */
+
+#ifndef I2CSIM_H
+#define I2CSIM_H
+
+#include <stdint.h>
+#include <linux/i2c.h>
+
+#define E_SIM_SUCCESS               0
+#define E_SIM_FAIL                 -1
+#define E_SIM_NULL                 -2
+#define E_SIM_INVAL_PARAM          -3
+#define E_SIM_IN_USE               -4
+#define E_SIM_NODEV                -5
+
+#define I2C_SIM_MAX_SIZE           (64 * 1024)
+#define I2C_SIM_BITS_PER_BYTE       9   // 8 data bits and the ACK
+
+// the address to attach a device behind channel of the mux at mux
+#define I2C_SIM_MUXED(mux,channel,addr) \
+                        (((mux) << 16) | (((channel) + 1) << 8) | (addr))
+
+struct _i2c_sim_config {
+    int  size;               // bytes, a power of two
+    int  page_size;          // bytes, a power of two
+    bool addr16;             // two address bytes
+    int  write_cycle_us;
+    int  bus_khz;            // 0: transfers take no time
+};
+
+struct _i2c_sim_stats {
+    uint64_t messages;       // addressed to the device
+    uint64_t nacks;          // not acknowledged, busy programming
+    uint64_t bus_bits;       // clocks on the bus for the device
+    uint64_t bus_us;         // time of these at bus_khz
+    uint64_t write_cycles;
+    uint64_t bytes_programmed;
+    uint32_t pages_written;  // pages with at least one write cycle
+    uint32_t max_page_wear;  // write cycles of the most written page
+};
+
+int i2cSimAttach( int bus, int addr, const struct _i2c_sim_config* pConfig );
+int i2cSimDetach( int bus, int addr );
+int i2cSimAttachMux( int bus, int muxAddr, int muxType );
+bool i2cSimIsBus( int bus );
+int i2cSimLoad( int bus, int addr, int offset, const uint8_t* pData,
+                int len );
+
+// the transfer functions behave like write(), read() and the
+// I2C_RDWR ioctl on an adapter: -1 and errno on error
+int i2cSimWrite( int bus, int addr, const uint8_t* pData, int len );
+int i2cSimRead( int bus, int addr, uint8_t* pData, int len );
+int i2cSimTransfer( int bus, struct i2c_msg* pMsgs, int count );
+int i2cSimProbe( int bus, int addr );
+
+int i2cSimGetStats( int bus, int addr, struct _i2c_sim_stats* pStats );
+
+#endif /* I2CSIM_H */
+
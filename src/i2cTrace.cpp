@@ -0,0 +1,307 @@
+/*
+ ***********************************************************************
+ *
+ *  i2cTrace.cpp - part of eeprom access project
+ *
+ *  Copyright (C) 2013-2019 Dreamshader (aka Dirk Schanz)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ *
+ ***********************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+
+#include "i2cCore.h"
+#include "i2cTrace.h"
+
+struct _i2c_trace_ring {
+    uint64_t tid;
+    uint64_t head;       // events written, next slot is head % size
+    bool     active;     // false once the thread is gone
+    struct _i2c_trace_event events[I2C_TRACE_RING_SIZE];
+};
+
+static pthread_mutex_t traceLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t  traceOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t   traceKey;
+static struct _i2c_trace_ring* traceRings[I2C_TRACE_MAX_RINGS];
+static int traceRingCount = 0;
+static uint64_t traceDropped = 0;
+
+static __thread struct _i2c_trace_ring* pThreadRing = NULL;
+static __thread bool threadNoRing = false;
+
+static const char* traceEventNames[I2C_EV_MAX] = {
+    "?", "open", "ee-read", "ee-write", "bus-read", "bus-write",
+    "bus-xfer", "wait", "retry", "fail", "deadline", "mux"
+};
+
+/*
+ ***************************************************************************
+ * static void traceAtExit( void )
+ * static void traceThreadGone( void* pArg )
+ * static void traceSetup( void )
+ * ----------------------------------------------------
+ * dump at exit if I2C_TRACE_FILE is set, retire the ring of an
+ * ended thread so a new thread may take it over, set both up
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+static void traceAtExit( void )
+{
+    const char* pPath;
+
+    if( (pPath = getenv( I2C_TRACE_FILE_ENV )) != NULL )
+    {
+        i2cTraceDump( pPath );
+    }
+}
+
+static void traceThreadGone( void* pArg )
+{
+    struct _i2c_trace_ring* pRing = (struct _i2c_trace_ring*) pArg;
+
+    __atomic_store_n( &pRing->active, false, __ATOMIC_RELEASE );
+}
+
+static void traceSetup( void )
+{
+    pthread_key_create( &traceKey, traceThreadGone );
+    atexit( traceAtExit );
+}
+
+/*
+ ***************************************************************************
+ * void i2cTraceThreadInit( void )
+ * ----------------------------------------------------
+ * get a ring for the calling thread. Done by the first event
+ * anyway; call it at thread start to keep the allocation out
+ * of the transfer path. A new ring is allocated while there
+ * are less than I2C_TRACE_MAX_RINGS, then rings of ended
+ * threads are taken over. If there is none, the events of the
+ * thread are dropped
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+void i2cTraceThreadInit( void )
+{
+    struct _i2c_trace_ring* pRing = NULL;
+    int i;
+
+    if( pThreadRing == NULL && !threadNoRing )
+    {
+        pthread_once( &traceOnce, traceSetup );
+
+        pthread_mutex_lock( &traceLock );
+
+        if( traceRingCount < I2C_TRACE_MAX_RINGS )
+        {
+            if( (pRing = (struct _i2c_trace_ring*) 
+                         calloc( 1, sizeof(*pRing) )) != NULL )
+            {
+                traceRings[traceRingCount++] = pRing;
+            }
+        }
+        else
+        {
+            for( i = 0; i < traceRingCount && pRing == NULL; i++ )
+            {
+                if( !__atomic_load_n( &traceRings[i]->active, 
+                                      __ATOMIC_ACQUIRE ) )
+                {
+                    pRing = traceRings[i];
+                    __atomic_store_n( &pRing->head, 0, __ATOMIC_RELAXED );
+                }
+            }
+        }
+
+        if( pRing != NULL )
+        {
+            pRing->tid    = (uint64_t) syscall( SYS_gettid );
+            pRing->active = true;
+            pThreadRing   = pRing;
+            pthread_setspecific( traceKey, pRing );
+        }
+        else
+        {
+            threadNoRing = true;
+        }
+
+        pthread_mutex_unlock( &traceLock );
+    }
+}
+
+/*
+ ***************************************************************************
+ * void i2cTraceEmit( uint16_t event, uint16_t dev, uint32_t a, 
+ *                    uint32_t b, int32_t result, uint32_t durUs )
+ * ----------------------------------------------------
+ * write an event to the ring of the calling thread. Use the
+ * I2C_TRACE() macro, it compiles to nothing above the level
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns nothing
+ ***************************************************************************
+*/
+void i2cTraceEmit( uint16_t event, uint16_t dev, uint32_t a, uint32_t b,
+                   int32_t result, uint32_t durUs )
+{
+    struct _i2c_trace_event* pEvent;
+    uint64_t head;
+
+    if( pThreadRing == NULL )
+    {
+        i2cTraceThreadInit();
+    }
+
+    if( pThreadRing != NULL )
+    {
+        // only this thread writes, readers see head after the event
+        head   = pThreadRing->head;
+        pEvent = &pThreadRing->events[head & (I2C_TRACE_RING_SIZE - 1)];
+
+        pEvent->ts_us    = i2cMonotonicUs();
+        pEvent->dur_us   = durUs;
+        pEvent->event    = event;
+        pEvent->dev      = dev;
+        pEvent->a        = a;
+        pEvent->b        = b;
+        pEvent->result   = result;
+        pEvent->reserved = 0;
+
+        __atomic_store_n( &pThreadRing->head, head + 1, __ATOMIC_RELEASE );
+    }
+    else
+    {
+        __atomic_fetch_add( &traceDropped, 1, __ATOMIC_RELAXED );
+    }
+}
+
+/*
+ ***************************************************************************
+ * int i2cTraceDump( const char* pPath )
+ * ----------------------------------------------------
+ * write the events of all rings to pPath. Events written
+ * while dumping may show up torn, dump when traffic is quiet
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns an errorcode, E_I2C_SUCCESS on success
+ ***************************************************************************
+*/
+int i2cTraceDump( const char* pPath )
+{
+    int retVal = E_I2C_SUCCESS;
+    FILE* pOut;
+    struct _i2c_trace_file_hdr fileHdr;
+    struct _i2c_trace_ring_hdr ringHdr;
+    struct _i2c_trace_ring* pRing;
+    uint64_t head;
+    uint64_t first;
+    uint64_t n;
+    int i;
+
+    if( pPath == NULL )
+    {
+        return( E_I2C_NULL );
+    }
+
+    if( (pOut = fopen( pPath, "wb" )) == NULL )
+    {
+        perror("i2cTraceDump");
+        return( E_I2C_FAIL );
+    }
+
+    pthread_mutex_lock( &traceLock );
+
+    memset( &fileHdr, 0, sizeof(fileHdr) );
+    memcpy( fileHdr.magic, I2C_TRACE_MAGIC, sizeof(fileHdr.magic) );
+    fileHdr.version = I2C_TRACE_VERSION;
+    fileHdr.rings   = traceRingCount;
+    fileHdr.dropped = __atomic_load_n( &traceDropped, __ATOMIC_RELAXED );
+
+    if( fwrite( &fileHdr, sizeof(fileHdr), 1, pOut ) != 1 )
+    {
+        retVal = E_I2C_FAIL;
+    }
+
+    for( i = 0; i < traceRingCount && retVal == E_I2C_SUCCESS; i++ )
+    {
+        pRing = traceRings[i];
+        head  = __atomic_load_n( &pRing->head, __ATOMIC_ACQUIRE );
+        first = head > I2C_TRACE_RING_SIZE ? head - I2C_TRACE_RING_SIZE : 0;
+
+        memset( &ringHdr, 0, sizeof(ringHdr) );
+        ringHdr.tid     = pRing->tid;
+        ringHdr.written = head;
+        ringHdr.count   = (uint32_t) (head - first);
+
+        if( fwrite( &ringHdr, sizeof(ringHdr), 1, pOut ) != 1 )
+        {
+            retVal = E_I2C_FAIL;
+        }
+
+        for( n = first; n < head && retVal == E_I2C_SUCCESS; n++ )
+        {
+            if( fwrite( &pRing->events[n & (I2C_TRACE_RING_SIZE - 1)],
+                        sizeof(struct _i2c_trace_event), 1, pOut ) != 1 )
+            {
+                retVal = E_I2C_FAIL;
+            }
+        }
+    }
+
+    pthread_mutex_unlock( &traceLock );
+
+    if( fclose( pOut ) != 0 )
+    {
+        retVal = E_I2C_FAIL;
+    }
+
+    return( retVal );
+}
+
+/*
+ ***************************************************************************
+ * const char* i2cTraceEventName( uint16_t event )
+ * ----------------------------------------------------
+ * name of an event id
+ * ----------------------------------------------------
+ *
+ * ----------------------------------------------------
+ * returns the name, "?" for unknown ids
+ ***************************************************************************
+*/
+const char* i2cTraceEventName( uint16_t event )
+{
+    return( event < I2C_EV_MAX ? traceEventNames[event] : "?" );
+}
+
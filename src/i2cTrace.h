@@ -0,0 +1,123 @@
+/*
+ ***********************************************************************
+ *
+ *  i2cTrace.h - part of eeprom access project
+ *
+ *  Copyright (C) 2013-2019 Dreamshader (aka Dirk Schanz)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ *
+ ***********************************************************************
+ *
+ * Structured tracing of the library, binary and in memory.
+ *
+ * Trace points are compiled in up to level I2C_TRACE_LEVEL, given
+ * as -DI2C_TRACE_LEVEL=<n>, default 0: nothing is compiled in.
+ *
+ *   1  errors: failed transfers, missed deadlines
+ *   2  operations: eeRead*(), eeWrite*(), open
+ *   3  bus: every transfer attempt, write cycle waits, retries
+ *
+ * Each thread writes its events into a ring buffer of its own
+ * without locks; when the ring is full the oldest events are
+ * overwritten. i2cTraceDump() writes all rings to a file, with
+ * I2C_TRACE_FILE set in the environment that is done at exit.
+ * eeTrace decodes the file.
+ *
+ ***********************************************************************
+ */
+
+#ifndef I2CTRACE_H
+#define I2CTRACE_H
+
+#include <stdint.h>
+
+#ifndef I2C_TRACE_LEVEL
+#define I2C_TRACE_LEVEL             0
+#endif
+
+#define I2C_TRACE_ERROR             1
+#define I2C_TRACE_OPS               2
+#define I2C_TRACE_BUS               3
+
+// events per thread, a power of two
+#define I2C_TRACE_RING_SIZE      4096
+#define I2C_TRACE_MAX_RINGS       256
+#define I2C_TRACE_FILE_ENV       "I2C_TRACE_FILE"
+#define I2C_TRACE_MAGIC          "I2CTRACE"
+#define I2C_TRACE_VERSION           1
+
+// event ids, see i2cTraceEventName()
+#define I2C_EV_OPEN                 1   // a: bus, b: addr
+#define I2C_EV_EE_READ              2   // a: addr, b: amount
+#define I2C_EV_EE_WRITE             3   // a: addr, b: amount
+#define I2C_EV_BUS_READ             4   // a: length
+#define I2C_EV_BUS_WRITE            5   // a: length
+#define I2C_EV_BUS_XFER             6   // a: length, b: messages
+#define I2C_EV_WAIT                 7   // dur: time slept
+#define I2C_EV_RETRY                8   // a: errno, b: attempt
+#define I2C_EV_FAIL                 9   // a: errno
+#define I2C_EV_DEADLINE            10   // a: transfer length
+#define I2C_EV_MUX                 11   // a: mux addr, b: channel
+#define I2C_EV_MAX                 12
+
+// device id of an event
+#define I2C_TRACE_DEV(bus,addr)     ((uint16_t) (((bus) << 8) | \
+                                                 ((addr) & 0xff)))
+
+struct _i2c_trace_event {
+    uint64_t ts_us;      // CLOCK_MONOTONIC
+    uint32_t dur_us;
+    uint16_t event;
+    uint16_t dev;
+    uint32_t a;
+    uint32_t b;
+    int32_t  result;
+    uint32_t reserved;
+};
+
+// layout of the dump: file header, then per ring a ring header
+// followed by count events, oldest first
+struct _i2c_trace_file_hdr {
+    char     magic[8];
+    uint32_t version;
+    uint32_t rings;
+    uint64_t dropped;    // events of threads that got no ring
+};
+
+struct _i2c_trace_ring_hdr {
+    uint64_t tid;
+    uint64_t written;    // events written in total
+    uint32_t count;      // events following
+    uint32_t reserved;
+};
+
+#define I2C_TRACE(level,ev,dev,a,b,res,dur) \
+    do { \
+        if( (level) <= I2C_TRACE_LEVEL ) \
+        { \
+            i2cTraceEmit( (ev), (dev), (a), (b), (res), (dur) ); \
+        } \
+    } while( 0 )
+
+void i2cTraceEmit( uint16_t event, uint16_t dev, uint32_t a, uint32_t b,
+                   int32_t result, uint32_t durUs );
+void i2cTraceThreadInit( void );
+int i2cTraceDump( const char* pPath );
+const char* i2cTraceEventName( uint16_t event );
+
+#endif /* I2CTRACE_H */
+